@@ -122,6 +122,7 @@ extern const uint8_t qjsc_qjscalc[];
 extern const uint32_t qjsc_qjscalc_size;
 static int bignum_ext;
 #endif
+static int lazy_compile;
 
 static int eval_buf(JSContext *ctx, const void *buf, int buf_len,
                     const char *filename, int eval_flags)
@@ -129,6 +130,8 @@ static int eval_buf(JSContext *ctx, const void *buf, int buf_len,
     JSValue val;
     int ret;
 
+    if (lazy_compile)
+        eval_flags |= JS_EVAL_FLAG_LAZY;
     if ((eval_flags & JS_EVAL_TYPE_MASK) == JS_EVAL_TYPE_MODULE) {
         /* for the modules, we compile then run to be able to set
            import.meta */
@@ -363,6 +366,7 @@ void help(void)
            "-i  --interactive  go to interactive mode\n"
            "-m  --module       load as ES6 module (default=autodetect)\n"
            "    --script       load as ES6 script (default=autodetect)\n"
+           "-b  --bytecode     run a bytecode file generated by 'qjsc -b'\n"
            "-I  --include file include an additional file\n"
            "    --std          make 'std' and 'os' available to the loaded script\n"
 #ifdef CONFIG_BIGNUM
@@ -373,6 +377,10 @@ void help(void)
            "-d  --dump         dump the memory usage stats\n"
            "    --memory-limit n       limit the memory usage to 'n' bytes\n"
            "    --stack-size n         limit the stack size to 'n' bytes\n"
+           "    --slab                 use the slab allocator for small structures\n"
+           "    --lazy                 compile the functions on their first call\n"
+           "    --jit                  compile the hot functions to native code (x86-64 only)\n"
+           "    --eval-cache dir       keep the compiled scripts in 'dir'\n"
            "    --unhandled-rejection  dump unhandled promise rejections\n"
            "-q  --quit         just instantiate the interpreter and quit\n");
     exit(1);
@@ -392,7 +400,13 @@ int main(int argc, char **argv)
     int module = -1;
     int load_std = 0;
     int dump_unhandled_promise_rejection = 0;
+    int use_slab = 0;
+    int use_jit = 0;
     size_t memory_limit = 0;
+    const char *eval_cache_dir = NULL;
+    int bytecode = 0;
+    uint8_t *bytecode_buf = NULL;
+    size_t bytecode_len = 0;
     char *include_list[32];
     int i, include_count = 0;
 #ifdef CONFIG_BIGNUM
@@ -465,6 +479,10 @@ int main(int argc, char **argv)
                 interactive++;
                 continue;
             }
+            if (opt == 'b' || !strcmp(longopt, "bytecode")) {
+                bytecode = 1;
+                continue;
+            }
             if (opt == 'm' || !strcmp(longopt, "module")) {
                 module = 1;
                 continue;
@@ -489,6 +507,18 @@ int main(int argc, char **argv)
                 dump_unhandled_promise_rejection = 1;
                 continue;
             }
+            if (!strcmp(longopt, "slab")) {
+                use_slab = 1;
+                continue;
+            }
+            if (!strcmp(longopt, "lazy")) {
+                lazy_compile = 1;
+                continue;
+            }
+            if (!strcmp(longopt, "jit")) {
+                use_jit = 1;
+                continue;
+            }
 #ifdef CONFIG_BIGNUM
             if (!strcmp(longopt, "bignum")) {
                 bignum_ext = 1;
@@ -511,6 +541,14 @@ int main(int argc, char **argv)
                 memory_limit = (size_t)strtod(argv[optind++], NULL);
                 continue;
             }
+            if (!strcmp(longopt, "eval-cache")) {
+                if (optind >= argc) {
+                    fprintf(stderr, "expecting eval cache directory");
+                    exit(1);
+                }
+                eval_cache_dir = argv[optind++];
+                continue;
+            }
             if (!strcmp(longopt, "stack-size")) {
                 if (optind >= argc) {
                     fprintf(stderr, "expecting stack size");
@@ -542,12 +580,34 @@ int main(int argc, char **argv)
         fprintf(stderr, "qjs: cannot allocate JS runtime\n");
         exit(2);
     }
+    if (bytecode && !expr && optind < argc) {
+        /* the byte code is executed in place from the mapped file.
+           Its atoms are created first so that no relocation is
+           necessary. */
+        bytecode_buf = js_map_file(&bytecode_len, argv[optind]);
+        if (!bytecode_buf) {
+            perror(argv[optind]);
+            exit(1);
+        }
+        if (JS_ReserveObjectAtoms(rt, bytecode_buf, bytecode_len)) {
+            fprintf(stderr, "qjs: %s: invalid bytecode file\n", argv[optind]);
+            exit(1);
+        }
+    }
     if (memory_limit != 0)
         JS_SetMemoryLimit(rt, memory_limit);
     if (stack_size != 0)
         JS_SetMaxStackSize(rt, stack_size);
+    if (use_slab)
+        JS_EnableSlabAllocator(rt, TRUE);
+    if (use_jit)
+        JS_EnableJIT(rt, TRUE);
     js_std_set_worker_new_context_func(JS_NewCustomContext);
     js_std_init_handlers(rt);
+    if (eval_cache_dir && js_std_set_eval_cache(rt, 0, eval_cache_dir)) {
+        fprintf(stderr, "qjs: cannot set the eval cache\n");
+        exit(2);
+    }
     ctx = JS_NewCustomContext(rt);
     if (!ctx) {
         fprintf(stderr, "qjs: cannot allocate JS context\n");
@@ -594,8 +654,12 @@ int main(int argc, char **argv)
         } else {
             const char *filename;
             filename = argv[optind];
-            if (eval_file(ctx, filename, module))
+            if (bytecode_buf) {
+                js_std_eval_binary(ctx, bytecode_buf, bytecode_len,
+                                   JS_STD_EVAL_BINARY_ROM_DATA);
+            } else if (eval_file(ctx, filename, module)) {
                 goto fail;
+            }
         }
         if (interactive) {
             js_std_eval_binary(ctx, qjsc_repl, qjsc_repl_size, 0);
@@ -611,6 +675,8 @@ int main(int argc, char **argv)
     js_std_free_handlers(rt);
     JS_FreeContext(ctx);
     JS_FreeRuntime(rt);
+    if (bytecode_buf)
+        js_unmap_file(bytecode_buf, bytecode_len);
 
     if (empty_run && dump_memory) {
         clock_t t[5];
@@ -641,5 +707,7 @@ int main(int argc, char **argv)
     js_std_free_handlers(rt);
     JS_FreeContext(ctx);
     JS_FreeRuntime(rt);
+    if (bytecode_buf)
+        js_unmap_file(bytecode_buf, bytecode_len);
     return 1;
 }
@@ -134,6 +134,7 @@ static uint64_t feature_bitmap;
 static FILE *outfile;
 static BOOL byte_swap;
 static BOOL dynamic_export;
+static BOOL binary_output;
 static const char *c_ident_prefix = "qjsc_";
 
 #define FE_ALL (-1)
@@ -262,6 +263,16 @@ static void output_object_code(JSContext *ctx,
         exit(1);
     }
 
+    if (binary_output) {
+        /* the byte code is directly stored in the output file */
+        if (fwrite(out_buf, 1, out_buf_len, fo) != out_buf_len) {
+            perror("fwrite");
+            exit(1);
+        }
+        js_free(ctx, out_buf);
+        return;
+    }
+
     namelist_add(&cname_list, c_name, NULL, load_only);
     
     fprintf(fo, "const uint32_t %s_size = %u;\n\n", 
@@ -315,6 +326,10 @@ JSModuleDef *jsc_module_loader(JSContext *ctx,
         namelist_add(&init_module_list, e->name, e->short_name, 0);
         /* create a dummy module */
         m = JS_NewCModule(ctx, module_name, js_module_dummy_init);
+    } else if (binary_output) {
+        /* the imported modules are loaded when the binary file is
+           executed */
+        m = JS_NewCModule(ctx, module_name, js_module_dummy_init);
     } else if (has_suffix(module_name, ".so")) {
         fprintf(stderr, "Warning: binary module '%s' will be dynamically loaded\n", module_name);
         /* create a dummy module */
@@ -419,6 +434,7 @@ void help(void)
            "usage: " PROG_NAME " [options] [files]\n"
            "\n"
            "options are:\n"
+           "-b          only output bytecode in a binary file (run with 'qjs -b')\n"
            "-c          only output bytecode in a C file\n"
            "-e          output main() and bytecode in a C file (default = executable output)\n"
            "-o output   set the output filename\n"
@@ -553,6 +569,7 @@ typedef enum {
     OUTPUT_C,
     OUTPUT_C_MAIN,
     OUTPUT_EXECUTABLE,
+    OUTPUT_BINARY,
 } OutputTypeEnum;
 
 int main(int argc, char **argv)
@@ -588,7 +605,7 @@ int main(int argc, char **argv)
     namelist_add(&cmodule_list, "os", "os", 0);
 
     for(;;) {
-        c = getopt(argc, argv, "ho:cN:f:mxevM:p:S:D:");
+        c = getopt(argc, argv, "ho:bcN:f:mxevM:p:S:D:");
         if (c == -1)
             break;
         switch(c) {
@@ -597,6 +614,9 @@ int main(int argc, char **argv)
         case 'o':
             out_filename = optarg;
             break;
+        case 'b':
+            output_type = OUTPUT_BINARY;
+            break;
         case 'c':
             output_type = OUTPUT_C;
             break;
@@ -676,10 +696,19 @@ int main(int argc, char **argv)
 
     if (optind >= argc)
         help();
+    if (output_type == OUTPUT_BINARY) {
+        if (optind + 1 != argc) {
+            fprintf(stderr, "only one file can be compiled in a binary file\n");
+            exit(1);
+        }
+        binary_output = TRUE;
+    }
 
     if (!out_filename) {
         if (output_type == OUTPUT_EXECUTABLE) {
             out_filename = "a.out";
+        } else if (output_type == OUTPUT_BINARY) {
+            out_filename = "out.qbc";
         } else {
             out_filename = "out.c";
         }
@@ -696,7 +725,7 @@ int main(int argc, char **argv)
         pstrcpy(cfilename, sizeof(cfilename), out_filename);
     }
     
-    fo = fopen(cfilename, "w");
+    fo = fopen(cfilename, binary_output ? "wb" : "w");
     if (!fo) {
         perror(cfilename);
         exit(1);
@@ -717,18 +746,19 @@ int main(int argc, char **argv)
     /* loader for ES6 modules */
     JS_SetModuleLoaderFunc(rt, NULL, jsc_module_loader, NULL);
 
-    fprintf(fo, "/* File generated automatically by the QuickJS compiler. */\n"
-            "\n"
-            );
-    
-    if (output_type != OUTPUT_C) {
-        fprintf(fo, "#include \"quickjs-libc.h\"\n"
-                "\n"
-                );
-    } else {
-        fprintf(fo, "#include <inttypes.h>\n"
+    if (!binary_output) {
+        fprintf(fo, "/* File generated automatically by the QuickJS compiler. */\n"
                 "\n"
                 );
+        if (output_type != OUTPUT_C) {
+            fprintf(fo, "#include \"quickjs-libc.h\"\n"
+                    "\n"
+                    );
+        } else {
+            fprintf(fo, "#include <inttypes.h>\n"
+                    "\n"
+                    );
+        }
     }
 
     for(i = optind; i < argc; i++) {
@@ -745,7 +775,7 @@ int main(int argc, char **argv)
         }
     }
     
-    if (output_type != OUTPUT_C) {
+    if (output_type != OUTPUT_C && !binary_output) {
         fprintf(fo,
                 "static JSContext *JS_NewCustomContext(JSRuntime *rt)\n"
                 "{\n"
@@ -22,6 +22,11 @@ void js_runtime_free(JSRuntime* rt)
     JS_FreeRuntime(rt);
 }
 
+void js_runtime_set_eval_cache(JSRuntime* rt, size_t max_size)
+{
+    JS_SetEvalCache(rt, max_size, NULL, NULL);
+}
+
 JSContext* js_context_new(JSRuntime* rt)
 {
     JSContext* ctx = JS_NewContextRaw(rt);
@@ -40,8 +45,44 @@ JSContext* js_context_new(JSRuntime* rt)
     return ctx;
 }
 
+JSContext* js_context_clone(JSContext* ctx)
+{
+    return ctx ? JS_CloneContext(ctx) : NULL;
+}
+
+JSContext* js_context_new_arena(JSRuntime* rt)
+{
+    JSContext* ctx = js_context_new(rt);
+    if (ctx) {
+        JS_EnableValueArena(ctx, 1);
+    }
+    return ctx;
+}
+
+void js_context_reset_arena(JSContext* ctx)
+{
+    if (ctx) {
+        JS_ResetValueArena(ctx);
+    }
+}
+
+int js_scope_open(JSContext* ctx)
+{
+    return ctx ? JS_OpenValueScope(ctx) : -1;
+}
+
+void js_scope_close(JSContext* ctx, int scope)
+{
+    if (ctx) {
+        JS_CloseValueScope(ctx, scope);
+    }
+}
+
 void js_context_free(JSContext* ctx)
 {
+    /* the arena values may reference objects of this context, so they
+       must be released before the context reference */
+    JS_ResetValueArena(ctx);
     JS_FreeContext(ctx);
 }
 
@@ -58,7 +99,11 @@ static inline void js_value_set(JSValue* dst, JSValue src)
 static inline JSValue* js_value_alloc(JSContext* ctx, JSValue v)
 {
     JSValue* value;
-    
+
+    if (JS_IsValueArenaEnabled(ctx) || JS_GetValueScopeLevel(ctx) > 0) {
+        return JS_NewArenaValue(ctx, v);
+    }
+
     value = (JSValue*)js_malloc(ctx, sizeof(JSValue));
     if (value) {
         js_value_set(value, v);
@@ -89,6 +134,28 @@ static inline void js_value_move(JSContext* ctx, JSValue* out, JSValue val)
     }
 }
 
+static int js_value_move_result(JSContext* ctx, JSValue* out, JSValue val)
+{
+    int result = JS_OK;
+
+    if (JS_IsException(val)) {
+        result = JS_ERR_EXCEPTION;
+        val = JS_GetException(ctx);
+    }
+
+    js_value_move(ctx, out, val);
+    return result;
+}
+
+/* throw a TypeError for invalid arguments and move it to 'out' */
+static int js_value_invalid_args(JSContext* ctx, JSValue* out)
+{
+    if (!ctx) {
+        return JS_ERR_EXCEPTION;
+    }
+    return js_value_move_result(ctx, out, JS_ThrowTypeError(ctx, "invalid arguments"));
+}
+
 JSValue* js_value_new(JSContext* ctx)
 {
     return js_value_alloc(ctx, JS_UNDEFINED);
@@ -119,8 +186,40 @@ void js_value_release(JSContext* ctx, JSValue* value)
 void js_value_free(JSContext* ctx, JSValue* value)
 {
     if (value) {
-        JS_FreeValue(ctx, *value);
-        js_free(ctx, value);
+        /* also true for the values of a closed scope, which are
+           already released */
+        if (JS_IsArenaValue(ctx, value)) {
+            JS_FreeArenaValue(ctx, value);
+        } else {
+            JS_FreeValue(ctx, *value);
+            js_free(ctx, value);
+        }
+    }
+}
+
+JSValue* js_value_escape(JSContext* ctx, JSValue* value)
+{
+    JSValue* result;
+
+    if (!ctx || !value || !JS_IsArenaValue(ctx, value)) {
+        return value;
+    }
+
+    result = (JSValue*)js_malloc(ctx, sizeof(JSValue));
+    if (result) {
+        js_value_set(result, *value);
+        js_value_set(value, JS_UNDEFINED);
+    }
+    return result;
+}
+
+void js_value_free_rt(JSRuntime* rt, JSValue* value)
+{
+    /* the arena values belong to their context: they are released
+       by the context, not by js_free_rt() */
+    if (rt && value && !JS_IsArenaValueRT(rt, value)) {
+        JS_FreeValueRT(rt, *value);
+        js_free_rt(rt, value);
     }
 }
 
@@ -258,6 +357,7 @@ int js_value_get_type(JSValue* value)
                 result = JS_VALUE_TYPE_MODULE;
                 break;
             case JS_TAG_STRING:
+            case JS_TAG_STRING_ROPE:
                 result = JS_VALUE_TYPE_STRING;
                 break;
             case JS_TAG_SYMBOL:
@@ -374,6 +474,62 @@ void js_str_free(JSContext* ctx, const char* str)
     }
 }
 
+int js_str_read16(JSContext* ctx, JSValue* value, uint16_t* buf, size_t size, size_t* length)
+{
+    JSValue str;
+    const void* chars;
+    size_t len, i;
+    JS_BOOL wide;
+
+    if (!ctx || !value || (size > 0 && !buf)) {
+        return JS_ERR_EXCEPTION;
+    }
+
+    str = JS_ToString(ctx, *value);
+    chars = JS_IsException(str) ? NULL : JS_GetStringBuffer(ctx, str, &len, &wide);
+    if (!chars) {
+        JS_FreeValue(ctx, str);
+        return JS_ERR_EXCEPTION;
+    }
+
+    if (size > len) {
+        size = len;
+    }
+    if (size > 0) {
+        if (wide) {
+            memcpy(buf, chars, size * sizeof(uint16_t));
+        } else {
+            for (i = 0; i < size; i++) {
+                buf[i] = ((const uint8_t*)chars)[i];
+            }
+        }
+    }
+    if (length) {
+        *length = len;
+    }
+
+    JS_FreeValue(ctx, str);
+    return JS_OK;
+}
+
+const void* js_str_borrow(JSContext* ctx, JSValue* value, size_t* length, int* wide)
+{
+    const void* result = NULL;
+    JS_BOOL is_wide = 0;
+    size_t len = 0;
+
+    if (ctx && value) {
+        result = JS_GetStringBuffer(ctx, *value, &len, &is_wide);
+    }
+    if (length) {
+        *length = len;
+    }
+    if (wide) {
+        *wide = is_wide;
+    }
+    return result;
+}
+
 JSValue* js_value_new_ref_globals(JSContext* ctx)
 {
     JSValue* result = js_value_alloc(ctx, JS_GetGlobalObject(ctx));
@@ -423,6 +579,133 @@ void js_obj_read_property(JSContext* ctx, JSValue* out, JSValue* obj, const char
     }
 }
 
+JSAtom js_atom_new(JSContext* ctx, const char* name)
+{
+    return js_atom_new_str(ctx, name, name ? strlen(name) : 0);
+}
+
+JSAtom js_atom_new_str(JSContext* ctx, const char* name, size_t length)
+{
+    if (!ctx || !name) {
+        return JS_ATOM_NULL;
+    }
+
+    return JS_NewAtomLen(ctx, name, length);
+}
+
+void js_atom_free(JSContext* ctx, JSAtom atom)
+{
+    if (ctx && atom != JS_ATOM_NULL) {
+        JS_FreeAtom(ctx, atom);
+    }
+}
+
+void js_obj_set_property_atom(JSContext* ctx, JSValue* obj, JSAtom atom, JSValue* value)
+{
+    if (!ctx || !obj || JS_VALUE_GET_TAG(*obj) != JS_TAG_OBJECT || atom == JS_ATOM_NULL || !value) {
+        return;
+    }
+
+    JS_SetProperty(ctx, *obj, atom, JS_DupValue(ctx, *value));
+}
+
+JSValue* js_obj_get_property_atom(JSContext* ctx, JSValue* obj, JSAtom atom)
+{
+    JSValue* result = js_value_new(ctx);
+    js_obj_read_property_atom(ctx, result, obj, atom);
+    return result;
+}
+
+void js_obj_read_property_atom(JSContext* ctx, JSValue* out, JSValue* obj, JSAtom atom)
+{
+    if (ctx && out && obj && JS_VALUE_GET_TAG(*obj) == JS_TAG_OBJECT && atom != JS_ATOM_NULL) {
+        js_value_move(ctx, out, JS_GetProperty(ctx, *obj, atom));
+    }
+}
+
+void js_obj_set_index(JSContext* ctx, JSValue* obj, uint32_t index, JSValue* value)
+{
+    if (!ctx || !obj || JS_VALUE_GET_TAG(*obj) != JS_TAG_OBJECT || !value) {
+        return;
+    }
+
+    JS_SetPropertyUint32(ctx, *obj, index, JS_DupValue(ctx, *value));
+}
+
+JSValue* js_obj_get_index(JSContext* ctx, JSValue* obj, uint32_t index)
+{
+    JSValue* result = js_value_new(ctx);
+    js_obj_read_index(ctx, result, obj, index);
+    return result;
+}
+
+void js_obj_read_index(JSContext* ctx, JSValue* out, JSValue* obj, uint32_t index)
+{
+    if (ctx && out && obj && JS_VALUE_GET_TAG(*obj) == JS_TAG_OBJECT) {
+        js_value_move(ctx, out, JS_GetPropertyUint32(ctx, *obj, index));
+    }
+}
+
+int js_obj_set_properties(JSContext* ctx, JSValue* obj, int n, const JSAtom* atoms, const JSValue* values)
+{
+    if (!ctx || !obj || JS_VALUE_GET_TAG(*obj) != JS_TAG_OBJECT || n < 0 || (n > 0 && (!atoms || !values))) {
+        /* as for a failing property, the exception is left pending */
+        if (ctx) {
+            JS_ThrowTypeError(ctx, "invalid arguments");
+        }
+        return JS_ERR_EXCEPTION;
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (JS_SetProperty(ctx, *obj, atoms[i], JS_DupValue(ctx, values[i])) < 0) {
+            return JS_ERR_EXCEPTION;
+        }
+    }
+    return JS_OK;
+}
+
+int js_obj_get_properties(JSContext* ctx, JSValue* obj, int n, const JSAtom* atoms, JSValue* out)
+{
+    if (!ctx || !obj || JS_VALUE_GET_TAG(*obj) != JS_TAG_OBJECT || n < 0 || (n > 0 && (!atoms || !out))) {
+        return js_value_invalid_args(ctx, n > 0 ? out : NULL);
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (js_value_move_result(ctx, &out[i], JS_GetProperty(ctx, *obj, atoms[i])) != JS_OK) {
+            return JS_ERR_EXCEPTION;
+        }
+    }
+    return JS_OK;
+}
+
+JSValue* js_obj_new_template(JSContext* ctx, int n, const JSAtom* atoms)
+{
+    JSValue obj;
+
+    if (!ctx || n < 0 || (n > 0 && !atoms)) {
+        return NULL;
+    }
+
+    obj = JS_NewObject(ctx);
+    for (int i = 0; i < n && !JS_IsException(obj); i++) {
+        if (JS_DefinePropertyValue(ctx, obj, atoms[i], JS_UNDEFINED, JS_PROP_C_W_E) < 0) {
+            JS_FreeValue(ctx, obj);
+            obj = JS_EXCEPTION;
+        }
+    }
+    return js_value_alloc(ctx, obj);
+}
+
+int js_obj_new_from_template(JSContext* ctx, JSValue* out, const JSValue* tmpl, int n, const JSValue* values)
+{
+    if (!ctx || !tmpl || n < 0) {
+        return js_value_invalid_args(ctx, out);
+    }
+
+    return js_value_move_result(ctx, out,
+                                JS_NewObjectFromTemplate(ctx, *tmpl, n, (JSValueConst*)values));
+}
+
 JSValue* js_value_new_str(JSContext* ctx, const char* str, size_t length)
 {
     JSValue* result = NULL;
@@ -447,21 +730,36 @@ void js_value_load_cstr(JSContext* ctx, JSValue* out, const char* str)
     js_value_load_str(ctx, out, str, str ? strlen(str) : 0);
 }
 
-int js_eval(JSContext* ctx, JSValue* out, const char* input, size_t length, const char *filename, int eval_flags)
+JSValue* js_value_new_str16(JSContext* ctx, const uint16_t* str, size_t length)
 {
-    int result = JS_OK;
-    JSValue val;
-    
-    val = JS_Eval(ctx, input, length, filename, eval_flags);
-    if (JS_IsException(val)) {
-        result = JS_ERR_EXCEPTION;
-        val = JS_GetException(ctx);
+    JSValue* result = NULL;
+    if (ctx && (str || length == 0)) {
+        result = js_value_alloc(ctx, JS_NewString16(ctx, str, length));
     }
+    return result;
+}
 
-    js_value_move(ctx, out, val);
+void js_value_load_str16(JSContext* ctx, JSValue* out, const uint16_t* str, size_t length)
+{
+    if (str || length == 0) {
+        js_value_load(ctx, out, JS_NewString16(ctx, str, length));
+    }
+}
+
+JSValue* js_value_new_str_buffer(JSContext* ctx, size_t length, int wide, void** buf)
+{
+    JSValue* result = NULL;
+    if (ctx && buf) {
+        result = js_value_alloc(ctx, JS_NewStringBuffer(ctx, length, wide != 0, buf));
+    }
     return result;
 }
 
+int js_eval(JSContext* ctx, JSValue* out, const char* input, size_t length, const char *filename, int eval_flags)
+{
+    return js_value_move_result(ctx, out, JS_Eval(ctx, input, length, filename, eval_flags));
+}
+
 int js_eval_cstr(JSContext* ctx, JSValue* out, const char* input, const char *filename, int eval_flags)
 {
     size_t length;
@@ -472,17 +770,9 @@ int js_eval_cstr(JSContext* ctx, JSValue* out, const char* input, const char *fi
 
 int js_eval_this(JSContext* ctx, const JSValue* this_obj, JSValue* out, const char* input, size_t length, const char *filename, int eval_flags)
 {
-    int result = JS_OK;
-    JSValue val;
-
-    val = JS_EvalThis(ctx, this_obj ? *this_obj : JS_UNDEFINED, input, length, filename, eval_flags);
-    if (JS_IsException(val)) {
-        result = JS_ERR_EXCEPTION;
-        val = JS_GetException(ctx);
-    }
-
-    js_value_move(ctx, out, val);
-    return result;
+    return js_value_move_result(ctx, out,
+                                JS_EvalThis(ctx, this_obj ? *this_obj : JS_UNDEFINED,
+                                            input, length, filename, eval_flags));
 }
 
 int js_eval_this_cstr(JSContext* ctx, const JSValue* this_obj, JSValue* out, const char* input, const char *filename, int eval_flags)
@@ -493,6 +783,40 @@ int js_eval_this_cstr(JSContext* ctx, const JSValue* this_obj, JSValue* out, con
     return js_eval_this(ctx, this_obj, out, input, length, filename, eval_flags);
 }
 
+int js_value_call(JSContext* ctx, JSValue* out, const JSValue* func, const JSValue* this_obj, int argc, const JSValue* argv)
+{
+    if (!ctx || argc < 0 || (argc > 0 && !argv)) {
+        return js_value_invalid_args(ctx, out);
+    }
+
+    return js_value_move_result(ctx, out,
+                                JS_Call(ctx, func ? *func : JS_UNDEFINED,
+                                        this_obj ? *this_obj : JS_UNDEFINED,
+                                        argc, (JSValueConst*)argv));
+}
+
+int js_value_call_method_atom(JSContext* ctx, JSValue* out, const JSValue* this_obj, JSAtom atom, int argc, const JSValue* argv)
+{
+    if (!ctx || atom == JS_ATOM_NULL || argc < 0 || (argc > 0 && !argv)) {
+        return js_value_invalid_args(ctx, out);
+    }
+
+    return js_value_move_result(ctx, out,
+                                JS_Invoke(ctx, this_obj ? *this_obj : JS_UNDEFINED,
+                                          atom, argc, (JSValueConst*)argv));
+}
+
+int js_value_construct(JSContext* ctx, JSValue* out, const JSValue* func, int argc, const JSValue* argv)
+{
+    if (!ctx || argc < 0 || (argc > 0 && !argv)) {
+        return js_value_invalid_args(ctx, out);
+    }
+
+    return js_value_move_result(ctx, out,
+                                JS_CallConstructor(ctx, func ? *func : JS_UNDEFINED,
+                                                   argc, (JSValueConst*)argv));
+}
+
 int js_json_parse_str(JSContext* ctx, JSValue* out, const char* input, size_t length)
 {
     int result = JS_OK;
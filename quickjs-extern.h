@@ -49,8 +49,38 @@ QUICKJS_EXPORT JSRuntime* js_runtime_new(void);
 
 QUICKJS_EXPORT void js_runtime_free(JSRuntime* rt);
 
+/* Keep the compiled code of the evaluated scripts so that evaluating the
+   same source again, e.g. in a new context, does not compile it again.
+   At most 'max_size' bytes of byte code are kept (0 disables the cache). */
+QUICKJS_EXPORT void js_runtime_set_eval_cache(JSRuntime* rt, size_t max_size);
+
 QUICKJS_EXPORT JSContext* js_context_new(JSRuntime* rt);
 
+/* Create a context with a copy of the global objects and functions of
+   'ctx', typically a context where the bootstrap scripts were evaluated.
+   Return NULL if 'ctx' contains objects which cannot be copied. */
+QUICKJS_EXPORT JSContext* js_context_clone(JSContext* ctx);
+
+/* Create a context whose values are allocated from a bump arena. They are
+   all released by js_context_reset_arena() or js_context_free(), so
+   js_value_free() is optional. Use js_value_escape() to keep a value
+   after the arena is released. */
+QUICKJS_EXPORT JSContext* js_context_new_arena(JSRuntime* rt);
+
+QUICKJS_EXPORT void js_context_reset_arena(JSContext* ctx);
+
+/* Open a handle scope. The values created until the scope is closed are
+   allocated from a slab instead of the heap, even if the context has no
+   arena. Return the scope to pass to js_scope_close(), or -1 if there is
+   no memory. */
+QUICKJS_EXPORT int js_scope_open(JSContext* ctx);
+
+/* Release all the values of 'scope' and of the scopes opened after it.
+   Use js_value_escape() to keep a value after its scope is closed.
+   js_value_free() ignores the values of a closed scope as long as no
+   value is created after the close. */
+QUICKJS_EXPORT void js_scope_close(JSContext* ctx, int scope);
+
 QUICKJS_EXPORT void js_context_free(JSContext* ctx);
 
 QUICKJS_EXPORT size_t js_value_size(void);
@@ -65,6 +95,17 @@ QUICKJS_EXPORT void js_value_release(JSContext* ctx, JSValue* value);
 
 QUICKJS_EXPORT void js_value_free(JSContext* ctx, JSValue* value);
 
+/* Move an arena value to the heap. The result must be freed with
+   js_value_free() or, once the context is freed, js_value_free_rt(). */
+QUICKJS_EXPORT JSValue* js_value_escape(JSContext* ctx, JSValue* value);
+
+/* Free a heap value without its context, e.g. a value returned by
+   js_value_escape() after js_context_free(). The values of a scope or of
+   a context arena must never be passed to js_value_free_rt(): they are
+   ignored while their context is alive and are dangling pointers once it
+   is freed. */
+QUICKJS_EXPORT void js_value_free_rt(JSRuntime* rt, JSValue* value);
+
 QUICKJS_EXPORT void js_value_load_int32(JSContext* ctx, JSValue* out, int32_t v);
 
 QUICKJS_EXPORT void js_value_load_int64(JSContext* ctx, JSValue* out, int64_t v);
@@ -113,6 +154,17 @@ QUICKJS_EXPORT const char* js_str_from_value(JSContext* ctx, JSValue* value);
 
 QUICKJS_EXPORT void js_str_free(JSContext* ctx, const char* str);
 
+/* Copy the UTF-16 code units of 'value' converted to a string into 'buf'
+   of 'size' units, without UTF-8 transcoding. '*length' receives the
+   length of the whole string, so 'buf' can be NULL to query it. */
+QUICKJS_EXPORT int js_str_read16(JSContext* ctx, JSValue* value, uint16_t* buf, size_t size, size_t* length);
+
+/* Return the characters of the string 'value' without copy: Latin-1
+   bytes if '*wide' is 0, UTF-16 code units otherwise. They stay valid
+   while 'value' holds the string, e.g. until its scope is closed. Return
+   NULL if 'value' is not a string. */
+QUICKJS_EXPORT const void* js_str_borrow(JSContext* ctx, JSValue* value, size_t* length, int* wide);
+
 QUICKJS_EXPORT JSValue* js_value_new_ref_globals(JSContext* ctx);
 
 QUICKJS_EXPORT void js_value_load_ref_globals(JSContext* ctx, JSValue* out);
@@ -127,6 +179,49 @@ QUICKJS_EXPORT JSValue* js_obj_get_property(JSContext* ctx, JSValue* obj, const
 
 QUICKJS_EXPORT void js_obj_read_property(JSContext* ctx, JSValue* out, JSValue* obj, const char* name);
 
+/* Property names interned once, e.g. at startup, to avoid converting the
+   name at each access. An atom is valid in all the contexts of the
+   runtime until it is released with js_atom_free(). JS_ATOM_NULL is
+   returned in case of error. */
+QUICKJS_EXPORT JSAtom js_atom_new(JSContext* ctx, const char* name);
+
+QUICKJS_EXPORT JSAtom js_atom_new_str(JSContext* ctx, const char* name, size_t length);
+
+QUICKJS_EXPORT void js_atom_free(JSContext* ctx, JSAtom atom);
+
+QUICKJS_EXPORT void js_obj_set_property_atom(JSContext* ctx, JSValue* obj, JSAtom atom, JSValue* value);
+
+QUICKJS_EXPORT JSValue* js_obj_get_property_atom(JSContext* ctx, JSValue* obj, JSAtom atom);
+
+QUICKJS_EXPORT void js_obj_read_property_atom(JSContext* ctx, JSValue* out, JSValue* obj, JSAtom atom);
+
+QUICKJS_EXPORT void js_obj_set_index(JSContext* ctx, JSValue* obj, uint32_t index, JSValue* value);
+
+QUICKJS_EXPORT JSValue* js_obj_get_index(JSContext* ctx, JSValue* obj, uint32_t index);
+
+QUICKJS_EXPORT void js_obj_read_index(JSContext* ctx, JSValue* out, JSValue* obj, uint32_t index);
+
+/* Set the properties 'atoms' of 'obj' to the contiguous array 'values'
+   in a single call. Return JS_ERR_EXCEPTION at the first failure with
+   the exception pending (JS_GetException()). Invalid arguments throw a
+   TypeError. */
+QUICKJS_EXPORT int js_obj_set_properties(JSContext* ctx, JSValue* obj, int n, const JSAtom* atoms, const JSValue* values);
+
+/* Read the properties 'atoms' of 'obj' into the contiguous array 'out'
+   of 'n' values. In case of exception, the slot of the failing property
+   receives the exception and JS_ERR_EXCEPTION is returned. Invalid
+   arguments throw a TypeError which is stored in the first slot. */
+QUICKJS_EXPORT int js_obj_get_properties(JSContext* ctx, JSValue* obj, int n, const JSAtom* atoms, JSValue* out);
+
+/* Create a template object with the properties 'atoms' set to undefined.
+   The objects created from it share its precomputed shape. */
+QUICKJS_EXPORT JSValue* js_obj_new_template(JSContext* ctx, int n, const JSAtom* atoms);
+
+/* Create an object from 'tmpl' whose 'n' properties are filled directly
+   with 'values', in the order of the template atoms. If 'values' is NULL,
+   the values of 'tmpl' are copied. */
+QUICKJS_EXPORT int js_obj_new_from_template(JSContext* ctx, JSValue* out, const JSValue* tmpl, int n, const JSValue* values);
+
 QUICKJS_EXPORT JSValue* js_value_new_str(JSContext* ctx, const char* str, size_t length);
 
 QUICKJS_EXPORT JSValue* js_value_new_cstr(JSContext* ctx, const char* str);
@@ -135,6 +230,15 @@ QUICKJS_EXPORT void js_value_load_str(JSContext* ctx, JSValue* out, const char*
 
 QUICKJS_EXPORT void js_value_load_cstr(JSContext* ctx, JSValue* out, const char* str);
 
+QUICKJS_EXPORT JSValue* js_value_new_str16(JSContext* ctx, const uint16_t* str, size_t length);
+
+QUICKJS_EXPORT void js_value_load_str16(JSContext* ctx, JSValue* out, const uint16_t* str, size_t length);
+
+/* Create a string of 'length' Latin-1 (wide = 0) or UTF-16 (wide = 1)
+   characters which the host writes in place into '*buf' before using
+   the value, so the host string is copied only once. */
+QUICKJS_EXPORT JSValue* js_value_new_str_buffer(JSContext* ctx, size_t length, int wide, void** buf);
+
 QUICKJS_EXPORT int js_eval(JSContext* ctx, JSValue* out, const char* input, size_t length, const char *filename, int eval_flags);
 
 QUICKJS_EXPORT int js_eval_cstr(JSContext* ctx, JSValue* out, const char* input, const char *filename, int eval_flags);
@@ -143,6 +247,18 @@ QUICKJS_EXPORT int js_eval_this(JSContext* ctx, const JSValue* this_obj, JSValue
 
 QUICKJS_EXPORT int js_eval_this_cstr(JSContext* ctx, const JSValue* this_obj, JSValue* out, const char* input, const char *filename, int eval_flags);
 
+/* Call a function value. 'argv' is a contiguous array of 'argc' values
+   owned by the caller. As with js_eval(), 'out' receives the result or
+   the exception and JS_ERR_EXCEPTION is returned in case of exception.
+   Invalid arguments throw a TypeError. */
+QUICKJS_EXPORT int js_value_call(JSContext* ctx, JSValue* out, const JSValue* func, const JSValue* this_obj, int argc, const JSValue* argv);
+
+/* Call the method 'atom' of 'this_obj' */
+QUICKJS_EXPORT int js_value_call_method_atom(JSContext* ctx, JSValue* out, const JSValue* this_obj, JSAtom atom, int argc, const JSValue* argv);
+
+/* Call 'func' as a constructor, as with the 'new' operator */
+QUICKJS_EXPORT int js_value_construct(JSContext* ctx, JSValue* out, const JSValue* func, int argc, const JSValue* argv);
+
 QUICKJS_EXPORT int js_json_parse_str(JSContext* ctx, JSValue* out, const char* input, size_t length);
 
 QUICKJS_EXPORT int js_json_parse_cstr(JSContext* ctx, JSValue* out, const char* input);
@@ -48,6 +48,7 @@
 #       include <utime.h>
 #   else
 #       include <dlfcn.h>
+#       include <sys/mman.h>
 #       include <termios.h>
 #       include <sys/ioctl.h>
 #       include <sys/wait.h>
@@ -132,6 +133,7 @@ typedef struct JSThreadState {
     int eval_script_recurse; /* only used in the main thread */
     /* not used in the main thread */
     JSWorkerMessagePipe *recv_pipe, *send_pipe;
+    char *eval_cache_dir; /* NULL if no persistent JS_Eval() cache */
 } JSThreadState;
 
 static uint64_t os_pending_signals;
@@ -408,6 +410,46 @@ uint8_t *js_load_file(JSContext *ctx, size_t *pbuf_len, const char *filename)
     return buf;
 }
 
+uint8_t *js_map_file(size_t *pbuf_len, const char *filename)
+{
+#if defined(_WIN32)
+    return js_load_file(NULL, pbuf_len, filename);
+#else
+    int fd;
+    struct stat st;
+    void *buf;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &st) < 0)
+        goto fail;
+    if (!S_ISREG(st.st_mode) || st.st_size == 0) {
+        errno = EINVAL;
+        goto fail;
+    }
+    /* the pages are shared with the other processes mapping the file */
+    buf = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (buf == MAP_FAILED) {
+    fail:
+        close(fd);
+        return NULL;
+    }
+    close(fd);
+    *pbuf_len = st.st_size;
+    return buf;
+#endif
+}
+
+void js_unmap_file(uint8_t *buf, size_t buf_len)
+{
+#if defined(_WIN32)
+    free(buf);
+#else
+    munmap(buf, buf_len);
+#endif
+}
+
 /* load and evaluate a file */
 static JSValue js_loadScript(JSContext *ctx, JSValueConst this_val,
                              int argc, JSValueConst *argv)
@@ -3806,6 +3848,95 @@ void js_std_init_handlers(JSRuntime *rt)
 #endif
 }
 
+static uint8_t *js_std_eval_cache_load(JSRuntime *rt, void *opaque,
+                                       const char *key, size_t *psize)
+{
+    JSThreadState *ts = opaque;
+    char path[PATH_MAX];
+    FILE *f;
+    uint8_t *buf;
+    long len;
+
+    snprintf(path, sizeof(path), "%s/%s.jsbc", ts->eval_cache_dir, key);
+    f = fopen(path, "rb");
+    if (!f)
+        return NULL;
+    buf = NULL;
+    if (fseek(f, 0, SEEK_END) < 0)
+        goto done;
+    /* ftell() fails if the size does not fit in a long */
+    len = ftell(f);
+    if (len < 0)
+        goto done;
+    if (len == 0 || fseek(f, 0, SEEK_SET) < 0)
+        goto done;
+    buf = js_malloc_rt(rt, len);
+    if (!buf)
+        goto done;
+    if (fread(buf, 1, len, f) != (size_t)len) {
+        js_free_rt(rt, buf);
+        buf = NULL;
+        goto done;
+    }
+    *psize = len;
+ done:
+    fclose(f);
+    return buf;
+}
+
+static void js_std_eval_cache_store(JSRuntime *rt, void *opaque,
+                                    const char *key, const uint8_t *buf,
+                                    size_t size)
+{
+    JSThreadState *ts = opaque;
+    char path[PATH_MAX], tmp_path[PATH_MAX];
+    FILE *f;
+    BOOL ok;
+    unsigned int pid;
+
+    /* the file is renamed once complete so that the other processes
+       never read a partial file */
+#if defined(_WIN32)
+    pid = GetCurrentProcessId();
+#else
+    pid = getpid();
+#endif
+    snprintf(path, sizeof(path), "%s/%s.jsbc", ts->eval_cache_dir, key);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%u.tmp", path, pid);
+    f = fopen(tmp_path, "wb");
+    if (!f)
+        return;
+    ok = (fwrite(buf, 1, size, f) == size);
+    if (fclose(f) != 0)
+        ok = FALSE;
+    if (!ok || rename(tmp_path, path) != 0)
+        remove(tmp_path);
+}
+
+int js_std_set_eval_cache(JSRuntime *rt, size_t max_size, const char *dir)
+{
+    JSThreadState *ts = JS_GetRuntimeOpaque(rt);
+    JSEvalCacheFunctions cf;
+    char *dir1;
+
+    dir1 = NULL;
+    if (dir) {
+        dir1 = strdup(dir);
+        if (!dir1)
+            return -1;
+    }
+    free(ts->eval_cache_dir);
+    ts->eval_cache_dir = dir1;
+    if (dir1) {
+        cf.load = js_std_eval_cache_load;
+        cf.store = js_std_eval_cache_store;
+        JS_SetEvalCache(rt, max_size, &cf, ts);
+    } else {
+        JS_SetEvalCache(rt, max_size, NULL, NULL);
+    }
+    return 0;
+}
+
 void js_std_free_handlers(JSRuntime *rt)
 {
     JSThreadState *ts = JS_GetRuntimeOpaque(rt);
@@ -3834,6 +3965,10 @@ void js_std_free_handlers(JSRuntime *rt)
     js_free_message_pipe(ts->send_pipe);
 #endif
 
+    if (ts->eval_cache_dir) {
+        JS_SetEvalCache(rt, 0, NULL, NULL);
+        free(ts->eval_cache_dir);
+    }
     free(ts);
     JS_SetRuntimeOpaque(rt, NULL); /* fail safe */
 }
@@ -3910,13 +4045,18 @@ void js_std_loop(JSContext *ctx)
 }
 
 void js_std_eval_binary(JSContext *ctx, const uint8_t *buf, size_t buf_len,
-                        int load_only)
+                        int flags)
 {
     JSValue obj, val;
-    obj = JS_ReadObject(ctx, buf, buf_len, JS_READ_OBJ_BYTECODE);
+    int read_flags;
+
+    read_flags = JS_READ_OBJ_BYTECODE;
+    if (flags & JS_STD_EVAL_BINARY_ROM_DATA)
+        read_flags |= JS_READ_OBJ_ROM_DATA;
+    obj = JS_ReadObject(ctx, buf, buf_len, read_flags);
     if (JS_IsException(obj))
         goto exception;
-    if (load_only) {
+    if (flags & JS_STD_EVAL_BINARY_LOAD_ONLY) {
         if (JS_VALUE_GET_TAG(obj) == JS_TAG_MODULE) {
             js_module_set_import_meta(ctx, obj, FALSE, FALSE);
         }
@@ -41,16 +41,30 @@ void js_std_init_handlers(JSRuntime *rt);
 void js_std_free_handlers(JSRuntime *rt);
 void js_std_dump_error(JSContext *ctx);
 uint8_t *js_load_file(JSContext *ctx, size_t *pbuf_len, const char *filename);
+/* map a file read-only in memory so that its pages are shared between
+   the processes (the file is read if mmap() is not available). The
+   buffer is released with js_unmap_file(). */
+uint8_t *js_map_file(size_t *pbuf_len, const char *filename);
+void js_unmap_file(uint8_t *buf, size_t buf_len);
 int js_module_set_import_meta(JSContext *ctx, JSValueConst func_val,
                               JS_BOOL use_realpath, JS_BOOL is_main);
 JSModuleDef *js_module_loader(JSContext *ctx,
                               const char *module_name, void *opaque);
+/* js_std_eval_binary() flags */
+#define JS_STD_EVAL_BINARY_LOAD_ONLY (1 << 0)
+/* use the byte code in place: 'buf' must be kept until the runtime
+   is freed */
+#define JS_STD_EVAL_BINARY_ROM_DATA  (1 << 1)
 void js_std_eval_binary(JSContext *ctx, const uint8_t *buf, size_t buf_len,
                         int flags);
 void js_std_promise_rejection_tracker(JSContext *ctx, JSValueConst promise,
                                       JSValueConst reason,
                                       JS_BOOL is_handled, void *opaque);
 void js_std_set_worker_new_context_func(JSContext *(*func)(JSRuntime *rt));
+/* enable the JS_Eval() compilation cache with 'max_size' bytes in
+   memory. If 'dir' is not NULL, the byte code is also stored in files
+   of this directory. */
+int js_std_set_eval_cache(JSRuntime *rt, size_t max_size, const char *dir);
                                         
 #ifdef __cplusplus
 } /* extern "C" { */
@@ -53,6 +53,7 @@ FMT(atom_u16)
 FMT(atom_label_u8)
 FMT(atom_label_u16)
 FMT(label_u16)
+FMT(loc8_label8)
 #undef FMT
 #endif /* FMT */
 
@@ -106,6 +107,7 @@ DEF(    call_method, 3, 2, 1, npop) /* arguments are not counted in n_pop */
 DEF(tail_call_method, 3, 2, 0, npop) /* arguments are not counted in n_pop */
 DEF(     array_from, 3, 0, 1, npop) /* arguments are not counted in n_pop */
 DEF(          apply, 3, 3, 1, u16)
+DEF(   apply_spread, 3, 3, 1, u16) /* func this iterable -> ret */
 DEF(         return, 1, 1, 0, none)
 DEF(   return_undef, 1, 0, 0, none)
 DEF(check_ctor_return, 1, 1, 2, none)
@@ -123,11 +125,11 @@ DEF(      get_super, 1, 1, 1, none)
 DEF(         import, 1, 1, 1, none) /* dynamic module import */
 
 DEF(      check_var, 5, 0, 1, atom) /* check if a variable exists */
-DEF(  get_var_undef, 5, 0, 1, atom) /* push undefined if the variable does not exist */
-DEF(        get_var, 5, 0, 1, atom) /* throw an exception if the variable does not exist */
-DEF(        put_var, 5, 1, 0, atom) /* must come after get_var */
-DEF(   put_var_init, 5, 1, 0, atom) /* must come after put_var. Used to initialize a global lexical variable */
-DEF( put_var_strict, 5, 2, 0, atom) /* for strict mode variable write */
+DEF(  get_var_undef, 7, 0, 1, atom_u16) /* push undefined if the variable does not exist. u16 is the inline cache index */
+DEF(        get_var, 7, 0, 1, atom_u16) /* throw an exception if the variable does not exist */
+DEF(        put_var, 7, 1, 0, atom_u16) /* must come after get_var */
+DEF(   put_var_init, 7, 1, 0, atom_u16) /* must come after put_var. Used to initialize a global lexical variable */
+DEF( put_var_strict, 7, 2, 0, atom_u16) /* for strict mode variable write */
 
 DEF(  get_ref_value, 1, 2, 3, none)
 DEF(  put_ref_value, 1, 3, 0, none)
@@ -135,9 +137,9 @@ DEF(  put_ref_value, 1, 3, 0, none)
 DEF(     define_var, 6, 0, 0, atom_u8)
 DEF(check_define_var, 6, 0, 0, atom_u8)
 DEF(    define_func, 6, 1, 0, atom_u8)
-DEF(      get_field, 5, 1, 1, atom)
-DEF(     get_field2, 5, 1, 2, atom)
-DEF(      put_field, 5, 2, 0, atom)
+DEF(      get_field, 7, 1, 1, atom_u16) /* u16 is the inline cache index */
+DEF(     get_field2, 7, 1, 2, atom_u16)
+DEF(      put_field, 7, 2, 0, atom_u16)
 DEF( get_private_field, 1, 2, 1, none) /* obj prop -> value */
 DEF( put_private_field, 1, 3, 0, none) /* obj value prop -> */
 DEF(define_private_field, 1, 3, 1, none) /* obj prop value -> obj */
@@ -358,6 +360,13 @@ DEF(   is_undefined, 1, 1, 1, none)
 DEF(        is_null, 1, 1, 1, none)
 DEF(typeof_is_undefined, 1, 1, 1, none)
 DEF( typeof_is_function, 1, 1, 1, none)
+
+/* superinstructions for the most frequent opcode sequences in loops */
+DEF(   lt_if_false8, 2, 2, 0, label8)
+DEF(  lte_if_false8, 2, 2, 0, label8) /* must come after lt_if_false8 */
+DEF(   gt_if_false8, 2, 2, 0, label8) /* must come after lte_if_false8 */
+DEF(  gte_if_false8, 2, 2, 0, label8) /* must come after gt_if_false8 */
+DEF(  inc_loc_goto8, 3, 0, 0, loc8_label8)
 #endif
 
 #undef DEF
@@ -80,6 +80,15 @@
 #define CONFIG_STACK_CHECK
 #endif
 
+#if defined(__x86_64__) && !defined(_WIN32) && !defined(EMSCRIPTEN) && \
+    !defined(__ANDROID__) && !defined(JS_NAN_BOXING) && \
+    !defined(CONFIG_CHECK_JSVALUE)
+/* enable the baseline JIT compiler. It only generates x86-64 code:
+   JS_EnableJIT() has no effect on the other targets (AArch64
+   included) which always use the interpreter. */
+#define CONFIG_JIT
+#endif
+
 
 /* dump object free */
 //#define DUMP_FREE
@@ -117,6 +126,10 @@
 #include <errno.h>
 #endif
 
+#ifdef CONFIG_JIT
+#include <sys/mman.h>
+#endif
+
 enum {
     /* classid tag        */    /* union usage   | properties */
     JS_CLASS_OBJECT = 1,        /* must be first */
@@ -240,6 +253,21 @@ typedef struct {
 } JSNumericOperations;
 #endif
 
+#define JS_SLAB_ALIGN       16
+#define JS_SLAB_MAX_SIZE    128
+#define JS_SLAB_CHUNK_SIZE  (16 * 1024)
+
+typedef struct JSSlabChunk {
+    struct JSSlabChunk *next;
+    /* the blocks start at offset JS_SLAB_ALIGN */
+} JSSlabChunk;
+
+typedef struct JSSlabClass {
+    void *free_list;
+    uint8_t *ptr; /* unused part of the last chunk */
+    uint8_t *end;
+} JSSlabClass;
+
 struct JSRuntime {
     JSMallocFunctions mf;
     JSMallocState malloc_state;
@@ -252,6 +280,15 @@ struct JSRuntime {
     uint32_t *atom_hash;
     JSAtomStruct **atom_array;
     int atom_free_index; /* 0 = none */
+    /* shared one character Latin-1 strings, allocated on first use */
+    JSString *char_strings[256];
+
+    BOOL slab_enabled;
+    JSSlabClass slab_classes[JS_SLAB_MAX_SIZE / JS_SLAB_ALIGN];
+    JSSlabChunk *slab_chunks;
+    size_t slab_chunk_count;
+    size_t slab_used_size;
+    size_t slab_live_count; /* allocated blocks, even if not enabled */
 
     int class_count;    /* size of class_array */
     JSClass *class_array;
@@ -260,11 +297,17 @@ struct JSRuntime {
     /* list of JSGCObjectHeader.link. List of allocated GC objects (used
        by the garbage collector) */
     struct list_head gc_obj_list;
+    /* list of JSGCObjectHeader.link. GC objects allocated since the
+       last cycle removal pass (young generation). */
+    struct list_head gc_young_obj_list;
     /* list of JSGCObjectHeader.link. Used during JS_FreeValueRT() */
     struct list_head gc_zero_ref_count_list; 
     struct list_head tmp_obj_list; /* used during GC */
+    struct list_head *gc_minor_obj_list; /* used during the minor GC */
     JSGCPhaseEnum gc_phase : 8;
     size_t malloc_gc_threshold;
+    size_t minor_gc_count; /* GC objects allocated since the last minor GC */
+    size_t minor_gc_threshold; /* 0 = no automatic minor GC */
 #ifdef DUMP_LEAKS
     struct list_head string_list; /* list of JSString.link */
 #endif
@@ -291,7 +334,21 @@ struct JSRuntime {
     JSModuleLoaderFunc *module_loader_func;
     void *module_loader_opaque;
 
+    /* JS_Eval() compilation cache */
+    size_t eval_cache_max_size; /* 0 = no memory cache */
+    size_t eval_cache_size;
+    /* list of JSEvalCacheEntry.link, most recently used first */
+    struct list_head eval_cache_list;
+    int64_t eval_cache_hit_count;
+    JSEvalCacheFunctions eval_cache_funcs;
+    void *eval_cache_opaque;
+
+    /* atoms created by JS_ReserveObjectAtoms() */
+    JSAtom *reserved_atoms;
+    int reserved_atom_count;
+
     BOOL can_block : 8; /* TRUE if Atomics.wait can block */
+    BOOL jit_enabled : 8; /* compile the hot functions to native code */
     /* used to allocate, free and clone SharedArrayBuffers */
     JSSharedArrayBufferFunctions sab_funcs;
     
@@ -300,6 +357,7 @@ struct JSRuntime {
     int shape_hash_size;
     int shape_hash_count; /* number of hashed shapes */
     JSShape **shape_hash;
+    uint64_t shape_version; /* last value of JSShape.version */
 #ifdef CONFIG_BIGNUM
     bf_context_t bf_ctx;
     JSNumericOperations bigint_ops;
@@ -354,7 +412,9 @@ typedef enum {
 struct JSGCObjectHeader {
     int ref_count; /* must come first, 32-bit */
     JSGCObjectTypeEnum gc_obj_type : 4;
-    uint8_t mark : 4; /* used by the GC */
+    /* used by the GC. During a minor GC: 0 = not examined, 1 =
+       examined, 2 = to be examined */
+    uint8_t mark : 4;
     uint8_t dummy1; /* not used by the GC */
     uint16_t dummy2; /* not used by the GC */
     struct list_head link;
@@ -412,6 +472,23 @@ typedef enum {
    enough to call the interrupt callback often. */
 #define JS_INTERRUPT_COUNTER_INIT 10000
 
+#define JS_VALUE_ARENA_MIN_SLOTS 256
+
+/* block of the value arena. The slots are allocated by bumping 'count'
+   and are only reclaimed all together. */
+typedef struct JSValueArenaBlock {
+    struct JSValueArenaBlock *next;
+    uint32_t count; /* number of used slots */
+    uint32_t size; /* number of slots */
+    JSValue slots[0];
+} JSValueArenaBlock;
+
+/* position of the value arena when a value scope was opened */
+typedef struct JSValueArenaMark {
+    JSValueArenaBlock *block;
+    uint32_t count;
+} JSValueArenaMark;
+
 struct JSContext {
     JSGCObjectHeader header; /* must come first */
     JSRuntime *rt;
@@ -459,6 +536,16 @@ struct JSContext {
                              const char *input, size_t input_len,
                              const char *filename, int flags, int scope_idx);
     void *user_opaque;
+    /* value arena: the first block is the current one. NULL if disabled */
+    JSValueArenaBlock *value_arena;
+    BOOL value_arena_enabled;
+    /* blocks released by JS_CloseValueScope(), kept for the next scopes
+       so that opening and closing scopes does not call malloc() and so
+       that the slots of the closed scopes stay valid pointers */
+    JSValueArenaBlock *value_arena_spare;
+    JSValueArenaMark *value_scopes;
+    int value_scope_count;
+    int value_scope_size;
 };
 
 typedef union JSFloat64Union {
@@ -506,6 +593,22 @@ struct JSString {
     } u;
 };
 
+/* A string rope is the lazy concatenation of two strings. It is
+   created by JS_ConcatString() for long results and is linearized in
+   place when its characters are needed. */
+typedef struct JSStringRope {
+    JSRefCountHeader header; /* must come first, 32-bit */
+    uint32_t len;
+    uint8_t is_wide_char; /* 0 = 8 bits, 1 = 16 bits characters */
+    uint8_t depth; /* depth of the tree, 0 if linearized */
+    /* JS_TAG_STRING or JS_TAG_STRING_ROPE. When the rope is linearized,
+       'left' is the whole string and 'right' is JS_UNDEFINED */
+    JSValue left;
+    JSValue right;
+} JSStringRope;
+
+#define JS_VALUE_GET_STRING_ROPE(v) ((JSStringRope *)JS_VALUE_GET_PTR(v))
+
 typedef struct JSClosureVar {
     uint8_t is_local : 1;
     uint8_t is_arg : 1;
@@ -584,6 +687,27 @@ typedef enum JSFunctionKindEnum {
     JS_FUNC_ASYNC_GENERATOR = (JS_FUNC_GENERATOR | JS_FUNC_ASYNC),
 } JSFunctionKindEnum;
 
+/* Inline caches of the property access opcodes (OP_get_field,
+   OP_get_field2, OP_put_field) and of the global variable opcodes
+   (OP_get_var, OP_put_var, ...). The cache is keyed by the shape
+   version of the object so it does not hold any reference. */
+#define JS_IC_ENTRY_COUNT 4 /* polymorphic entries per access site */
+#define JS_IC_INDEX_NONE  0xffff /* access site without inline cache */
+
+typedef struct JSInlineCacheEntry {
+    uint64_t shape_version; /* version of the object shape */
+    /* 0 if the property is an own property, otherwise version of the
+       shape of the prototype holding the property */
+    uint64_t proto_version;
+    uint32_t prop_idx; /* index in the shape holding the property */
+} JSInlineCacheEntry;
+
+typedef struct JSInlineCache {
+    uint8_t count; /* number of valid entries */
+    uint8_t is_megamorphic : 1; /* TRUE if the cache is no longer updated */
+    JSInlineCacheEntry entries[JS_IC_ENTRY_COUNT];
+} JSInlineCache;
+
 typedef struct JSFunctionBytecode {
     JSGCObjectHeader header; /* must come first */
     uint8_t js_mode;
@@ -599,8 +723,18 @@ typedef struct JSFunctionBytecode {
     uint8_t arguments_allowed : 1;
     uint8_t has_debug : 1;
     uint8_t backtrace_barrier : 1; /* stop backtrace on this function */
+    /* byte_code_buf and debug.pc2line_buf point to the
+       JS_READ_OBJ_ROM_DATA input of JS_ReadObject() */
     uint8_t read_only_bytecode : 1;
-    /* XXX: 4 bits available */
+    /* if is_lazy is set, the function is not compiled yet: there is
+       no byte code, debug.source contains the function source and
+       cpool[0] is the compiled function or JS_NULL */
+    uint8_t is_lazy : 1;
+    uint8_t lazy_is_func_expr : 1;
+    uint8_t lazy_is_module : 1;
+    /* owned by a JSSharedBytecode: immutable and not reference counted
+       by the functions of the other runtimes */
+    uint8_t is_shared : 1;
     uint8_t *byte_code_buf; /* (self pointer) */
     int byte_code_len;
     JSAtom func_name;
@@ -614,6 +748,18 @@ typedef struct JSFunctionBytecode {
     JSValue *cpool; /* constant pool (self pointer) */
     int cpool_count;
     int closure_var_count;
+    int ic_count; /* number of inline caches */
+    JSInlineCache *ic; /* allocated on first use, NULL if none */
+#ifdef CONFIG_JIT
+    uint32_t jit_counter; /* number of calls and loop iterations */
+    /* set if js_jit_compile() failed: the function stays interpreted */
+    BOOL jit_disabled;
+    struct JSJitCode *jit_code; /* native code, NULL if not compiled */
+#endif
+    /* if not NULL, the bytecode was copied by JS_CloneContext(). Only
+       the realm, the constant pool, the inline caches and the native
+       code belong to the copy. The rest is owned by 'parent'. */
+    struct JSFunctionBytecode *parent;
     struct {
         /* debug info, move to separate structure to save memory? */
         JSAtom filename;
@@ -625,6 +771,34 @@ typedef struct JSFunctionBytecode {
     } debug;
 } JSFunctionBytecode;
 
+#ifdef CONFIG_JIT
+typedef struct JSJitCode JSJitCode;
+
+/* interpreter state exchanged with the native code */
+typedef struct JSJitFrame {
+    JSRuntime *rt;
+    JSContext *ctx;
+    JSFunctionBytecode *b;
+    JSStackFrame *sf;
+    JSVarRef **var_refs;
+    JSValue *var_buf;
+    JSValue *arg_buf;
+    JSValueConst this_obj;
+    JSValue *sp;
+    const uint8_t *pc;
+    JSValue ret_val;
+} JSJitFrame;
+
+typedef enum {
+    JS_JIT_RETURN, /* the function returned ret_val */
+    JS_JIT_EXCEPTION, /* exception at pc */
+    JS_JIT_BAILOUT, /* continue in the interpreter at pc */
+} JSJitStatusEnum;
+
+/* number of calls and loop iterations before compiling a function */
+#define JS_JIT_THRESHOLD 1000
+#endif
+
 typedef struct JSBoundFunction {
     JSValue func_obj;
     JSValue this_val;
@@ -856,11 +1030,21 @@ struct JSShape {
        small array index properties */
     uint8_t has_small_array_index;
     uint32_t hash; /* current hash value */
+    /* unique value which changes each time the shape is modified in
+       place. Used as key by the inline caches. Never 0. It is 64 bit
+       so that it never wraps: a cache entry of the prototype path
+       cannot check that the property is absent from the object. */
+    uint64_t version;
     uint32_t prop_hash_mask;
     int prop_size; /* allocated properties */
     int prop_count; /* include deleted properties */
     int deleted_prop_count;
     JSShape *shape_hash_next; /* in JSRuntime.shape_hash[h] list */
+    /* Shape transition tree. Only hashed shapes are in the tree. A
+       child is its parent shape with one more property. The links are
+       weak and removed when a shape is modified in place or freed. */
+    struct list_head transition_list; /* list of JSShape.transition_link */
+    struct list_head transition_link; /* next = NULL if no parent */
     JSObject *proto;
     JSShapeProperty prop[0]; /* prop_size elements */
 };
@@ -1015,6 +1199,17 @@ static JSValue JS_CallConstructorInternal(JSContext *ctx,
                                           JSValueConst func_obj,
                                           JSValueConst new_target,
                                           int argc, JSValue *argv, int flags);
+static JSValue js_compile_lazy_function(JSContext *ctx,
+                                        JSFunctionBytecode *lb);
+static void js_free_eval_cache(JSRuntime *rt);
+static JSValue js_eval_cached(JSContext *ctx, JSValueConst this_obj,
+                              const char *input, size_t input_len,
+                              const char *filename, int eval_flags);
+#ifdef CONFIG_JIT
+static int js_jit_compile(JSRuntime *rt, JSFunctionBytecode *b);
+static int js_jit_run(JSJitFrame *f);
+static void js_jit_free_code(JSRuntime *rt, JSJitCode *jc);
+#endif
 static JSValue JS_CallFree(JSContext *ctx, JSValue func_obj, JSValueConst this_obj,
                            int argc, JSValueConst *argv);
 static JSValue JS_InvokeFree(JSContext *ctx, JSValue this_val, JSAtom atom,
@@ -1039,6 +1234,9 @@ static __maybe_unused void JS_PrintValue(JSContext *ctx,
 static __maybe_unused void JS_DumpShapes(JSRuntime *rt);
 static JSValue js_function_apply(JSContext *ctx, JSValueConst this_val,
                                  int argc, JSValueConst *argv, int magic);
+static JSValue js_function_apply_spread(JSContext *ctx, JSValueConst func_obj,
+                                        JSValueConst this_arg,
+                                        JSValueConst iterable, int magic);
 static void js_array_finalizer(JSRuntime *rt, JSValue val);
 static void js_array_mark(JSRuntime *rt, JSValueConst val,
                           JS_MarkFunc *mark_func);
@@ -1101,6 +1299,7 @@ static JSValue js_compile_regexp(JSContext *ctx, JSValueConst pattern,
 static JSValue js_regexp_constructor_internal(JSContext *ctx, JSValueConst ctor,
                                               JSValue pattern, JSValue bc);
 static void gc_decref(JSRuntime *rt);
+static void gc_promote_young(JSRuntime *rt);
 static int JS_NewClass1(JSRuntime *rt, JSClassID class_id,
                         const JSClassDef *class_def, JSAtom name);
 
@@ -1230,7 +1429,7 @@ static __exception int js_get_length64(JSContext *ctx, int64_t *pres,
                                        JSValueConst obj);
 static void free_arg_list(JSContext *ctx, JSValue *tab, uint32_t len);
 static JSValue *build_arg_list(JSContext *ctx, uint32_t *plen,
-                               JSValueConst array_arg);
+                               JSValueConst array_arg, BOOL *pborrowed);
 static BOOL js_get_fast_array(JSContext *ctx, JSValueConst obj,
                               JSValue **arrpp, uint32_t *countp);
 static JSValue JS_CreateAsyncFromSyncIterator(JSContext *ctx,
@@ -1276,6 +1475,10 @@ static void js_trigger_gc(JSRuntime *rt, size_t size)
         JS_RunGC(rt);
         rt->malloc_gc_threshold = rt->malloc_state.malloc_size +
             (rt->malloc_state.malloc_size >> 1);
+    } else if (rt->minor_gc_threshold != 0 &&
+               rt->minor_gc_count >= rt->minor_gc_threshold) {
+        /* only look for the cycles in the young generation */
+        JS_RunGCStep(rt, 0);
     }
 }
 
@@ -1284,9 +1487,20 @@ static size_t js_malloc_usable_size_unknown(const void *ptr)
     return 0;
 }
 
+#if defined(JS_NAN_BOXING) && defined(JS_PTR64)
+/* the NaN boxed JSValues can only hold 47 bit pointers */
+#define js_check_value_ptr(ptr) \
+    assert(((uintptr_t)(ptr) & ~(uintptr_t)JS_VALUE_PTR_MASK) == 0)
+#else
+#define js_check_value_ptr(ptr) ((void)0)
+#endif
+
 void *js_malloc_rt(JSRuntime *rt, size_t size)
 {
-    return rt->mf.js_malloc(&rt->malloc_state, size);
+    void *ptr;
+    ptr = rt->mf.js_malloc(&rt->malloc_state, size);
+    js_check_value_ptr(ptr);
+    return ptr;
 }
 
 void js_free_rt(JSRuntime *rt, void *ptr)
@@ -1296,7 +1510,9 @@ void js_free_rt(JSRuntime *rt, void *ptr)
 
 void *js_realloc_rt(JSRuntime *rt, void *ptr, size_t size)
 {
-    return rt->mf.js_realloc(&rt->malloc_state, ptr, size);
+    ptr = rt->mf.js_realloc(&rt->malloc_state, ptr, size);
+    js_check_value_ptr(ptr);
+    return ptr;
 }
 
 size_t js_malloc_usable_size_rt(JSRuntime *rt, const void *ptr)
@@ -1384,6 +1600,86 @@ size_t js_malloc_usable_size(JSContext *ctx, const void *ptr)
     return js_malloc_usable_size_rt(ctx->rt, ptr);
 }
 
+/* Slab allocator for the small fixed size structures (JSObject,
+   JSVarRef, JSMapRecord, JSStringRope). The blocks are carved from
+   chunks allocated with js_malloc_rt() and are kept in a free list
+   per size class. The chunks are only released by
+   JS_FreeRuntime(). The size of the block must be given when freeing
+   it. */
+
+static void *js_slab_malloc_rt(JSRuntime *rt, size_t size)
+{
+    JSSlabClass *sc;
+    JSSlabChunk *c;
+    void *ptr;
+
+    if (!rt->slab_enabled) {
+        ptr = js_malloc_rt(rt, size);
+        if (ptr)
+            rt->slab_live_count++;
+        return ptr;
+    }
+    assert(size != 0 && size <= JS_SLAB_MAX_SIZE);
+    sc = &rt->slab_classes[(size - 1) / JS_SLAB_ALIGN];
+    size = ((size - 1) / JS_SLAB_ALIGN + 1) * JS_SLAB_ALIGN;
+    ptr = sc->free_list;
+    if (ptr) {
+        sc->free_list = *(void **)ptr;
+    } else {
+        if (unlikely(sc->ptr + size > sc->end)) {
+            c = js_malloc_rt(rt, JS_SLAB_CHUNK_SIZE);
+            if (!c)
+                return NULL;
+            c->next = rt->slab_chunks;
+            rt->slab_chunks = c;
+            rt->slab_chunk_count++;
+            sc->ptr = (uint8_t *)c + JS_SLAB_ALIGN;
+            sc->end = (uint8_t *)c + JS_SLAB_CHUNK_SIZE;
+        }
+        ptr = sc->ptr;
+        sc->ptr += size;
+    }
+    rt->slab_live_count++;
+    rt->slab_used_size += size;
+    return ptr;
+}
+
+static void *js_slab_malloc(JSContext *ctx, size_t size)
+{
+    void *ptr;
+    ptr = js_slab_malloc_rt(ctx->rt, size);
+    if (unlikely(!ptr)) {
+        JS_ThrowOutOfMemory(ctx);
+        return NULL;
+    }
+    return ptr;
+}
+
+static void js_slab_free_rt(JSRuntime *rt, void *ptr, size_t size)
+{
+    JSSlabClass *sc;
+
+    rt->slab_live_count--;
+    if (!rt->slab_enabled) {
+        js_free_rt(rt, ptr);
+        return;
+    }
+    sc = &rt->slab_classes[(size - 1) / JS_SLAB_ALIGN];
+    *(void **)ptr = sc->free_list;
+    sc->free_list = ptr;
+    rt->slab_used_size -= ((size - 1) / JS_SLAB_ALIGN + 1) * JS_SLAB_ALIGN;
+}
+
+/* Return -1 if the allocator cannot be changed because some
+   structures were already allocated. */
+int JS_EnableSlabAllocator(JSRuntime *rt, BOOL enable)
+{
+    if (rt->slab_live_count != 0)
+        return -1;
+    rt->slab_enabled = (enable != 0);
+    return 0;
+}
+
 /* Throw out of memory exception in case of error */
 char *js_strndup(JSContext *ctx, const char *s, size_t n)
 {
@@ -1618,6 +1914,7 @@ JSRuntime *JS_NewRuntime2(const JSMallocFunctions *mf, void *opaque)
     }
     rt->malloc_state = ms;
     rt->malloc_gc_threshold = 256 * 1024;
+    rt->minor_gc_threshold = 10000;
 
 #ifdef CONFIG_BIGNUM
     bf_context_init(&rt->bf_ctx, js_bf_realloc, rt);
@@ -1628,6 +1925,7 @@ JSRuntime *JS_NewRuntime2(const JSMallocFunctions *mf, void *opaque)
 
     init_list_head(&rt->context_list);
     init_list_head(&rt->gc_obj_list);
+    init_list_head(&rt->gc_young_obj_list);
     init_list_head(&rt->gc_zero_ref_count_list);
     rt->gc_phase = JS_GC_PHASE_NONE;
     
@@ -1635,6 +1933,7 @@ JSRuntime *JS_NewRuntime2(const JSMallocFunctions *mf, void *opaque)
     init_list_head(&rt->string_list);
 #endif
     init_list_head(&rt->job_list);
+    init_list_head(&rt->eval_cache_list);
 
     if (JS_InitAtoms(rt))
         goto fail;
@@ -1782,6 +2081,13 @@ void JS_SetGCThreshold(JSRuntime *rt, size_t gc_threshold)
     rt->malloc_gc_threshold = gc_threshold;
 }
 
+/* number of GC object allocations triggering a minor GC. Use 0 to
+   disable the automatic minor GC. */
+void JS_SetMinorGCThreshold(JSRuntime *rt, size_t count)
+{
+    rt->minor_gc_threshold = count;
+}
+
 #define malloc(s) malloc_is_forbidden(s)
 #define free(p) free_is_forbidden(p)
 #define realloc(p,s) realloc_is_forbidden(p,s)
@@ -1797,6 +2103,13 @@ void JS_SetCanBlock(JSRuntime *rt, BOOL can_block)
     rt->can_block = can_block;
 }
 
+void JS_EnableJIT(JSRuntime *rt, BOOL enable)
+{
+#ifdef CONFIG_JIT
+    rt->jit_enabled = enable;
+#endif
+}
+
 void JS_SetSharedArrayBufferFunctions(JSRuntime *rt,
                                       const JSSharedArrayBufferFunctions *sf)
 {
@@ -1943,6 +2256,15 @@ void JS_FreeRuntime(JSRuntime *rt)
 
     JS_RunGC(rt);
 
+    for(i = 0; i < countof(rt->char_strings); i++) {
+        if (rt->char_strings[i])
+            JS_FreeValueRT(rt, JS_MKPTR(JS_TAG_STRING, rt->char_strings[i]));
+    }
+
+    for(i = 0; i < rt->reserved_atom_count; i++)
+        JS_FreeAtomRT(rt, rt->reserved_atoms[i]);
+    js_free_rt(rt, rt->reserved_atoms);
+
 #ifdef DUMP_LEAKS
     /* leaking objects */
     {
@@ -1983,6 +2305,9 @@ void JS_FreeRuntime(JSRuntime *rt)
     }
 #endif
     assert(list_empty(&rt->gc_obj_list));
+    assert(list_empty(&rt->gc_young_obj_list));
+
+    js_free_eval_cache(rt);
 
     /* free the classes */
     for(i = 0; i < rt->class_count; i++) {
@@ -2068,6 +2393,13 @@ void JS_FreeRuntime(JSRuntime *rt)
     js_free_rt(rt, rt->atom_array);
     js_free_rt(rt, rt->atom_hash);
     js_free_rt(rt, rt->shape_hash);
+
+    /* free the slab chunks */
+    while (rt->slab_chunks != NULL) {
+        JSSlabChunk *c = rt->slab_chunks;
+        rt->slab_chunks = c->next;
+        js_free_rt(rt, c);
+    }
 #ifdef DUMP_LEAKS
     if (!list_empty(&rt->string_list)) {
         if (rt->rt_info) {
@@ -2114,7 +2446,8 @@ void JS_FreeRuntime(JSRuntime *rt)
     }
 }
 
-JSContext *JS_NewContextRaw(JSRuntime *rt)
+/* context without any object */
+static JSContext *JS_NewContext0(JSRuntime *rt)
 {
     JSContext *ctx;
     int i;
@@ -2144,7 +2477,16 @@ JSContext *JS_NewContextRaw(JSRuntime *rt)
     ctx->regexp_ctor = JS_NULL;
     ctx->promise_ctor = JS_NULL;
     init_list_head(&ctx->loaded_modules);
+    return ctx;
+}
+
+JSContext *JS_NewContextRaw(JSRuntime *rt)
+{
+    JSContext *ctx;
 
+    ctx = JS_NewContext0(rt);
+    if (!ctx)
+        return NULL;
     JS_AddIntrinsicBasicObjects(ctx);
     return ctx;
 }
@@ -2227,6 +2569,203 @@ static void js_free_modules(JSContext *ctx, JSFreeModuleEnum flag)
     }
 }
 
+static void js_free_value_arena_blocks(JSRuntime *rt, JSValueArenaBlock *b)
+{
+    JSValueArenaBlock *b_next;
+    for(; b != NULL; b = b_next) {
+        b_next = b->next;
+        js_free_rt(rt, b);
+    }
+}
+
+/* Enable or disable the value arena of the context. When enabled,
+   JS_NewArenaValue() returns JSValue slots which are released all
+   together by JS_ResetValueArena() or JS_FreeContext(). */
+void JS_EnableValueArena(JSContext *ctx, BOOL enable)
+{
+    if (!enable) {
+        JS_ResetValueArena(ctx);
+        js_free_value_arena_blocks(ctx->rt, ctx->value_arena);
+        ctx->value_arena = NULL;
+        js_free_value_arena_blocks(ctx->rt, ctx->value_arena_spare);
+        ctx->value_arena_spare = NULL;
+    }
+    ctx->value_arena_enabled = enable;
+}
+
+BOOL JS_IsValueArenaEnabled(JSContext *ctx)
+{
+    return ctx->value_arena_enabled;
+}
+
+/* Store 'v' in a new slot of the value arena. The ownership of 'v' is
+   transferred to the slot. Return NULL if the arena is disabled or in
+   case of memory error ('v' is then freed). */
+JSValue *JS_NewArenaValue(JSContext *ctx, JSValue v)
+{
+    JSValueArenaBlock *b;
+    uint32_t size;
+
+    b = ctx->value_arena;
+    if (unlikely(!b || b->count >= b->size)) {
+        if (!ctx->value_arena_enabled && ctx->value_scope_count == 0) {
+            JS_FreeValue(ctx, v);
+            return NULL;
+        }
+        if (ctx->value_arena_spare) {
+            b = ctx->value_arena_spare;
+            ctx->value_arena_spare = b->next;
+        } else {
+            /* the block size grows geometrically so that
+               JS_IsArenaValue() only has a few blocks to scan */
+            size = b ? b->size * 2 : JS_VALUE_ARENA_MIN_SLOTS;
+            b = js_malloc(ctx, sizeof(*b) + sizeof(b->slots[0]) * size);
+            if (!b) {
+                JS_FreeValue(ctx, v);
+                return NULL;
+            }
+            b->size = size;
+        }
+        b->next = ctx->value_arena;
+        b->count = 0;
+        ctx->value_arena = b;
+    }
+    b->slots[b->count] = v;
+    return &b->slots[b->count++];
+}
+
+static BOOL js_value_arena_has_slot(JSValueArenaBlock *b, const JSValue *pv)
+{
+    for(; b != NULL; b = b->next) {
+        if (pv >= b->slots && pv < b->slots + b->size)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/* Return TRUE if 'pv' is a slot of the value arena, including the
+   slots released by JS_CloseValueScope() */
+BOOL JS_IsArenaValue(JSContext *ctx, const JSValue *pv)
+{
+    return js_value_arena_has_slot(ctx->value_arena, pv) ||
+        js_value_arena_has_slot(ctx->value_arena_spare, pv);
+}
+
+/* same as JS_IsArenaValue() for all the contexts of 'rt' */
+BOOL JS_IsArenaValueRT(JSRuntime *rt, const JSValue *pv)
+{
+    struct list_head *el;
+    JSContext *ctx;
+
+    list_for_each(el, &rt->context_list) {
+        ctx = list_entry(el, JSContext, link);
+        if (JS_IsArenaValue(ctx, pv))
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/* Free the value stored in an arena slot. The slot itself is only
+   reused if it is the last allocated one. */
+void JS_FreeArenaValue(JSContext *ctx, JSValue *pv)
+{
+    JSValueArenaBlock *b;
+    JSValue v;
+
+    v = *pv;
+    *pv = JS_UNDEFINED;
+    b = ctx->value_arena;
+    if (b && b->count != 0 && pv == &b->slots[b->count - 1]) {
+        /* the slots below the mark of the innermost scope are not
+           reused because closing the scope would not release them */
+        if (ctx->value_scope_count == 0 ||
+            ctx->value_scopes[ctx->value_scope_count - 1].block != b ||
+            ctx->value_scopes[ctx->value_scope_count - 1].count < b->count)
+            b->count--;
+    }
+    JS_FreeValue(ctx, v);
+}
+
+/* Free all the values of the arena and close all the value scopes. Only
+   the largest block is kept so that a context reused for many requests
+   does not call malloc() again. */
+void JS_ResetValueArena(JSContext *ctx)
+{
+    JSValueArenaBlock *b;
+    JSValue v;
+    uint32_t i;
+
+    ctx->value_scope_count = 0;
+
+    for(b = ctx->value_arena; b != NULL; b = b->next) {
+        for(i = 0; i < b->count; i++) {
+            v = b->slots[i];
+            b->slots[i] = JS_UNDEFINED;
+            JS_FreeValue(ctx, v);
+        }
+    }
+    b = ctx->value_arena;
+    if (b) {
+        js_free_value_arena_blocks(ctx->rt, b->next);
+        b->next = NULL;
+        b->count = 0;
+    }
+}
+
+/* Open a value scope. Until it is closed, JS_NewArenaValue() succeeds
+   even if the value arena is disabled. Return the level of the new
+   scope (>= 1) or -1 if there is no memory. */
+int JS_OpenValueScope(JSContext *ctx)
+{
+    JSValueArenaMark *m;
+    JSValueArenaBlock *b;
+
+    if (js_resize_array(ctx, (void **)&ctx->value_scopes,
+                        sizeof(ctx->value_scopes[0]),
+                        &ctx->value_scope_size, ctx->value_scope_count + 1))
+        return -1;
+    b = ctx->value_arena;
+    m = &ctx->value_scopes[ctx->value_scope_count++];
+    m->block = b;
+    m->count = b ? b->count : 0;
+    return ctx->value_scope_count;
+}
+
+/* Close the scope of level 'level' and the scopes opened after it. The
+   values allocated in the arena since the scope was opened are freed. */
+void JS_CloseValueScope(JSContext *ctx, int level)
+{
+    JSValueArenaMark *m;
+    JSValueArenaBlock *b;
+    JSValue v;
+    uint32_t count;
+
+    if (level < 1 || level > ctx->value_scope_count)
+        return;
+    m = &ctx->value_scopes[level - 1];
+    ctx->value_scope_count = level - 1;
+    for(;;) {
+        b = ctx->value_arena;
+        count = (b == m->block) ? m->count : 0;
+        while (b && b->count > count) {
+            /* JS_FreeArenaValue() is a no-op on the released slots */
+            v = b->slots[--b->count];
+            b->slots[b->count] = JS_UNDEFINED;
+            JS_FreeValue(ctx, v);
+        }
+        if (b == m->block)
+            break;
+        ctx->value_arena = b->next;
+        b->next = ctx->value_arena_spare;
+        ctx->value_arena_spare = b;
+    }
+}
+
+int JS_GetValueScopeLevel(JSContext *ctx)
+{
+    return ctx->value_scope_count;
+}
+
 JSContext *JS_DupContext(JSContext *ctx)
 {
     ctx->header.ref_count++;
@@ -2293,6 +2832,7 @@ void JS_FreeContext(JSContext *ctx)
         JSGCObjectHeader *p;
         printf("JSObjects: {\n");
         JS_DumpObjectHeader(ctx->rt);
+        gc_promote_young(rt);
         list_for_each(el, &rt->gc_obj_list) {
             p = list_entry(el, JSGCObjectHeader, link);
             JS_DumpGCObject(rt, p);
@@ -2310,6 +2850,11 @@ void JS_FreeContext(JSContext *ctx)
 
     js_free_modules(ctx, JS_FREE_MODULE_ALL);
 
+    JS_ResetValueArena(ctx);
+    js_free_value_arena_blocks(rt, ctx->value_arena);
+    js_free_value_arena_blocks(rt, ctx->value_arena_spare);
+    js_free_rt(rt, ctx->value_scopes);
+
     JS_FreeValue(ctx, ctx->global_obj);
     JS_FreeValue(ctx, ctx->global_var_obj);
 
@@ -3458,12 +4003,16 @@ int JS_NewClass(JSRuntime *rt, JSClassID class_id, const JSClassDef *class_def)
     return ret;
 }
 
+static JSValue js_new_string_char(JSContext *ctx, uint16_t c);
+
 static JSValue js_new_string8(JSContext *ctx, const uint8_t *buf, int len)
 {
     JSString *str;
 
     if (len <= 0) {
         return JS_AtomToString(ctx, JS_ATOM_empty_string);
+    } else if (len == 1) {
+        return js_new_string_char(ctx, buf[0]);
     }
     str = js_alloc_string(ctx, len, 0);
     if (!str)
@@ -3483,11 +4032,22 @@ static JSValue js_new_string16(JSContext *ctx, const uint16_t *buf, int len)
     return JS_MKPTR(JS_TAG_STRING, str);
 }
 
+/* the Latin-1 one character strings are shared to avoid allocating
+   them each time a string is indexed or split */
 static JSValue js_new_string_char(JSContext *ctx, uint16_t c)
 {
     if (c < 0x100) {
-        uint8_t ch8 = c;
-        return js_new_string8(ctx, &ch8, 1);
+        JSRuntime *rt = ctx->rt;
+        JSString *str = rt->char_strings[c];
+        if (unlikely(!str)) {
+            str = js_alloc_string(ctx, 1, 0);
+            if (!str)
+                return JS_EXCEPTION;
+            str->u.str8[0] = c;
+            str->u.str8[1] = '\0';
+            rt->char_strings[c] = str;
+        }
+        return JS_DupValue(ctx, JS_MKPTR(JS_TAG_STRING, str));
     } else {
         uint16_t ch16 = c;
         return js_new_string16(ctx, &ch16, 1);
@@ -3500,6 +4060,10 @@ static JSValue js_sub_string(JSContext *ctx, JSString *p, int start, int end)
     if (start == 0 && end == p->len) {
         return JS_DupValue(ctx, JS_MKPTR(JS_TAG_STRING, p));
     }
+    if (len == 1) {
+        return js_new_string_char(ctx, p->is_wide_char ? p->u.str16[start] :
+                                  p->u.str8[start]);
+    }
     if (p->is_wide_char && len > 0) {
         JSString *str;
         int i;
@@ -3523,6 +4087,156 @@ static JSValue js_sub_string(JSContext *ctx, JSString *p, int start, int end)
     }
 }
 
+/* String ropes */
+
+#define JS_STRING_ROPE_SHORT_LEN 256 /* shorter results are always flat */
+#define JS_STRING_ROPE_LEAF_LEN  512 /* max length of the merged leaves */
+#define JS_STRING_ROPE_MAX_DEPTH 48
+
+typedef struct JSStringRopeIter {
+    int sp;
+    JSValueConst stack[JS_STRING_ROPE_MAX_DEPTH + 2];
+} JSStringRopeIter;
+
+/* 'val' must be a string or a string rope */
+static inline uint32_t js_string_value_len(JSValueConst val)
+{
+    if (JS_VALUE_GET_TAG(val) == JS_TAG_STRING)
+        return JS_VALUE_GET_STRING(val)->len;
+    else
+        return JS_VALUE_GET_STRING_ROPE(val)->len;
+}
+
+static void string_rope_iter_init(JSStringRopeIter *s, JSValueConst val)
+{
+    s->sp = 0;
+    s->stack[s->sp++] = val;
+}
+
+/* return the next flat string of the rope or NULL at the end */
+static JSString *string_rope_iter_next(JSStringRopeIter *s)
+{
+    JSValueConst val;
+    JSStringRope *r;
+
+    if (s->sp == 0)
+        return NULL;
+    val = s->stack[--s->sp];
+    while (JS_VALUE_GET_TAG(val) == JS_TAG_STRING_ROPE) {
+        r = JS_VALUE_GET_STRING_ROPE(val);
+        if (r->depth != 0) {
+            assert(s->sp < countof(s->stack));
+            s->stack[s->sp++] = r->right;
+        }
+        val = r->left;
+    }
+    return JS_VALUE_GET_STRING(val);
+}
+
+/* Linearize the rope 'val' in place. Return its content as a string
+   whose reference is held by the rope, or NULL if exception. */
+static JSString *js_string_rope_linearize(JSContext *ctx, JSValueConst val)
+{
+    JSStringRope *r = JS_VALUE_GET_STRING_ROPE(val);
+    JSStringRopeIter it;
+    JSString *str, *p;
+    uint32_t pos;
+    int i;
+
+    if (r->depth == 0)
+        return JS_VALUE_GET_STRING(r->left);
+    str = js_alloc_string(ctx, r->len, r->is_wide_char);
+    if (!str)
+        return NULL;
+    pos = 0;
+    string_rope_iter_init(&it, val);
+    while ((p = string_rope_iter_next(&it)) != NULL) {
+        if (!str->is_wide_char) {
+            memcpy(str->u.str8 + pos, p->u.str8, p->len);
+        } else if (p->is_wide_char) {
+            memcpy(str->u.str16 + pos, p->u.str16, p->len * 2);
+        } else {
+            for(i = 0; i < p->len; i++)
+                str->u.str16[pos + i] = p->u.str8[i];
+        }
+        pos += p->len;
+    }
+    if (!str->is_wide_char)
+        str->u.str8[pos] = '\0';
+    JS_FreeValue(ctx, r->left);
+    JS_FreeValue(ctx, r->right);
+    r->left = JS_MKPTR(JS_TAG_STRING, str);
+    r->right = JS_UNDEFINED;
+    r->depth = 0;
+    return str;
+}
+
+/* 'val' must be a string or a string rope. Return NULL if exception. */
+static JSString *js_get_flat_string(JSContext *ctx, JSValueConst val)
+{
+    if (JS_VALUE_GET_TAG(val) == JS_TAG_STRING)
+        return JS_VALUE_GET_STRING(val);
+    else
+        return js_string_rope_linearize(ctx, val);
+}
+
+static uint32_t hash_string_rope(JSValueConst val, uint32_t h)
+{
+    JSStringRopeIter it;
+    JSString *p;
+
+    string_rope_iter_init(&it, val);
+    while ((p = string_rope_iter_next(&it)) != NULL)
+        h = hash_string(p, h);
+    return h;
+}
+
+/* 'val' is freed. Return the flat string of a linearized rope. */
+static inline JSValue js_string_rope_unwrap(JSContext *ctx, JSValue val)
+{
+    JSValue ret;
+    if (JS_VALUE_GET_TAG(val) == JS_TAG_STRING_ROPE &&
+        JS_VALUE_GET_STRING_ROPE(val)->depth == 0) {
+        ret = JS_DupValue(ctx, JS_VALUE_GET_STRING_ROPE(val)->left);
+        JS_FreeValue(ctx, val);
+        return ret;
+    }
+    return val;
+}
+
+static inline BOOL tag_is_string(uint32_t tag)
+{
+    return (tag == JS_TAG_STRING || tag == JS_TAG_STRING_ROPE);
+}
+
+/* Replace the ropes in 'op1' and 'op2' by flat strings. Both values
+   are freed in case of exception. */
+static int js_flatten_string_ropes(JSContext *ctx, JSValue *pop1,
+                                   JSValue *pop2)
+{
+    JSValue val;
+
+    if (unlikely(JS_VALUE_GET_TAG(*pop1) == JS_TAG_STRING_ROPE)) {
+        val = JS_ToString(ctx, *pop1);
+        JS_FreeValue(ctx, *pop1);
+        *pop1 = val;
+        if (JS_IsException(val))
+            goto fail;
+    }
+    if (unlikely(JS_VALUE_GET_TAG(*pop2) == JS_TAG_STRING_ROPE)) {
+        val = JS_ToString(ctx, *pop2);
+        JS_FreeValue(ctx, *pop2);
+        *pop2 = val;
+        if (JS_IsException(val))
+            goto fail;
+    }
+    return 0;
+ fail:
+    JS_FreeValue(ctx, *pop1);
+    JS_FreeValue(ctx, *pop2);
+    return -1;
+}
+
 typedef struct StringBuffer {
     JSContext *ctx;
     JSString *str;
@@ -3783,6 +4497,16 @@ static int string_buffer_concat_value(StringBuffer *s, JSValueConst v)
         /* prevent exception overload */
         return -1;
     }
+    if (JS_VALUE_GET_TAG(v) == JS_TAG_STRING_ROPE) {
+        /* no need to linearize the rope */
+        JSStringRopeIter it;
+        string_rope_iter_init(&it, v);
+        while ((p = string_rope_iter_next(&it)) != NULL) {
+            if (string_buffer_concat(s, p, 0, p->len))
+                return -1;
+        }
+        return 0;
+    }
     if (unlikely(JS_VALUE_GET_TAG(v) != JS_TAG_STRING)) {
         v1 = JS_ToString(s->ctx, v);
         if (JS_IsException(v1))
@@ -3842,6 +4566,12 @@ static JSValue string_buffer_end(StringBuffer *s)
         s->str = NULL;
         return JS_AtomToString(s->ctx, JS_ATOM_empty_string);
     }
+    if (s->len == 1 && !s->is_wide_char) {
+        uint8_t c = str->u.str8[0];
+        js_free(s->ctx, str);
+        s->str = NULL;
+        return js_new_string_char(s->ctx, c);
+    }
     if (s->len < s->size) {
         /* smaller size so js_realloc should not fail, but OK if it does */
         /* XXX: should add some slack to avoid unnecessary calls */
@@ -4080,6 +4810,75 @@ void JS_FreeCString(JSContext *ctx, const char *ptr)
     JS_FreeValue(ctx, JS_MKPTR(JS_TAG_STRING, p));
 }
 
+/* Create a string from UTF-16 code units. It is stored with 8 bit
+   characters if they are all Latin-1. */
+JSValue JS_NewString16(JSContext *ctx, const uint16_t *buf, size_t len)
+{
+    JSString *str;
+    size_t i;
+
+    if (len > JS_STRING_LEN_MAX)
+        return JS_ThrowInternalError(ctx, "string too long");
+    for(i = 0; i < len; i++) {
+        if (buf[i] >= 0x100)
+            return js_new_string16(ctx, buf, len);
+    }
+    str = js_alloc_string(ctx, len, 0);
+    if (!str)
+        return JS_EXCEPTION;
+    for(i = 0; i < len; i++)
+        str->u.str8[i] = buf[i];
+    str->u.str8[len] = '\0';
+    return JS_MKPTR(JS_TAG_STRING, str);
+}
+
+/* Create a string of 'len' characters whose contents must be written in
+   '*pbuf' by the caller before the string is used. */
+JSValue JS_NewStringBuffer(JSContext *ctx, size_t len, BOOL is_wide_char,
+                           void **pbuf)
+{
+    JSString *str;
+
+    if (len > JS_STRING_LEN_MAX)
+        return JS_ThrowInternalError(ctx, "string too long");
+    /* an empty wide string is the description of Symbol() */
+    if (len == 0)
+        is_wide_char = FALSE;
+    str = js_alloc_string(ctx, len, is_wide_char);
+    if (!str)
+        return JS_EXCEPTION;
+    if (is_wide_char) {
+        *pbuf = str->u.str16;
+    } else {
+        str->u.str8[len] = '\0';
+        *pbuf = str->u.str8;
+    }
+    return JS_MKPTR(JS_TAG_STRING, str);
+}
+
+/* Return the characters of the string 'val' without copying them: 8 bit
+   Latin-1 characters if '*pis_wide_char' is FALSE, UTF-16 code units
+   otherwise. The pointer stays valid as long as 'val' is alive. A rope
+   is linearized in place. Return NULL if 'val' is not a string or in
+   case of exception. */
+const void *JS_GetStringBuffer(JSContext *ctx, JSValueConst val,
+                               size_t *plen, BOOL *pis_wide_char)
+{
+    JSString *p;
+
+    if (!tag_is_string(JS_VALUE_GET_TAG(val)))
+        return NULL;
+    p = js_get_flat_string(ctx, val);
+    if (!p)
+        return NULL;
+    *plen = p->len;
+    *pis_wide_char = p->is_wide_char;
+    if (p->is_wide_char)
+        return p->u.str16;
+    else
+        return p->u.str8;
+}
+
 static int memcmp16_8(const uint16_t *src1, const uint8_t *src2, int len)
 {
     int c, i;
@@ -4176,53 +4975,374 @@ static JSValue JS_ConcatString1(JSContext *ctx,
     return JS_MKPTR(JS_TAG_STRING, p);
 }
 
+/* Concatenate in place in available space at the end of p1. Return
+   FALSE if there is not enough space. */
+static BOOL js_string_append_in_place(JSContext *ctx, JSString *p1,
+                                      const JSString *p2)
+{
+    if (p1->header.ref_count == 1 && p1->is_wide_char == p2->is_wide_char
+    &&  js_malloc_usable_size(ctx, p1) >= sizeof(*p1) + ((p1->len + p2->len) << p2->is_wide_char) + 1 - p1->is_wide_char) {
+        if (p1->is_wide_char) {
+            memcpy(p1->u.str16 + p1->len, p2->u.str16, p2->len << 1);
+            p1->len += p2->len;
+        } else {
+            memcpy(p1->u.str8 + p1->len, p2->u.str8, p2->len);
+            p1->len += p2->len;
+            p1->u.str8[p1->len] = '\0';
+        }
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/* return TRUE if the strings or ropes 'op1' and 'op2' are equal */
+static BOOL js_string_rope_equal(JSValueConst op1, JSValueConst op2)
+{
+    JSStringRopeIter it1, it2;
+    JSString *p1, *p2;
+    uint32_t pos1, pos2, len;
+    int res;
+
+    if (js_string_value_len(op1) != js_string_value_len(op2))
+        return FALSE;
+    string_rope_iter_init(&it1, op1);
+    string_rope_iter_init(&it2, op2);
+    p1 = p2 = NULL;
+    pos1 = pos2 = 0;
+    for(;;) {
+        while (!p1 || pos1 == p1->len) {
+            p1 = string_rope_iter_next(&it1);
+            if (!p1)
+                return TRUE; /* same length */
+            pos1 = 0;
+        }
+        while (!p2 || pos2 == p2->len) {
+            p2 = string_rope_iter_next(&it2);
+            pos2 = 0;
+        }
+        len = min_uint32(p1->len - pos1, p2->len - pos2);
+        if (!p1->is_wide_char) {
+            if (!p2->is_wide_char)
+                res = memcmp(p1->u.str8 + pos1, p2->u.str8 + pos2, len);
+            else
+                res = memcmp16_8(p2->u.str16 + pos2, p1->u.str8 + pos1, len);
+        } else {
+            if (!p2->is_wide_char)
+                res = memcmp16_8(p1->u.str16 + pos1, p2->u.str8 + pos2, len);
+            else
+                res = memcmp16(p1->u.str16 + pos1, p2->u.str16 + pos2, len);
+        }
+        if (res != 0)
+            return FALSE;
+        pos1 += len;
+        pos2 += len;
+    }
+}
+
+/* 'left' and 'right' are freed */
+static JSValue js_new_string_rope(JSContext *ctx, JSValue left, JSValue right)
+{
+    JSStringRope *r;
+    int depth1, depth2;
+
+    r = js_slab_malloc(ctx, sizeof(*r));
+    if (!r) {
+        JS_FreeValue(ctx, left);
+        JS_FreeValue(ctx, right);
+        return JS_EXCEPTION;
+    }
+    r->header.ref_count = 1;
+    r->len = js_string_value_len(left) + js_string_value_len(right);
+    depth1 = depth2 = 0;
+    if (JS_VALUE_GET_TAG(left) == JS_TAG_STRING_ROPE) {
+        depth1 = JS_VALUE_GET_STRING_ROPE(left)->depth;
+        r->is_wide_char = JS_VALUE_GET_STRING_ROPE(left)->is_wide_char;
+    } else {
+        r->is_wide_char = JS_VALUE_GET_STRING(left)->is_wide_char;
+    }
+    if (JS_VALUE_GET_TAG(right) == JS_TAG_STRING_ROPE) {
+        depth2 = JS_VALUE_GET_STRING_ROPE(right)->depth;
+        r->is_wide_char |= JS_VALUE_GET_STRING_ROPE(right)->is_wide_char;
+    } else {
+        r->is_wide_char |= JS_VALUE_GET_STRING(right)->is_wide_char;
+    }
+    r->depth = max_int(depth1, depth2) + 1;
+    r->left = left;
+    r->right = right;
+    return JS_MKPTR(JS_TAG_STRING_ROPE, r);
+}
+
+static inline int js_string_rope_depth(JSValueConst val)
+{
+    if (JS_VALUE_GET_TAG(val) == JS_TAG_STRING_ROPE)
+        return JS_VALUE_GET_STRING_ROPE(val)->depth;
+    else
+        return 0;
+}
+
+/* Rope rebalancing (Boehm, Atkinson and Plass, "Ropes: an Alternative
+   to Strings"). forest[i] is empty (JS_UNDEFINED) or contains a rope
+   of length in [min_len[i], min_len[i + 1]). A rope of depth d is
+   balanced if its length is at least min_len[d]. */
+typedef struct JSStringRopeForest {
+    uint64_t min_len[JS_STRING_ROPE_MAX_DEPTH + 2];
+    JSValue forest[JS_STRING_ROPE_MAX_DEPTH + 1];
+} JSStringRopeForest;
+
+/* concatenation without merging. JS_UNDEFINED is the empty rope. 'a'
+   and 'b' are freed. */
+static JSValue js_string_rope_forest_concat(JSContext *ctx, JSValue a,
+                                            JSValue b)
+{
+    if (JS_IsException(a) || JS_IsException(b)) {
+        JS_FreeValue(ctx, a);
+        JS_FreeValue(ctx, b);
+        return JS_EXCEPTION;
+    }
+    if (JS_IsUndefined(a))
+        return b;
+    if (JS_IsUndefined(b))
+        return a;
+    return js_new_string_rope(ctx, a, b);
+}
+
+/* 'val' is freed */
+static int js_string_rope_add_leaf(JSContext *ctx, JSStringRopeForest *f,
+                                   JSValue val)
+{
+    JSValue too_tiny, insertee;
+    uint32_t len;
+    int i;
+
+    len = js_string_value_len(val);
+    too_tiny = JS_UNDEFINED;
+    for(i = 0; len >= f->min_len[i + 1]; i++) {
+        too_tiny = js_string_rope_forest_concat(ctx, f->forest[i], too_tiny);
+        f->forest[i] = JS_UNDEFINED;
+    }
+    insertee = js_string_rope_forest_concat(ctx, too_tiny, val);
+    for(;;) {
+        insertee = js_string_rope_forest_concat(ctx, f->forest[i], insertee);
+        f->forest[i] = JS_UNDEFINED;
+        if (JS_IsException(insertee))
+            return -1;
+        if (i == JS_STRING_ROPE_MAX_DEPTH ||
+            js_string_value_len(insertee) < f->min_len[i + 1]) {
+            f->forest[i] = insertee;
+            return 0;
+        }
+        i++;
+    }
+}
+
+static int js_string_rope_add_to_forest(JSContext *ctx,
+                                        JSStringRopeForest *f,
+                                        JSValueConst val)
+{
+    JSStringRope *r;
+    int depth;
+
+    depth = js_string_rope_depth(val);
+    if (depth <= JS_STRING_ROPE_MAX_DEPTH &&
+        js_string_value_len(val) >= f->min_len[depth]) {
+        return js_string_rope_add_leaf(ctx, f, JS_DupValue(ctx, val));
+    }
+    r = JS_VALUE_GET_STRING_ROPE(val);
+    if (js_string_rope_add_to_forest(ctx, f, r->left))
+        return -1;
+    return js_string_rope_add_to_forest(ctx, f, r->right);
+}
+
+/* 'val' is freed */
+static JSValue js_string_rope_rebalance(JSContext *ctx, JSValue val)
+{
+    JSStringRopeForest f;
+    JSValue ret;
+    int i;
+
+    f.min_len[0] = 1;
+    f.min_len[1] = 2;
+    for(i = 2; i < countof(f.min_len); i++)
+        f.min_len[i] = f.min_len[i - 1] + f.min_len[i - 2];
+    for(i = 0; i < countof(f.forest); i++)
+        f.forest[i] = JS_UNDEFINED;
+    if (js_string_rope_add_to_forest(ctx, &f, val)) {
+        ret = JS_EXCEPTION;
+    } else {
+        ret = JS_UNDEFINED;
+        for(i = 0; i < countof(f.forest); i++) {
+            ret = js_string_rope_forest_concat(ctx, f.forest[i], ret);
+            f.forest[i] = JS_UNDEFINED;
+        }
+    }
+    for(i = 0; i < countof(f.forest); i++)
+        JS_FreeValue(ctx, f.forest[i]);
+    JS_FreeValue(ctx, val);
+    if (!JS_IsException(ret) &&
+        js_string_rope_depth(ret) > JS_STRING_ROPE_MAX_DEPTH) {
+        /* should not happen: linearize as a fallback */
+        if (!js_string_rope_linearize(ctx, ret)) {
+            JS_FreeValue(ctx, ret);
+            return JS_EXCEPTION;
+        }
+    }
+    return ret;
+}
+
+/* concatenate two flat strings into a new leaf with room for further
+   in place concatenations */
+static JSValue js_string_rope_new_leaf(JSContext *ctx, const JSString *p1,
+                                       const JSString *p2)
+{
+    JSString *p;
+    uint32_t len;
+    int is_wide_char;
+
+    len = p1->len + p2->len;
+    is_wide_char = p1->is_wide_char | p2->is_wide_char;
+    p = js_alloc_string(ctx, max_int(len, JS_STRING_ROPE_LEAF_LEN),
+                        is_wide_char);
+    if (!p)
+        return JS_EXCEPTION;
+    p->len = len;
+    if (!is_wide_char) {
+        memcpy(p->u.str8, p1->u.str8, p1->len);
+        memcpy(p->u.str8 + p1->len, p2->u.str8, p2->len);
+        p->u.str8[len] = '\0';
+    } else {
+        copy_str16(p->u.str16, p1, 0, p1->len);
+        copy_str16(p->u.str16 + p1->len, p2, 0, p2->len);
+    }
+    return JS_MKPTR(JS_TAG_STRING, p);
+}
+
+/* op1 and op2 are strings or ropes and are freed. The result has at
+   least JS_STRING_ROPE_SHORT_LEN characters. */
+static JSValue js_concat_string_rope(JSContext *ctx, JSValue op1, JSValue op2)
+{
+    JSStringRope *r;
+    JSValue leaf, ret;
+    JSString *p1, *p2;
+
+    if (JS_VALUE_GET_TAG(op1) == JS_TAG_STRING_ROPE &&
+        JS_VALUE_GET_TAG(op2) == JS_TAG_STRING) {
+        /* append to the last leaf if it is short */
+        r = JS_VALUE_GET_STRING_ROPE(op1);
+        p2 = JS_VALUE_GET_STRING(op2);
+        if (r->depth != 0 && JS_VALUE_GET_TAG(r->right) == JS_TAG_STRING) {
+            p1 = JS_VALUE_GET_STRING(r->right);
+            if (p1->len + p2->len <= JS_STRING_ROPE_LEAF_LEN) {
+                if (r->header.ref_count == 1) {
+                    /* the rope can be modified in place */
+                    if (!js_string_append_in_place(ctx, p1, p2)) {
+                        leaf = js_string_rope_new_leaf(ctx, p1, p2);
+                        if (JS_IsException(leaf)) {
+                            JS_FreeValue(ctx, op1);
+                            JS_FreeValue(ctx, op2);
+                            return JS_EXCEPTION;
+                        }
+                        JS_FreeValue(ctx, r->right);
+                        r->right = leaf;
+                    }
+                    r->len += p2->len;
+                    r->is_wide_char |= p2->is_wide_char;
+                    JS_FreeValue(ctx, op2);
+                    return op1;
+                }
+                leaf = js_string_rope_new_leaf(ctx, p1, p2);
+                ret = JS_DupValue(ctx, r->left);
+                JS_FreeValue(ctx, op1);
+                JS_FreeValue(ctx, op2);
+                if (JS_IsException(leaf)) {
+                    JS_FreeValue(ctx, ret);
+                    return JS_EXCEPTION;
+                }
+                return js_new_string_rope(ctx, ret, leaf);
+            }
+        }
+    } else if (JS_VALUE_GET_TAG(op1) == JS_TAG_STRING &&
+               JS_VALUE_GET_TAG(op2) == JS_TAG_STRING_ROPE) {
+        /* prepend to the first leaf if it is short */
+        r = JS_VALUE_GET_STRING_ROPE(op2);
+        p1 = JS_VALUE_GET_STRING(op1);
+        if (r->depth != 0 && JS_VALUE_GET_TAG(r->left) == JS_TAG_STRING) {
+            p2 = JS_VALUE_GET_STRING(r->left);
+            if (p1->len + p2->len <= JS_STRING_ROPE_LEAF_LEN) {
+                leaf = JS_ConcatString1(ctx, p1, p2);
+                ret = JS_DupValue(ctx, r->right);
+                JS_FreeValue(ctx, op1);
+                JS_FreeValue(ctx, op2);
+                if (JS_IsException(leaf)) {
+                    JS_FreeValue(ctx, ret);
+                    return JS_EXCEPTION;
+                }
+                return js_new_string_rope(ctx, leaf, ret);
+            }
+        }
+    }
+    ret = js_new_string_rope(ctx, op1, op2);
+    if (js_string_rope_depth(ret) > JS_STRING_ROPE_MAX_DEPTH)
+        ret = js_string_rope_rebalance(ctx, ret);
+    return ret;
+}
+
 /* op1 and op2 are converted to strings. For convience, op1 or op2 =
-   JS_EXCEPTION are accepted and return JS_EXCEPTION.  */
+   JS_EXCEPTION are accepted and return JS_EXCEPTION. Long results are
+   represented as ropes. */
 static JSValue JS_ConcatString(JSContext *ctx, JSValue op1, JSValue op2)
 {
     JSValue ret;
     JSString *p1, *p2;
+    uint32_t len1, len2;
 
-    if (unlikely(JS_VALUE_GET_TAG(op1) != JS_TAG_STRING)) {
+    if (unlikely(!JS_IsString(op1))) {
         op1 = JS_ToStringFree(ctx, op1);
         if (JS_IsException(op1)) {
             JS_FreeValue(ctx, op2);
             return JS_EXCEPTION;
         }
     }
-    if (unlikely(JS_VALUE_GET_TAG(op2) != JS_TAG_STRING)) {
+    if (unlikely(!JS_IsString(op2))) {
         op2 = JS_ToStringFree(ctx, op2);
         if (JS_IsException(op2)) {
             JS_FreeValue(ctx, op1);
             return JS_EXCEPTION;
         }
     }
-    p1 = JS_VALUE_GET_STRING(op1);
-    p2 = JS_VALUE_GET_STRING(op2);
-
-    /* XXX: could also check if p1 is empty */
-    if (p2->len == 0) {
-        goto ret_op1;
+    len1 = js_string_value_len(op1);
+    len2 = js_string_value_len(op2);
+    if (len2 == 0) {
+        JS_FreeValue(ctx, op2);
+        return op1;
     }
-    if (p1->header.ref_count == 1 && p1->is_wide_char == p2->is_wide_char
-    &&  js_malloc_usable_size(ctx, p1) >= sizeof(*p1) + ((p1->len + p2->len) << p2->is_wide_char) + 1 - p1->is_wide_char) {
-        /* Concatenate in place in available space at the end of p1 */
-        if (p1->is_wide_char) {
-            memcpy(p1->u.str16 + p1->len, p2->u.str16, p2->len << 1);
-            p1->len += p2->len;
-        } else {
-            memcpy(p1->u.str8 + p1->len, p2->u.str8, p2->len);
-            p1->len += p2->len;
-            p1->u.str8[p1->len] = '\0';
+    if (len1 == 0) {
+        JS_FreeValue(ctx, op1);
+        return op2;
+    }
+    if (JS_VALUE_GET_TAG(op1) == JS_TAG_STRING &&
+        JS_VALUE_GET_TAG(op2) == JS_TAG_STRING) {
+        p1 = JS_VALUE_GET_STRING(op1);
+        p2 = JS_VALUE_GET_STRING(op2);
+        if (js_string_append_in_place(ctx, p1, p2)) {
+            JS_FreeValue(ctx, op2);
+            return op1;
+        }
+        if (len1 + len2 < JS_STRING_ROPE_SHORT_LEN) {
+            ret = JS_ConcatString1(ctx, p1, p2);
+            JS_FreeValue(ctx, op1);
+            JS_FreeValue(ctx, op2);
+            return ret;
         }
-    ret_op1:
+    }
+    if (len1 + len2 > JS_STRING_LEN_MAX) {
+        JS_FreeValue(ctx, op1);
         JS_FreeValue(ctx, op2);
-        return op1;
+        return JS_ThrowInternalError(ctx, "string too long");
     }
-    ret = JS_ConcatString1(ctx, p1, p2);
-    JS_FreeValue(ctx, op1);
-    JS_FreeValue(ctx, op2);
-    return ret;
+    /* linearized ropes are replaced by their flat string */
+    op1 = js_string_rope_unwrap(ctx, op1);
+    op2 = js_string_rope_unwrap(ctx, op2);
+    return js_concat_string_rope(ctx, op1, op2);
 }
 
 /* Shape support */
@@ -4334,6 +5454,32 @@ static void js_shape_hash_unlink(JSRuntime *rt, JSShape *sh)
     rt->shape_hash_count--;
 }
 
+/* must be called when the shape is created or modified in place so
+   that the inline caches referencing it are invalidated */
+static inline void js_shape_new_version(JSRuntime *rt, JSShape *sh)
+{
+    sh->version = ++rt->shape_version;
+}
+
+static void js_shape_transition_init(JSShape *sh)
+{
+    init_list_head(&sh->transition_list);
+    sh->transition_link.prev = NULL;
+    sh->transition_link.next = NULL;
+}
+
+/* remove 'sh' and its children from the shape transition tree */
+static void js_shape_transition_unlink(JSShape *sh)
+{
+    struct list_head *el, *el1;
+
+    if (sh->transition_link.next)
+        list_del(&sh->transition_link);
+    list_for_each_safe(el, el1, &sh->transition_list) {
+        list_del(el);
+    }
+}
+
 /* create a new empty shape with prototype 'proto' */
 static no_inline JSShape *js_new_shape2(JSContext *ctx, JSObject *proto,
                                         int hash_size, int prop_size)
@@ -4362,6 +5508,8 @@ static no_inline JSShape *js_new_shape2(JSContext *ctx, JSObject *proto,
     sh->prop_size = prop_size;
     sh->prop_count = 0;
     sh->deleted_prop_count = 0;
+    js_shape_new_version(rt, sh);
+    js_shape_transition_init(sh);
     
     /* insert in the hash table */
     sh->hash = shape_initial_hash(proto);
@@ -4398,6 +5546,8 @@ static JSShape *js_clone_shape(JSContext *ctx, JSShape *sh1)
     sh->header.ref_count = 1;
     add_gc_object(ctx->rt, &sh->header, JS_GC_OBJ_TYPE_SHAPE);
     sh->is_hashed = FALSE;
+    js_shape_new_version(ctx->rt, sh);
+    js_shape_transition_init(sh);
     if (sh->proto) {
         JS_DupValue(ctx, JS_MKPTR(JS_TAG_OBJECT, sh->proto));
     }
@@ -4419,8 +5569,10 @@ static void js_free_shape0(JSRuntime *rt, JSShape *sh)
     JSShapeProperty *pr;
 
     assert(sh->header.ref_count == 0);
-    if (sh->is_hashed)
+    if (sh->is_hashed) {
         js_shape_hash_unlink(rt, sh);
+        js_shape_transition_unlink(sh);
+    }
     if (sh->proto != NULL) {
         JS_FreeValueRT(rt, JS_MKPTR(JS_TAG_OBJECT, sh->proto));
     }
@@ -4457,6 +5609,8 @@ static no_inline int resize_properties(JSContext *ctx, JSShape **psh,
     intptr_t h;
 
     sh = *psh;
+    /* the shape is moved in memory */
+    js_shape_transition_unlink(sh);
     new_size = max_int(count, sh->prop_size * 3 / 2);
     /* Reallocate prop array first to avoid crash or size inconsistency
        in case of memory allocation failure */
@@ -4483,6 +5637,7 @@ static no_inline int resize_properties(JSContext *ctx, JSShape **psh,
         memcpy(sh, old_sh,
                sizeof(JSShape) + sizeof(sh->prop[0]) * old_sh->prop_count);
         list_add_tail(&sh->header.link, &ctx->rt->gc_obj_list);
+        js_shape_transition_init(sh);
         new_hash_mask = new_hash_size - 1;
         sh->prop_hash_mask = new_hash_mask;
         memset(prop_hash_end(sh) - new_hash_size, 0,
@@ -4507,6 +5662,7 @@ static no_inline int resize_properties(JSContext *ctx, JSShape **psh,
         }
         sh = get_shape_from_alloc(sh_alloc, new_hash_size);
         list_add_tail(&sh->header.link, &ctx->rt->gc_obj_list);
+        js_shape_transition_init(sh);
     }
     *psh = sh;
     sh->prop_size = new_size;
@@ -4544,6 +5700,7 @@ static int compact_properties(JSContext *ctx, JSObject *p)
     list_del(&old_sh->header.link);
     memcpy(sh, old_sh, sizeof(JSShape));
     list_add_tail(&sh->header.link, &ctx->rt->gc_obj_list);
+    js_shape_transition_init(sh);
     
     memset(prop_hash_end(sh) - new_hash_size, 0,
            sizeof(prop_hash_end(sh)[0]) * new_hash_size);
@@ -4570,6 +5727,7 @@ static int compact_properties(JSContext *ctx, JSObject *p)
     sh->prop_size = new_size;
     sh->deleted_prop_count = 0;
     sh->prop_count = j;
+    js_shape_new_version(ctx->rt, sh);
 
     p->shape = sh;
     js_free(ctx, get_alloc_from_shape(old_sh));
@@ -4593,6 +5751,7 @@ static int add_shape_property(JSContext *ctx, JSShape **psh,
     /* update the shape hash */
     if (sh->is_hashed) {
         js_shape_hash_unlink(rt, sh);
+        js_shape_transition_unlink(sh);
         new_shape_hash = shape_hash(shape_hash(sh->hash, atom), prop_flags);
     }
 
@@ -4617,6 +5776,7 @@ static int add_shape_property(JSContext *ctx, JSShape **psh,
     pr->atom = JS_DupAtom(ctx, atom);
     pr->flags = prop_flags;
     sh->has_small_array_index |= __JS_AtomIsTaggedInt(atom);
+    js_shape_new_version(rt, sh);
     /* add in hash table */
     hash_mask = sh->prop_hash_mask;
     h = atom & hash_mask;
@@ -4677,6 +5837,29 @@ static JSShape *find_hashed_shape_prop(JSRuntime *rt, JSShape *sh,
     return NULL;
 }
 
+/* find the child of the hashed shape 'sh' with the additional
+   property (atom, prop_flags). Return NULL if not found */
+static JSShape *find_shape_transition(JSRuntime *rt, JSShape *sh,
+                                      JSAtom atom, int prop_flags)
+{
+    struct list_head *el;
+    JSShapeProperty *pr;
+    JSShape *sh1;
+
+    list_for_each(el, &sh->transition_list) {
+        sh1 = list_entry(el, JSShape, transition_link);
+        pr = &sh1->prop[sh1->prop_count - 1];
+        if (pr->atom == atom && pr->flags == prop_flags)
+            return sh1;
+    }
+    /* the matching shape may have been built by modifying another
+       shape in place: add the missing transition */
+    sh1 = find_hashed_shape_prop(rt, sh, atom, prop_flags);
+    if (sh1 && !sh1->transition_link.next)
+        list_add_tail(&sh1->transition_link, &sh->transition_list);
+    return sh1;
+}
+
 static __maybe_unused void JS_DumpShape(JSRuntime *rt, int i, JSShape *sh)
 {
     char atom_buf[ATOM_GET_STR_BUF_SIZE];
@@ -4710,6 +5893,7 @@ static __maybe_unused void JS_DumpShapes(JSRuntime *rt)
         }
     }
     /* dump non-hashed shapes */
+    gc_promote_young(rt);
     list_for_each(el, &rt->gc_obj_list) {
         gp = list_entry(el, JSGCObjectHeader, link);
         if (gp->gc_obj_type == JS_GC_OBJ_TYPE_JS_OBJECT) {
@@ -4727,7 +5911,7 @@ static JSValue JS_NewObjectFromShape(JSContext *ctx, JSShape *sh, JSClassID clas
     JSObject *p;
 
     js_trigger_gc(ctx->rt, sizeof(JSObject));
-    p = js_malloc(ctx, sizeof(JSObject));
+    p = js_slab_malloc(ctx, sizeof(JSObject));
     if (unlikely(!p))
         goto fail;
     p->class_id = class_id;
@@ -4744,7 +5928,7 @@ static JSValue JS_NewObjectFromShape(JSContext *ctx, JSShape *sh, JSClassID clas
     p->shape = sh;
     p->prop = js_malloc(ctx, sizeof(JSProperty) * sh->prop_size);
     if (unlikely(!p->prop)) {
-        js_free(ctx, p);
+        js_slab_free_rt(ctx->rt, p, sizeof(JSObject));
     fail:
         js_free_shape(ctx->rt, sh);
         return JS_EXCEPTION;
@@ -4929,6 +6113,48 @@ JSValue JS_NewObject(JSContext *ctx)
     return JS_NewObjectProtoClass(ctx, ctx->class_proto[JS_CLASS_OBJECT], JS_CLASS_OBJECT);
 }
 
+/* Create an object sharing the shape of the template object 'tmpl'. Its
+   properties are set to the 'count' values of 'values' in definition
+   order or, if 'values' is NULL, to the values of 'tmpl'. 'tmpl' must be
+   a plain object with data properties only and no deleted property. */
+JSValue JS_NewObjectFromTemplate(JSContext *ctx, JSValueConst tmpl,
+                                 int count, JSValueConst *values)
+{
+    JSObject *p, *p1;
+    JSShape *sh;
+    JSShapeProperty *prs;
+    JSValue obj;
+    int i;
+
+    if (JS_VALUE_GET_TAG(tmpl) != JS_TAG_OBJECT)
+        goto fail;
+    p = JS_VALUE_GET_OBJ(tmpl);
+    sh = p->shape;
+    /* an unhashed shape cannot be shared because add_property()
+       modifies it in place */
+    if (p->class_id != JS_CLASS_OBJECT || !sh->is_hashed)
+        goto fail;
+    if (values && count != sh->prop_count)
+        goto fail;
+    for(i = 0, prs = get_shape_prop(sh); i < sh->prop_count; i++, prs++) {
+        if ((prs->flags & JS_PROP_TMASK) != JS_PROP_NORMAL)
+            goto fail;
+    }
+    obj = JS_NewObjectFromShape(ctx, js_dup_shape(sh), JS_CLASS_OBJECT);
+    if (JS_IsException(obj))
+        return obj;
+    p1 = JS_VALUE_GET_OBJ(obj);
+    for(i = 0; i < sh->prop_count; i++) {
+        if (values)
+            p1->prop[i].u.value = JS_DupValue(ctx, values[i]);
+        else
+            p1->prop[i].u.value = JS_DupValue(ctx, p->prop[i].u.value);
+    }
+    return obj;
+ fail:
+    return JS_ThrowTypeError(ctx, "invalid object template");
+}
+
 static void js_function_set_properties(JSContext *ctx, JSValueConst func_obj,
                                        JSAtom name, int len)
 {
@@ -5243,7 +6469,7 @@ static void free_var_ref(JSRuntime *rt, JSVarRef *var_ref)
             } else {
                 list_del(&var_ref->header.link); /* still on the stack */
             }
-            js_free_rt(rt, var_ref);
+            js_slab_free_rt(rt, var_ref, sizeof(JSVarRef));
         }
     }
 }
@@ -5437,7 +6663,7 @@ static void free_object(JSRuntime *rt, JSObject *p)
     if (rt->gc_phase == JS_GC_PHASE_REMOVE_CYCLES && p->header.ref_count != 0) {
         list_add_tail(&p->header.link, &rt->gc_zero_ref_count_list);
     } else {
-        js_free_rt(rt, p);
+        js_slab_free_rt(rt, p, sizeof(JSObject));
     }
 }
 
@@ -5503,6 +6729,14 @@ void __JS_FreeValueRT(JSRuntime *rt, JSValue v)
             }
         }
         break;
+    case JS_TAG_STRING_ROPE:
+        {
+            JSStringRope *r = JS_VALUE_GET_STRING_ROPE(v);
+            JS_FreeValueRT(rt, r->left);
+            JS_FreeValueRT(rt, r->right);
+            js_slab_free_rt(rt, r, sizeof(*r));
+        }
+        break;
     case JS_TAG_OBJECT:
     case JS_TAG_FUNCTION_BYTECODE:
         {
@@ -5513,6 +6747,11 @@ void __JS_FreeValueRT(JSRuntime *rt, JSValue v)
                 if (rt->gc_phase == JS_GC_PHASE_NONE) {
                     free_zero_refcount(rt);
                 }
+            } else if (p->mark == 0) {
+                /* object outside of the freed cycles (only happens
+                   after a minor GC): free it with them */
+                list_del(&p->link);
+                list_add_tail(&p->link, &rt->tmp_obj_list);
             }
         }
         break;
@@ -5560,7 +6799,22 @@ static void add_gc_object(JSRuntime *rt, JSGCObjectHeader *h,
 {
     h->mark = 0;
     h->gc_obj_type = type;
-    list_add_tail(&h->link, &rt->gc_obj_list);
+    list_add_tail(&h->link, &rt->gc_young_obj_list);
+    rt->minor_gc_count++;
+}
+
+/* move the young generation to the old one */
+static void gc_promote_young(JSRuntime *rt)
+{
+    struct list_head *el;
+    el = &rt->gc_young_obj_list;
+    if (!list_empty(el)) {
+        el->next->prev = rt->gc_obj_list.prev;
+        rt->gc_obj_list.prev->next = el->next;
+        el->prev->next = &rt->gc_obj_list;
+        rt->gc_obj_list.prev = el->prev;
+        init_list_head(el);
+    }
 }
 
 static void remove_gc_object(JSGCObjectHeader *h)
@@ -5639,6 +6893,8 @@ static void mark_children(JSRuntime *rt, JSGCObjectHeader *gp,
             }
             if (b->realm)
                 mark_func(rt, &b->realm->header);
+            if (b->parent && !b->parent->is_shared)
+                mark_func(rt, &b->parent->header);
         }
         break;
     case JS_GC_OBJ_TYPE_VAR_REF:
@@ -5789,14 +7045,117 @@ static void gc_free_cycles(JSRuntime *rt)
         p = list_entry(el, JSGCObjectHeader, link);
         assert(p->gc_obj_type == JS_GC_OBJ_TYPE_JS_OBJECT ||
                p->gc_obj_type == JS_GC_OBJ_TYPE_FUNCTION_BYTECODE);
-        js_free_rt(rt, p);
+        if (p->gc_obj_type == JS_GC_OBJ_TYPE_JS_OBJECT)
+            js_slab_free_rt(rt, p, sizeof(JSObject));
+        else
+            js_free_rt(rt, p);
     }
 
     init_list_head(&rt->gc_zero_ref_count_list);
 }
 
+/* Minor GC: trial deletion restricted to a subset of the GC
+   objects. The references coming from outside the subset are
+   considered as external roots, so only the cycles made exclusively of
+   objects of the subset are freed. */
+
+static void gc_decref_child_minor(JSRuntime *rt, JSGCObjectHeader *p)
+{
+    if (p->mark == 0)
+        return; /* not in the subset */
+    assert(p->ref_count > 0);
+    p->ref_count--;
+    if (p->ref_count == 0 && p->mark == 1) {
+        list_del(&p->link);
+        list_add_tail(&p->link, &rt->tmp_obj_list);
+    }
+}
+
+static void gc_scan_incref_child_minor(JSRuntime *rt, JSGCObjectHeader *p)
+{
+    if (p->mark == 0)
+        return;
+    p->ref_count++;
+    if (p->ref_count == 1) {
+        /* ref_count was 0: put it back in the subset */
+        list_del(&p->link);
+        list_add_tail(&p->link, rt->gc_minor_obj_list);
+    }
+}
+
+static void gc_scan_incref_child2_minor(JSRuntime *rt, JSGCObjectHeader *p)
+{
+    if (p->mark != 0)
+        p->ref_count++;
+}
+
+/* Examine at most 'budget' objects of the young generation, starting
+   with the oldest ones (0 = no limit). The examined objects which are
+   not freed are moved to the old generation. Return TRUE if some
+   young objects remain to be examined. */
+BOOL JS_RunGCStep(JSRuntime *rt, size_t budget)
+{
+    struct list_head obj_list, *el, *el1;
+    JSGCObjectHeader *p;
+    size_t n;
+
+    if (rt->gc_phase != JS_GC_PHASE_NONE)
+        return !list_empty(&rt->gc_young_obj_list);
+    /* select the subset */
+    init_list_head(&obj_list);
+    n = 0;
+    list_for_each_safe(el, el1, &rt->gc_young_obj_list) {
+        if (budget != 0 && n >= budget)
+            break;
+        p = list_entry(el, JSGCObjectHeader, link);
+        p->mark = 2;
+        list_del(&p->link);
+        list_add_tail(&p->link, &obj_list);
+        n++;
+    }
+    if (list_empty(&rt->gc_young_obj_list))
+        rt->minor_gc_count = 0;
+    rt->gc_minor_obj_list = &obj_list;
+
+    init_list_head(&rt->tmp_obj_list);
+    list_for_each_safe(el, el1, &obj_list) {
+        p = list_entry(el, JSGCObjectHeader, link);
+        mark_children(rt, p, gc_decref_child_minor);
+        p->mark = 1;
+        if (p->ref_count == 0) {
+            list_del(&p->link);
+            list_add_tail(&p->link, &rt->tmp_obj_list);
+        }
+    }
+
+    list_for_each(el, &obj_list) {
+        p = list_entry(el, JSGCObjectHeader, link);
+        assert(p->ref_count > 0);
+        mark_children(rt, p, gc_scan_incref_child_minor);
+    }
+    list_for_each(el, &rt->tmp_obj_list) {
+        p = list_entry(el, JSGCObjectHeader, link);
+        mark_children(rt, p, gc_scan_incref_child2_minor);
+    }
+
+    /* the surviving objects are moved to the old generation */
+    list_for_each_safe(el, el1, &obj_list) {
+        p = list_entry(el, JSGCObjectHeader, link);
+        p->mark = 0;
+        list_del(&p->link);
+        list_add_tail(&p->link, &rt->gc_obj_list);
+    }
+    rt->gc_minor_obj_list = NULL;
+
+    gc_free_cycles(rt);
+    return !list_empty(&rt->gc_young_obj_list);
+}
+
 void JS_RunGC(JSRuntime *rt)
 {
+    gc_promote_young(rt);
+    rt->minor_gc_count = 0;
+
     /* decrement the reference of the children of each object. mark =
        1 after this pass. */
     gc_decref(rt);
@@ -5850,6 +7209,17 @@ static void compute_bytecode_size(JSFunctionBytecode *b, JSMemoryUsage_helper *h
     int memory_used_count, js_func_size, i;
 
     memory_used_count = 0;
+    if (b->parent) {
+        /* the rest is counted with the parent */
+        js_func_size = sizeof(*b) + b->cpool_count * sizeof(*b->cpool);
+        for (i = 0; i < b->cpool_count; i++)
+            compute_value_size(b->cpool[i], hp);
+        if (b->ic)
+            js_func_size += b->ic_count * sizeof(*b->ic);
+        hp->js_func_size += js_func_size;
+        hp->js_func_count += 1;
+        return;
+    }
     js_func_size = offsetof(JSFunctionBytecode, debug);
     if (b->vardefs) {
         js_func_size += (b->arg_count + b->var_count) * sizeof(*b->vardefs);
@@ -5867,13 +7237,17 @@ static void compute_bytecode_size(JSFunctionBytecode *b, JSMemoryUsage_helper *h
     if (!b->read_only_bytecode && b->byte_code_buf) {
         hp->js_func_code_size += b->byte_code_len;
     }
+    if (b->ic) {
+        memory_used_count++;
+        js_func_size += b->ic_count * sizeof(*b->ic);
+    }
     if (b->has_debug) {
         js_func_size += sizeof(*b) - offsetof(JSFunctionBytecode, debug);
         if (b->debug.source) {
             memory_used_count++;
             js_func_size += b->debug.source_len + 1;
         }
-        if (b->debug.pc2line_len) {
+        if (b->debug.pc2line_len && !b->read_only_bytecode) {
             memory_used_count++;
             hp->js_func_pc2line_count += 1;
             hp->js_func_pc2line_size += b->debug.pc2line_len;
@@ -5890,6 +7264,15 @@ static void compute_value_size(JSValueConst val, JSMemoryUsage_helper *hp)
     case JS_TAG_STRING:
         compute_jsstring_size(JS_VALUE_GET_STRING(val), hp);
         break;
+    case JS_TAG_STRING_ROPE:
+        {
+            JSStringRope *r = JS_VALUE_GET_STRING_ROPE(val);
+            hp->memory_used_count += 1.0 / r->header.ref_count;
+            hp->str_size += (double)sizeof(*r) / r->header.ref_count;
+            compute_value_size(r->left, hp);
+            compute_value_size(r->right, hp);
+        }
+        break;
 #ifdef CONFIG_BIGNUM
     case JS_TAG_BIG_INT:
     case JS_TAG_BIG_FLOAT:
@@ -5910,6 +7293,9 @@ void JS_ComputeMemoryUsage(JSRuntime *rt, JSMemoryUsage *s)
     s->malloc_count = rt->malloc_state.malloc_count;
     s->malloc_size = rt->malloc_state.malloc_size;
     s->malloc_limit = rt->malloc_state.malloc_limit;
+    s->slab_count = rt->slab_chunk_count;
+    s->slab_size = rt->slab_chunk_count * JS_SLAB_CHUNK_SIZE;
+    s->slab_used_size = rt->slab_used_size;
 
     s->memory_used_count = 2; /* rt + rt->class_array */
     s->memory_used_size = sizeof(JSRuntime) + sizeof(JSValue) * rt->class_count;
@@ -5962,6 +7348,7 @@ void JS_ComputeMemoryUsage(JSRuntime *rt, JSMemoryUsage *s)
         }
     }
 
+    gc_promote_young(rt);
     list_for_each(el, &rt->gc_obj_list) {
         JSGCObjectHeader *gp = list_entry(el, JSGCObjectHeader, link);
         JSObject *p;
@@ -6231,6 +7618,7 @@ void JS_DumpMemoryUsage(FILE *fp, const JSMemoryUsage *s, JSRuntime *rt)
             int obj_classes[JS_CLASS_INIT_COUNT + 1] = { 0 };
             int class_id;
             struct list_head *el;
+            gc_promote_young(rt);
             list_for_each(el, &rt->gc_obj_list) {
                 JSGCObjectHeader *gp = list_entry(el, JSGCObjectHeader, link);
                 JSObject *p;
@@ -6246,7 +7634,7 @@ void JS_DumpMemoryUsage(FILE *fp, const JSMemoryUsage *s, JSRuntime *rt)
                 if (obj_classes[class_id]) {
                     char buf[ATOM_GET_STR_BUF_SIZE];
                     fprintf(fp, "  %5d  %2.0d %s\n", obj_classes[class_id], class_id,
-                            JS_AtomGetStrRT(rt, buf, sizeof(buf), js_std_class_def[class_id - 1].class_name));
+                            JS_AtomGetStrRT(rt, buf, sizeof(buf), rt->class_array[class_id].class_name));
                 }
             }
             if (obj_classes[JS_CLASS_INIT_COUNT])
@@ -6317,6 +7705,11 @@ void JS_DumpMemoryUsage(FILE *fp, const JSMemoryUsage *s, JSRuntime *rt)
         fprintf(fp, "%-20s %8"PRId64" %8"PRId64"\n",
                 "binary objects", s->binary_object_count, s->binary_object_size);
     }
+    if (s->slab_count) {
+        fprintf(fp, "%-20s %8"PRId64" %8"PRId64"  (%"PRId64" used)\n",
+                "slab chunks", s->slab_count, s->slab_size,
+                s->slab_used_size);
+    }
 }
 
 JSValue JS_GetGlobalObject(JSContext *ctx)
@@ -6460,7 +7853,7 @@ static const char *get_func_name(JSContext *ctx, JSValueConst func)
     if ((prs->flags & JS_PROP_TMASK) != JS_PROP_NORMAL)
         return NULL;
     val = pr->u.value;
-    if (JS_VALUE_GET_TAG(val) != JS_TAG_STRING)
+    if (!JS_IsString(val))
         return NULL;
     return JS_ToCString(ctx, val);
 }
@@ -6896,6 +8289,7 @@ static JSValueConst JS_GetPrototypePrimitive(JSContext *ctx, JSValueConst val)
         val = ctx->class_proto[JS_CLASS_BOOLEAN];
         break;
     case JS_TAG_STRING:
+    case JS_TAG_STRING_ROPE:
         val = ctx->class_proto[JS_CLASS_STRING];
         break;
     case JS_TAG_SYMBOL:
@@ -7109,6 +8503,28 @@ JSValue JS_GetPropertyInternal(JSContext *ctx, JSValueConst obj,
                 }
             }
             break;
+        case JS_TAG_STRING_ROPE:
+            {
+                JSStringRope *r = JS_VALUE_GET_STRING_ROPE(obj);
+                JSString *p1;
+                if (__JS_AtomIsTaggedInt(prop)) {
+                    uint32_t idx, ch;
+                    idx = __JS_AtomToUInt32(prop);
+                    if (idx < r->len) {
+                        p1 = js_string_rope_linearize(ctx, obj);
+                        if (!p1)
+                            return JS_EXCEPTION;
+                        if (p1->is_wide_char)
+                            ch = p1->u.str16[idx];
+                        else
+                            ch = p1->u.str8[idx];
+                        return js_new_string_char(ctx, ch);
+                    }
+                } else if (prop == JS_ATOM_length) {
+                    return JS_NewInt32(ctx, r->len);
+                }
+            }
+            break;
         default:
             break;
         }
@@ -7979,12 +9395,13 @@ JSValue JS_GetPropertyStr(JSContext *ctx, JSValueConst this_obj,
 static JSProperty *add_property(JSContext *ctx,
                                 JSObject *p, JSAtom prop, int prop_flags)
 {
-    JSShape *sh, *new_sh;
+    JSShape *sh, *new_sh, *parent_sh;
 
     sh = p->shape;
+    parent_sh = NULL;
     if (sh->is_hashed) {
         /* try to find an existing shape */
-        new_sh = find_hashed_shape_prop(ctx->rt, sh, prop, prop_flags);
+        new_sh = find_shape_transition(ctx->rt, sh, prop, prop_flags);
         if (new_sh) {
             /* matching shape found: use it */
             /*  the property array may need to be resized */
@@ -8007,6 +9424,8 @@ static JSProperty *add_property(JSContext *ctx,
             /* hash the cloned shape */
             new_sh->is_hashed = TRUE;
             js_shape_hash_link(ctx->rt, new_sh);
+            /* 'sh' is still referenced by other objects */
+            parent_sh = sh;
             js_free_shape(ctx->rt, p->shape);
             p->shape = new_sh;
         }
@@ -8014,6 +9433,10 @@ static JSProperty *add_property(JSContext *ctx,
     assert(p->shape->header.ref_count == 1);
     if (add_shape_property(ctx, &p->shape, p, prop, prop_flags))
         return NULL;
+    if (parent_sh) {
+        list_add_tail(&p->shape->transition_link,
+                      &parent_sh->transition_list);
+    }
     return &p->prop[p->shape->prop_count - 1];
 }
 
@@ -8991,9 +10414,12 @@ static int js_shape_prepare_update(JSContext *ctx, JSObject *p,
                 *pprs = get_shape_prop(sh) + idx;
         } else {
             js_shape_hash_unlink(ctx->rt, sh);
+            js_shape_transition_unlink(sh);
             sh->is_hashed = FALSE;
         }
     }
+    /* the caller modifies the shape in place */
+    js_shape_new_version(ctx->rt, sh);
     return 0;
 }
 
@@ -9937,6 +11363,10 @@ static int JS_ToBoolFree(JSContext *ctx, JSValue val)
             JS_FreeValue(ctx, val);
             return ret;
         }
+    case JS_TAG_STRING_ROPE:
+        /* ropes are never empty */
+        JS_FreeValue(ctx, val);
+        return TRUE;
 #ifdef CONFIG_BIGNUM
     case JS_TAG_BIG_INT:
     case JS_TAG_BIG_FLOAT:
@@ -10458,6 +11888,7 @@ static JSValue JS_ToNumberHintFree(JSContext *ctx, JSValue val,
             return JS_EXCEPTION;
         goto redo;
     case JS_TAG_STRING:
+    case JS_TAG_STRING_ROPE:
         {
             const char *str;
             const char *p;
@@ -11551,6 +12982,13 @@ JSValue JS_ToStringInternal(JSContext *ctx, JSValueConst val, BOOL is_ToProperty
     switch(tag) {
     case JS_TAG_STRING:
         return JS_DupValue(ctx, val);
+    case JS_TAG_STRING_ROPE:
+        {
+            JSString *p = js_string_rope_linearize(ctx, val);
+            if (!p)
+                return JS_EXCEPTION;
+            return JS_DupValue(ctx, JS_MKPTR(JS_TAG_STRING, p));
+        }
     case JS_TAG_INT:
         snprintf(buf, sizeof(buf), "%d", JS_VALUE_GET_INT(val));
         str = buf;
@@ -11919,6 +13357,9 @@ static __maybe_unused void JS_DumpValueShort(JSRuntime *rt,
             JS_DumpString(rt, p);
         }
         break;
+    case JS_TAG_STRING_ROPE:
+        printf("[rope len=%u]", JS_VALUE_GET_STRING_ROPE(val)->len);
+        break;
     case JS_TAG_FUNCTION_BYTECODE:
         {
             JSFunctionBytecode *b = JS_VALUE_GET_PTR(val);
@@ -12194,6 +13635,7 @@ static bf_t *JS_ToBigIntFree(JSContext *ctx, bf_t *buf, JSValue val)
         JS_FreeValue(ctx, val);
         break;
     case JS_TAG_STRING:
+    case JS_TAG_STRING_ROPE:
         val = JS_StringToBigIntErr(ctx, val);
         if (JS_IsException(val))
             return NULL;
@@ -13478,10 +14920,10 @@ static no_inline __exception int js_add_slow(JSContext *ctx, JSValue *sp)
         /* try to call an overloaded operator */
         if ((tag1 == JS_TAG_OBJECT &&
              (tag2 != JS_TAG_NULL && tag2 != JS_TAG_UNDEFINED &&
-              tag2 != JS_TAG_STRING)) ||
+              !tag_is_string(tag2))) ||
             (tag2 == JS_TAG_OBJECT &&
              (tag1 != JS_TAG_NULL && tag1 != JS_TAG_UNDEFINED &&
-              tag1 != JS_TAG_STRING))) {
+              !tag_is_string(tag1)))) {
             ret = js_call_binary_op_fallback(ctx, &res, op1, op2, OP_add,
                                              FALSE, HINT_NONE);
             if (ret != 0) {
@@ -13511,7 +14953,7 @@ static no_inline __exception int js_add_slow(JSContext *ctx, JSValue *sp)
         tag2 = JS_VALUE_GET_NORM_TAG(op2);
     }
 
-    if (tag1 == JS_TAG_STRING || tag2 == JS_TAG_STRING) {
+    if (tag_is_string(tag1) || tag_is_string(tag2)) {
         sp[-2] = JS_ConcatString(ctx, op1, op2);
         if (JS_IsException(sp[-2]))
             goto exception;
@@ -13794,6 +15236,8 @@ static no_inline int js_relational_slow(JSContext *ctx, JSValue *sp,
         JS_FreeValue(ctx, op1);
         goto exception;
     }
+    if (js_flatten_string_ropes(ctx, &op1, &op2))
+        goto exception;
     tag1 = JS_VALUE_GET_NORM_TAG(op1);
     tag2 = JS_VALUE_GET_NORM_TAG(op2);
 
@@ -13928,6 +15372,8 @@ static no_inline __exception int js_eq_slow(JSContext *ctx, JSValue *sp,
     op1 = sp[-2];
     op2 = sp[-1];
  redo:
+    if (js_flatten_string_ropes(ctx, &op1, &op2))
+        goto exception;
     tag1 = JS_VALUE_GET_NORM_TAG(op1);
     tag2 = JS_VALUE_GET_NORM_TAG(op2);
     if (tag_is_number(tag1) && tag_is_number(tag2)) {
@@ -14310,7 +15756,7 @@ static no_inline __exception int js_add_slow(JSContext *ctx, JSValue *sp)
         }
         tag1 = JS_VALUE_GET_TAG(op1);
         tag2 = JS_VALUE_GET_TAG(op2);
-        if (tag1 == JS_TAG_STRING || tag2 == JS_TAG_STRING) {
+        if (tag_is_string(tag1) || tag_is_string(tag2)) {
             sp[-2] = JS_ConcatString(ctx, op1, op2);
             if (JS_IsException(sp[-2]))
                 goto exception;
@@ -14405,6 +15851,8 @@ static no_inline int js_relational_slow(JSContext *ctx, JSValue *sp,
         JS_FreeValue(ctx, op1);
         goto exception;
     }
+    if (js_flatten_string_ropes(ctx, &op1, &op2))
+        goto exception;
     if (JS_VALUE_GET_TAG(op1) == JS_TAG_STRING &&
         JS_VALUE_GET_TAG(op2) == JS_TAG_STRING) {
         JSString *p1, *p2;
@@ -14470,6 +15918,8 @@ static no_inline __exception int js_eq_slow(JSContext *ctx, JSValue *sp,
     op1 = sp[-2];
     op2 = sp[-1];
  redo:
+    if (js_flatten_string_ropes(ctx, &op1, &op2))
+        goto exception;
     tag1 = JS_VALUE_GET_NORM_TAG(op1);
     tag2 = JS_VALUE_GET_NORM_TAG(op2);
     if (tag1 == tag2 ||
@@ -14585,15 +16035,23 @@ static BOOL js_strict_eq2(JSContext *ctx, JSValue op1, JSValue op2,
     case JS_TAG_STRING:
         {
             JSString *p1, *p2;
-            if (tag1 != tag2) {
-                res = FALSE;
-            } else {
+            if (tag1 == tag2) {
                 p1 = JS_VALUE_GET_STRING(op1);
                 p2 = JS_VALUE_GET_STRING(op2);
                 res = (js_string_compare(ctx, p1, p2) == 0);
+            } else if (tag2 == JS_TAG_STRING_ROPE) {
+                res = js_string_rope_equal(op1, op2);
+            } else {
+                res = FALSE;
             }
         }
         break;
+    case JS_TAG_STRING_ROPE:
+        if (tag2 == JS_TAG_STRING || tag2 == JS_TAG_STRING_ROPE)
+            res = js_string_rope_equal(op1, op2);
+        else
+            res = FALSE;
+        break;
     case JS_TAG_SYMBOL:
         {
             JSAtomStruct *p1, *p2;
@@ -14835,6 +16293,7 @@ static __exception int js_operator_typeof(JSContext *ctx, JSValueConst op1)
         atom = JS_ATOM_boolean;
         break;
     case JS_TAG_STRING:
+    case JS_TAG_STRING_ROPE:
         atom = JS_ATOM_string;
         break;
     case JS_TAG_OBJECT:
@@ -15556,6 +17015,44 @@ static BOOL js_get_fast_array(JSContext *ctx, JSValueConst obj,
     return FALSE;
 }
 
+/* Return TRUE if 'obj' is a fast array whose iteration with the
+   default array iterator has no side effect, so that its elements can
+   be read directly. No getter is called. */
+static BOOL js_get_fast_array_iterable(JSContext *ctx, JSValueConst obj,
+                                       JSValue **arrpp, uint32_t *countp)
+{
+    JSObject *p, *proto;
+    JSShapeProperty *prs;
+    JSProperty *pr;
+    uint32_t len;
+
+    if (!js_get_fast_array(ctx, obj, arrpp, countp))
+        return FALSE;
+    p = JS_VALUE_GET_OBJ(obj);
+    /* if len > count, the elements >= count might be read in the
+       prototypes */
+    if (js_get_length32(ctx, &len, obj) || len != *countp)
+        return FALSE;
+    if (find_own_property(&pr, p, JS_ATOM_Symbol_iterator))
+        return FALSE;
+    proto = p->shape->proto;
+    if (proto != JS_VALUE_GET_OBJ(ctx->class_proto[JS_CLASS_ARRAY]))
+        return FALSE;
+    prs = find_own_property(&pr, proto, JS_ATOM_Symbol_iterator);
+    if (!prs || (prs->flags & JS_PROP_TMASK) != JS_PROP_NORMAL ||
+        !JS_IsCFunction(ctx, pr->u.value,
+                        (JSCFunction *)js_create_array_iterator,
+                        JS_ITERATOR_KIND_VALUE))
+        return FALSE;
+    proto = JS_VALUE_GET_OBJ(ctx->class_proto[JS_CLASS_ARRAY_ITERATOR]);
+    prs = find_own_property(&pr, proto, JS_ATOM_next);
+    if (!prs || (prs->flags & JS_PROP_TMASK) != JS_PROP_NORMAL ||
+        !JS_IsCFunction(ctx, pr->u.value,
+                        (JSCFunction *)js_array_iterator_next, 0))
+        return FALSE;
+    return TRUE;
+}
+
 static __exception int js_append_enumerate(JSContext *ctx, JSValue *sp)
 {
     JSValue iterator, enumobj, method, value;
@@ -15570,10 +17067,18 @@ static __exception int js_append_enumerate(JSContext *ctx, JSValue *sp)
 
     pos = JS_VALUE_GET_INT(sp[-2]);
 
+    if (js_get_fast_array_iterable(ctx, sp[-1], &arrp, &count32)) {
+        /* no iterator object is needed */
+        for (i = 0; i < count32; i++) {
+            if (JS_DefinePropertyValueUint32(ctx, sp[-3], pos++,
+                                             JS_DupValue(ctx, arrp[i]), JS_PROP_C_W_E) < 0)
+                return -1;
+        }
+        sp[-2] = JS_NewInt32(ctx, pos);
+        return 0;
+    }
+
     /* XXX: further optimisations:
-       - use ctx->array_proto_values?
-       - check if array_iterator_prototype next method is built-in and
-         avoid constructing actual iterator object?
        - build this into js_for_of_start and use in all `for (x of o)` loops
      */
     iterator = JS_GetProperty(ctx, sp[-1], JS_ATOM_Symbol_iterator);
@@ -15731,7 +17236,7 @@ static JSVarRef *get_var_ref(JSContext *ctx, JSStackFrame *sf,
         }
     }
     /* create a new one */
-    var_ref = js_malloc(ctx, sizeof(JSVarRef));
+    var_ref = js_slab_malloc(ctx, sizeof(JSVarRef));
     if (!var_ref)
         return NULL;
     var_ref->header.ref_count = 1;
@@ -16181,6 +17686,749 @@ static JSValue js_call_bound_function(JSContext *ctx, JSValueConst func_obj,
     }
 }
 
+/* return TRUE if a property which is not an own property of 'p' can
+   be directly looked up in its prototype */
+static inline BOOL js_ic_can_use_proto(JSObject *p, JSAtom atom)
+{
+    if (likely(!p->is_exotic))
+        return TRUE;
+    /* the other exotic behaviors only concern array indexes */
+    return p->fast_array && !__JS_AtomIsTaggedInt(atom) &&
+        (p->class_id == JS_CLASS_ARRAY || p->class_id == JS_CLASS_ARGUMENTS);
+}
+
+/* return the property slot of 'atom' in 'p' or in its prototype if
+   it is in the inline cache, NULL otherwise. Only normal data
+   properties are cached. For writes, only writable own properties are
+   cached. */
+static force_inline JSProperty *js_ic_find(JSInlineCache *ic, JSObject *p,
+                                           JSAtom atom, BOOL is_put)
+{
+    JSInlineCacheEntry *e;
+    JSShapeProperty *prs;
+    JSShape *sh;
+    JSObject *p1;
+    int i;
+
+    sh = p->shape;
+    for(i = 0; i < ic->count; i++) {
+        e = &ic->entries[i];
+        if (e->shape_version != sh->version)
+            continue;
+        if (e->proto_version == 0) {
+            p1 = p;
+        } else {
+            p1 = sh->proto;
+            if (unlikely(is_put || !p1 ||
+                         p1->shape->version != e->proto_version ||
+                         !js_ic_can_use_proto(p, atom)))
+                return NULL;
+            sh = p1->shape;
+        }
+        /* cannot fail since the versions are unique: safety check */
+        prs = &get_shape_prop(sh)[e->prop_idx];
+        if (unlikely(e->prop_idx >= sh->prop_count || prs->atom != atom))
+            return NULL;
+        if (is_put) {
+            if (unlikely((prs->flags & (JS_PROP_TMASK | JS_PROP_WRITABLE |
+                                        JS_PROP_LENGTH)) != JS_PROP_WRITABLE))
+                return NULL;
+        } else {
+            if (unlikely(prs->flags & JS_PROP_TMASK))
+                return NULL;
+        }
+        return &p1->prop[e->prop_idx];
+    }
+    return NULL;
+}
+
+/* update the inline cache 'ic_idx' of 'b' after a lookup of 'atom' in
+   'obj' */
+static no_inline void js_ic_update(JSRuntime *rt, JSFunctionBytecode *b,
+                                   int ic_idx, JSValueConst obj,
+                                   JSAtom atom, BOOL is_put)
+{
+    JSInlineCache *ic;
+    JSInlineCacheEntry *e;
+    JSShapeProperty *prs;
+    JSProperty *pr;
+    JSObject *p, *p1;
+    uint64_t proto_version;
+    int i;
+
+    if (ic_idx == JS_IC_INDEX_NONE || JS_VALUE_GET_TAG(obj) != JS_TAG_OBJECT)
+        return;
+    if (!b->ic) {
+        b->ic = js_mallocz_rt(rt, sizeof(b->ic[0]) * b->ic_count);
+        if (!b->ic)
+            return;
+    }
+    ic = &b->ic[ic_idx];
+    if (ic->is_megamorphic)
+        return;
+    p = JS_VALUE_GET_OBJ(obj);
+    p1 = p;
+    proto_version = 0;
+    prs = find_own_property(&pr, p, atom);
+    if (!prs) {
+        if (is_put || !js_ic_can_use_proto(p, atom))
+            return;
+        p1 = p->shape->proto;
+        if (!p1)
+            return;
+        prs = find_own_property(&pr, p1, atom);
+        if (!prs)
+            return;
+        proto_version = p1->shape->version;
+    }
+    if (is_put) {
+        if ((prs->flags & (JS_PROP_TMASK | JS_PROP_WRITABLE |
+                           JS_PROP_LENGTH)) != JS_PROP_WRITABLE)
+            return;
+    } else {
+        if (prs->flags & JS_PROP_TMASK)
+            return;
+    }
+    /* reuse the entry of the same shape if it is no longer valid */
+    for(i = 0; i < ic->count; i++) {
+        if (ic->entries[i].shape_version == p->shape->version)
+            break;
+    }
+    if (i == JS_IC_ENTRY_COUNT) {
+        ic->is_megamorphic = TRUE;
+        return;
+    }
+    if (i == ic->count)
+        ic->count++;
+    e = &ic->entries[i];
+    e->shape_version = p->shape->version;
+    e->proto_version = proto_version;
+    e->prop_idx = prs - get_shape_prop(p1->shape);
+}
+
+/* Global variables use a single entry: 'shape_version' is the version
+   of ctx->global_var_obj and 'proto_version' is 0 if the variable is a
+   global lexical variable, otherwise the version of ctx->global_obj.
+   Return the property slot if it is in the inline cache and if its
+   value can be directly read or written, NULL otherwise. */
+static force_inline JSProperty *js_ic_find_global(JSContext *ctx,
+                                                  JSInlineCache *ic,
+                                                  JSAtom atom, BOOL is_put)
+{
+    JSInlineCacheEntry *e;
+    JSShapeProperty *prs;
+    JSProperty *pr;
+    JSShape *sh;
+    JSObject *p;
+
+    e = &ic->entries[0];
+    p = JS_VALUE_GET_OBJ(ctx->global_var_obj);
+    if (ic->count == 0 || e->shape_version != p->shape->version)
+        return NULL;
+    if (e->proto_version != 0) {
+        p = JS_VALUE_GET_OBJ(ctx->global_obj);
+        if (unlikely(p->shape->version != e->proto_version))
+            return NULL;
+    }
+    sh = p->shape;
+    prs = &get_shape_prop(sh)[e->prop_idx];
+    if (unlikely(e->prop_idx >= sh->prop_count || prs->atom != atom))
+        return NULL;
+    if (is_put) {
+        if (unlikely((prs->flags & (JS_PROP_TMASK | JS_PROP_WRITABLE |
+                                    JS_PROP_LENGTH)) != JS_PROP_WRITABLE))
+            return NULL;
+    } else {
+        if (unlikely(prs->flags & JS_PROP_TMASK))
+            return NULL;
+    }
+    pr = &p->prop[e->prop_idx];
+    /* the lexical variables must be initialized */
+    if (unlikely(JS_IsUninitialized(pr->u.value)))
+        return NULL;
+    return pr;
+}
+
+/* update the inline cache 'ic_idx' of 'b' after an access to the
+   global variable 'atom' */
+static no_inline void js_ic_update_global(JSContext *ctx,
+                                          JSFunctionBytecode *b,
+                                          int ic_idx, JSAtom atom,
+                                          BOOL is_put)
+{
+    JSInlineCache *ic;
+    JSInlineCacheEntry *e;
+    JSShapeProperty *prs;
+    JSProperty *pr;
+    JSObject *p, *p1;
+    uint64_t proto_version;
+
+    if (ic_idx == JS_IC_INDEX_NONE)
+        return;
+    if (!b->ic) {
+        b->ic = js_mallocz_rt(ctx->rt, sizeof(b->ic[0]) * b->ic_count);
+        if (!b->ic)
+            return;
+    }
+    ic = &b->ic[ic_idx];
+    p = JS_VALUE_GET_OBJ(ctx->global_var_obj);
+    p1 = p;
+    proto_version = 0;
+    prs = find_own_property(&pr, p, atom);
+    if (!prs) {
+        p1 = JS_VALUE_GET_OBJ(ctx->global_obj);
+        if (p1->is_exotic)
+            return;
+        prs = find_own_property(&pr, p1, atom);
+        if (!prs)
+            return;
+        proto_version = p1->shape->version;
+    }
+    if (is_put) {
+        if ((prs->flags & (JS_PROP_TMASK | JS_PROP_WRITABLE |
+                           JS_PROP_LENGTH)) != JS_PROP_WRITABLE)
+            return;
+    } else {
+        if (prs->flags & JS_PROP_TMASK)
+            return;
+    }
+    if (JS_IsUninitialized(pr->u.value))
+        return;
+    /* the global objects only change shape when global variables are
+       added or removed, so the previous entry is simply replaced */
+    ic->count = 1;
+    e = &ic->entries[0];
+    e->shape_version = p->shape->version;
+    e->proto_version = proto_version;
+    e->prop_idx = prs - get_shape_prop(p1->shape);
+}
+
+/* Replace the lazy function stub of the function object 'p' by the
+   compiled function. The closure variables of the compiled function
+   are a subset of the stub ones. Return NULL if exception. */
+static JSFunctionBytecode *js_function_compile_lazy(JSContext *ctx,
+                                                    JSObject *p)
+{
+    JSFunctionBytecode *lb = p->u.func.function_bytecode, *b;
+    JSVarRef **var_refs;
+    JSValue func_obj;
+    int i;
+
+    func_obj = js_compile_lazy_function(ctx, lb);
+    if (JS_IsException(func_obj))
+        return NULL;
+    b = JS_VALUE_GET_PTR(func_obj);
+    var_refs = NULL;
+    if (b->closure_var_count) {
+        var_refs = js_malloc(ctx, sizeof(var_refs[0]) * b->closure_var_count);
+        if (!var_refs) {
+            JS_FreeValue(ctx, func_obj);
+            return NULL;
+        }
+        for(i = 0; i < b->closure_var_count; i++) {
+            JSVarRef *var_ref = p->u.func.var_refs[b->closure_var[i].var_idx];
+            var_ref->header.ref_count++;
+            var_refs[i] = var_ref;
+        }
+    }
+    if (p->u.func.var_refs) {
+        for(i = 0; i < lb->closure_var_count; i++)
+            free_var_ref(ctx->rt, p->u.func.var_refs[i]);
+        js_free(ctx, p->u.func.var_refs);
+    }
+    p->u.func.var_refs = var_refs;
+    p->u.func.function_bytecode = b;
+    JS_FreeValue(ctx, JS_MKPTR(JS_TAG_FUNCTION_BYTECODE, lb));
+    return b;
+}
+
+/* Implementation of the opcodes shared by JS_CallInternal() and the
+   native code of the JIT. 'sp' is the stack pointer before the
+   opcode. The functions return -1 if exception. The caller updates
+   the stack pointer after the call, as indicated by the stack effect
+   in the comments, and raises the exception with the values below
+   the updated stack pointer still on the stack. */
+
+/* -> this */
+static force_inline int js_op_push_this(JSContext *ctx, JSFunctionBytecode *b,
+                                        JSValueConst this_obj, JSValue *sp)
+{
+    JSValue val;
+    if (!(b->js_mode & JS_MODE_STRICT)) {
+        uint32_t tag = JS_VALUE_GET_TAG(this_obj);
+        if (likely(tag == JS_TAG_OBJECT))
+            goto normal_this;
+        if (tag == JS_TAG_NULL || tag == JS_TAG_UNDEFINED) {
+            val = JS_DupValue(ctx, ctx->global_obj);
+        } else {
+            val = JS_ToObject(ctx, this_obj);
+            if (JS_IsException(val))
+                return -1;
+        }
+    } else {
+    normal_this:
+        val = JS_DupValue(ctx, this_obj);
+    }
+    sp[0] = val;
+    return 0;
+}
+
+/* free the function, 'this' if n_pop = 2 and the arguments of a call
+   and push its result. Return the new stack pointer. */
+static force_inline JSValue *js_op_call_end(JSContext *ctx, JSValue *call_argv,
+                                            int call_argc, int n_pop,
+                                            JSValue ret_val)
+{
+    int i;
+    for(i = -n_pop; i < call_argc; i++)
+        JS_FreeValue(ctx, call_argv[i]);
+    call_argv[-n_pop] = ret_val;
+    return call_argv - n_pop + 1;
+}
+
+/* a0 ... a(argc - 1) -> array */
+static force_inline int js_op_array_from(JSContext *ctx, JSValue *sp, int argc)
+{
+    JSValue *argv, arr;
+    int i, ret;
+
+    arr = JS_NewArray(ctx);
+    if (unlikely(JS_IsException(arr)))
+        return -1;
+    argv = sp - argc;
+    for(i = 0; i < argc; i++) {
+        ret = JS_DefinePropertyValue(ctx, arr, __JS_AtomFromUInt32(i), argv[i],
+                                     JS_PROP_C_W_E | JS_PROP_THROW);
+        argv[i] = JS_UNDEFINED;
+        if (ret < 0) {
+            JS_FreeValue(ctx, arr);
+            return -1;
+        }
+    }
+    argv[0] = arr;
+    return 0;
+}
+
+/* func this array -> ret_val */
+static force_inline int js_op_apply(JSContext *ctx, JSValue *sp, int magic)
+{
+    JSValue ret_val;
+
+    ret_val = js_function_apply(ctx, sp[-3], 2, (JSValueConst *)&sp[-2], magic);
+    if (unlikely(JS_IsException(ret_val)))
+        return -1;
+    JS_FreeValue(ctx, sp[-3]);
+    JS_FreeValue(ctx, sp[-2]);
+    JS_FreeValue(ctx, sp[-1]);
+    sp[-3] = ret_val;
+    return 0;
+}
+
+/* -> value */
+static force_inline int js_op_get_var(JSContext *ctx, JSFunctionBytecode *b,
+                                      JSValue *sp, JSAtom atom, int ic_idx,
+                                      BOOL throw_ref_error)
+{
+    JSValue val;
+    JSProperty *pr;
+
+    if (likely(b->ic && ic_idx != JS_IC_INDEX_NONE)) {
+        pr = js_ic_find_global(ctx, &b->ic[ic_idx], atom, FALSE);
+        if (pr) {
+            sp[0] = JS_DupValue(ctx, pr->u.value);
+            return 0;
+        }
+    }
+    val = JS_GetGlobalVar(ctx, atom, throw_ref_error);
+    if (unlikely(JS_IsException(val)))
+        return -1;
+    js_ic_update_global(ctx, b, ic_idx, atom, FALSE);
+    sp[0] = val;
+    return 0;
+}
+
+/* value -> (the value is freed in all cases) */
+static force_inline int js_op_put_var(JSContext *ctx, JSFunctionBytecode *b,
+                                      JSValue *sp, JSAtom atom, int ic_idx,
+                                      int flag)
+{
+    JSProperty *pr;
+
+    if (likely(b->ic && ic_idx != JS_IC_INDEX_NONE)) {
+        pr = js_ic_find_global(ctx, &b->ic[ic_idx], atom, TRUE);
+        if (pr) {
+            set_value(ctx, &pr->u.value, sp[-1]);
+            return 0;
+        }
+    }
+    if (unlikely(JS_SetGlobalVar(ctx, atom, sp[-1], flag) < 0))
+        return -1;
+    js_ic_update_global(ctx, b, ic_idx, atom, TRUE);
+    return 0;
+}
+
+/* bool value -> (the value is freed in all cases) */
+static force_inline int js_op_put_var_strict(JSContext *ctx,
+                                             JSFunctionBytecode *b,
+                                             JSValue *sp, JSAtom atom,
+                                             int ic_idx)
+{
+    /* sp[-2] is JS_TRUE or JS_FALSE */
+    if (unlikely(!JS_VALUE_GET_INT(sp[-2]))) {
+        JS_FreeValue(ctx, sp[-1]);
+        JS_ThrowReferenceErrorNotDefined(ctx, atom);
+        return -1;
+    }
+    return js_op_put_var(ctx, b, sp, atom, ic_idx, 2);
+}
+
+/* OP_get_loc_check, OP_get_var_ref_check: -> value */
+static force_inline int js_op_get_var_check(JSContext *ctx,
+                                            JSFunctionBytecode *b,
+                                            JSValue *sp, JSValue *pvalue,
+                                            int idx, BOOL is_ref)
+{
+    if (unlikely(JS_IsUninitialized(*pvalue))) {
+        JS_ThrowReferenceErrorUninitialized2(ctx, b, idx, is_ref);
+        return -1;
+    }
+    sp[0] = JS_DupValue(ctx, *pvalue);
+    return 0;
+}
+
+/* OP_put_loc_check, OP_put_var_ref_check and their '_init' variant:
+   value -> */
+static force_inline int js_op_put_var_check(JSContext *ctx,
+                                            JSFunctionBytecode *b,
+                                            JSValue *sp, JSValue *pvalue,
+                                            int idx, BOOL is_ref, BOOL is_init)
+{
+    if (unlikely(JS_IsUninitialized(*pvalue) != is_init)) {
+        if (is_init && !is_ref)
+            JS_ThrowReferenceError(ctx, "'this' can be initialized only once");
+        else
+            JS_ThrowReferenceErrorUninitialized2(ctx, b, idx, is_ref);
+        return -1;
+    }
+    set_value(ctx, pvalue, sp[-1]);
+    return 0;
+}
+
+/* iter_obj next catch_offset -> (the values are freed in all cases) */
+static force_inline int js_op_iterator_close(JSContext *ctx, JSValue *sp)
+{
+    /* the catch offset is dropped before closing the iterator to
+       avoid getting caught by exception */
+    JS_FreeValue(ctx, sp[-2]); /* drop the next method */
+    if (!JS_IsUndefined(sp[-3])) {
+        if (JS_IteratorClose(ctx, sp[-3], FALSE)) {
+            JS_FreeValue(ctx, sp[-3]);
+            return -1;
+        }
+        JS_FreeValue(ctx, sp[-3]);
+    }
+    return 0;
+}
+
+/* obj -> value */
+static force_inline int js_op_get_field(JSContext *ctx, JSFunctionBytecode *b,
+                                        JSValue *sp, JSAtom atom, int ic_idx)
+{
+    JSValue val;
+    JSProperty *pr;
+
+    if (likely(JS_VALUE_GET_TAG(sp[-1]) == JS_TAG_OBJECT &&
+               b->ic && ic_idx != JS_IC_INDEX_NONE)) {
+        pr = js_ic_find(&b->ic[ic_idx], JS_VALUE_GET_OBJ(sp[-1]),
+                        atom, FALSE);
+        if (pr) {
+            val = JS_DupValue(ctx, pr->u.value);
+            goto done;
+        }
+    }
+    val = JS_GetProperty(ctx, sp[-1], atom);
+    if (unlikely(JS_IsException(val)))
+        return -1;
+    js_ic_update(ctx->rt, b, ic_idx, sp[-1], atom, FALSE);
+ done:
+    JS_FreeValue(ctx, sp[-1]);
+    sp[-1] = val;
+    return 0;
+}
+
+/* obj -> obj value */
+static force_inline int js_op_get_field2(JSContext *ctx, JSFunctionBytecode *b,
+                                         JSValue *sp, JSAtom atom, int ic_idx)
+{
+    JSValue val;
+    JSProperty *pr;
+
+    if (likely(JS_VALUE_GET_TAG(sp[-1]) == JS_TAG_OBJECT &&
+               b->ic && ic_idx != JS_IC_INDEX_NONE)) {
+        pr = js_ic_find(&b->ic[ic_idx], JS_VALUE_GET_OBJ(sp[-1]),
+                        atom, FALSE);
+        if (pr) {
+            sp[0] = JS_DupValue(ctx, pr->u.value);
+            return 0;
+        }
+    }
+    val = JS_GetProperty(ctx, sp[-1], atom);
+    if (unlikely(JS_IsException(val)))
+        return -1;
+    js_ic_update(ctx->rt, b, ic_idx, sp[-1], atom, FALSE);
+    sp[0] = val;
+    return 0;
+}
+
+/* obj value -> (the values are freed in all cases) */
+static force_inline int js_op_put_field(JSContext *ctx, JSFunctionBytecode *b,
+                                        JSValue *sp, JSAtom atom, int ic_idx)
+{
+    JSProperty *pr;
+    int ret;
+
+    if (likely(JS_VALUE_GET_TAG(sp[-2]) == JS_TAG_OBJECT &&
+               b->ic && ic_idx != JS_IC_INDEX_NONE)) {
+        pr = js_ic_find(&b->ic[ic_idx], JS_VALUE_GET_OBJ(sp[-2]),
+                        atom, TRUE);
+        if (pr) {
+            set_value(ctx, &pr->u.value, sp[-1]);
+            JS_FreeValue(ctx, sp[-2]);
+            return 0;
+        }
+    }
+    ret = JS_SetPropertyInternal(ctx, sp[-2], atom, sp[-1],
+                                 JS_PROP_THROW_STRICT);
+    if (likely(ret >= 0))
+        js_ic_update(ctx->rt, b, ic_idx, sp[-2], atom, TRUE);
+    JS_FreeValue(ctx, sp[-2]);
+    return ret;
+}
+
+/* a b -> a + b */
+static force_inline int js_op_add(JSContext *ctx, JSValue *sp)
+{
+    JSValue op1, op2;
+    op1 = sp[-2];
+    op2 = sp[-1];
+    if (likely(JS_VALUE_IS_BOTH_INT(op1, op2))) {
+        int64_t r;
+        r = (int64_t)JS_VALUE_GET_INT(op1) + JS_VALUE_GET_INT(op2);
+        if (unlikely((int)r != r))
+            goto add_slow;
+        sp[-2] = JS_NewInt32(ctx, r);
+    } else if (JS_VALUE_IS_BOTH_FLOAT(op1, op2)) {
+        sp[-2] = __JS_NewFloat64(ctx, JS_VALUE_GET_FLOAT64(op1) +
+                                 JS_VALUE_GET_FLOAT64(op2));
+    } else {
+    add_slow:
+        return js_add_slow(ctx, sp);
+    }
+    return 0;
+}
+
+/* value -> (*pv += value, the value is freed in all cases) */
+static force_inline int js_op_add_loc(JSContext *ctx, JSValue *pv, JSValue *sp)
+{
+    if (likely(JS_VALUE_IS_BOTH_INT(*pv, sp[-1]))) {
+        int64_t r;
+        r = (int64_t)JS_VALUE_GET_INT(*pv) +
+            JS_VALUE_GET_INT(sp[-1]);
+        if (unlikely((int)r != r))
+            goto add_loc_slow;
+        *pv = JS_NewInt32(ctx, r);
+    } else if (JS_IsString(*pv)) {
+        JSValue op1, op2;
+        op1 = JS_ToPrimitiveFree(ctx, sp[-1], HINT_NONE);
+        if (JS_IsException(op1))
+            return -1;
+        if (!JS_IsString(op1)) {
+            op1 = JS_ToStringFree(ctx, op1);
+            if (JS_IsException(op1))
+                return -1;
+        }
+        if (js_string_value_len(*pv) +
+            js_string_value_len(op1) > JS_STRING_LEN_MAX) {
+            JS_FreeValue(ctx, op1);
+            JS_ThrowInternalError(ctx, "string too long");
+            return -1;
+        }
+        /* the variable is not referenced during the
+           concatenation so that it can be extended in place */
+        op2 = *pv;
+        *pv = JS_ConcatString(ctx, op2, op1);
+        if (JS_IsException(*pv)) {
+            *pv = JS_UNDEFINED;
+            return -1;
+        }
+    } else {
+        JSValue ops[2];
+    add_loc_slow:
+        /* In case of exception, js_add_slow frees ops[0]
+           and ops[1], so we must duplicate *pv */
+        ops[0] = JS_DupValue(ctx, *pv);
+        ops[1] = sp[-1];
+        if (js_add_slow(ctx, ops + 2))
+            return -1;
+        set_value(ctx, pv, ops[0]);
+    }
+    return 0;
+}
+
+/* a -> +a */
+static force_inline int js_op_plus(JSContext *ctx, JSValue *sp)
+{
+    uint32_t tag;
+    tag = JS_VALUE_GET_TAG(sp[-1]);
+    if (tag == JS_TAG_INT || JS_TAG_IS_FLOAT64(tag))
+        return 0;
+    return js_unary_arith_slow(ctx, sp, OP_plus);
+}
+
+/* a -> -a */
+static force_inline int js_op_neg(JSContext *ctx, JSValue *sp)
+{
+    JSValue op1;
+    uint32_t tag;
+    int val;
+    double d;
+    op1 = sp[-1];
+    tag = JS_VALUE_GET_TAG(op1);
+    if (tag == JS_TAG_INT) {
+        val = JS_VALUE_GET_INT(op1);
+        /* Note: -0 cannot be expressed as integer */
+        if (unlikely(val == 0)) {
+            d = -0.0;
+            goto neg_fp_res;
+        }
+        if (unlikely(val == INT32_MIN)) {
+            d = -(double)val;
+            goto neg_fp_res;
+        }
+        sp[-1] = JS_NewInt32(ctx, -val);
+    } else if (JS_TAG_IS_FLOAT64(tag)) {
+        d = -JS_VALUE_GET_FLOAT64(op1);
+    neg_fp_res:
+        sp[-1] = __JS_NewFloat64(ctx, d);
+    } else {
+        return js_unary_arith_slow(ctx, sp, OP_neg);
+    }
+    return 0;
+}
+
+/* OP_inc_loc, OP_dec_loc: 'op' is OP_inc or OP_dec */
+static force_inline int js_op_inc_loc(JSContext *ctx, JSValue *pv, int op)
+{
+    JSValue op1;
+    int val;
+
+    op1 = *pv;
+    if (JS_VALUE_GET_TAG(op1) == JS_TAG_INT) {
+        val = JS_VALUE_GET_INT(op1);
+        if (likely(val != (op == OP_inc ? INT32_MAX : INT32_MIN))) {
+            *pv = JS_NewInt32(ctx, val + (op == OP_inc ? 1 : -1));
+            return 0;
+        }
+    }
+    /* must duplicate otherwise the variable value may
+       be destroyed before JS code accesses it */
+    op1 = JS_DupValue(ctx, op1);
+    if (js_unary_arith_slow(ctx, &op1 + 1, op))
+        return -1;
+    set_value(ctx, pv, op1);
+    return 0;
+}
+
+/* a -> typeof a */
+static force_inline void js_op_typeof(JSContext *ctx, JSValue *sp)
+{
+    JSAtom atom;
+
+    atom = js_operator_typeof(ctx, sp[-1]);
+    JS_FreeValue(ctx, sp[-1]);
+    sp[-1] = JS_AtomToString(ctx, atom);
+}
+
+/* OP_is_undefined_or_null, OP_is_undefined, OP_is_null,
+   OP_typeof_is_undefined, OP_typeof_is_function: a -> bool */
+static force_inline void js_op_is(JSContext *ctx, JSValue *sp, int opcode)
+{
+    uint32_t tag = JS_VALUE_GET_TAG(sp[-1]);
+    BOOL res;
+
+    switch(opcode) {
+    case OP_is_undefined_or_null:
+        res = (tag == JS_TAG_UNDEFINED || tag == JS_TAG_NULL);
+        break;
+#if SHORT_OPCODES
+    case OP_is_undefined:
+        res = (tag == JS_TAG_UNDEFINED);
+        break;
+    case OP_is_null:
+        res = (tag == JS_TAG_NULL);
+        break;
+    case OP_typeof_is_undefined:
+        /* different from OP_is_undefined because of isHTMLDDA */
+        res = (js_operator_typeof(ctx, sp[-1]) == JS_ATOM_undefined);
+        break;
+    case OP_typeof_is_function:
+        res = (js_operator_typeof(ctx, sp[-1]) == JS_ATOM_function);
+        break;
+#endif
+    default:
+        abort();
+    }
+    JS_FreeValue(ctx, sp[-1]);
+    sp[-1] = JS_NewBool(ctx, res);
+}
+
+/* a -> object */
+static force_inline int js_op_to_object(JSContext *ctx, JSValue *sp)
+{
+    JSValue val;
+
+    if (JS_VALUE_GET_TAG(sp[-1]) != JS_TAG_OBJECT) {
+        val = JS_ToObject(ctx, sp[-1]);
+        if (JS_IsException(val))
+            return -1;
+        JS_FreeValue(ctx, sp[-1]);
+        sp[-1] = val;
+    }
+    return 0;
+}
+
+/* a -> property key */
+static force_inline int js_op_to_propkey(JSContext *ctx, JSValue *sp)
+{
+    JSValue val;
+
+    switch (JS_VALUE_GET_TAG(sp[-1])) {
+    case JS_TAG_INT:
+    case JS_TAG_STRING:
+    case JS_TAG_SYMBOL:
+        break;
+    default:
+        val = JS_ToPropertyKey(ctx, sp[-1]);
+        if (JS_IsException(val))
+            return -1;
+        JS_FreeValue(ctx, sp[-1]);
+        sp[-1] = val;
+        break;
+    }
+    return 0;
+}
+
+/* obj a -> obj property_key */
+static force_inline int js_op_to_propkey2(JSContext *ctx, JSValue *sp)
+{
+    /* must be tested first */
+    if (unlikely(JS_IsUndefined(sp[-2]) || JS_IsNull(sp[-2]))) {
+        JS_ThrowTypeError(ctx, "value has no property");
+        return -1;
+    }
+    return js_op_to_propkey(ctx, sp);
+}
+
 /* argument of OP_special_object */
 typedef enum {
     OP_SPECIAL_OBJECT_ARGUMENTS,
@@ -16210,7 +18458,9 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
     int opcode, arg_allocated_size, i;
     JSValue *local_buf, *stack_buf, *var_buf, *arg_buf, *sp, ret_val, *pval;
     JSVarRef **var_refs;
-    size_t alloca_size;
+    size_t alloca_size = 0;
+    /* function and 'this' of the last tail call reusing the frame */
+    JSValue tail_func_obj = JS_UNDEFINED, tail_this_obj = JS_UNDEFINED;
 
 #if !DIRECT_DISPATCH
 #define SWITCH(pc)      switch (opcode = *pc++)
@@ -16232,6 +18482,19 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
 #define CASE(op)        case_ ## op
 #define DEFAULT         case_default
 #define BREAK           SWITCH(pc)
+#endif
+#ifdef CONFIG_JIT
+    /* switch to the native code at the function start and at the
+       loop back edges once the function is hot */
+#define JIT_CHECK()                                                     \
+    do {                                                                \
+        if (rt->jit_enabled && !b->is_shared &&                         \
+            (b->jit_code || (!b->jit_disabled &&                        \
+                             ++b->jit_counter == JS_JIT_THRESHOLD)))    \
+            goto jit_enter;                                             \
+    } while (0)
+#else
+#define JIT_CHECK() do { } while (0)
 #endif
 
     if (js_poll_interrupts(caller_ctx))
@@ -16274,6 +18537,11 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                          (JSValueConst *)argv, flags);
     }
     b = p->u.func.function_bytecode;
+    if (unlikely(b->is_lazy)) {
+        b = js_function_compile_lazy(caller_ctx, p);
+        if (!b)
+            return JS_EXCEPTION;
+    }
 
     if (unlikely(argc < b->arg_count || (flags & JS_CALL_FLAG_COPY_ARGV))) {
         arg_allocated_size = b->arg_count;
@@ -16316,7 +18584,8 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
     sf->prev_frame = rt->current_stack_frame;
     rt->current_stack_frame = sf;
     ctx = b->realm; /* set the current realm */
-    
+    JIT_CHECK();
+
  restart:
     for(;;) {
         int call_argc;
@@ -16386,25 +18655,9 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
             BREAK;
         CASE(OP_push_this):
             /* OP_push_this is only called at the start of a function */
-            {
-                JSValue val;
-                if (!(b->js_mode & JS_MODE_STRICT)) {
-                    uint32_t tag = JS_VALUE_GET_TAG(this_obj);
-                    if (likely(tag == JS_TAG_OBJECT))
-                        goto normal_this;
-                    if (tag == JS_TAG_NULL || tag == JS_TAG_UNDEFINED) {
-                        val = JS_DupValue(ctx, ctx->global_obj);
-                    } else {
-                        val = JS_ToObject(ctx, this_obj);
-                        if (JS_IsException(val))
-                            goto exception;
-                    }
-                } else {
-                normal_this:
-                    val = JS_DupValue(ctx, this_obj);
-                }
-                *sp++ = val;
-            }
+            if (js_op_push_this(ctx, b, this_obj, sp))
+                goto exception;
+            sp++;
             BREAK;
         CASE(OP_push_false):
             *sp++ = JS_FALSE;
@@ -16641,16 +18894,16 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
             has_call_argc:
                 call_argv = sp - call_argc;
                 sf->cur_pc = pc;
+                if (opcode == OP_tail_call)
+                    goto tail_call;
+            tail_call_function:
                 ret_val = JS_CallInternal(ctx, call_argv[-1], JS_UNDEFINED,
                                           JS_UNDEFINED, call_argc, call_argv, 0);
                 if (unlikely(JS_IsException(ret_val)))
                     goto exception;
                 if (opcode == OP_tail_call)
                     goto done;
-                for(i = -1; i < call_argc; i++)
-                    JS_FreeValue(ctx, call_argv[i]);
-                sp -= call_argc + 1;
-                *sp++ = ret_val;
+                sp = js_op_call_end(ctx, call_argv, call_argc, 1, ret_val);
             }
             BREAK;
         CASE(OP_call_constructor):
@@ -16664,10 +18917,7 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                                                      call_argc, call_argv, 0);
                 if (unlikely(JS_IsException(ret_val)))
                     goto exception;
-                for(i = -2; i < call_argc; i++)
-                    JS_FreeValue(ctx, call_argv[i]);
-                sp -= call_argc + 2;
-                *sp++ = ret_val;
+                sp = js_op_call_end(ctx, call_argv, call_argc, 2, ret_val);
             }
             BREAK;
         CASE(OP_call_method):
@@ -16677,40 +18927,133 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                 pc += 2;
                 call_argv = sp - call_argc;
                 sf->cur_pc = pc;
+                if (opcode == OP_tail_call_method)
+                    goto tail_call;
+            tail_call_method:
                 ret_val = JS_CallInternal(ctx, call_argv[-1], call_argv[-2],
                                           JS_UNDEFINED, call_argc, call_argv, 0);
                 if (unlikely(JS_IsException(ret_val)))
                     goto exception;
                 if (opcode == OP_tail_call_method)
                     goto done;
-                for(i = -2; i < call_argc; i++)
-                    JS_FreeValue(ctx, call_argv[i]);
-                sp -= call_argc + 2;
-                *sp++ = ret_val;
+                sp = js_op_call_end(ctx, call_argv, call_argc, 2, ret_val);
             }
             BREAK;
-        CASE(OP_array_from):
+        tail_call:
+            /* In strict mode, the current frame is reused when calling
+               a bytecode function (possibly bound) so that the tail
+               calls do not consume stack space. */
             {
-                int i, ret;
-
-                call_argc = get_u16(pc);
-                pc += 2;
-                ret_val = JS_NewArray(ctx);
-                if (unlikely(JS_IsException(ret_val)))
-                    goto exception;
-                call_argv = sp - call_argc;
-                for(i = 0; i < call_argc; i++) {
-                    ret = JS_DefinePropertyValue(ctx, ret_val, __JS_AtomFromUInt32(i), call_argv[i],
-                                                 JS_PROP_C_W_E | JS_PROP_THROW);
-                    call_argv[i] = JS_UNDEFINED;
-                    if (ret < 0) {
-                        JS_FreeValue(ctx, ret_val);
-                        goto exception;
-                    }
+                JSObject *p1;
+                JSFunctionBytecode *b1;
+                JSBoundFunction *bf;
+                JSValue *new_local_buf, func_val, this_val;
+                int n_pop, bound_argc, arg_size;
+                size_t size;
+
+                n_pop = 1 + (opcode == OP_tail_call_method);
+                if (!(b->js_mode & JS_MODE_STRICT) ||
+                    b->func_kind != JS_FUNC_NORMAL ||
+                    JS_VALUE_GET_TAG(call_argv[-1]) != JS_TAG_OBJECT)
+                    goto tail_call_slow;
+                p1 = JS_VALUE_GET_OBJ(call_argv[-1]);
+                bf = NULL;
+                bound_argc = 0;
+                if (p1->class_id == JS_CLASS_BOUND_FUNCTION) {
+                    bf = p1->u.bound_function;
+                    bound_argc = bf->argc;
+                    if (JS_VALUE_GET_TAG(bf->func_obj) != JS_TAG_OBJECT)
+                        goto tail_call_slow;
+                    p1 = JS_VALUE_GET_OBJ(bf->func_obj);
+                }
+                if (p1->class_id != JS_CLASS_BYTECODE_FUNCTION)
+                    goto tail_call_slow;
+                b1 = p1->u.func.function_bytecode;
+                if (b1->func_kind != JS_FUNC_NORMAL || b1->is_lazy)
+                    goto tail_call_slow;
+                /* the exception handlers of the frame must be kept */
+                for(pval = stack_buf; pval < call_argv - n_pop; pval++) {
+                    if (JS_VALUE_GET_TAG(*pval) == JS_TAG_CATCH_OFFSET)
+                        goto tail_call_slow;
+                }
+                arg_size = max_int(bound_argc + call_argc, b1->arg_count);
+                size = sizeof(JSValue) * (arg_size + b1->var_count +
+                                          b1->stack_size);
+                if (size > alloca_size) {
+                    if (js_check_stack_overflow(rt, size))
+                        goto tail_call_slow;
+                    new_local_buf = alloca(size);
+                    alloca_size = size;
+                } else {
+                    new_local_buf = local_buf;
                 }
-                sp -= call_argc;
-                *sp++ = ret_val;
+                if (js_poll_interrupts(ctx))
+                    goto exception;
+
+                /* free the current frame except the function, 'this'
+                   and the arguments of the call */
+                if (unlikely(!list_empty(&sf->var_ref_list))) {
+                    close_var_refs(rt, sf);
+                    init_list_head(&sf->var_ref_list);
+                }
+                for(pval = local_buf; pval < call_argv - n_pop; pval++) {
+                    JS_FreeValue(ctx, *pval);
+                }
+                func_val = call_argv[-1];
+                this_val = (n_pop == 2) ? call_argv[-2] : JS_UNDEFINED;
+
+                /* setup the new frame as in the function prologue. The
+                   arguments are always copied to the frame. */
+                memmove(new_local_buf + bound_argc, call_argv,
+                        sizeof(JSValue) * call_argc);
+                if (bf) {
+                    JSValue bound_func_val = func_val;
+                    for(i = 0; i < bound_argc; i++)
+                        new_local_buf[i] = JS_DupValue(ctx, bf->argv[i]);
+                    JS_FreeValue(ctx, this_val);
+                    this_val = JS_DupValue(ctx, bf->this_val);
+                    func_val = JS_DupValue(ctx, bf->func_obj);
+                    JS_FreeValue(ctx, bound_func_val);
+                }
+                for(i = bound_argc + call_argc; i < arg_size; i++)
+                    new_local_buf[i] = JS_UNDEFINED;
+                JS_FreeValueRT(rt, tail_func_obj);
+                JS_FreeValueRT(rt, tail_this_obj);
+                tail_func_obj = func_val;
+                tail_this_obj = this_val;
+
+                local_buf = new_local_buf;
+                b = b1;
+                ctx = b->realm;
+                this_obj = tail_this_obj;
+                new_target = JS_UNDEFINED;
+                argc = bound_argc + call_argc;
+                argv = arg_buf = local_buf;
+                sf->js_mode = b->js_mode;
+                sf->cur_func = tail_func_obj;
+                sf->arg_count = arg_size;
+                sf->arg_buf = arg_buf;
+                var_refs = p1->u.func.var_refs;
+                var_buf = local_buf + arg_size;
+                sf->var_buf = var_buf;
+                for(i = 0; i < b->var_count; i++)
+                    var_buf[i] = JS_UNDEFINED;
+                stack_buf = var_buf + b->var_count;
+                sp = stack_buf;
+                pc = b->byte_code_buf;
+                BREAK;
+            tail_call_slow:
+                if (opcode == OP_tail_call)
+                    goto tail_call_function;
+                else
+                    goto tail_call_method;
             }
+        CASE(OP_array_from):
+            call_argc = get_u16(pc);
+            pc += 2;
+            if (js_op_array_from(ctx, sp, call_argc))
+                goto exception;
+            sp -= call_argc - 1;
             BREAK;
 
         CASE(OP_apply):
@@ -16719,7 +19062,18 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                 magic = get_u16(pc);
                 pc += 2;
 
-                ret_val = js_function_apply(ctx, sp[-3], 2, (JSValueConst *)&sp[-2], magic);
+                if (js_op_apply(ctx, sp, magic))
+                    goto exception;
+                sp -= 2;
+            }
+            BREAK;
+        CASE(OP_apply_spread):
+            {
+                int magic;
+                magic = get_u16(pc);
+                pc += 2;
+
+                ret_val = js_function_apply_spread(ctx, sp[-3], sp[-2], sp[-1], magic);
                 if (unlikely(JS_IsException(ret_val)))
                     goto exception;
                 JS_FreeValue(ctx, sp[-3]);
@@ -16840,7 +19194,7 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
 
                 scope_idx = get_u16(pc) - 1;
                 pc += 2;
-                tab = build_arg_list(ctx, &len, sp[-1]);
+                tab = build_arg_list(ctx, &len, sp[-1], NULL);
                 if (!tab)
                     goto exception;
                 if (js_same_value(ctx, sp[-2], ctx->eval_obj)) {
@@ -16911,15 +19265,16 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
         CASE(OP_get_var_undef):
         CASE(OP_get_var):
             {
-                JSValue val;
                 JSAtom atom;
+                int ic_idx;
                 atom = get_u32(pc);
-                pc += 4;
+                ic_idx = get_u16(pc + 4);
+                pc += 6;
 
-                val = JS_GetGlobalVar(ctx, atom, opcode - OP_get_var_undef);
-                if (unlikely(JS_IsException(val)))
+                if (js_op_get_var(ctx, b, sp, atom, ic_idx,
+                                  opcode - OP_get_var_undef))
                     goto exception;
-                *sp++ = val;
+                sp++;
             }
             BREAK;
 
@@ -16928,10 +19283,13 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
             {
                 int ret;
                 JSAtom atom;
+                int ic_idx;
                 atom = get_u32(pc);
-                pc += 4;
+                ic_idx = get_u16(pc + 4);
+                pc += 6;
 
-                ret = JS_SetGlobalVar(ctx, atom, sp[-1], opcode - OP_put_var);
+                ret = js_op_put_var(ctx, b, sp, atom, ic_idx,
+                                    opcode - OP_put_var);
                 sp--;
                 if (unlikely(ret < 0))
                     goto exception;
@@ -16942,15 +19300,12 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
             {
                 int ret;
                 JSAtom atom;
+                int ic_idx;
                 atom = get_u32(pc);
-                pc += 4;
+                ic_idx = get_u16(pc + 4);
+                pc += 6;
 
-                /* sp[-2] is JS_TRUE or JS_FALSE */
-                if (unlikely(!JS_VALUE_GET_INT(sp[-2]))) {
-                    JS_ThrowReferenceErrorNotDefined(ctx, atom);
-                    goto exception;
-                }
-                ret = JS_SetGlobalVar(ctx, atom, sp[-1], 2);
+                ret = js_op_put_var_strict(ctx, b, sp, atom, ic_idx);
                 sp -= 2;
                 if (unlikely(ret < 0))
                     goto exception;
@@ -17120,15 +19475,11 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
         CASE(OP_get_var_ref_check):
             {
                 int idx;
-                JSValue val;
                 idx = get_u16(pc);
                 pc += 2;
-                val = *var_refs[idx]->pvalue;
-                if (unlikely(JS_IsUninitialized(val))) {
-                    JS_ThrowReferenceErrorUninitialized2(ctx, b, idx, TRUE);
+                if (js_op_get_var_check(ctx, b, sp, var_refs[idx]->pvalue,
+                                        idx, TRUE))
                     goto exception;
-                }
-                sp[0] = JS_DupValue(ctx, val);
                 sp++;
             }
             BREAK;
@@ -17137,11 +19488,9 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                 int idx;
                 idx = get_u16(pc);
                 pc += 2;
-                if (unlikely(JS_IsUninitialized(*var_refs[idx]->pvalue))) {
-                    JS_ThrowReferenceErrorUninitialized2(ctx, b, idx, TRUE);
+                if (js_op_put_var_check(ctx, b, sp, var_refs[idx]->pvalue,
+                                        idx, TRUE, FALSE))
                     goto exception;
-                }
-                set_value(ctx, var_refs[idx]->pvalue, sp[-1]);
                 sp--;
             }
             BREAK;
@@ -17150,11 +19499,9 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                 int idx;
                 idx = get_u16(pc);
                 pc += 2;
-                if (unlikely(!JS_IsUninitialized(*var_refs[idx]->pvalue))) {
-                    JS_ThrowReferenceErrorUninitialized2(ctx, b, idx, TRUE);
+                if (js_op_put_var_check(ctx, b, sp, var_refs[idx]->pvalue,
+                                        idx, TRUE, TRUE))
                     goto exception;
-                }
-                set_value(ctx, var_refs[idx]->pvalue, sp[-1]);
                 sp--;
             }
             BREAK;
@@ -17171,11 +19518,8 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                 int idx;
                 idx = get_u16(pc);
                 pc += 2;
-                if (unlikely(JS_IsUninitialized(var_buf[idx]))) {
-                    JS_ThrowReferenceErrorUninitialized2(ctx, b, idx, FALSE);
+                if (js_op_get_var_check(ctx, b, sp, &var_buf[idx], idx, FALSE))
                     goto exception;
-                }
-                sp[0] = JS_DupValue(ctx, var_buf[idx]);
                 sp++;
             }
             BREAK;
@@ -17184,11 +19528,9 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                 int idx;
                 idx = get_u16(pc);
                 pc += 2;
-                if (unlikely(JS_IsUninitialized(var_buf[idx]))) {
-                    JS_ThrowReferenceErrorUninitialized2(ctx, b, idx, FALSE);
+                if (js_op_put_var_check(ctx, b, sp, &var_buf[idx], idx,
+                                        FALSE, FALSE))
                     goto exception;
-                }
-                set_value(ctx, &var_buf[idx], sp[-1]);
                 sp--;
             }
             BREAK;
@@ -17197,11 +19539,9 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                 int idx;
                 idx = get_u16(pc);
                 pc += 2;
-                if (unlikely(!JS_IsUninitialized(var_buf[idx]))) {
-                    JS_ThrowReferenceError(ctx, "'this' can be initialized only once");
+                if (js_op_put_var_check(ctx, b, sp, &var_buf[idx], idx,
+                                        FALSE, TRUE))
                     goto exception;
-                }
-                set_value(ctx, &var_buf[idx], sp[-1]);
                 sp--;
             }
             BREAK;
@@ -17259,25 +19599,40 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
             BREAK;
 
         CASE(OP_goto):
-            pc += (int32_t)get_u32(pc);
-            if (unlikely(js_poll_interrupts(ctx)))
-                goto exception;
+            {
+                int32_t diff = get_u32(pc);
+                pc += diff;
+                if (unlikely(js_poll_interrupts(ctx)))
+                    goto exception;
+                if (diff < 0)
+                    JIT_CHECK();
+            }
             BREAK;
 #if SHORT_OPCODES
         CASE(OP_goto16):
-            pc += (int16_t)get_u16(pc);
-            if (unlikely(js_poll_interrupts(ctx)))
-                goto exception;
+            {
+                int diff = (int16_t)get_u16(pc);
+                pc += diff;
+                if (unlikely(js_poll_interrupts(ctx)))
+                    goto exception;
+                if (diff < 0)
+                    JIT_CHECK();
+            }
             BREAK;
         CASE(OP_goto8):
-            pc += (int8_t)pc[0];
-            if (unlikely(js_poll_interrupts(ctx)))
-                goto exception;
+            {
+                int diff = (int8_t)pc[0];
+                pc += diff;
+                if (unlikely(js_poll_interrupts(ctx)))
+                    goto exception;
+                if (diff < 0)
+                    JIT_CHECK();
+            }
             BREAK;
 #endif
         CASE(OP_if_true):
             {
-                int res;
+                int res, diff = 0;
                 JSValue op1;
 
                 op1 = sp[-1];
@@ -17289,10 +19644,13 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                 }
                 sp--;
                 if (res) {
-                    pc += (int32_t)get_u32(pc - 4) - 4;
+                    diff = (int32_t)get_u32(pc - 4);
+                    pc += diff - 4;
                 }
                 if (unlikely(js_poll_interrupts(ctx)))
                     goto exception;
+                if (diff < 0)
+                    JIT_CHECK();
             }
             BREAK;
         CASE(OP_if_false):
@@ -17318,7 +19676,7 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
 #if SHORT_OPCODES
         CASE(OP_if_true8):
             {
-                int res;
+                int res, diff = 0;
                 JSValue op1;
 
                 op1 = sp[-1];
@@ -17330,10 +19688,13 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                 }
                 sp--;
                 if (res) {
-                    pc += (int8_t)pc[-1] - 1;
+                    diff = (int8_t)pc[-1];
+                    pc += diff - 1;
                 }
                 if (unlikely(js_poll_interrupts(ctx)))
                     goto exception;
+                if (diff < 0)
+                    JIT_CHECK();
             }
             BREAK;
         CASE(OP_if_false8):
@@ -17437,16 +19798,14 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
             BREAK;
 
         CASE(OP_iterator_close):
-            /* iter_obj next catch_offset -> */
-            sp--; /* drop the catch offset to avoid getting caught by exception */
-            JS_FreeValue(ctx, sp[-1]); /* drop the next method */
-            sp--;
-            if (!JS_IsUndefined(sp[-1])) {
-                if (JS_IteratorClose(ctx, sp[-1], FALSE))
+            {
+                int ret;
+                /* iter_obj next catch_offset -> */
+                ret = js_op_iterator_close(ctx, sp);
+                sp -= 3;
+                if (ret)
                     goto exception;
-                JS_FreeValue(ctx, sp[-1]);
             }
-            sp--;
             BREAK;
         CASE(OP_iterator_close_return):
             {
@@ -17534,30 +19893,28 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
 
         CASE(OP_get_field):
             {
-                JSValue val;
                 JSAtom atom;
+                int ic_idx;
                 atom = get_u32(pc);
-                pc += 4;
+                ic_idx = get_u16(pc + 4);
+                pc += 6;
 
-                val = JS_GetProperty(ctx, sp[-1], atom);
-                if (unlikely(JS_IsException(val)))
+                if (js_op_get_field(ctx, b, sp, atom, ic_idx))
                     goto exception;
-                JS_FreeValue(ctx, sp[-1]);
-                sp[-1] = val;
             }
             BREAK;
 
         CASE(OP_get_field2):
             {
-                JSValue val;
                 JSAtom atom;
+                int ic_idx;
                 atom = get_u32(pc);
-                pc += 4;
+                ic_idx = get_u16(pc + 4);
+                pc += 6;
 
-                val = JS_GetProperty(ctx, sp[-1], atom);
-                if (unlikely(JS_IsException(val)))
+                if (js_op_get_field2(ctx, b, sp, atom, ic_idx))
                     goto exception;
-                *sp++ = val;
+                sp++;
             }
             BREAK;
 
@@ -17565,12 +19922,12 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
             {
                 int ret;
                 JSAtom atom;
+                int ic_idx;
                 atom = get_u32(pc);
-                pc += 4;
+                ic_idx = get_u16(pc + 4);
+                pc += 6;
 
-                ret = JS_SetPropertyInternal(ctx, sp[-2], atom, sp[-1],
-                                             JS_PROP_THROW_STRICT);
-                JS_FreeValue(ctx, sp[-2]);
+                ret = js_op_put_field(ctx, b, sp, atom, ic_idx);
                 sp -= 2;
                 if (unlikely(ret < 0))
                     goto exception;
@@ -17915,68 +20272,20 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
             BREAK;
 
         CASE(OP_add):
-            {
-                JSValue op1, op2;
-                op1 = sp[-2];
-                op2 = sp[-1];
-                if (likely(JS_VALUE_IS_BOTH_INT(op1, op2))) {
-                    int64_t r;
-                    r = (int64_t)JS_VALUE_GET_INT(op1) + JS_VALUE_GET_INT(op2);
-                    if (unlikely((int)r != r))
-                        goto add_slow;
-                    sp[-2] = JS_NewInt32(ctx, r);
-                    sp--;
-                } else if (JS_VALUE_IS_BOTH_FLOAT(op1, op2)) {
-                    sp[-2] = __JS_NewFloat64(ctx, JS_VALUE_GET_FLOAT64(op1) +
-                                             JS_VALUE_GET_FLOAT64(op2));
-                    sp--;
-                } else {
-                add_slow:
-                    if (js_add_slow(ctx, sp))
-                        goto exception;
-                    sp--;
-                }
-            }
+            if (js_op_add(ctx, sp))
+                goto exception;
+            sp--;
             BREAK;
         CASE(OP_add_loc):
             {
-                JSValue *pv;
-                int idx;
+                int idx, ret;
                 idx = *pc;
                 pc += 1;
 
-                pv = &var_buf[idx];
-                if (likely(JS_VALUE_IS_BOTH_INT(*pv, sp[-1]))) {
-                    int64_t r;
-                    r = (int64_t)JS_VALUE_GET_INT(*pv) +
-                        JS_VALUE_GET_INT(sp[-1]);
-                    if (unlikely((int)r != r))
-                        goto add_loc_slow;
-                    *pv = JS_NewInt32(ctx, r);
-                    sp--;
-                } else if (JS_VALUE_GET_TAG(*pv) == JS_TAG_STRING) {
-                    JSValue op1;
-                    op1 = sp[-1];
-                    sp--;
-                    op1 = JS_ToPrimitiveFree(ctx, op1, HINT_NONE);
-                    if (JS_IsException(op1))
-                        goto exception;
-                    op1 = JS_ConcatString(ctx, JS_DupValue(ctx, *pv), op1);
-                    if (JS_IsException(op1))
-                        goto exception;
-                    set_value(ctx, pv, op1);
-                } else {
-                    JSValue ops[2];
-                add_loc_slow:
-                    /* In case of exception, js_add_slow frees ops[0]
-                       and ops[1], so we must duplicate *pv */
-                    ops[0] = JS_DupValue(ctx, *pv);
-                    ops[1] = sp[-1];
-                    sp--;
-                    if (js_add_slow(ctx, ops + 2))
-                        goto exception;
-                    set_value(ctx, pv, ops[0]);
-                }
+                ret = js_op_add_loc(ctx, &var_buf[idx], sp);
+                sp--;
+                if (ret)
+                    goto exception;
             }
             BREAK;
         CASE(OP_sub):
@@ -18092,47 +20401,12 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
             BREAK;
 
         CASE(OP_plus):
-            {
-                JSValue op1;
-                uint32_t tag;
-                op1 = sp[-1];
-                tag = JS_VALUE_GET_TAG(op1);
-                if (tag == JS_TAG_INT || JS_TAG_IS_FLOAT64(tag)) {
-                } else {
-                    if (js_unary_arith_slow(ctx, sp, opcode))
-                        goto exception;
-                }
-            }
+            if (js_op_plus(ctx, sp))
+                goto exception;
             BREAK;
         CASE(OP_neg):
-            {
-                JSValue op1;
-                uint32_t tag;
-                int val;
-                double d;
-                op1 = sp[-1];
-                tag = JS_VALUE_GET_TAG(op1);
-                if (tag == JS_TAG_INT) {
-                    val = JS_VALUE_GET_INT(op1);
-                    /* Note: -0 cannot be expressed as integer */
-                    if (unlikely(val == 0)) {
-                        d = -0.0;
-                        goto neg_fp_res;
-                    }
-                    if (unlikely(val == INT32_MIN)) {
-                        d = -(double)val;
-                        goto neg_fp_res;
-                    }
-                    sp[-1] = JS_NewInt32(ctx, -val);
-                } else if (JS_TAG_IS_FLOAT64(tag)) {
-                    d = -JS_VALUE_GET_FLOAT64(op1);
-                neg_fp_res:
-                    sp[-1] = __JS_NewFloat64(ctx, d);
-                } else {
-                    if (js_unary_arith_slow(ctx, sp, opcode))
-                        goto exception;
-                }
-            }
+            if (js_op_neg(ctx, sp))
+                goto exception;
             BREAK;
         CASE(OP_inc):
             {
@@ -18176,52 +20450,41 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
             BREAK;
         CASE(OP_inc_loc):
             {
-                JSValue op1;
-                int val;
                 int idx;
                 idx = *pc;
                 pc += 1;
 
-                op1 = var_buf[idx];
-                if (JS_VALUE_GET_TAG(op1) == JS_TAG_INT) {
-                    val = JS_VALUE_GET_INT(op1);
-                    if (unlikely(val == INT32_MAX))
-                        goto inc_loc_slow;
-                    var_buf[idx] = JS_NewInt32(ctx, val + 1);
-                } else {
-                inc_loc_slow:
-                    /* must duplicate otherwise the variable value may
-                       be destroyed before JS code accesses it */
-                    op1 = JS_DupValue(ctx, op1);
-                    if (js_unary_arith_slow(ctx, &op1 + 1, OP_inc))
-                        goto exception;
-                    set_value(ctx, &var_buf[idx], op1);
-                }
+                if (js_op_inc_loc(ctx, &var_buf[idx], OP_inc))
+                    goto exception;
             }
             BREAK;
+#if SHORT_OPCODES
+        CASE(OP_inc_loc_goto8):
+            {
+                int diff;
+                int idx;
+                idx = pc[0];
+                pc += 2;
+
+                if (js_op_inc_loc(ctx, &var_buf[idx], OP_inc))
+                    goto exception;
+                diff = (int8_t)pc[-1];
+                pc += diff - 1;
+                if (unlikely(js_poll_interrupts(ctx)))
+                    goto exception;
+                if (diff < 0)
+                    JIT_CHECK();
+            }
+            BREAK;
+#endif
         CASE(OP_dec_loc):
             {
-                JSValue op1;
-                int val;
                 int idx;
                 idx = *pc;
                 pc += 1;
 
-                op1 = var_buf[idx];
-                if (JS_VALUE_GET_TAG(op1) == JS_TAG_INT) {
-                    val = JS_VALUE_GET_INT(op1);
-                    if (unlikely(val == INT32_MIN))
-                        goto dec_loc_slow;
-                    var_buf[idx] = JS_NewInt32(ctx, val - 1);
-                } else {
-                dec_loc_slow:
-                    /* must duplicate otherwise the variable value may
-                       be destroyed before JS code accesses it */
-                    op1 = JS_DupValue(ctx, op1);
-                    if (js_unary_arith_slow(ctx, &op1 + 1, OP_dec))
-                        goto exception;
-                    set_value(ctx, &var_buf[idx], op1);
-                }
+                if (js_op_inc_loc(ctx, &var_buf[idx], OP_dec))
+                    goto exception;
             }
             BREAK;
         CASE(OP_not):
@@ -18405,6 +20668,39 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
             OP_CMP(OP_strict_eq, ==, js_strict_eq_slow(ctx, sp, 0));
             OP_CMP(OP_strict_neq, !=, js_strict_eq_slow(ctx, sp, 1));
 
+#if SHORT_OPCODES
+#define OP_CMP_IF_FALSE8(opcode, cmp_opcode, binary_op)           \
+            CASE(opcode):                                       \
+                {                                               \
+                JSValue op1, op2;                               \
+                int res;                                        \
+                op1 = sp[-2];                                   \
+                op2 = sp[-1];                                   \
+                pc += 1;                                        \
+                if (likely(JS_VALUE_IS_BOTH_INT(op1, op2))) {   \
+                    res = JS_VALUE_GET_INT(op1) binary_op JS_VALUE_GET_INT(op2); \
+                } else if (JS_VALUE_IS_BOTH_FLOAT(op1, op2)) {  \
+                    res = JS_VALUE_GET_FLOAT64(op1) binary_op JS_VALUE_GET_FLOAT64(op2); \
+                } else {                                        \
+                    if (js_relational_slow(ctx, sp, cmp_opcode)) \
+                        goto exception;                         \
+                    res = JS_VALUE_GET_BOOL(sp[-2]);            \
+                }                                               \
+                sp -= 2;                                        \
+                if (!res) {                                     \
+                    pc += (int8_t)pc[-1] - 1;                   \
+                }                                               \
+                if (unlikely(js_poll_interrupts(ctx)))          \
+                    goto exception;                             \
+                }                                               \
+            BREAK
+
+            OP_CMP_IF_FALSE8(OP_lt_if_false8, OP_lt, <);
+            OP_CMP_IF_FALSE8(OP_lte_if_false8, OP_lte, <=);
+            OP_CMP_IF_FALSE8(OP_gt_if_false8, OP_gt, >);
+            OP_CMP_IF_FALSE8(OP_gte_if_false8, OP_gte, >=);
+#endif
+
 #ifdef CONFIG_BIGNUM
         CASE(OP_mul_pow10):
             if (rt->bigfloat_ops.mul_pow10(ctx, sp))
@@ -18423,15 +20719,7 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
             sp--;
             BREAK;
         CASE(OP_typeof):
-            {
-                JSValue op1;
-                JSAtom atom;
-
-                op1 = sp[-1];
-                atom = js_operator_typeof(ctx, op1);
-                JS_FreeValue(ctx, op1);
-                sp[-1] = JS_AtomToString(ctx, atom);
-            }
+            js_op_typeof(ctx, sp);
             BREAK;
         CASE(OP_delete):
             if (js_operator_delete(ctx, sp))
@@ -18454,50 +20742,18 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
             BREAK;
 
         CASE(OP_to_object):
-            if (JS_VALUE_GET_TAG(sp[-1]) != JS_TAG_OBJECT) {
-                ret_val = JS_ToObject(ctx, sp[-1]);
-                if (JS_IsException(ret_val))
-                    goto exception;
-                JS_FreeValue(ctx, sp[-1]);
-                sp[-1] = ret_val;
-            }
+            if (js_op_to_object(ctx, sp))
+                goto exception;
             BREAK;
 
         CASE(OP_to_propkey):
-            switch (JS_VALUE_GET_TAG(sp[-1])) {
-            case JS_TAG_INT:
-            case JS_TAG_STRING:
-            case JS_TAG_SYMBOL:
-                break;
-            default:
-                ret_val = JS_ToPropertyKey(ctx, sp[-1]);
-                if (JS_IsException(ret_val))
-                    goto exception;
-                JS_FreeValue(ctx, sp[-1]);
-                sp[-1] = ret_val;
-                break;
-            }
+            if (js_op_to_propkey(ctx, sp))
+                goto exception;
             BREAK;
 
         CASE(OP_to_propkey2):
-            /* must be tested first */
-            if (unlikely(JS_IsUndefined(sp[-2]) || JS_IsNull(sp[-2]))) {
-                JS_ThrowTypeError(ctx, "value has no property");
+            if (js_op_to_propkey2(ctx, sp))
                 goto exception;
-            }
-            switch (JS_VALUE_GET_TAG(sp[-1])) {
-            case JS_TAG_INT:
-            case JS_TAG_STRING:
-            case JS_TAG_SYMBOL:
-                break;
-            default:
-                ret_val = JS_ToPropertyKey(ctx, sp[-1]);
-                if (JS_IsException(ret_val))
-                    goto exception;
-                JS_FreeValue(ctx, sp[-1]);
-                sp[-1] = ret_val;
-                break;
-            }
             BREAK;
 #if 0
         CASE(OP_to_string):
@@ -18610,49 +20866,23 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
         CASE(OP_nop):
             BREAK;
         CASE(OP_is_undefined_or_null):
-            if (JS_VALUE_GET_TAG(sp[-1]) == JS_TAG_UNDEFINED ||
-                JS_VALUE_GET_TAG(sp[-1]) == JS_TAG_NULL) {
-                goto set_true;
-            } else {
-                goto free_and_set_false;
-            }
+            js_op_is(ctx, sp, OP_is_undefined_or_null);
+            BREAK;
 #if SHORT_OPCODES
         CASE(OP_is_undefined):
-            if (JS_VALUE_GET_TAG(sp[-1]) == JS_TAG_UNDEFINED) {
-                goto set_true;
-            } else {
-                goto free_and_set_false;
-            }
+            js_op_is(ctx, sp, OP_is_undefined);
+            BREAK;
         CASE(OP_is_null):
-            if (JS_VALUE_GET_TAG(sp[-1]) == JS_TAG_NULL) {
-                goto set_true;
-            } else {
-                goto free_and_set_false;
-            }
+            js_op_is(ctx, sp, OP_is_null);
+            BREAK;
             /* XXX: could merge to a single opcode */
         CASE(OP_typeof_is_undefined):
-            /* different from OP_is_undefined because of isHTMLDDA */
-            if (js_operator_typeof(ctx, sp[-1]) == JS_ATOM_undefined) {
-                goto free_and_set_true;
-            } else {
-                goto free_and_set_false;
-            }
-        CASE(OP_typeof_is_function):
-            if (js_operator_typeof(ctx, sp[-1]) == JS_ATOM_function) {
-                goto free_and_set_true;
-            } else {
-                goto free_and_set_false;
-            }
-        free_and_set_true:
-            JS_FreeValue(ctx, sp[-1]);
-#endif
-        set_true:
-            sp[-1] = JS_TRUE;
+            js_op_is(ctx, sp, OP_typeof_is_undefined);
             BREAK;
-        free_and_set_false:
-            JS_FreeValue(ctx, sp[-1]);
-            sp[-1] = JS_FALSE;
+        CASE(OP_typeof_is_function):
+            js_op_is(ctx, sp, OP_typeof_is_function);
             BREAK;
+#endif
         CASE(OP_invalid):
         DEFAULT:
             JS_ThrowInternalError(ctx, "invalid opcode: pc=%u opcode=0x%02x",
@@ -18660,6 +20890,39 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
             goto exception;
         }
     }
+#ifdef CONFIG_JIT
+ jit_enter:
+    {
+        JSJitFrame jf;
+        int status;
+
+        if (!b->jit_code && js_jit_compile(rt, b) < 0) {
+            /* the compilation is not retried */
+            b->jit_disabled = TRUE;
+            goto restart;
+        }
+        jf.rt = rt;
+        jf.ctx = ctx;
+        jf.b = b;
+        jf.sf = sf;
+        jf.var_refs = var_refs;
+        jf.var_buf = var_buf;
+        jf.arg_buf = arg_buf;
+        jf.this_obj = this_obj;
+        jf.sp = sp;
+        jf.pc = pc;
+        status = js_jit_run(&jf);
+        sp = jf.sp;
+        pc = jf.pc;
+        if (status == JS_JIT_RETURN) {
+            ret_val = jf.ret_val;
+            goto done;
+        } else if (status == JS_JIT_EXCEPTION) {
+            goto exception;
+        }
+        goto restart;
+    }
+#endif
  exception:
     if (is_backtrace_needed(ctx, rt->current_exception)) {
         /* add the backtrace information now (it is not done
@@ -18706,6 +20969,8 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
         for(pval = local_buf; pval < sp; pval++) {
             JS_FreeValue(ctx, *pval);
         }
+        JS_FreeValueRT(rt, tail_func_obj);
+        JS_FreeValueRT(rt, tail_this_obj);
     }
     rt->current_stack_frame = sf->prev_frame;
     return ret_val;
@@ -19980,6 +22245,10 @@ typedef struct JSFunctionDef {
     BOOL is_derived_class_constructor;
     BOOL in_function_body;
     BOOL backtrace_barrier;
+    BOOL lazy_compile; /* TRUE if the compilation of the inner functions
+                          can be deferred to their first call */
+    BOOL lazy_body_skipped; /* TRUE if the body was skipped without
+                               being parsed (see js_parse_skip_body()) */
     JSFunctionKindEnum func_kind : 8;
     JSParseFunctionEnum func_type : 8;
     uint8_t js_mode; /* bitmap of JS_MODE_x */
@@ -20022,6 +22291,7 @@ typedef struct JSFunctionDef {
     int last_opcode_pos; /* -1 if no last opcode */
     int last_opcode_line_num;
     BOOL use_short_opcodes; /* true if short opcodes are used in byte_code */
+    int ic_count; /* number of inline caches, set in resolve_labels() */
     
     LabelSlot *label_slots;
     int label_size; /* allocated size for label_slots[] */
@@ -20056,6 +22326,12 @@ typedef struct JSFunctionDef {
     char *source;  /* raw source, utf-8 encoded */
     int source_len;
 
+    /* identifiers of a skipped body which may reference a variable of
+       the enclosing functions (sorted by js_create_lazy_function()) */
+    JSAtom *lazy_names;
+    int lazy_name_count;
+    int lazy_name_size;
+
     JSModuleDef *module; /* != NULL when parsing a module */
 } JSFunctionDef;
 
@@ -21571,6 +23847,13 @@ static void emit_atom(JSParseState *s, JSAtom name)
     emit_u32(s, JS_DupAtom(s->ctx, name));
 }
 
+/* inline cache index of a property access opcode. The actual value is
+   set in resolve_labels() */
+static void emit_ic(JSParseState *s)
+{
+    emit_u16(s, 0);
+}
+
 static int update_label(JSFunctionDef *s, int label, int delta)
 {
     LabelSlot *ls;
@@ -22164,13 +24447,263 @@ static int seal_template_obj(JSContext *ctx, JSValueConst obj)
     return 0;
 }
 
+/* Constant folding. The operands are recognized in the byte code
+   emitted so far, so nested constant expressions are folded bottom up
+   while parsing. */
+
+/* Return TRUE if the byte code between 'pos' and 'end' is a single
+   push of a number, string, boolean, null or undefined constant,
+   optionally preceded by line number information. If 'pval' is not
+   NULL, the constant value is returned in it. */
+static BOOL js_get_const_code(JSParseState *s, int pos, int end,
+                              JSValue *pval)
+{
+    JSFunctionDef *fd = s->cur_func;
+    const uint8_t *bc_buf = fd->byte_code.buf;
+    JSValue val;
+    int op;
+
+    while (pos < end && bc_buf[pos] == OP_line_num)
+        pos += opcode_info[OP_line_num].size;
+    if (pos >= end)
+        return FALSE;
+    op = bc_buf[pos];
+    if (pos + opcode_info[op].size != end)
+        return FALSE;
+    switch(op) {
+    case OP_push_i32:
+        val = JS_NewInt32(s->ctx, get_i32(bc_buf + pos + 1));
+        break;
+    case OP_push_const:
+        val = fd->cpool[get_u32(bc_buf + pos + 1)];
+        switch(JS_VALUE_GET_NORM_TAG(val)) {
+        case JS_TAG_INT:
+        case JS_TAG_FLOAT64:
+        case JS_TAG_STRING:
+            break;
+        default:
+            return FALSE;
+        }
+        val = JS_DupValue(s->ctx, val);
+        break;
+    case OP_push_atom_value:
+        val = JS_AtomToString(s->ctx, get_u32(bc_buf + pos + 1));
+        if (JS_IsException(val)) {
+            JS_FreeValue(s->ctx, JS_GetException(s->ctx));
+            return FALSE;
+        }
+        break;
+    case OP_undefined:
+        val = JS_UNDEFINED;
+        break;
+    case OP_null:
+        val = JS_NULL;
+        break;
+    case OP_push_false:
+    case OP_push_true:
+        val = JS_NewBool(s->ctx, op == OP_push_true);
+        break;
+    default:
+        return FALSE;
+    }
+    if (pval)
+        *pval = val;
+    else
+        JS_FreeValue(s->ctx, val);
+    return TRUE;
+}
+
+/* Remove the constant byte code after 'pos'. The atoms it references
+   are freed and so are the constant pool entries it added. */
+static void js_remove_const_code(JSParseState *s, int pos)
+{
+    JSFunctionDef *fd = s->cur_func;
+    const uint8_t *bc_buf = fd->byte_code.buf;
+    int op, pos1, pos_next, idx, cpool_idx;
+
+    cpool_idx = fd->cpool_count;
+    for(pos1 = pos; pos1 < fd->byte_code.size; pos1 = pos_next) {
+        op = bc_buf[pos1];
+        pos_next = pos1 + opcode_info[op].size;
+        switch(opcode_info[op].fmt) {
+        case OP_FMT_atom:
+        case OP_FMT_atom_u8:
+        case OP_FMT_atom_u16:
+        case OP_FMT_atom_label_u8:
+        case OP_FMT_atom_label_u16:
+            JS_FreeAtom(s->ctx, get_u32(bc_buf + pos1 + 1));
+            break;
+        case OP_FMT_const:
+            idx = get_u32(bc_buf + pos1 + 1);
+            cpool_idx = min_int(cpool_idx, idx);
+            break;
+        default:
+            if (op == OP_line_num)
+                fd->last_opcode_line_num = -1;
+            break;
+        }
+    }
+    /* the constants were added while parsing the removed code */
+    while (fd->cpool_count > cpool_idx)
+        JS_FreeValue(s->ctx, fd->cpool[--fd->cpool_count]);
+    fd->byte_code.size = pos;
+    fd->last_opcode_pos = -1;
+}
+
+/* Evaluate 'op' at compile time if its operands are constants: the
+   unary operand is the code after 'pos' ('pos1' < 0), the binary
+   operands are the code in [pos, pos1) and after 'pos1'. Return 1 if
+   the operation was replaced by its result, 0 if it must be emitted
+   and -1 in case of exception. */
+static int js_fold_constants(JSParseState *s, OPCodeEnum op,
+                             int pos, int pos1)
+{
+    JSContext *ctx = s->ctx;
+    JSFunctionDef *fd = s->cur_func;
+    JSValue stack[2], val;
+    int n, ret;
+
+    switch(op) {
+    case OP_neg:
+    case OP_plus:
+    case OP_not:
+        n = 1;
+        break;
+    case OP_add:
+    case OP_sub:
+    case OP_mul:
+    case OP_div:
+    case OP_mod:
+    case OP_pow:
+    case OP_shl:
+    case OP_sar:
+    case OP_shr:
+    case OP_and:
+    case OP_or:
+    case OP_xor:
+        n = 2;
+        break;
+    default:
+        return 0;
+    }
+#ifdef CONFIG_BIGNUM
+    /* the operators are overloaded in math mode */
+    if ((fd->js_mode & JS_MODE_MATH) || is_math_mode(ctx))
+        return 0;
+#endif
+    if (n == 1) {
+        if (!js_get_const_code(s, pos, fd->byte_code.size, &stack[0]))
+            return 0;
+    } else {
+        if (!js_get_const_code(s, pos, pos1, &stack[0]))
+            return 0;
+        if (!js_get_const_code(s, pos1, fd->byte_code.size, &stack[1])) {
+            JS_FreeValue(ctx, stack[0]);
+            return 0;
+        }
+    }
+    /* primitive operands: no user code can be called */
+    switch(op) {
+    case OP_neg:
+    case OP_plus:
+        ret = js_unary_arith_slow(ctx, stack + 1, op);
+        break;
+    case OP_not:
+        ret = js_not_slow(ctx, stack + 1);
+        break;
+    case OP_add:
+        ret = js_add_slow(ctx, stack + 2);
+        break;
+    case OP_shl:
+    case OP_sar:
+    case OP_and:
+    case OP_or:
+    case OP_xor:
+        ret = js_binary_logic_slow(ctx, stack + 2, op);
+        break;
+    case OP_shr:
+        ret = js_shr_slow(ctx, stack + 2);
+        break;
+    default:
+        ret = js_binary_arith_slow(ctx, stack + 2, op);
+        break;
+    }
+    if (ret) {
+        /* e.g. string too long: let the operation fail at run time */
+        JS_FreeValue(ctx, JS_GetException(ctx));
+        return 0;
+    }
+    val = stack[0];
+    if (JS_VALUE_GET_TAG(val) == JS_TAG_STRING_ROPE) {
+        val = JS_ToStringFree(ctx, val);
+        if (JS_IsException(val))
+            return -1;
+    }
+    js_remove_const_code(s, pos);
+    if (JS_VALUE_GET_TAG(val) == JS_TAG_INT) {
+        emit_op(s, OP_push_i32);
+        emit_u32(s, JS_VALUE_GET_INT(val));
+        ret = 0;
+    } else {
+        ret = emit_push_const(s, val, 1);
+    }
+    JS_FreeValue(ctx, val);
+    if (ret)
+        return -1;
+    return 1;
+}
+
+/* Replace the code of a template literal starting at 'pos' whose parts
+   are all constants by its string value. The code is the first string,
+   get_field2 'concat' and the other parts. Return 1 if the code was
+   replaced, 0 if the call to 'concat' must be emitted and -1 in case of
+   exception. */
+static int js_fold_template(JSParseState *s, int pos)
+{
+    JSFunctionDef *fd = s->cur_func;
+    StringBuffer b_s, *b = &b_s;
+    JSValue val;
+    int pos1, pos_next, op;
+
+    string_buffer_init(s->ctx, b, 0);
+    for(pos1 = pos; pos1 < fd->byte_code.size; pos1 = pos_next) {
+        op = fd->byte_code.buf[pos1];
+        pos_next = pos1 + opcode_info[op].size;
+        if (op == OP_line_num || op == OP_get_field2)
+            continue;
+        if (!js_get_const_code(s, pos1, pos_next, &val)) {
+            /* not a single constant part: keep the code */
+            string_buffer_free(b);
+            return 0;
+        }
+        if (string_buffer_concat_value_free(b, val))
+            goto fail;
+    }
+    val = string_buffer_end(b);
+    if (JS_IsException(val))
+        return -1;
+    js_remove_const_code(s, pos);
+    if (emit_push_const(s, val, 1)) {
+        JS_FreeValue(s->ctx, val);
+        return -1;
+    }
+    JS_FreeValue(s->ctx, val);
+    return 1;
+ fail:
+    string_buffer_free(b);
+    return -1;
+}
+
 static __exception int js_parse_template(JSParseState *s, int call, int *argc)
 {
     JSContext *ctx = s->ctx;
     JSValue raw_array, template_object;
     JSToken cooked;
-    int depth, ret;
+    int depth, ret, pos, expr_pos;
+    BOOL is_const;
 
+    pos = s->cur_func->byte_code.size;
+    is_const = !call;
     raw_array = JS_UNDEFINED; /* avoid warning */
     template_object = JS_UNDEFINED; /* avoid warning */
     if (call) {
@@ -22234,6 +24767,7 @@ static __exception int js_parse_template(JSParseState *s, int call, int *argc)
                         goto done1;
                     emit_op(s, OP_get_field2);
                     emit_atom(s, JS_ATOM_concat);
+                    emit_ic(s);
                 }
                 depth++;
             } else {
@@ -22244,8 +24778,11 @@ static __exception int js_parse_template(JSParseState *s, int call, int *argc)
             goto done;
         if (next_token(s))
             return -1;
+        expr_pos = s->cur_func->byte_code.size;
         if (js_parse_expr(s))
             return -1;
+        if (is_const)
+            is_const = js_get_const_code(s, expr_pos, s->cur_func->byte_code.size, NULL);
         depth++;
         if (s->token.val != '}') {
             return js_parse_error(s, "expected '}' after template expression");
@@ -22268,8 +24805,17 @@ static __exception int js_parse_template(JSParseState *s, int call, int *argc)
         seal_template_obj(ctx, template_object);
         *argc = depth + 1;
     } else {
-        emit_op(s, OP_call_method);
-        emit_u16(s, depth - 1);
+        ret = 0;
+        if (is_const) {
+            /* only constant parts: concatenate them at compile time */
+            ret = js_fold_template(s, pos);
+            if (ret < 0)
+                return -1;
+        }
+        if (!ret) {
+            emit_op(s, OP_call_method);
+            emit_u16(s, depth - 1);
+        }
     }
  done1:
     return next_token(s);
@@ -22593,6 +25139,167 @@ static int js_parse_skip_parens_token(JSParseState *s, int *pbits, BOOL no_line_
     return tok;
 }
 
+static int js_lazy_add_name(JSContext *ctx, JSFunctionDef *fd, JSAtom name)
+{
+    if (js_resize_array(ctx, (void **)&fd->lazy_names,
+                        sizeof(fd->lazy_names[0]),
+                        &fd->lazy_name_size, fd->lazy_name_count + 1))
+        return -1;
+    fd->lazy_names[fd->lazy_name_count++] = JS_DupAtom(ctx, name);
+    return 0;
+}
+
+/* Skip the body of a function whose compilation is deferred to its
+   first call. The current token is the first one after '{'. Only the
+   tokens and the nesting of the brackets and templates are checked.
+   The other syntax errors are reported when the function is
+   compiled. The identifiers are added to the lazy names of the
+   current function. Return 1 if the body is skipped (the current
+   token is then its closing '}') or 0 if it must be parsed. In this
+   case, the position is restored so that the parser reports the
+   errors at the right place. */
+static int js_parse_skip_body(JSParseState *s)
+{
+    JSContext *ctx = s->ctx;
+    JSFunctionDef *fd = s->cur_func;
+    /* '(' or '[', 'c' for the condition of a statement, '{' for a
+       block, 'o' for an object literal and '`' for a template
+       substitution */
+    char state[256];
+    size_t level;
+    JSParsePos pos;
+    int c, last_tok, tok_len, i;
+    BOOL regexp_allowed;
+
+    js_parse_get_pos(s, &pos);
+    level = 0;
+    state[level++] = '{';
+    last_tok = '{';
+    regexp_allowed = TRUE;
+    for (;;) {
+        switch(s->token.val) {
+        case '(':
+            if (last_tok == TOK_IF || last_tok == TOK_WHILE ||
+                last_tok == TOK_FOR || last_tok == TOK_WITH)
+                c = 'c';
+            else
+                c = '(';
+            goto push;
+        case '[':
+            c = '[';
+            goto push;
+        case '{':
+            /* an object literal is an expression */
+            c = '{';
+            if (regexp_allowed && last_tok != '{' && last_tok != '}' &&
+                last_tok != ';' && last_tok != ':' && last_tok != ')' &&
+                last_tok != TOK_ARROW && last_tok != TOK_ELSE &&
+                last_tok != TOK_DO && last_tok != TOK_TRY &&
+                last_tok != TOK_FINALLY)
+                c = 'o';
+        push:
+            if (level >= sizeof(state))
+                goto fail;
+            state[level++] = c;
+            break;
+        case ')':
+            c = state[--level];
+            if (c != '(' && c != 'c')
+                goto fail;
+            /* a statement may start after the condition */
+            regexp_allowed = (c == 'c');
+            goto next;
+        case ']':
+            if (state[--level] != '[')
+                goto fail;
+            break;
+        case '}':
+            c = state[--level];
+            if (c == '`') {
+                /* continue the parsing of the template */
+                free_token(s, &s->token);
+                s->got_lf = FALSE;
+                s->last_line_num = s->token.line_num;
+                if (js_parse_template_part(s, s->buf_ptr))
+                    goto fail;
+                goto handle_template;
+            }
+            if (c != '{' && c != 'o')
+                goto fail;
+            if (level == 0)
+                return 1; /* end of the function body */
+            /* a statement may start after a block */
+            regexp_allowed = (c == '{');
+            goto next;
+        case TOK_TEMPLATE:
+        handle_template:
+            if (s->token.u.str.sep != '`') {
+                /* '${' inside the template: the closing '}' continues
+                   the template */
+                if (level >= sizeof(state))
+                    goto fail;
+                state[level++] = '`';
+                regexp_allowed = TRUE;
+            } else {
+                regexp_allowed = FALSE;
+            }
+            last_tok = TOK_TEMPLATE;
+            goto next1;
+        case TOK_IDENT:
+            /* the property names are not variable references */
+            if (last_tok == '.' || last_tok == TOK_QUESTION_MARK_DOT)
+                break;
+            /* a direct eval may reference any variable */
+            if (s->token.u.ident.atom == JS_ATOM_eval)
+                goto fail;
+            if (s->token.u.ident.atom != JS_ATOM_arguments) {
+                if (js_lazy_add_name(ctx, fd, s->token.u.ident.atom))
+                    goto fail;
+            }
+            break;
+        case TOK_PRIVATE_NAME:
+            /* the private names are resolved in the class scope */
+            goto fail;
+        case TOK_EOF:
+            goto fail;
+        case TOK_DIV_ASSIGN:
+            tok_len = 2;
+            goto parse_regexp;
+        case '/':
+            tok_len = 1;
+        parse_regexp:
+            if (regexp_allowed) {
+                s->buf_ptr -= tok_len;
+                if (js_parse_regexp(s))
+                    goto fail;
+            }
+            break;
+        }
+        regexp_allowed = is_regexp_allowed(s->token.val);
+        if (s->token.val == TOK_IDENT &&
+            (token_is_pseudo_keyword(s, JS_ATOM_of) ||
+             token_is_pseudo_keyword(s, JS_ATOM_yield)))
+            regexp_allowed = TRUE;
+    next:
+        last_tok = s->token.val;
+    next1:
+        if (next_token(s))
+            goto fail;
+    }
+ fail:
+    /* the errors are reported by the parser */
+    JS_FreeValue(ctx, JS_GetException(ctx));
+    for(i = 0; i < fd->lazy_name_count; i++)
+        JS_FreeAtom(ctx, fd->lazy_names[i]);
+    js_free(ctx, fd->lazy_names);
+    fd->lazy_names = NULL;
+    fd->lazy_name_count = 0;
+    fd->lazy_name_size = 0;
+    if (js_parse_seek_token(s, &pos))
+        return -1;
+    return 0;
+}
+
 static void set_object_name(JSParseState *s, JSAtom name)
 {
     JSFunctionDef *fd = s->cur_func;
@@ -23431,6 +26138,7 @@ static __exception int js_parse_array_literal(JSParseState *s)
             emit_u32(s, idx);
             emit_op(s, OP_put_field);
             emit_atom(s, JS_ATOM_length);
+            emit_ic(s);
         }
         goto done;
     }
@@ -23495,6 +26203,7 @@ static __exception int js_parse_array_literal(JSParseState *s)
         emit_op(s, OP_dup1);    /* array length - array array length */
         emit_op(s, OP_put_field);
         emit_atom(s, JS_ATOM_length);
+        emit_ic(s);
     } else {
         emit_op(s, OP_drop);    /* array length - array */
     }
@@ -23595,6 +26304,7 @@ static __exception int get_lvalue(JSParseState *s, int *popcode, int *pscope,
         case OP_get_field:
             emit_op(s, OP_get_field2);
             emit_atom(s, name);
+            emit_ic(s);
             break;
         case OP_scope_get_private_field:
             emit_op(s, OP_scope_get_private_field2);
@@ -23687,6 +26397,9 @@ static void put_lvalue(JSParseState *s, int opcode, int scope,
         /* depth = 2 */
         if (opcode == OP_get_ref_value) {
             JS_FreeAtom(s->ctx, name);
+            /* room for the global variable store, see
+               optimize_scope_make_global_ref() */
+            emit_op(s, OP_nop);
             emit_label(s, label);
         }
         switch(special) {
@@ -23742,6 +26455,7 @@ static void put_lvalue(JSParseState *s, int opcode, int scope,
     case OP_get_field:
         emit_op(s, OP_put_field);
         emit_u32(s, name);  /* name has refcount */
+        emit_ic(s);
         break;
     case OP_scope_get_private_field:
         emit_op(s, OP_scope_put_private_field);
@@ -24003,6 +26717,7 @@ static int js_parse_destructuring_element(JSParseState *s, int tok, int is_arg,
                         /* get the named property from the source object */
                         emit_op(s, OP_get_field2);
                         emit_u32(s, prop_name);
+                        emit_ic(s);
                     }
                     if (js_parse_destructuring_element(s, tok, is_arg, TRUE, -1, TRUE) < 0)
                         return -1;
@@ -24092,6 +26807,7 @@ static int js_parse_destructuring_element(JSParseState *s, int tok, int is_arg,
                     /* source -- val */
                     emit_op(s, OP_get_field);
                     emit_u32(s, prop_name);
+                    emit_ic(s);
                 }
             } else {
                 /* prop_type = PROP_TYPE_VAR, cannot be a computed property */
@@ -24123,6 +26839,7 @@ static int js_parse_destructuring_element(JSParseState *s, int tok, int is_arg,
                 /* source -- source val */
                 emit_op(s, OP_get_field2);
                 emit_u32(s, prop_name);
+                emit_ic(s);
             }
         set_val:
             if (tok) {
@@ -24759,13 +27476,37 @@ static __exception int js_parse_postfix_expr(JSParseState *s, int parse_flags)
                     return -1;
             }
             if (s->token.val == TOK_ELLIPSIS) {
-                emit_op(s, OP_array_from);
-                emit_u16(s, arg_count);
-                emit_op(s, OP_push_i32);
-                emit_u32(s, arg_count);
+                int apply_opcode = OP_apply;
+
+                if (arg_count == 0 && opcode != OP_eval) {
+                    /* f(...a): the iterable is passed to OP_apply_spread
+                       which avoids building the argument array */
+                    if (next_token(s))
+                        return -1;
+                    if (js_parse_assign_expr(s))
+                        return -1;
+                    if (s->token.val == ')') {
+                        apply_opcode = OP_apply_spread;
+                    } else {
+                        emit_op(s, OP_array_from);
+                        emit_u16(s, 0);
+                        emit_op(s, OP_push_i32);
+                        emit_u32(s, 0);
+                        /* val array idx -> array idx val */
+                        emit_op(s, OP_rot3l);
+                        emit_op(s, OP_append);
+                        if (js_parse_expect(s, ','))
+                            return -1;
+                    }
+                } else {
+                    emit_op(s, OP_array_from);
+                    emit_u16(s, arg_count);
+                    emit_op(s, OP_push_i32);
+                    emit_u32(s, arg_count);
+                }
 
                 /* on stack: array idx */
-                while (s->token.val != ')') {
+                while (apply_opcode == OP_apply && s->token.val != ')') {
                     if (s->token.val == TOK_ELLIPSIS) {
                         if (next_token(s))
                             return -1;
@@ -24815,7 +27556,8 @@ static __exception int js_parse_postfix_expr(JSParseState *s, int parse_flags)
                 if (next_token(s))
                     return -1;
                 /* drop the index */
-                emit_op(s, OP_drop);
+                if (apply_opcode == OP_apply)
+                    emit_op(s, OP_drop);
 
                 /* apply function call */
                 switch(opcode) {
@@ -24825,7 +27567,7 @@ static __exception int js_parse_postfix_expr(JSParseState *s, int parse_flags)
                 case OP_scope_get_ref:
                     /* obj func array -> func obj array */
                     emit_op(s, OP_perm3);
-                    emit_op(s, OP_apply);
+                    emit_op(s, apply_opcode);
                     emit_u16(s, call_type == FUNC_CALL_NEW);
                     break;
                 case OP_eval:
@@ -24835,7 +27577,7 @@ static __exception int js_parse_postfix_expr(JSParseState *s, int parse_flags)
                     break;
                 default:
                     if (call_type == FUNC_CALL_SUPER_CTOR) {
-                        emit_op(s, OP_apply);
+                        emit_op(s, apply_opcode);
                         emit_u16(s, 1);
                         /* set the 'this' value */
                         emit_op(s, OP_dup);
@@ -24847,13 +27589,13 @@ static __exception int js_parse_postfix_expr(JSParseState *s, int parse_flags)
                     } else if (call_type == FUNC_CALL_NEW) {
                         /* obj func array -> func obj array */
                         emit_op(s, OP_perm3);
-                        emit_op(s, OP_apply);
+                        emit_op(s, apply_opcode);
                         emit_u16(s, 1);
                     } else {
                         /* func array -> func undef array */
                         emit_op(s, OP_undefined);
                         emit_op(s, OP_swap);
-                        emit_op(s, OP_apply);
+                        emit_op(s, apply_opcode);
                         emit_u16(s, 0);
                     }
                     break;
@@ -24933,6 +27675,7 @@ static __exception int js_parse_postfix_expr(JSParseState *s, int parse_flags)
                     }
                     emit_op(s, OP_get_field);
                     emit_atom(s, s->token.u.ident.atom);
+                    emit_ic(s);
                 }
             }
             if (next_token(s))
@@ -25028,8 +27771,9 @@ static __exception int js_parse_delete(JSParseState *s)
 /* allowed parse_flags: PF_ARROW_FUNC, PF_POW_ALLOWED, PF_POW_FORBIDDEN */
 static __exception int js_parse_unary(JSParseState *s, int parse_flags)
 {
-    int op;
+    int op, pos, ret;
 
+    pos = s->cur_func->byte_code.size;
     switch(s->token.val) {
     case '+':
     case '-':
@@ -25043,17 +27787,18 @@ static __exception int js_parse_unary(JSParseState *s, int parse_flags)
             return -1;
         switch(op) {
         case '-':
-            emit_op(s, OP_neg);
-            break;
         case '+':
-            emit_op(s, OP_plus);
+        case '~':
+            op = (op == '-') ? OP_neg : (op == '+') ? OP_plus : OP_not;
+            ret = js_fold_constants(s, op, pos, -1);
+            if (ret < 0)
+                return -1;
+            if (!ret)
+                emit_op(s, op);
             break;
         case '!':
             emit_op(s, OP_lnot);
             break;
-        case '~':
-            emit_op(s, OP_not);
-            break;
         case TOK_VOID:
             emit_op(s, OP_drop);
             emit_op(s, OP_undefined);
@@ -25134,6 +27879,7 @@ static __exception int js_parse_unary(JSParseState *s, int parse_flags)
         break;
     }
     if (parse_flags & (PF_POW_ALLOWED | PF_POW_FORBIDDEN)) {
+        int pos1;
 #ifdef CONFIG_BIGNUM
         if (s->token.val == TOK_POW || s->token.val == TOK_MATH_POW) {
             /* Extended exponentiation syntax rules: we extend the ES7
@@ -25147,9 +27893,14 @@ static __exception int js_parse_unary(JSParseState *s, int parse_flags)
             }
             if (next_token(s))
                 return -1;
+            pos1 = s->cur_func->byte_code.size;
             if (js_parse_unary(s, PF_POW_ALLOWED))
                 return -1;
-            emit_op(s, OP_pow);
+            ret = js_fold_constants(s, OP_pow, pos, pos1);
+            if (ret < 0)
+                return -1;
+            if (!ret)
+                emit_op(s, OP_pow);
         }
 #else
         if (s->token.val == TOK_POW) {
@@ -25164,9 +27915,14 @@ static __exception int js_parse_unary(JSParseState *s, int parse_flags)
             }
             if (next_token(s))
                 return -1;
+            pos1 = s->cur_func->byte_code.size;
             if (js_parse_unary(s, PF_POW_ALLOWED))
                 return -1;
-            emit_op(s, OP_pow);
+            ret = js_fold_constants(s, OP_pow, pos, pos1);
+            if (ret < 0)
+                return -1;
+            if (!ret)
+                emit_op(s, OP_pow);
         }
 #endif
     }
@@ -25177,12 +27933,13 @@ static __exception int js_parse_unary(JSParseState *s, int parse_flags)
 static __exception int js_parse_expr_binary(JSParseState *s, int level,
                                             int parse_flags)
 {
-    int op, opcode;
+    int op, opcode, pos, pos1, ret;
 
     if (level == 0) {
         return js_parse_unary(s, (parse_flags & PF_ARROW_FUNC) |
                               PF_POW_ALLOWED);
     }
+    pos = s->cur_func->byte_code.size;
     if (js_parse_expr_binary(s, level - 1, parse_flags))
         return -1;
     for(;;) {
@@ -25313,9 +28070,14 @@ static __exception int js_parse_expr_binary(JSParseState *s, int level,
         }
         if (next_token(s))
             return -1;
+        pos1 = s->cur_func->byte_code.size;
         if (js_parse_expr_binary(s, level - 1, parse_flags & ~PF_ARROW_FUNC))
             return -1;
-        emit_op(s, opcode);
+        ret = js_fold_constants(s, opcode, pos, pos1);
+        if (ret < 0)
+            return -1;
+        if (!ret)
+            emit_op(s, opcode);
     }
     return 0;
 }
@@ -25478,12 +28240,14 @@ static __exception int js_parse_assign_expr2(JSParseState *s, int parse_flags)
             emit_op(s, OP_iterator_check_object);
             emit_op(s, OP_get_field2);
             emit_atom(s, JS_ATOM_done);
+            emit_ic(s);
             label_next = emit_goto(s, OP_if_true, -1); /* end of loop */
             emit_label(s, label_yield);
             if (is_async) {
                 /* OP_async_yield_star takes the value as parameter */
                 emit_op(s, OP_get_field);
                 emit_atom(s, JS_ATOM_value);
+                emit_ic(s);
                 emit_op(s, OP_await);
                 emit_op(s, OP_async_yield_star);
             } else {
@@ -25512,10 +28276,12 @@ static __exception int js_parse_assign_expr2(JSParseState *s, int parse_flags)
             emit_op(s, OP_iterator_check_object);
             emit_op(s, OP_get_field2);
             emit_atom(s, JS_ATOM_done);
+            emit_ic(s);
             emit_goto(s, OP_if_false, label_yield);
 
             emit_op(s, OP_get_field);
             emit_atom(s, JS_ATOM_value);
+            emit_ic(s);
             
             emit_label(s, label_return1);
             emit_op(s, OP_nip);
@@ -25533,6 +28299,7 @@ static __exception int js_parse_assign_expr2(JSParseState *s, int parse_flags)
             emit_op(s, OP_iterator_check_object);
             emit_op(s, OP_get_field2);
             emit_atom(s, JS_ATOM_done);
+            emit_ic(s);
             emit_goto(s, OP_if_false, label_yield);
             emit_goto(s, OP_goto, label_next);
             /* close the iterator and throw a type error exception */
@@ -25551,6 +28318,7 @@ static __exception int js_parse_assign_expr2(JSParseState *s, int parse_flags)
             emit_label(s, label_next);
             emit_op(s, OP_get_field);
             emit_atom(s, JS_ATOM_value);
+            emit_ic(s);
             emit_op(s, OP_nip); /* keep the value associated with
                                    done = true */
             emit_op(s, OP_nip);
@@ -25802,6 +28570,7 @@ static void emit_return(JSParseState *s, BOOL hasval)
                 emit_op(s, OP_drop); /* next */
                 emit_op(s, OP_get_field2);
                 emit_atom(s, JS_ATOM_return);
+                emit_ic(s);
                 /* stack: iter_obj return_func */
                 emit_op(s, OP_dup);
                 emit_op(s, OP_is_undefined_or_null);
@@ -27845,7 +30614,7 @@ static int js_resolve_module(JSContext *ctx, JSModuleDef *m)
 static JSVarRef *js_create_module_var(JSContext *ctx, BOOL is_lexical)
 {
     JSVarRef *var_ref;
-    var_ref = js_malloc(ctx, sizeof(JSVarRef));
+    var_ref = js_slab_malloc(ctx, sizeof(JSVarRef));
     if (!var_ref)
         return NULL;
     var_ref->header.ref_count = 1;
@@ -28736,6 +31505,7 @@ static JSFunctionDef *js_new_function_def(JSContext *ctx,
         list_add_tail(&fd->link, &parent->child_list);
         fd->js_mode = parent->js_mode;
         fd->parent_scope_level = parent->scope_level;
+        fd->lazy_compile = parent->lazy_compile;
     }
 
     fd->is_eval = is_eval;
@@ -28862,6 +31632,10 @@ static void js_free_function_def(JSContext *ctx, JSFunctionDef *fd)
 
     js_free(ctx, fd->source);
 
+    for(i = 0; i < fd->lazy_name_count; i++)
+        JS_FreeAtom(ctx, fd->lazy_names[i]);
+    js_free(ctx, fd->lazy_names);
+
     if (fd->parent) {
         /* remove in parent list */
         list_del(&fd->link);
@@ -28927,6 +31701,10 @@ static void dump_byte_code(JSContext *ctx, int pass,
                 pos++;
                 addr = (int16_t)get_u16(tab + pos);
                 goto has_addr;
+            case OP_FMT_loc8_label8:
+                pos += 2;
+                addr = (int8_t)tab[pos];
+                goto has_addr;
 #endif
             case OP_FMT_atom_label_u8:
             case OP_FMT_atom_label_u16:
@@ -29117,6 +31895,16 @@ static void dump_byte_code(JSContext *ctx, int pass,
         case OP_FMT_none_loc:
             idx = (op - OP_get_loc0) % 4;
             goto has_loc;
+#if SHORT_OPCODES
+        case OP_FMT_loc8_label8:
+            idx = get_u8(tab + pos);
+            printf(" %d: ", idx);
+            if (idx < var_count) {
+                print_atom(ctx, vars[idx].var_name);
+            }
+            printf(",%u", get_i8(tab + pos + 1) + pos + 1);
+            break;
+#endif
         case OP_FMT_loc8:
             idx = get_u8(tab + pos);
             goto has_loc;
@@ -29461,14 +32249,15 @@ static int optimize_scope_make_global_ref(JSContext *ctx, JSFunctionDef *s,
     if (bc_buf[pos_next] == OP_get_ref_value) {
         dbuf_putc(bc, OP_get_var);
         dbuf_put_u32(bc, JS_DupAtom(ctx, var_name));
+        dbuf_put_u16(bc, 0);
         pos_next++;
     }
     /* remove the OP_label to make room for replacement */
     /* label should have a refcount of 0 anyway */
     /* XXX: should have emitted several OP_nop to avoid this kludge */
     label_pos = ls->pos;
-    pos = label_pos - 5;
-    assert(bc_buf[pos] == OP_label);
+    pos = label_pos - 6;
+    assert(bc_buf[pos] == OP_nop && bc_buf[pos + 1] == OP_label);
     end_pos = label_pos + 2;
     op = bc_buf[label_pos];
     if (is_strict) {
@@ -29500,7 +32289,8 @@ static int optimize_scope_make_global_ref(JSContext *ctx, JSFunctionDef *s,
         /* XXX: need 2 extra OP_drop if destructuring an array */
     }
     put_u32(bc_buf + pos + 1, JS_DupAtom(ctx, var_name));
-    pos += 5;
+    put_u16(bc_buf + pos + 5, 0);
+    pos += 7;
     /* pad with OP_nop */
     while (pos < end_pos)
         bc_buf[pos++] = OP_nop;
@@ -29982,16 +32772,19 @@ static int resolve_scope_var(JSContext *ctx, JSFunctionDef *s,
         dbuf_putc(bc, OP_undefined);
         dbuf_putc(bc, OP_get_var);
         dbuf_put_u32(bc, JS_DupAtom(ctx, var_name));
+        dbuf_put_u16(bc, 0);
         break;
     case OP_scope_get_var_undef:
     case OP_scope_get_var:
     case OP_scope_put_var:
         dbuf_putc(bc, OP_get_var_undef + (op - OP_scope_get_var_undef));
         dbuf_put_u32(bc, JS_DupAtom(ctx, var_name));
+        dbuf_put_u16(bc, 0);
         break;
     case OP_scope_put_var_init:
         dbuf_putc(bc, OP_put_var_init);
         dbuf_put_u32(bc, JS_DupAtom(ctx, var_name));
+        dbuf_put_u16(bc, 0);
         break;
     case OP_scope_delete_var:
         dbuf_putc(bc, OP_delete_var);
@@ -30686,6 +33479,7 @@ static void instantiate_hoisted_definitions(JSContext *ctx, JSFunctionDef *s, Dy
                 /* XXX: Check if variable is writable and enumerable */
                 dbuf_putc(bc, OP_put_var);
                 dbuf_put_u32(bc, JS_DupAtom(ctx, hf->var_name));
+                dbuf_put_u16(bc, 0);
             }
         }
     done_global_var:
@@ -31130,6 +33924,396 @@ static __exception int resolve_variables(JSContext *ctx, JSFunctionDef *s)
     return -1;
 }
 
+#define LOCAL_VAR_READ_UNINIT  (1 << 0) /* may be read before being written */
+#define LOCAL_VAR_NO_SHARE     (1 << 1) /* the stack slot cannot be shared */
+#define LOCAL_VAR_HAS_UNINIT   (1 << 2) /* set_loc_uninitialized is used */
+#define LOCAL_VAR_DROP_UNINIT  (1 << 3) /* set_loc_uninitialized is useless */
+
+/* limit the size of the label states of the initialization analysis */
+#define LOCAL_VAR_FLOW_MAX     (1 << 20)
+
+/* Local variable optimizations done on the phase 2 byte code:
+   - the TDZ checks of a lexical variable are removed when it is
+     written on every path since its scope was entered,
+   - set_loc_uninitialized is removed when no read of the variable
+     can see it,
+   - the non captured variables of disjoint block scopes share the
+     same stack slot (only for variables of the same name if the
+     debug info is kept, so that the error messages are unchanged).
+   The set of the initialized variables is computed with a forward
+   data flow analysis. Labels are the only jump targets at this
+   stage. The exception handlers and the finally blocks are
+   conservatively assumed to be entered with no initialized
+   variable. */
+static __exception int optimize_local_vars(JSContext *ctx, JSFunctionDef *s)
+{
+    int pos, pos_next, bc_len, op, len, idx, i, scope, ret, label;
+    int var_count, new_count, slot_count, drop_count, words;
+    BOOL reachable, changed, rewrite;
+    uint8_t *bc_buf, *var_flags;
+    uint32_t *label_state, *cur, *st;
+    int *label_refs, *var_map, *new_idx, *scope_end, *slot_var, *slot_end;
+    JSVarDef *vd;
+    DynBuf bc_out;
+
+    var_count = s->var_count;
+    if (s->has_eval_call || var_count == 0)
+        return 0;
+
+    ret = -1;
+    words = (var_count + 31) >> 5;
+    label_state = NULL;
+    label_refs = NULL;
+    var_flags = js_mallocz(ctx, var_count * sizeof(var_flags[0]));
+    var_map = js_malloc(ctx, var_count * sizeof(var_map[0]));
+    new_idx = js_malloc(ctx, var_count * sizeof(new_idx[0]));
+    slot_var = js_malloc(ctx, var_count * sizeof(slot_var[0]));
+    slot_end = js_malloc(ctx, var_count * sizeof(slot_end[0]));
+    scope_end = js_malloc(ctx, s->scope_count * sizeof(scope_end[0]));
+    cur = js_malloc(ctx, words * sizeof(cur[0]));
+    if (!var_flags || !var_map || !new_idx || !slot_var || !slot_end ||
+        !scope_end || !cur)
+        goto done;
+    if (s->label_count > 0 &&
+        (int64_t)s->label_count * words <= LOCAL_VAR_FLOW_MAX) {
+        label_state = js_malloc(ctx, s->label_count * words *
+                                sizeof(label_state[0]));
+        label_refs = js_mallocz(ctx, s->label_count * sizeof(label_refs[0]));
+        if (!label_state || !label_refs)
+            goto done;
+        memset(label_state, 0xff, s->label_count * words *
+               sizeof(label_state[0]));
+    }
+
+    bc_buf = s->byte_code.buf;
+    bc_len = s->byte_code.size;
+    for (pos = 0; pos < bc_len; pos = pos_next) {
+        op = bc_buf[pos];
+        pos_next = pos + opcode_info[op].size;
+        switch(opcode_info[op].fmt) {
+        case OP_FMT_label:
+            if (op != OP_label && label_refs) {
+                label = get_u32(bc_buf + pos + 1);
+                label_refs[label]++;
+                if (op == OP_catch || op == OP_gosub)
+                    label_refs[label] = INT32_MIN;
+            }
+            break;
+        case OP_FMT_atom_label_u8:
+            if (label_refs)
+                label_refs[get_u32(bc_buf + pos + 5)]++;
+            break;
+        case OP_FMT_loc8:
+        case OP_FMT_none_loc:
+        case OP_FMT_loc8_label8:
+        case OP_FMT_label8:
+        case OP_FMT_label16:
+        case OP_FMT_label_u16:
+        case OP_FMT_atom_label_u16:
+            /* not expected at this stage */
+            ret = 0;
+            goto done;
+        default:
+            break;
+        }
+    }
+    if (label_state) {
+        /* the labels with unknown predecessors start with no
+           initialized variable */
+        for (label = 0; label < s->label_count; label++) {
+            if (label_refs[label] != s->label_slots[label].ref_count)
+                memset(label_state + label * words, 0, words * sizeof(cur[0]));
+        }
+    }
+
+    /* iterate until the label states are stable, then remove the
+       redundant TDZ checks in a last pass */
+    rewrite = FALSE;
+    for (;;) {
+        changed = FALSE;
+        reachable = TRUE;
+        memset(cur, 0, words * sizeof(cur[0]));
+        for (pos = 0; pos < bc_len; pos = pos_next) {
+            op = bc_buf[pos];
+            len = opcode_info[op].size;
+            pos_next = pos + len;
+            switch(op) {
+            case OP_label:
+                if (!label_state) {
+                    memset(cur, 0, words * sizeof(cur[0]));
+                } else {
+                    st = label_state + get_u32(bc_buf + pos + 1) * words;
+                    for (i = 0; i < words; i++) {
+                        if (reachable)
+                            st[i] &= cur[i];
+                        cur[i] = st[i];
+                    }
+                }
+                reachable = TRUE;
+                break;
+            case OP_if_false:
+            case OP_if_true:
+            case OP_goto:
+            case OP_with_get_var:
+            case OP_with_put_var:
+            case OP_with_delete_var:
+            case OP_with_make_ref:
+            case OP_with_get_ref:
+            case OP_with_get_ref_undef:
+                if (label_state) {
+                    label = get_u32(bc_buf + pos + (op >= OP_with_get_var ? 5 : 1));
+                    st = label_state + label * words;
+                    for (i = 0; i < words; i++) {
+                        if (st[i] & ~cur[i]) {
+                            st[i] &= cur[i];
+                            /* backward jump: another pass is needed */
+                            if (s->label_slots[label].pos2 <= pos)
+                                changed = TRUE;
+                        }
+                    }
+                }
+                if (op == OP_goto)
+                    reachable = FALSE;
+                break;
+            case OP_gosub:
+                /* the finally block may be entered from several places */
+                memset(cur, 0, words * sizeof(cur[0]));
+                break;
+            case OP_return:
+            case OP_return_undef:
+            case OP_return_async:
+            case OP_throw:
+            case OP_throw_error:
+            case OP_ret:
+                reachable = FALSE;
+                break;
+            case OP_get_loc:
+                idx = get_u16(bc_buf + pos + 1);
+                if (rewrite && !(cur[idx >> 5] & (1U << (idx & 31))))
+                    var_flags[idx] |= LOCAL_VAR_READ_UNINIT;
+                break;
+            case OP_put_loc:
+            case OP_set_loc:
+                idx = get_u16(bc_buf + pos + 1);
+                cur[idx >> 5] |= 1U << (idx & 31);
+                break;
+            case OP_get_loc_check:
+            case OP_put_loc_check:
+                idx = get_u16(bc_buf + pos + 1);
+                if (rewrite) {
+                    if (cur[idx >> 5] & (1U << (idx & 31)))
+                        bc_buf[pos] = OP_get_loc + (op - OP_get_loc_check);
+                    else
+                        var_flags[idx] |= LOCAL_VAR_READ_UNINIT;
+                }
+                /* initialized if the check succeeds */
+                cur[idx >> 5] |= 1U << (idx & 31);
+                break;
+            case OP_put_loc_check_init:
+                idx = get_u16(bc_buf + pos + 1);
+                var_flags[idx] |= LOCAL_VAR_READ_UNINIT;
+                cur[idx >> 5] |= 1U << (idx & 31);
+                break;
+            case OP_set_loc_uninitialized:
+                idx = get_u16(bc_buf + pos + 1);
+                var_flags[idx] |= LOCAL_VAR_HAS_UNINIT;
+                cur[idx >> 5] &= ~(1U << (idx & 31));
+                break;
+            case OP_close_loc:
+                idx = get_u16(bc_buf + pos + 1);
+                var_flags[idx] |= LOCAL_VAR_READ_UNINIT | LOCAL_VAR_NO_SHARE;
+                break;
+            case OP_make_loc_ref:
+                idx = get_u16(bc_buf + pos + 5);
+                var_flags[idx] |= LOCAL_VAR_READ_UNINIT | LOCAL_VAR_NO_SHARE;
+                break;
+            default:
+                break;
+            }
+        }
+        if (rewrite)
+            break;
+        if (!changed)
+            rewrite = TRUE;
+    }
+
+    drop_count = 0;
+    for (i = 0; i < var_count; i++) {
+        if ((var_flags[i] & (LOCAL_VAR_HAS_UNINIT | LOCAL_VAR_READ_UNINIT)) ==
+            LOCAL_VAR_HAS_UNINIT && !s->vars[i].is_captured) {
+            var_flags[i] |= LOCAL_VAR_DROP_UNINIT;
+            drop_count++;
+        }
+    }
+
+    /* the scopes are numbered in preorder: the descendants of a
+       scope are in [scope + 1, scope_end[scope]] */
+    for (scope = 0; scope < s->scope_count; scope++)
+        scope_end[scope] = scope;
+    for (scope = s->scope_count - 1; scope > 0; scope--) {
+        int parent = s->scopes[scope].parent;
+        if (parent >= 0 && scope_end[scope] > scope_end[parent])
+            scope_end[parent] = scope_end[scope];
+    }
+
+    /* linear scan allocation of the block scoped variables. They are
+       reset each time their scope is entered. */
+    for (i = 0; i < var_count; i++)
+        var_map[i] = i;
+    slot_count = 0;
+    if (s->body_scope >= 0) {
+        for (scope = s->body_scope + 1; scope <= scope_end[s->body_scope];
+             scope++) {
+            for (idx = s->scopes[scope].first;
+                 idx >= 0 && s->vars[idx].scope_level == scope;
+                 idx = s->vars[idx].scope_next) {
+                vd = &s->vars[idx];
+                if (vd->is_captured || (var_flags[idx] & LOCAL_VAR_NO_SHARE))
+                    continue;
+                if (!(var_flags[idx] & LOCAL_VAR_HAS_UNINIT) &&
+                    vd->var_kind != JS_VAR_FUNCTION_DECL &&
+                    vd->var_kind != JS_VAR_NEW_FUNCTION_DECL)
+                    continue;
+                for (i = 0; i < slot_count; i++) {
+                    if (slot_end[i] < scope &&
+                        ((s->js_mode & JS_MODE_STRIP) ||
+                         s->vars[slot_var[i]].var_name == vd->var_name))
+                        break;
+                }
+                if (i == slot_count)
+                    slot_var[slot_count++] = idx;
+                else
+                    var_map[idx] = slot_var[i];
+                slot_end[i] = scope_end[scope];
+            }
+        }
+    }
+
+    new_count = 0;
+    for (i = 0; i < var_count; i++) {
+        if (var_map[i] == i)
+            new_idx[i] = new_count++;
+    }
+    for (i = 0; i < var_count; i++) {
+        if (var_map[i] != i)
+            new_idx[i] = new_idx[var_map[i]];
+    }
+
+    if (new_count == var_count && drop_count == 0) {
+        ret = 0;
+        goto done;
+    }
+
+    /* rewrite the byte code with the new variable indexes */
+    js_dbuf_init(ctx, &bc_out);
+    for (pos = 0; pos < bc_len; pos = pos_next) {
+        op = bc_buf[pos];
+        len = opcode_info[op].size;
+        pos_next = pos + len;
+        switch(op) {
+        case OP_label:
+            label = get_u32(bc_buf + pos + 1);
+            s->label_slots[label].pos2 = bc_out.size + len;
+            dbuf_put(&bc_out, bc_buf + pos, len);
+            break;
+        case OP_set_loc_uninitialized:
+            idx = get_u16(bc_buf + pos + 1);
+            if (var_flags[idx] & LOCAL_VAR_DROP_UNINIT)
+                break;
+            goto remap_loc;
+        case OP_make_loc_ref:
+            dbuf_put(&bc_out, bc_buf + pos, len);
+            idx = get_u16(bc_buf + pos + 5);
+            put_u16(bc_out.buf + bc_out.size - 2, new_idx[idx]);
+            break;
+        default:
+            if (opcode_info[op].fmt == OP_FMT_loc) {
+            remap_loc:
+                dbuf_put(&bc_out, bc_buf + pos, len);
+                idx = get_u16(bc_buf + pos + 1);
+                put_u16(bc_out.buf + bc_out.size - 2, new_idx[idx]);
+            } else {
+                dbuf_put(&bc_out, bc_buf + pos, len);
+            }
+            break;
+        }
+    }
+    if (dbuf_error(&bc_out)) {
+        dbuf_free(&bc_out);
+        JS_ThrowOutOfMemory(ctx);
+        goto done;
+    }
+    dbuf_free(&s->byte_code);
+    s->byte_code = bc_out;
+
+    if (new_count < var_count) {
+        /* remove the merged variables from the scope chains */
+        for (scope = 0; scope < s->scope_count; scope++) {
+            idx = s->scopes[scope].first;
+            while (idx >= 0 && var_map[idx] != idx)
+                idx = s->vars[idx].scope_next;
+            s->scopes[scope].first = idx < 0 ? idx : new_idx[idx];
+        }
+        /* only the scope_next of the merged variables is read */
+        for (i = 0; i < var_count; i++) {
+            if (var_map[i] != i)
+                continue;
+            vd = &s->vars[i];
+            idx = vd->scope_next;
+            while (idx >= 0 && var_map[idx] != idx)
+                idx = s->vars[idx].scope_next;
+            vd->scope_next = idx < 0 ? idx : new_idx[idx];
+        }
+        for (i = 0; i < var_count; i++) {
+            vd = &s->vars[i];
+            if (var_map[i] != i)
+                JS_FreeAtom(ctx, vd->var_name);
+            else
+                s->vars[new_idx[i]] = *vd;
+        }
+        s->var_count = new_count;
+
+#define REMAP_VAR_IDX(v) do { if ((v) >= 0) (v) = new_idx[v]; } while (0)
+        REMAP_VAR_IDX(s->var_object_idx);
+        REMAP_VAR_IDX(s->arg_var_object_idx);
+        REMAP_VAR_IDX(s->arguments_var_idx);
+        REMAP_VAR_IDX(s->arguments_arg_idx);
+        REMAP_VAR_IDX(s->func_var_idx);
+        REMAP_VAR_IDX(s->eval_ret_idx);
+        REMAP_VAR_IDX(s->this_var_idx);
+        REMAP_VAR_IDX(s->new_target_var_idx);
+        REMAP_VAR_IDX(s->this_active_func_var_idx);
+        REMAP_VAR_IDX(s->home_object_var_idx);
+#undef REMAP_VAR_IDX
+
+        /* the child functions reference the captured variables */
+        for (i = 0; i < s->cpool_count; i++) {
+            JSFunctionBytecode *b;
+            int j;
+            if (JS_VALUE_GET_TAG(s->cpool[i]) != JS_TAG_FUNCTION_BYTECODE)
+                continue;
+            b = JS_VALUE_GET_PTR(s->cpool[i]);
+            for (j = 0; j < b->closure_var_count; j++) {
+                JSClosureVar *cv = &b->closure_var[j];
+                if (cv->is_local && !cv->is_arg)
+                    cv->var_idx = new_idx[cv->var_idx];
+            }
+        }
+    }
+    ret = 0;
+ done:
+    js_free(ctx, label_state);
+    js_free(ctx, label_refs);
+    js_free(ctx, cur);
+    js_free(ctx, var_flags);
+    js_free(ctx, var_map);
+    js_free(ctx, new_idx);
+    js_free(ctx, slot_var);
+    js_free(ctx, slot_end);
+    js_free(ctx, scope_end);
+    return ret;
+}
+
 /* the pc2line table gives a line number for each PC value */
 static void add_pc2line_info(JSFunctionDef *s, uint32_t pc, int line_num)
 {
@@ -31264,6 +34448,30 @@ static int find_jump_target(JSFunctionDef *s, int label, int *pop, int *pline)
     return label;
 }
 
+/* return TRUE if the code at 'pos' directly returns the value on
+   the top of the stack, possibly after some jumps */
+static BOOL code_is_return(JSFunctionDef *s, int pos)
+{
+    int i;
+
+    for (i = 0; i < 20 && pos < s->byte_code.size; i++) {
+        switch(s->byte_code.buf[pos]) {
+        case OP_line_num:
+        case OP_label:
+            pos += 5;
+            break;
+        case OP_goto:
+            pos = s->label_slots[get_u32(s->byte_code.buf + pos + 1)].pos2;
+            break;
+        case OP_return:
+            return TRUE;
+        default:
+            return FALSE;
+        }
+    }
+    return FALSE;
+}
+
 static void push_short_int(DynBuf *bc_out, int val)
 {
 #if SHORT_OPCODES
@@ -31498,6 +34706,13 @@ static __exception int resolve_labels(JSContext *ctx, JSFunctionDef *s)
                     pos_next = skip_dead_code(s, bc_buf, bc_len, cc.pos, &line_num);
                     break;
                 }
+                if (code_is_return(s, pos_next)) {
+                    /* call in a branch of a conditional expression */
+                    add_pc2line_info(s, bc_out.size, line_num);
+                    put_short_code(&bc_out, op + 1, argc);
+                    pos_next = skip_dead_code(s, bc_buf, bc_len, pos_next, &line_num);
+                    break;
+                }
                 add_pc2line_info(s, bc_out.size, line_num);
                 put_short_code(&bc_out, op, argc);
                 break;
@@ -31889,6 +35104,7 @@ static __exception int resolve_labels(JSContext *ctx, JSFunctionDef *s)
                     add_pc2line_info(s, bc_out.size, line_num);
                     dbuf_putc(&bc_out, cc.op);
                     dbuf_put_u32(&bc_out, cc.atom);
+                    dbuf_put_u16(&bc_out, cc.val);
                     pos_next = cc.pos;
                     break;
                 }
@@ -31938,9 +35154,36 @@ static __exception int resolve_labels(JSContext *ctx, JSFunctionDef *s)
                     code_match(&cc, pos_next, M2(OP_dec, OP_inc), OP_dup, OP_put_loc, idx, OP_drop, -1)) {
                     if (cc.line_num >= 0) line_num = cc.line_num;
                     add_pc2line_info(s, bc_out.size, line_num);
-                    dbuf_putc(&bc_out, (cc.op == OP_inc || cc.op == OP_post_inc) ? OP_inc_loc : OP_dec_loc);
-                    dbuf_putc(&bc_out, idx);
+                    op1 = (cc.op == OP_inc || cc.op == OP_post_inc) ? OP_inc_loc : OP_dec_loc;
                     pos_next = cc.pos;
+#if SHORT_OPCODES
+                    /* transformation:
+                       inc_loc(n) goto(l1) -> inc_loc_goto8(n, l1) if l1 is a close backward label
+                     */
+                    if (op1 == OP_inc_loc && code_match(&cc, pos_next, OP_goto, -1)) {
+                        int op2, diff;
+                        label = find_jump_target(s, cc.label, &op2, NULL);
+                        ls = &label_slots[label];
+                        diff = ls->addr - bc_out.size - 2;
+                        if (ls->addr != -1 && diff == (int8_t)diff) {
+                            jp = &s->jump_slots[s->jump_count++];
+                            jp->op = OP_inc_loc_goto8;
+                            jp->size = 1;
+                            jp->pos = bc_out.size + 2;
+                            jp->label = label;
+                            dbuf_putc(&bc_out, OP_inc_loc_goto8);
+                            dbuf_putc(&bc_out, idx);
+                            dbuf_putc(&bc_out, diff);
+                            pos_next = skip_dead_code(s, bc_buf, bc_len, cc.pos, &line_num);
+                            break;
+                        }
+                        /* the goto is emitted separately */
+                        update_label(s, cc.label, +1);
+                        update_label(s, label, -1);
+                    }
+#endif
+                    dbuf_putc(&bc_out, op1);
+                    dbuf_putc(&bc_out, idx);
                     break;
                 }
                 /* transformation:
@@ -32058,6 +35301,7 @@ static __exception int resolve_labels(JSContext *ctx, JSFunctionDef *s)
                     dbuf_putc(&bc_out, OP_dec + (op - OP_post_dec));
                     dbuf_putc(&bc_out, cc.op);
                     dbuf_put_u32(&bc_out, cc.atom);
+                    dbuf_put_u16(&bc_out, cc.val);
                     pos_next = cc.pos;
                     break;
                 }
@@ -32073,6 +35317,46 @@ static __exception int resolve_labels(JSContext *ctx, JSFunctionDef *s)
             goto no_change;
 
 #if SHORT_OPCODES
+        case OP_lt:
+        case OP_lte:
+        case OP_gt:
+        case OP_gte:
+            if (OPTIMIZE) {
+                /* transform lt if_false(l1) -> lt_if_false8(l1) if the jump is short */
+                if (code_match(&cc, pos_next, OP_if_false, -1)) {
+                    int diff;
+                    label = find_jump_target(s, cc.label, &op1, NULL);
+                    ls = &label_slots[label];
+                    if (ls->addr == -1)
+                        diff = ls->pos2 - pos - 1;
+                    else
+                        diff = ls->addr - bc_out.size - 1;
+                    if (diff == (int8_t)diff) {
+                        if (cc.line_num >= 0) line_num = cc.line_num;
+                        add_pc2line_info(s, bc_out.size, line_num);
+                        jp = &s->jump_slots[s->jump_count++];
+                        jp->op = OP_lt_if_false8 + (op - OP_lt);
+                        jp->size = 1;
+                        jp->pos = bc_out.size + 1;
+                        jp->label = label;
+                        dbuf_putc(&bc_out, OP_lt_if_false8 + (op - OP_lt));
+                        if (ls->addr == -1) {
+                            dbuf_putc(&bc_out, 0);
+                            if (!add_reloc(ctx, ls, bc_out.size - 1, 1))
+                                goto fail;
+                        } else {
+                            dbuf_putc(&bc_out, diff);
+                        }
+                        pos_next = cc.pos;
+                        break;
+                    }
+                    /* the if_false is optimized separately */
+                    update_label(s, cc.label, +1);
+                    update_label(s, label, -1);
+                }
+            }
+            goto no_change;
+
         case OP_typeof:
             if (OPTIMIZE) {
                 /* simplify typeof tests */
@@ -32207,6 +35491,32 @@ static __exception int resolve_labels(JSContext *ctx, JSFunctionDef *s)
 #endif
     js_free(ctx, s->label_slots);
     s->label_slots = NULL;
+
+    /* number the inline caches of the property and global variable
+       access opcodes */
+    s->ic_count = 0;
+    for (pos = 0; pos < bc_out.size; pos += short_opcode_info(op).size) {
+        op = bc_out.buf[pos];
+        switch(op) {
+        case OP_get_field:
+        case OP_get_field2:
+        case OP_put_field:
+        case OP_get_var_undef:
+        case OP_get_var:
+        case OP_put_var:
+        case OP_put_var_init:
+        case OP_put_var_strict:
+            if (s->ic_count < JS_IC_INDEX_NONE) {
+                put_u16(bc_out.buf + pos + 5, s->ic_count++);
+            } else {
+                put_u16(bc_out.buf + pos + 5, JS_IC_INDEX_NONE);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
     /* XXX: should delay until copying to runtime bytecode function */
     compute_pc2line_info(s);
     js_free(ctx, s->line_number_slots);
@@ -32364,10 +35674,18 @@ static __exception int compute_stack_size(JSContext *ctx,
             break;
         case OP_if_true8:
         case OP_if_false8:
+        case OP_lt_if_false8:
+        case OP_lte_if_false8:
+        case OP_gt_if_false8:
+        case OP_gte_if_false8:
             diff = (int8_t)bc_buf[pos + 1];
             if (ss_check(ctx, s, pos + 1 + diff, op, stack_len))
                 goto fail;
             break;
+        case OP_inc_loc_goto8:
+            diff = (int8_t)bc_buf[pos + 2];
+            pos_next = pos + 2 + diff;
+            break;
 #endif
         case OP_if_true:
         case OP_if_false:
@@ -32455,6 +35773,289 @@ static int add_module_variables(JSContext *ctx, JSFunctionDef *fd)
 /* create a function object from a function definition. The function
    definition is freed. All the child functions are also created. It
    must be done this way to resolve all the variables. */
+/* return TRUE if 'fd' and its child functions contain no direct eval
+   and no private field access, so that their free variables only
+   depend on their names */
+static BOOL js_lazy_function_ok(JSFunctionDef *fd)
+{
+    struct list_head *el;
+    const uint8_t *bc_buf;
+    int pos, op;
+
+    if (fd->has_eval_call)
+        return FALSE;
+    bc_buf = fd->byte_code.buf;
+    for (pos = 0; pos < fd->byte_code.size; pos += opcode_info[op].size) {
+        op = bc_buf[pos];
+        if (op == OP_scope_get_private_field ||
+            op == OP_scope_get_private_field2 ||
+            op == OP_scope_put_private_field)
+            return FALSE;
+    }
+    list_for_each(el, &fd->child_list) {
+        if (!js_lazy_function_ok(list_entry(el, JSFunctionDef, link)))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+/* return TRUE if the body of 'fd' can be skipped by the parser and
+   compiled on the first call. Its parameters are already parsed. */
+static BOOL js_lazy_can_skip_body(JSFunctionDef *fd)
+{
+    JSFunctionDef *parent = fd->parent;
+
+    /* the function compiled by js_compile_lazy_function() is the
+       child of a direct eval function */
+    return parent && parent->lazy_compile &&
+        !(parent->is_eval && parent->eval_type == JS_EVAL_TYPE_DIRECT) &&
+        !(fd->js_mode & JS_MODE_STRIP) &&
+        fd->func_kind == JS_FUNC_NORMAL &&
+        (fd->func_type == JS_PARSE_FUNC_STATEMENT ||
+         fd->func_type == JS_PARSE_FUNC_VAR ||
+         fd->func_type == JS_PARSE_FUNC_EXPR) &&
+        fd->js_mode == parent->js_mode && js_lazy_function_ok(fd);
+}
+
+/* add to the lazy names of 's' the variables referenced by the
+   phase 1 byte code of 'fd' and of its child functions (the code of
+   the parameters of 's') */
+static int js_lazy_add_bytecode_names(JSContext *ctx, JSFunctionDef *s,
+                                      JSFunctionDef *fd)
+{
+    struct list_head *el;
+    const uint8_t *bc_buf;
+    int pos, op;
+    JSAtom var_name;
+
+    bc_buf = fd->byte_code.buf;
+    for (pos = 0; pos < fd->byte_code.size; pos += opcode_info[op].size) {
+        op = bc_buf[pos];
+        switch(op) {
+        case OP_scope_get_var_undef:
+        case OP_scope_get_var:
+        case OP_scope_put_var:
+        case OP_scope_delete_var:
+        case OP_scope_get_ref:
+        case OP_scope_put_var_init:
+        case OP_scope_make_ref:
+            var_name = get_u32(bc_buf + pos + 1);
+            /* the pseudo variables are always local to 's' */
+            if (var_name == JS_ATOM_home_object ||
+                var_name == JS_ATOM_this_active_func ||
+                var_name == JS_ATOM_new_target ||
+                var_name == JS_ATOM_this ||
+                var_name == JS_ATOM_arguments)
+                break;
+            if (js_lazy_add_name(ctx, s, var_name))
+                return -1;
+            break;
+        default:
+            break;
+        }
+    }
+    list_for_each(el, &fd->child_list) {
+        if (js_lazy_add_bytecode_names(ctx, s, list_entry(el, JSFunctionDef, link)))
+            return -1;
+    }
+    return 0;
+}
+
+static int js_lazy_name_cmp(const void *a, const void *b, void *opaque)
+{
+    JSAtom a1 = *(const JSAtom *)a, b1 = *(const JSAtom *)b;
+    return (a1 > b1) - (a1 < b1);
+}
+
+/* return TRUE if the lazy function 's' may reference 'var_name' in
+   the enclosing scopes. The with and eval variable objects are always
+   referenced. */
+static BOOL is_lazy_name(JSFunctionDef *s, JSAtom var_name)
+{
+    int lo, hi, mid;
+
+    if (var_name == JS_ATOM__with_ || var_name == JS_ATOM__var_ ||
+        var_name == JS_ATOM__arg_var_)
+        return TRUE;
+    lo = 0;
+    hi = s->lazy_name_count;
+    while (lo < hi) {
+        mid = (lo + hi) >> 1;
+        if (s->lazy_names[mid] == var_name)
+            return TRUE;
+        if (s->lazy_names[mid] < var_name)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return FALSE;
+}
+
+/* Create the closure variables of the lazy function 's'. As for a
+   direct eval (see add_eval_variables()), the variables of the
+   enclosing scopes are added ordered by scope, so that the function
+   compiled from the closure variables resolves the names in the same
+   way. Only the variables whose name is referenced are added. */
+static int add_lazy_closure_vars(JSContext *ctx, JSFunctionDef *s)
+{
+    JSFunctionDef *fd;
+    JSVarDef *vd;
+    int i, j, scope_level, scope_idx;
+    BOOL is_arg_scope;
+
+    /* sort the names and remove the duplicates and the local ones */
+    rqsort(s->lazy_names, s->lazy_name_count, sizeof(s->lazy_names[0]),
+           js_lazy_name_cmp, NULL);
+    j = 0;
+    for(i = 0; i < s->lazy_name_count; i++) {
+        JSAtom name = s->lazy_names[i];
+        if ((j > 0 && s->lazy_names[j - 1] == name) ||
+            find_arg(ctx, s, name) >= 0 ||
+            (s->is_func_expr && s->func_name == name)) {
+            JS_FreeAtom(ctx, name);
+        } else {
+            s->lazy_names[j++] = name;
+        }
+    }
+    s->lazy_name_count = j;
+
+    fd = s;
+    for(;;) {
+        scope_level = fd->parent_scope_level;
+        fd = fd->parent;
+        if (!fd)
+            break;
+        if (fd->is_func_expr && fd->func_name != JS_ATOM_NULL &&
+            is_lazy_name(s, fd->func_name)) {
+            if (add_func_var(ctx, fd, fd->func_name) < 0)
+                return -1;
+        }
+
+        /* add lexical variables */
+        scope_idx = fd->scopes[scope_level].first;
+        while (scope_idx >= 0) {
+            vd = &fd->vars[scope_idx];
+            if (is_lazy_name(s, vd->var_name)) {
+                vd->is_captured = 1;
+                if (get_closure_var(ctx, s, fd, FALSE, scope_idx,
+                                    vd->var_name, vd->is_const,
+                                    vd->is_lexical, vd->var_kind) < 0)
+                    return -1;
+            }
+            scope_idx = vd->scope_next;
+        }
+        is_arg_scope = (scope_idx == ARG_SCOPE_END);
+        if (!is_arg_scope) {
+            /* add unscoped variables */
+            for(i = 0; i < fd->arg_count; i++) {
+                vd = &fd->args[i];
+                if (vd->var_name != JS_ATOM_NULL &&
+                    is_lazy_name(s, vd->var_name)) {
+                    vd->is_captured = 1;
+                    if (get_closure_var(ctx, s, fd, TRUE, i, vd->var_name,
+                                        FALSE, FALSE, JS_VAR_NORMAL) < 0)
+                        return -1;
+                }
+            }
+        }
+        for(i = 0; i < fd->var_count; i++) {
+            vd = &fd->vars[i];
+            if (vd->scope_level == 0 &&
+                (is_arg_scope ? is_var_in_arg_scope(vd) :
+                 vd->var_name != JS_ATOM__ret_) &&
+                vd->var_name != JS_ATOM_NULL &&
+                is_lazy_name(s, vd->var_name)) {
+                vd->is_captured = 1;
+                if (get_closure_var(ctx, s, fd, FALSE, i, vd->var_name,
+                                    vd->is_const, vd->is_lexical,
+                                    vd->var_kind) < 0)
+                    return -1;
+            }
+        }
+        if (fd->is_eval) {
+            /* add direct eval variables (we are necessarily at the
+               top level) */
+            for (i = 0; i < fd->closure_var_count; i++) {
+                JSClosureVar *cv = &fd->closure_var[i];
+                if (is_lazy_name(s, cv->var_name)) {
+                    if (get_closure_var2(ctx, s, fd, FALSE, cv->is_arg,
+                                         i, cv->var_name, cv->is_const,
+                                         cv->is_lexical, cv->var_kind) < 0)
+                        return -1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+/* Replace 'fd', whose body was skipped, by a function stub containing
+   its source code and the closure variables it may reference. The
+   function is compiled from its source on its first call. Return
+   JS_UNDEFINED if 'fd' must be compiled now. */
+static JSValue js_create_lazy_function(JSContext *ctx, JSFunctionDef *fd)
+{
+    JSFunctionBytecode *b;
+    JSFunctionDef *fd1;
+    int function_size;
+
+    if (!fd->lazy_body_skipped)
+        return JS_UNDEFINED;
+
+    if (js_lazy_add_bytecode_names(ctx, fd, fd) ||
+        add_lazy_closure_vars(ctx, fd))
+        return JS_EXCEPTION;
+
+    function_size = sizeof(*b) + sizeof(*b->cpool) +
+        fd->closure_var_count * sizeof(*b->closure_var);
+    b = js_mallocz(ctx, function_size);
+    if (!b)
+        return JS_EXCEPTION;
+    b->header.ref_count = 1;
+    b->is_lazy = 1;
+    b->cpool = (void *)(b + 1);
+    b->cpool[0] = JS_NULL;
+    b->cpool_count = 1;
+    b->closure_var_count = fd->closure_var_count;
+    if (b->closure_var_count) {
+        b->closure_var = (void *)(b->cpool + 1);
+        memcpy(b->closure_var, fd->closure_var,
+               b->closure_var_count * sizeof(*b->closure_var));
+    }
+    fd->closure_var_count = 0;
+    b->func_name = fd->func_name;
+    fd->func_name = JS_ATOM_NULL;
+    b->defined_arg_count = fd->defined_arg_count;
+
+    b->has_debug = 1;
+    b->debug.filename = fd->filename;
+    fd->filename = JS_ATOM_NULL;
+    b->debug.line_num = fd->line_num;
+    b->debug.source = fd->source;
+    b->debug.source_len = fd->source_len;
+    fd->source = NULL;
+
+    b->has_prototype = fd->has_prototype;
+    b->has_simple_parameter_list = fd->has_simple_parameter_list;
+    b->js_mode = fd->js_mode;
+    b->func_kind = fd->func_kind;
+    b->new_target_allowed = fd->new_target_allowed;
+    b->super_call_allowed = fd->super_call_allowed;
+    b->super_allowed = fd->super_allowed;
+    b->arguments_allowed = fd->arguments_allowed;
+    b->backtrace_barrier = fd->backtrace_barrier;
+    b->lazy_is_func_expr = fd->is_func_expr;
+    for (fd1 = fd; fd1->parent; fd1 = fd1->parent)
+        continue;
+    b->lazy_is_module = (fd1->module != NULL);
+    b->realm = JS_DupContext(ctx);
+
+    add_gc_object(ctx->rt, &b->header, JS_GC_OBJ_TYPE_FUNCTION_BYTECODE);
+
+    js_free_function_def(ctx, fd);
+    return JS_MKPTR(JS_TAG_FUNCTION_BYTECODE, b);
+}
+
 static JSValue js_create_function(JSContext *ctx, JSFunctionDef *fd)
 {
     JSValue func_obj;
@@ -32490,6 +36091,12 @@ static JSValue js_create_function(JSContext *ctx, JSFunctionDef *fd)
         }
     }
 
+    func_obj = js_create_lazy_function(ctx, fd);
+    if (JS_IsException(func_obj))
+        goto fail;
+    if (!JS_IsUndefined(func_obj))
+        return func_obj;
+
     /* if the function contains an eval call, the closure variables
        are used to compile the eval and they must be ordered by scope,
        so it is necessary to create the closure variables before any
@@ -32533,6 +36140,9 @@ static JSValue js_create_function(JSContext *ctx, JSFunctionDef *fd)
     if (resolve_variables(ctx, fd))
         goto fail;
 
+    if (optimize_local_vars(ctx, fd))
+        goto fail;
+
 #if defined(DUMP_BYTECODE) && (DUMP_BYTECODE & 2)
     if (!(fd->js_mode & JS_MODE_STRIP)) {
         printf("pass 2\n");
@@ -32613,6 +36223,7 @@ static JSValue js_create_function(JSContext *ctx, JSFunctionDef *fd)
     fd->cpool = NULL;
 
     b->stack_size = stack_size;
+    b->ic_count = fd->ic_count;
 
     if (fd->js_mode & JS_MODE_STRIP) {
         JS_FreeAtom(ctx, fd->filename);
@@ -32691,6 +36302,22 @@ static void free_function_bytecode(JSRuntime *rt, JSFunctionBytecode *b)
                JS_AtomGetStrRT(rt, buf, sizeof(buf), b->func_name));
     }
 #endif
+#ifdef CONFIG_JIT
+    if (b->jit_code)
+        js_jit_free_code(rt, b->jit_code);
+#endif
+    if (b->parent) {
+        for(i = 0; i < b->cpool_count; i++)
+            JS_FreeValueRT(rt, b->cpool[i]);
+        js_free_rt(rt, b->cpool);
+        js_free_rt(rt, b->ic);
+        if (b->realm)
+            JS_FreeContext(b->realm);
+        if (!b->parent->is_shared)
+            JS_FreeValueRT(rt, JS_MKPTR(JS_TAG_FUNCTION_BYTECODE, b->parent));
+        goto done;
+    }
+
     free_bytecode_atoms(rt, b->byte_code_buf, b->byte_code_len, TRUE);
 
     if (b->vardefs) {
@@ -32705,16 +36332,19 @@ static void free_function_bytecode(JSRuntime *rt, JSFunctionBytecode *b)
         JSClosureVar *cv = &b->closure_var[i];
         JS_FreeAtomRT(rt, cv->var_name);
     }
+    js_free_rt(rt, b->ic);
     if (b->realm)
         JS_FreeContext(b->realm);
 
     JS_FreeAtomRT(rt, b->func_name);
     if (b->has_debug) {
         JS_FreeAtomRT(rt, b->debug.filename);
-        js_free_rt(rt, b->debug.pc2line_buf);
+        if (!b->read_only_bytecode)
+            js_free_rt(rt, b->debug.pc2line_buf);
         js_free_rt(rt, b->debug.source);
     }
 
+ done:
     remove_gc_object(&b->header);
     if (rt->gc_phase == JS_GC_PHASE_REMOVE_CYCLES && b->header.ref_count != 0) {
         list_add_tail(&b->header.link, &rt->gc_zero_ref_count_list);
@@ -33311,6 +36941,12 @@ static __exception int js_parse_function_decl2(JSParseState *s,
     if (js_parse_function_check_names(s, fd, func_name))
         goto fail;
 
+    if (js_lazy_can_skip_body(fd)) {
+        int ret = js_parse_skip_body(s);
+        if (ret < 0)
+            goto fail;
+        fd->lazy_body_skipped = ret;
+    }
     while (s->token.val != '}') {
         if (js_parse_source_element(s))
             goto fail;
@@ -33629,6 +37265,7 @@ static JSValue __JS_EvalInternal(JSContext *ctx, JSValueConst this_obj,
     fd->eval_type = eval_type;
     fd->has_this_binding = (eval_type != JS_EVAL_TYPE_DIRECT);
     fd->backtrace_barrier = ((flags & JS_EVAL_FLAG_BACKTRACE_BARRIER) != 0);
+    fd->lazy_compile = ((flags & JS_EVAL_FLAG_LAZY) != 0);
     if (eval_type == JS_EVAL_TYPE_DIRECT) {
         fd->new_target_allowed = b->new_target_allowed;
         fd->super_call_allowed = b->super_call_allowed;
@@ -33685,6 +37322,89 @@ static JSValue __JS_EvalInternal(JSContext *ctx, JSValueConst this_obj,
     return JS_EXCEPTION;
 }
 
+/* Compile the function stub 'lb' created by js_create_lazy_function().
+   Its source is parsed as a function expression inside a direct eval
+   function whose closure variables are the ones of the stub, so that
+   the closure variable indexes of the result refer to the stub
+   closure variables. */
+static JSValue js_compile_lazy_function(JSContext *ctx,
+                                        JSFunctionBytecode *lb)
+{
+    JSParseState s1, *s = &s1;
+    JSFunctionDef *fd, *fd1;
+    JSFunctionBytecode *b;
+    JSValue fun_obj, func_obj;
+    const char *filename;
+    int i, cpool_idx;
+
+    if (!JS_IsNull(lb->cpool[0]))
+        return JS_DupValue(ctx, lb->cpool[0]);
+
+    ctx = lb->realm;
+    filename = JS_AtomToCString(ctx, lb->debug.filename);
+    if (!filename)
+        return JS_EXCEPTION;
+    js_parse_init(ctx, s, lb->debug.source, lb->debug.source_len, filename);
+    s->line_num = lb->debug.line_num;
+    s->is_module = lb->lazy_is_module;
+    s->allow_html_comments = !s->is_module;
+
+    fd = js_new_function_def(ctx, NULL, TRUE, FALSE, filename,
+                             lb->debug.line_num);
+    if (!fd)
+        goto fail1;
+    s->cur_func = fd;
+    fd->eval_type = JS_EVAL_TYPE_DIRECT;
+    fd->js_mode = lb->js_mode;
+    fd->lazy_compile = TRUE;
+    fd->func_name = JS_DupAtom(ctx, JS_ATOM__eval_);
+    for(i = 0; i < lb->closure_var_count; i++) {
+        JSClosureVar *cv = &lb->closure_var[i];
+        if (add_closure_var(ctx, fd, FALSE, cv->is_arg, i, cv->var_name,
+                            cv->is_const, cv->is_lexical, cv->var_kind) < 0)
+            goto fail;
+    }
+    push_scope(s); /* body scope */
+    fd->body_scope = fd->scope_level;
+
+    if (next_token(s))
+        goto fail;
+    if (s->token.val != TOK_FUNCTION) {
+        js_parse_error(s, "function expected");
+        goto fail;
+    }
+    if (js_parse_function_decl2(s, JS_PARSE_FUNC_EXPR, JS_FUNC_NORMAL,
+                                JS_ATOM_NULL, s->token.ptr,
+                                s->token.line_num, JS_PARSE_EXPORT_NONE,
+                                &fd1))
+        goto fail;
+    /* the function name binding is the one of the original definition */
+    fd1->is_func_expr = lb->lazy_is_func_expr;
+    cpool_idx = fd1->parent_cpool_idx;
+    emit_op(s, OP_drop);
+    emit_op(s, OP_return_undef);
+
+    fun_obj = js_create_function(ctx, fd);
+    JS_FreeCString(ctx, filename);
+    if (JS_IsException(fun_obj))
+        return JS_EXCEPTION;
+    b = JS_VALUE_GET_PTR(fun_obj);
+    func_obj = JS_DupValue(ctx, b->cpool[cpool_idx]);
+    JS_FreeValue(ctx, fun_obj);
+
+    b = JS_VALUE_GET_PTR(func_obj);
+    if (b->func_name == JS_ATOM_NULL)
+        b->func_name = JS_DupAtom(ctx, lb->func_name);
+    lb->cpool[0] = JS_DupValue(ctx, func_obj);
+    return func_obj;
+ fail:
+    free_token(s, &s->token);
+    js_free_function_def(ctx, fd);
+ fail1:
+    JS_FreeCString(ctx, filename);
+    return JS_EXCEPTION;
+}
+
 /* the indirection is needed to make 'eval' optional */
 static JSValue JS_EvalInternal(JSContext *ctx, JSValueConst this_obj,
                                const char *input, size_t input_len,
@@ -33724,6 +37444,9 @@ JSValue JS_EvalThis(JSContext *ctx, JSValueConst this_obj,
 
     assert(eval_type == JS_EVAL_TYPE_GLOBAL ||
            eval_type == JS_EVAL_TYPE_MODULE);
+    if (ctx->rt->eval_cache_max_size != 0 || ctx->rt->eval_cache_funcs.load)
+        return js_eval_cached(ctx, this_obj, input, input_len, filename,
+                              eval_flags);
     ret = JS_EvalInternal(ctx, this_obj, input, input_len, filename,
                           eval_flags, -1);
     return ret;
@@ -33880,9 +37603,9 @@ typedef enum BCTagEnum {
 } BCTagEnum;
 
 #ifdef CONFIG_BIGNUM
-#define BC_BASE_VERSION 2
+#define BC_BASE_VERSION 6
 #else
-#define BC_BASE_VERSION 1
+#define BC_BASE_VERSION 5
 #endif
 #define BC_BE_VERSION 0x40
 #ifdef WORDS_BIGENDIAN
@@ -34295,8 +38018,22 @@ static int JS_WriteObjectRec(BCWriterState *s, JSValueConst obj);
 static int JS_WriteFunctionTag(BCWriterState *s, JSValueConst obj)
 {
     JSFunctionBytecode *b = JS_VALUE_GET_PTR(obj);
+    JSFunctionBytecode *lb;
+    JSValue func_obj;
     uint32_t flags;
     int idx, i;
+
+    /* a lazy function is written as the compiled function with the
+       closure variables of the stub */
+    lb = NULL;
+    func_obj = JS_UNDEFINED;
+    if (b->is_lazy) {
+        func_obj = js_compile_lazy_function(s->ctx, b);
+        if (JS_IsException(func_obj))
+            goto fail;
+        lb = b;
+        b = JS_VALUE_GET_PTR(func_obj);
+    }
     
     bc_put_u8(s, BC_TAG_FUNCTION_BYTECODE);
     flags = idx = 0;
@@ -34323,6 +38060,7 @@ static int JS_WriteFunctionTag(BCWriterState *s, JSValueConst obj)
     bc_put_leb128(s, b->closure_var_count);
     bc_put_leb128(s, b->cpool_count);
     bc_put_leb128(s, b->byte_code_len);
+    bc_put_leb128(s, b->ic_count);
     if (b->vardefs) {
         /* XXX: this field is redundant */
         bc_put_leb128(s, b->arg_count + b->var_count);
@@ -34345,11 +38083,14 @@ static int JS_WriteFunctionTag(BCWriterState *s, JSValueConst obj)
     
     for(i = 0; i < b->closure_var_count; i++) {
         JSClosureVar *cv = &b->closure_var[i];
+        JSClosureVar *cv1 = cv;
+        if (lb)
+            cv1 = &lb->closure_var[cv->var_idx];
         bc_put_atom(s, cv->var_name);
-        bc_put_leb128(s, cv->var_idx);
+        bc_put_leb128(s, cv1->var_idx);
         flags = idx = 0;
-        bc_set_flags(&flags, &idx, cv->is_local, 1);
-        bc_set_flags(&flags, &idx, cv->is_arg, 1);
+        bc_set_flags(&flags, &idx, cv1->is_local, 1);
+        bc_set_flags(&flags, &idx, cv1->is_arg, 1);
         bc_set_flags(&flags, &idx, cv->is_const, 1);
         bc_set_flags(&flags, &idx, cv->is_lexical, 1);
         bc_set_flags(&flags, &idx, cv->var_kind, 4);
@@ -34371,8 +38112,10 @@ static int JS_WriteFunctionTag(BCWriterState *s, JSValueConst obj)
         if (JS_WriteObjectRec(s, b->cpool[i]))
             goto fail;
     }
+    JS_FreeValue(s->ctx, func_obj);
     return 0;
  fail:
+    JS_FreeValue(s->ctx, func_obj);
     return -1;
 }
 
@@ -34589,6 +38332,15 @@ static int JS_WriteObjectRec(BCWriterState *s, JSValueConst obj)
             JS_WriteString(s, p);
         }
         break;
+    case JS_TAG_STRING_ROPE:
+        {
+            JSString *p = js_string_rope_linearize(s->ctx, obj);
+            if (!p)
+                goto fail;
+            bc_put_u8(s, BC_TAG_STRING);
+            JS_WriteString(s, p);
+        }
+        break;
     case JS_TAG_FUNCTION_BYTECODE:
         if (!s->allow_bytecode)
             goto invalid_tag;
@@ -34779,6 +38531,25 @@ uint8_t *JS_WriteObject(JSContext *ctx, size_t *psize, JSValueConst obj,
     return JS_WriteObject2(ctx, psize, obj, flags, NULL, NULL);
 }
 
+/* Shared bytecode: the functions are read once in a private runtime
+   which is no longer modified. The other runtimes, possibly running
+   in other threads, only allocate copies of the functions (see
+   JSFunctionBytecode.parent) with their own constant pool. Their
+   bytecode, variable definitions and debug info are shared. */
+
+struct JSSharedBytecode {
+    JSRuntime *rt; /* owner of the shared functions */
+    JSContext *ctx;
+    JSValue obj; /* script function or module */
+    const uint8_t *buf;
+    size_t buf_len;
+    int atom_count;
+    /* shared functions in reading order */
+    JSFunctionBytecode **funcs;
+    int func_count;
+    int func_size;
+};
+
 typedef struct BCReaderState {
     JSContext *ctx;
     const uint8_t *buf_start, *ptr, *buf_end;
@@ -34789,7 +38560,14 @@ typedef struct BCReaderState {
     BOOL allow_sab : 8;
     BOOL allow_bytecode : 8;
     BOOL is_rom_data : 8;
+    /* TRUE if some atoms do not have the index used in the byte code */
+    BOOL has_relocated_atoms : 8;
     BOOL allow_reference : 8;
+    /* if not NULL, the functions are read as copies of the functions
+       of 'shared_bc' (or added to it if 'is_shared_owner' is TRUE) */
+    JSSharedBytecode *shared_bc;
+    BOOL is_shared_owner : 8;
+    int shared_func_index;
     /* object references */
     JSObject **objects;
     int objects_count;
@@ -35020,7 +38798,7 @@ static int JS_ReadFunctionBytecode(BCReaderState *s, JSFunctionBytecode *b,
     JSAtom atom;
     uint32_t idx;
 
-    if (s->is_rom_data) {
+    if (b->read_only_bytecode) {
         /* directly use the input buffer */
         if (unlikely(s->buf_end - s->ptr < bc_len))
             return bc_read_error_end(s);
@@ -35044,7 +38822,7 @@ static int JS_ReadFunctionBytecode(BCReaderState *s, JSFunctionBytecode *b,
         case OP_FMT_atom_label_u8:
         case OP_FMT_atom_label_u16:
             idx = get_u32(bc_buf + pos + 1);
-            if (s->is_rom_data) {
+            if (b->read_only_bytecode) {
                 /* just increment the reference count of the atom */
                 JS_DupAtom(s->ctx, (JSAtom)idx);
             } else {
@@ -35220,6 +38998,147 @@ static int BC_add_object_ref(BCReaderState *s, JSValueConst obj)
     return BC_add_object_ref1(s, JS_VALUE_GET_OBJ(obj));
 }
 
+static int bc_skip_vars(BCReaderState *s, int local_count,
+                        int closure_var_count)
+{
+    uint32_t v;
+    uint8_t v8;
+    int i;
+
+    for(i = 0; i < local_count; i++) {
+        if (bc_get_leb128(s, &v) || bc_get_leb128(s, &v) ||
+            bc_get_leb128(s, &v) || bc_get_u8(s, &v8))
+            return -1;
+    }
+    for(i = 0; i < closure_var_count; i++) {
+        if (bc_get_leb128(s, &v) || bc_get_leb128(s, &v) ||
+            bc_get_u8(s, &v8))
+            return -1;
+    }
+    return 0;
+}
+
+/* Return TRUE if the byte code of the function can be used in place,
+   i.e. if none of its atoms need to be relocated. 's' is positioned
+   on the variable definitions and is not modified. */
+static BOOL bc_is_rom_bytecode(BCReaderState *s, int local_count,
+                               int closure_var_count, uint32_t bc_len)
+{
+    BCReaderState s1 = *s;
+    const uint8_t *bc_buf;
+    uint32_t pos, idx;
+    int op;
+
+    /* errors are reported when reading the variable definitions */
+    if (bc_skip_vars(&s1, local_count, closure_var_count))
+        return FALSE;
+    if (s1.buf_end - s1.ptr < bc_len)
+        return FALSE;
+    bc_buf = s1.ptr;
+    for(pos = 0; pos < bc_len; pos += short_opcode_info(op).size) {
+        op = bc_buf[pos];
+        switch(short_opcode_info(op).fmt) {
+        case OP_FMT_atom:
+        case OP_FMT_atom_u8:
+        case OP_FMT_atom_u16:
+        case OP_FMT_atom_label_u8:
+        case OP_FMT_atom_label_u16:
+            if (bc_len - pos < 5)
+                return FALSE;
+            idx = get_u32(bc_buf + pos + 1);
+            if (!__JS_AtomIsTaggedInt(idx) && idx >= s->first_atom &&
+                (idx - s->first_atom >= s->idx_to_atom_count ||
+                 s->idx_to_atom[idx - s->first_atom] != idx))
+                return FALSE;
+            break;
+        default:
+            break;
+        }
+    }
+    return TRUE;
+}
+
+/* Read a function as a copy of the corresponding function of
+   's->shared_bc': only the constant pool is read, the rest is
+   shared. */
+static JSValue JS_ReadSharedFunctionTag(BCReaderState *s,
+                                        const JSFunctionBytecode *bc,
+                                        int local_count)
+{
+    JSContext *ctx = s->ctx;
+    JSSharedBytecode *sb = s->shared_bc;
+    JSFunctionBytecode *b, *b1;
+    JSValue obj, val;
+    JSValue *cpool;
+    uint32_t v;
+    int i;
+
+    if (bc_skip_vars(s, local_count, bc->closure_var_count))
+        return JS_EXCEPTION;
+    if (s->buf_end - s->ptr < bc->byte_code_len)
+        goto fail_end;
+    s->ptr += bc->byte_code_len;
+    if (bc->has_debug) {
+        if (bc_get_leb128(s, &v) || bc_get_leb128(s, &v) ||
+            bc_get_leb128(s, &v))
+            return JS_EXCEPTION;
+        if (s->buf_end - s->ptr < v)
+            goto fail_end;
+        s->ptr += v;
+    }
+    if (s->shared_func_index >= sb->func_count)
+        goto invalid;
+    b1 = sb->funcs[s->shared_func_index++];
+    if (b1->cpool_count != bc->cpool_count ||
+        b1->byte_code_len != bc->byte_code_len)
+        goto invalid;
+
+    b = js_malloc(ctx, sizeof(*b));
+    if (!b)
+        return JS_EXCEPTION;
+    cpool = NULL;
+    if (b1->cpool_count != 0) {
+        cpool = js_malloc(ctx, sizeof(cpool[0]) * b1->cpool_count);
+        if (!cpool) {
+            js_free(ctx, b);
+            return JS_EXCEPTION;
+        }
+        for(i = 0; i < b1->cpool_count; i++)
+            cpool[i] = JS_UNDEFINED;
+    }
+    memcpy(b, b1, b1->has_debug ? sizeof(*b) :
+           offsetof(JSFunctionBytecode, debug));
+    b->header.ref_count = 1;
+    b->is_shared = FALSE;
+    b->cpool = cpool;
+    b->ic = NULL;
+#ifdef CONFIG_JIT
+    b->jit_counter = 0;
+    b->jit_disabled = FALSE;
+    b->jit_code = NULL;
+#endif
+    b->realm = NULL;
+    b->parent = b1;
+    add_gc_object(ctx->rt, &b->header, JS_GC_OBJ_TYPE_FUNCTION_BYTECODE);
+    obj = JS_MKPTR(JS_TAG_FUNCTION_BYTECODE, b);
+
+    for(i = 0; i < b->cpool_count; i++) {
+        val = JS_ReadObjectRec(s);
+        if (JS_IsException(val)) {
+            JS_FreeValue(ctx, obj);
+            return JS_EXCEPTION;
+        }
+        b->cpool[i] = val;
+    }
+    b->realm = JS_DupContext(ctx);
+    return obj;
+ fail_end:
+    bc_read_error_end(s);
+    return JS_EXCEPTION;
+ invalid:
+    return JS_ThrowSyntaxError(ctx, "invalid shared bytecode");
+}
+
 static JSValue JS_ReadFunctionTag(BCReaderState *s)
 {
     JSContext *ctx = s->ctx;
@@ -35249,7 +39168,6 @@ static JSValue JS_ReadFunctionTag(BCReaderState *s)
     bc.arguments_allowed = bc_get_flags(v16, &idx, 1);
     bc.has_debug = bc_get_flags(v16, &idx, 1);
     bc.backtrace_barrier = bc_get_flags(v16, &idx, 1);
-    bc.read_only_bytecode = s->is_rom_data;
     if (bc_get_u8(s, &v8))
         goto fail;
     bc.js_mode = v8;
@@ -35269,8 +39187,18 @@ static JSValue JS_ReadFunctionTag(BCReaderState *s)
         goto fail;
     if (bc_get_leb128_int(s, &bc.byte_code_len))
         goto fail;
+    if (bc_get_leb128_int(s, &bc.ic_count))
+        goto fail;
     if (bc_get_leb128_int(s, &local_count))
         goto fail;
+    if (s->shared_bc && !s->is_shared_owner) {
+        JS_FreeAtom(ctx, bc.func_name);
+        return JS_ReadSharedFunctionTag(s, &bc, local_count);
+    }
+    bc.read_only_bytecode = s->is_rom_data &&
+        (!s->has_relocated_atoms ||
+         bc_is_rom_bytecode(s, local_count, bc.closure_var_count,
+                            bc.byte_code_len));
 
     if (bc.has_debug) {
         function_size = sizeof(*b);
@@ -35308,6 +39236,15 @@ static JSValue JS_ReadFunctionTag(BCReaderState *s)
             
     obj = JS_MKPTR(JS_TAG_FUNCTION_BYTECODE, b);
 
+    if (s->shared_bc) {
+        JSSharedBytecode *sb = s->shared_bc;
+        if (js_resize_array(ctx, (void **)&sb->funcs, sizeof(sb->funcs[0]),
+                            &sb->func_size, sb->func_count + 1))
+            goto fail;
+        sb->funcs[sb->func_count++] = b;
+        b->is_shared = TRUE;
+    }
+
 #ifdef DUMP_READ_OBJECT
     bc_read_trace(s, "name: "); print_atom(s->ctx, b->func_name); printf("\n");
 #endif
@@ -35381,11 +39318,18 @@ static JSValue JS_ReadFunctionTag(BCReaderState *s)
         if (bc_get_leb128_int(s, &b->debug.pc2line_len))
             goto fail;
         if (b->debug.pc2line_len) {
-            b->debug.pc2line_buf = js_mallocz(ctx, b->debug.pc2line_len);
-            if (!b->debug.pc2line_buf)
-                goto fail;
-            if (bc_get_buf(s, b->debug.pc2line_buf, b->debug.pc2line_len))
-                goto fail;
+            if (b->read_only_bytecode) {
+                if (unlikely(s->buf_end - s->ptr < b->debug.pc2line_len))
+                    goto fail_end;
+                b->debug.pc2line_buf = (uint8_t *)s->ptr;
+                s->ptr += b->debug.pc2line_len;
+            } else {
+                b->debug.pc2line_buf = js_mallocz(ctx, b->debug.pc2line_len);
+                if (!b->debug.pc2line_buf)
+                    goto fail;
+                if (bc_get_buf(s, b->debug.pc2line_buf, b->debug.pc2line_len))
+                    goto fail;
+            }
         }
 #ifdef DUMP_READ_OBJECT
         bc_read_trace(s, "filename: "); print_atom(s->ctx, b->debug.filename); printf("\n");
@@ -35405,6 +39349,8 @@ static JSValue JS_ReadFunctionTag(BCReaderState *s)
     }
     b->realm = JS_DupContext(ctx);
     return obj;
+ fail_end:
+    bc_read_error_end(s);
  fail:
     JS_FreeValue(ctx, obj);
     return JS_EXCEPTION;
@@ -35889,8 +39835,8 @@ static int JS_ReadObjectAtoms(BCReaderState *s)
         if (atom == JS_ATOM_NULL)
             return s->error_state = -1;
         s->idx_to_atom[i] = atom;
-        if (s->is_rom_data && (atom != (i + s->first_atom)))
-            s->is_rom_data = FALSE; /* atoms must be relocated */
+        if (atom != (i + s->first_atom))
+            s->has_relocated_atoms = TRUE;
     }
     bc_read_trace(s, "}\n");
     return 0;
@@ -35908,8 +39854,9 @@ static void bc_reader_free(BCReaderState *s)
     js_free(s->ctx, s->objects);
 }
 
-JSValue JS_ReadObject(JSContext *ctx, const uint8_t *buf, size_t buf_len,
-                       int flags)
+static JSValue js_read_object(JSContext *ctx, const uint8_t *buf,
+                              size_t buf_len, int flags,
+                              JSSharedBytecode *sb, BOOL is_shared_owner)
 {
     BCReaderState ss, *s = &ss;
     JSValue obj;
@@ -35926,12 +39873,17 @@ JSValue JS_ReadObject(JSContext *ctx, const uint8_t *buf, size_t buf_len,
     s->is_rom_data = ((flags & JS_READ_OBJ_ROM_DATA) != 0);
     s->allow_sab = ((flags & JS_READ_OBJ_SAB) != 0);
     s->allow_reference = ((flags & JS_READ_OBJ_REFERENCE) != 0);
+    s->shared_bc = sb;
+    s->is_shared_owner = is_shared_owner;
     if (s->allow_bytecode)
         s->first_atom = JS_ATOM_END;
     else
         s->first_atom = 1;
     if (JS_ReadObjectAtoms(s)) {
         obj = JS_EXCEPTION;
+    } else if (sb && s->has_relocated_atoms) {
+        /* the shared functions use the atom indexes of the buffer */
+        obj = JS_ThrowInternalError(ctx, "the atoms of the shared bytecode are not reserved");
     } else {
         obj = JS_ReadObjectRec(s);
     }
@@ -35939,6 +39891,2400 @@ JSValue JS_ReadObject(JSContext *ctx, const uint8_t *buf, size_t buf_len,
     return obj;
 }
 
+JSValue JS_ReadObject(JSContext *ctx, const uint8_t *buf, size_t buf_len,
+                       int flags)
+{
+    return js_read_object(ctx, buf, buf_len, flags, NULL, FALSE);
+}
+
+/* return the length of the atom table starting at 'p' or -1 if it is
+   invalid */
+static int bc_check_atom_table(const uint8_t *p, const uint8_t *p_end,
+                               uint32_t count)
+{
+    const uint8_t *p_start = p;
+    uint32_t i, len;
+    size_t size;
+    int ret;
+
+    for(i = 0; i < count; i++) {
+        ret = get_leb128(&len, p, p_end);
+        if (ret < 0)
+            return -1;
+        p += ret;
+        size = (size_t)(len >> 1) << (len & 1);
+        if (size > (size_t)(p_end - p) || (len >> 1) > JS_STRING_LEN_MAX)
+            return -1;
+        p += size;
+    }
+    return p - p_start;
+}
+
+int JS_ReserveObjectAtoms(JSRuntime *rt, const uint8_t *buf, size_t buf_len)
+{
+    const uint8_t *p, *p_end;
+    uint32_t i, count, len;
+    size_t size;
+    JSAtom *new_atoms, atom;
+    JSString *str;
+    BOOL is_wide_char;
+    int ret, res, atom_count0;
+
+    p = buf;
+    p_end = buf + buf_len;
+    if (buf_len < 1 || *p++ != BC_VERSION)
+        return -1;
+    ret = get_leb128(&count, p, p_end);
+    if (ret < 0)
+        return -1;
+    p += ret;
+    if (count > (size_t)(p_end - p))
+        return -1; /* each atom takes at least one byte */
+    /* no atom is created if the buffer is invalid */
+    if (bc_check_atom_table(p, p_end, count) < 0)
+        return -1;
+    new_atoms = js_realloc_rt(rt, rt->reserved_atoms,
+                              sizeof(rt->reserved_atoms[0]) *
+                              (rt->reserved_atom_count + count));
+    if (!new_atoms)
+        return -1;
+    rt->reserved_atoms = new_atoms;
+    atom_count0 = rt->reserved_atom_count;
+    res = 0;
+    for(i = 0; i < count; i++) {
+        p += get_leb128(&len, p, p_end);
+        is_wide_char = len & 1;
+        len >>= 1;
+        size = (size_t)len << is_wide_char;
+        str = js_alloc_string_rt(rt, len, is_wide_char);
+        if (!str)
+            goto fail;
+        memcpy(str->u.str8, p, size);
+        if (!is_wide_char)
+            str->u.str8[size] = '\0';
+        p += size;
+        atom = __JS_NewAtom(rt, str, JS_ATOM_TYPE_STRING);
+        if (atom == JS_ATOM_NULL)
+            goto fail;
+        rt->reserved_atoms[rt->reserved_atom_count++] = atom;
+        if (atom != JS_ATOM_END + i)
+            res = -1;
+    }
+    return res;
+ fail:
+    /* remove the atoms created by this call */
+    while (rt->reserved_atom_count > atom_count0) {
+        JS_FreeAtomRT(rt, rt->reserved_atoms[--rt->reserved_atom_count]);
+    }
+    return -1;
+}
+
+JSSharedBytecode *JS_NewSharedBytecode(const uint8_t *buf, size_t buf_len)
+{
+    JSRuntime *rt;
+    JSContext *ctx;
+    JSSharedBytecode *sb;
+
+    rt = JS_NewRuntime();
+    if (!rt)
+        return NULL;
+    if (JS_ReserveObjectAtoms(rt, buf, buf_len))
+        goto fail_rt;
+    ctx = JS_NewContextRaw(rt);
+    if (!ctx)
+        goto fail_rt;
+    sb = js_mallocz(ctx, sizeof(*sb));
+    if (!sb)
+        goto fail_ctx;
+    sb->rt = rt;
+    sb->ctx = ctx;
+    sb->buf = buf;
+    sb->buf_len = buf_len;
+    sb->atom_count = rt->reserved_atom_count;
+    sb->obj = js_read_object(ctx, buf, buf_len,
+                             JS_READ_OBJ_BYTECODE | JS_READ_OBJ_ROM_DATA,
+                             sb, TRUE);
+    if (JS_IsException(sb->obj)) {
+        js_free(ctx, sb->funcs);
+        js_free(ctx, sb);
+        goto fail_ctx;
+    }
+    return sb;
+ fail_ctx:
+    JS_FreeContext(ctx);
+ fail_rt:
+    JS_FreeRuntime(rt);
+    return NULL;
+}
+
+void JS_FreeSharedBytecode(JSSharedBytecode *sb)
+{
+    JSRuntime *rt = sb->rt;
+    JSContext *ctx = sb->ctx;
+
+    JS_FreeValue(ctx, sb->obj);
+    js_free(ctx, sb->funcs);
+    js_free(ctx, sb);
+    JS_FreeContext(ctx);
+    JS_FreeRuntime(rt);
+}
+
+JSValue JS_ReadSharedBytecode(JSContext *ctx, JSSharedBytecode *sb)
+{
+    JSRuntime *rt = ctx->rt;
+    int i;
+
+    /* the atoms must stay defined as long as the runtime */
+    if (rt->reserved_atom_count < sb->atom_count)
+        goto not_reserved;
+    for(i = 0; i < sb->atom_count; i++) {
+        if (rt->reserved_atoms[i] != JS_ATOM_END + i)
+            goto not_reserved;
+    }
+    return js_read_object(ctx, sb->buf, sb->buf_len,
+                          JS_READ_OBJ_BYTECODE | JS_READ_OBJ_ROM_DATA,
+                          sb, FALSE);
+ not_reserved:
+    return JS_ThrowInternalError(ctx, "the atoms of the shared bytecode are not reserved");
+}
+
+/*******************************************************************/
+/* JS_Eval() compilation cache */
+
+/* The cached data is a header followed by the byte code. The header
+   contains the source length and the filename, which are checked in
+   addition to the hash. */
+typedef struct JSEvalCacheEntry {
+    struct list_head link;
+    uint64_t hash[2];
+    size_t size;
+    uint8_t *buf;
+} JSEvalCacheEntry;
+
+void JS_SetEvalCache(JSRuntime *rt, size_t max_size,
+                     const JSEvalCacheFunctions *cf, void *opaque)
+{
+    rt->eval_cache_max_size = max_size;
+    if (cf) {
+        rt->eval_cache_funcs = *cf;
+    } else {
+        memset(&rt->eval_cache_funcs, 0, sizeof(rt->eval_cache_funcs));
+    }
+    rt->eval_cache_opaque = opaque;
+}
+
+int64_t JS_GetEvalCacheHitCount(JSRuntime *rt)
+{
+    return rt->eval_cache_hit_count;
+}
+
+static void eval_cache_free_entry(JSRuntime *rt, JSEvalCacheEntry *e)
+{
+    list_del(&e->link);
+    rt->eval_cache_size -= e->size;
+    js_free_rt(rt, e->buf);
+    js_free_rt(rt, e);
+}
+
+static void js_free_eval_cache(JSRuntime *rt)
+{
+    struct list_head *el, *el1;
+
+    list_for_each_safe(el, el1, &rt->eval_cache_list) {
+        JSEvalCacheEntry *e = list_entry(el, JSEvalCacheEntry, link);
+        eval_cache_free_entry(rt, e);
+    }
+}
+
+static uint64_t eval_cache_hash(uint64_t h, uint64_t k, int shift,
+                                const uint8_t *buf, size_t len)
+{
+    uint64_t v;
+
+    h ^= len;
+    while (len >= 8) {
+        memcpy(&v, buf, 8);
+        h = (h ^ v) * k;
+        h ^= h >> shift;
+        buf += 8;
+        len -= 8;
+    }
+    v = 0;
+    if (len > 0)
+        memcpy(&v, buf, len);
+    h = (h ^ v) * k;
+    h ^= h >> shift;
+    return h;
+}
+
+/* the context state which modifies the generated byte code */
+static int eval_cache_get_ctx_flags(JSContext *ctx)
+{
+    int flags = 0;
+#ifdef CONFIG_BIGNUM
+    if (ctx->bignum_ext)
+        flags |= 1;
+    if (is_math_mode(ctx))
+        flags |= 2;
+#endif
+    return flags;
+}
+
+/* the key depends on the byte code version so that the persistent
+   entries of other versions are ignored */
+static void eval_cache_compute_hash(uint64_t hash[2], const char *input,
+                                    size_t input_len, const char *filename,
+                                    int eval_flags, int ctx_flags)
+{
+    static const uint64_t k[2] = { 0x9e3779b97f4a7c15, 0xff51afd7ed558ccd };
+    static const int shift[2] = { 29, 33 };
+    int i;
+
+    for(i = 0; i < 2; i++) {
+        hash[i] = eval_cache_hash(BC_VERSION + i, k[i], shift[i],
+                                  (const uint8_t *)filename,
+                                  strlen(filename) + 1);
+        hash[i] = eval_cache_hash(hash[i] ^ eval_flags ^
+                                  ((uint64_t)ctx_flags << 32),
+                                  k[i], shift[i],
+                                  (const uint8_t *)input, input_len);
+    }
+}
+
+/* return the header length of the cached data 'buf' or -1 if it does
+   not match the source */
+static int eval_cache_check_header(const uint8_t *buf, size_t size,
+                                   size_t input_len, const char *filename)
+{
+    uint64_t len;
+    size_t filename_size;
+
+    filename_size = strlen(filename) + 1;
+    if (size < sizeof(len) + filename_size)
+        return -1;
+    memcpy(&len, buf, sizeof(len));
+    if (len != input_len ||
+        memcmp(buf + sizeof(len), filename, filename_size) != 0)
+        return -1;
+    return sizeof(len) + filename_size;
+}
+
+/* return the cached data for the byte code 'bc_buf' */
+static uint8_t *eval_cache_write_header(JSContext *ctx, size_t *psize,
+                                        const uint8_t *bc_buf, size_t bc_size,
+                                        size_t input_len, const char *filename)
+{
+    uint64_t len;
+    size_t filename_size;
+    uint8_t *buf;
+
+    len = input_len;
+    filename_size = strlen(filename) + 1;
+    *psize = sizeof(len) + filename_size + bc_size;
+    buf = js_malloc(ctx, *psize);
+    if (!buf)
+        return NULL;
+    memcpy(buf, &len, sizeof(len));
+    memcpy(buf + sizeof(len), filename, filename_size);
+    memcpy(buf + sizeof(len) + filename_size, bc_buf, bc_size);
+    return buf;
+}
+
+/* add 'buf' to the memory cache, evicting the least recently used
+   entries if necessary. 'buf' is freed if it is not added. */
+static void eval_cache_add(JSRuntime *rt, const uint64_t hash[2],
+                           uint8_t *buf, size_t size)
+{
+    JSEvalCacheEntry *e;
+
+    if (size > rt->eval_cache_max_size)
+        goto fail;
+    e = js_malloc_rt(rt, sizeof(*e));
+    if (!e)
+        goto fail;
+    while (rt->eval_cache_size + size > rt->eval_cache_max_size) {
+        eval_cache_free_entry(rt, list_entry(rt->eval_cache_list.prev,
+                                             JSEvalCacheEntry, link));
+    }
+    e->hash[0] = hash[0];
+    e->hash[1] = hash[1];
+    e->buf = buf;
+    e->size = size;
+    list_add(&e->link, &rt->eval_cache_list);
+    rt->eval_cache_size += size;
+    return;
+ fail:
+    js_free_rt(rt, buf);
+}
+
+/* Same as JS_EvalInternal() with the compiled code taken from the
+   cache if present. The byte code is copied by JS_ReadObject() so
+   that the entries can be evicted. */
+static JSValue js_eval_cached(JSContext *ctx, JSValueConst this_obj,
+                              const char *input, size_t input_len,
+                              const char *filename, int eval_flags)
+{
+    JSRuntime *rt = ctx->rt;
+    JSEvalCacheEntry *e;
+    struct list_head *el;
+    JSValue fun_obj;
+    uint64_t hash[2];
+    char key[JS_EVAL_CACHE_KEY_LEN + 1];
+    uint8_t *buf, *bc_buf;
+    size_t size, bc_size;
+    int header_len;
+
+    eval_cache_compute_hash(hash, input, input_len, filename,
+                            eval_flags & ~JS_EVAL_FLAG_COMPILE_ONLY,
+                            eval_cache_get_ctx_flags(ctx));
+    snprintf(key, sizeof(key), "%016" PRIx64 "%016" PRIx64,
+             hash[0], hash[1]);
+
+    fun_obj = JS_UNDEFINED;
+    list_for_each(el, &rt->eval_cache_list) {
+        e = list_entry(el, JSEvalCacheEntry, link);
+        if (e->hash[0] == hash[0] && e->hash[1] == hash[1]) {
+            header_len = eval_cache_check_header(e->buf, e->size,
+                                                 input_len, filename);
+            if (header_len < 0)
+                break;
+            fun_obj = JS_ReadObject(ctx, e->buf + header_len,
+                                    e->size - header_len,
+                                    JS_READ_OBJ_BYTECODE);
+            if (JS_IsException(fun_obj))
+                return JS_EXCEPTION;
+            /* move to the front of the LRU list */
+            list_del(&e->link);
+            list_add(&e->link, &rt->eval_cache_list);
+            break;
+        }
+    }
+    if (JS_IsUndefined(fun_obj) && rt->eval_cache_funcs.load) {
+        buf = rt->eval_cache_funcs.load(rt, rt->eval_cache_opaque, key, &size);
+        if (buf) {
+            header_len = eval_cache_check_header(buf, size, input_len,
+                                                 filename);
+            if (header_len >= 0) {
+                fun_obj = JS_ReadObject(ctx, buf + header_len,
+                                        size - header_len,
+                                        JS_READ_OBJ_BYTECODE);
+            }
+            if (header_len < 0 || JS_IsException(fun_obj)) {
+                /* invalid entry (e.g. other byte code version):
+                   compile the source */
+                JS_FreeValue(ctx, JS_GetException(ctx));
+                fun_obj = JS_UNDEFINED;
+                js_free(ctx, buf);
+            } else {
+                eval_cache_add(rt, hash, buf, size);
+            }
+        }
+    }
+
+    if (JS_IsUndefined(fun_obj)) {
+        fun_obj = JS_EvalInternal(ctx, this_obj, input, input_len, filename,
+                                  eval_flags | JS_EVAL_FLAG_COMPILE_ONLY, -1);
+        if (JS_IsException(fun_obj))
+            return JS_EXCEPTION;
+        bc_buf = JS_WriteObject(ctx, &bc_size, fun_obj, JS_WRITE_OBJ_BYTECODE);
+        buf = NULL;
+        if (bc_buf) {
+            buf = eval_cache_write_header(ctx, &size, bc_buf, bc_size,
+                                          input_len, filename);
+            js_free(ctx, bc_buf);
+        }
+        if (!buf) {
+            /* the cache is only an optimization */
+            JS_FreeValue(ctx, JS_GetException(ctx));
+        } else {
+            if (rt->eval_cache_funcs.store) {
+                rt->eval_cache_funcs.store(rt, rt->eval_cache_opaque, key,
+                                           buf, size);
+            }
+            eval_cache_add(rt, hash, buf, size);
+        }
+    } else {
+        rt->eval_cache_hit_count++;
+        if (JS_ResolveModule(ctx, fun_obj) < 0) {
+            JS_FreeValue(ctx, fun_obj);
+            return JS_EXCEPTION;
+        }
+    }
+
+    if (eval_flags & JS_EVAL_FLAG_COMPILE_ONLY)
+        return fun_obj;
+    return JS_EvalFunctionInternal(ctx, fun_obj, this_obj, NULL, NULL);
+}
+
+/*******************************************************************/
+/* Baseline JIT */
+
+#ifdef CONFIG_JIT
+
+/* The hot functions are translated to x86-64 code by concatenating a
+   template per opcode. The native code runs in the stack frame of
+   JS_CallInternal() so that the interpreter can switch to it at the
+   start of the function or at a loop back edge. The templates only
+   contain the fast paths: the other cases call js_jit_op() which
+   executes the opcode as the interpreter does. The opcodes without
+   template return to the interpreter. */
+
+typedef enum {
+    JIT_RAX, JIT_RCX, JIT_RDX, JIT_RBX, JIT_RSP, JIT_RBP, JIT_RSI, JIT_RDI,
+    JIT_R8, JIT_R9, JIT_R10, JIT_R11, JIT_R12, JIT_R13, JIT_R14, JIT_R15,
+} JITRegEnum;
+
+/* registers kept during the execution of the native code (callee
+   saved) */
+#define JIT_F    JIT_RBX /* JSJitFrame pointer */
+#define JIT_SP   JIT_R12 /* sp (see JSJitCompiler.sp_delta) */
+#define JIT_VAR  JIT_R13 /* var_buf */
+#define JIT_ARG  JIT_R14 /* arg_buf */
+
+typedef enum {
+    JIT_CC_O, JIT_CC_NO, JIT_CC_B, JIT_CC_AE, JIT_CC_E, JIT_CC_NE,
+    JIT_CC_BE, JIT_CC_A, JIT_CC_S, JIT_CC_NS, JIT_CC_P, JIT_CC_NP,
+    JIT_CC_L, JIT_CC_GE, JIT_CC_LE, JIT_CC_G,
+} JITCondEnum;
+
+/* group 1 operations (0x81 /n) and the corresponding 'reg, r/m'
+   opcodes */
+typedef enum {
+    JIT_ADD, JIT_OR, JIT_ADC, JIT_SBB, JIT_AND, JIT_SUB, JIT_XOR, JIT_CMP,
+} JITAluEnum;
+
+#define JIT_VAL(n)   ((n) * (int)sizeof(JSValue))
+#define JIT_TAG(n)   (JIT_VAL(n) + (int)offsetof(JSValue, tag))
+#define JIT_FRAME(field) ((int)offsetof(JSJitFrame, field))
+
+typedef struct JSJitEntry {
+    uint32_t pc_pos; /* bytecode position */
+    uint32_t code_pos; /* native code position */
+} JSJitEntry;
+
+struct JSJitCode {
+    uint8_t *code; /* executable memory */
+    size_t code_size;
+    int entry_count;
+    JSJitEntry entries[0]; /* sorted by pc_pos */
+};
+
+typedef int JSJitFunc(JSJitFrame *f, const uint8_t *entry);
+
+typedef struct JSJitFixup {
+    uint32_t code_pos; /* position of the 32 bit displacement */
+    uint32_t pc_pos; /* target bytecode position */
+} JSJitFixup;
+
+typedef struct JSJitCompiler {
+    JSRuntime *rt;
+    JSFunctionBytecode *b;
+    DynBuf code;
+    DynBuf fixups; /* JSJitFixup */
+    /* native position of the jump targets, -1 for the other bytecode
+       positions and -2 for the jump targets not emitted yet */
+    int *labels;
+    /* the value stack pointer is JIT_SP + sp_delta values. sp_delta
+       is zero at the jump targets */
+    int sp_delta;
+    int exception_pos; /* native position of the exception exit */
+    int epilogue_pos; /* native position of the function epilogue */
+} JSJitCompiler;
+
+static void jit_u8(JSJitCompiler *s, uint8_t v)
+{
+    dbuf_putc(&s->code, v);
+}
+
+static void jit_u32(JSJitCompiler *s, uint32_t v)
+{
+    dbuf_put_u32(&s->code, v);
+}
+
+static int jit_pos(JSJitCompiler *s)
+{
+    return s->code.size;
+}
+
+/* emit 'prefix REX opcode ModRM' with a register or [base + disp]
+   operand. The opcodes with a 0x0f escape are given as 0x0fXX. */
+static void jit_insn(JSJitCompiler *s, int prefix, int rex_w, int opcode,
+                     int reg, int rm, BOOL is_mem, int32_t disp)
+{
+    int rex, mod;
+
+    if (prefix)
+        jit_u8(s, prefix);
+    rex = (rex_w << 3) | ((reg >> 3) << 2) | (rm >> 3);
+    if (rex)
+        jit_u8(s, 0x40 | rex);
+    if (opcode > 0xff)
+        jit_u8(s, opcode >> 8);
+    jit_u8(s, opcode);
+    if (!is_mem) {
+        jit_u8(s, 0xc0 | ((reg & 7) << 3) | (rm & 7));
+    } else {
+        mod = (disp == (int8_t)disp) ? 1 : 2;
+        jit_u8(s, (mod << 6) | ((reg & 7) << 3) | (rm & 7));
+        if ((rm & 7) == JIT_RSP)
+            jit_u8(s, 0x24); /* SIB byte: no index */
+        if (mod == 1)
+            jit_u8(s, disp);
+        else
+            jit_u32(s, disp);
+    }
+}
+
+static void jit_mem(JSJitCompiler *s, int prefix, int rex_w, int opcode,
+                    int reg, int base, int32_t disp)
+{
+    jit_insn(s, prefix, rex_w, opcode, reg, base, TRUE, disp);
+}
+
+static void jit_reg(JSJitCompiler *s, int prefix, int rex_w, int opcode,
+                    int reg, int rm)
+{
+    jit_insn(s, prefix, rex_w, opcode, reg, rm, FALSE, 0);
+}
+
+/* mov reg, qword [base + disp] */
+static void jit_load(JSJitCompiler *s, int reg, int base, int32_t disp)
+{
+    jit_mem(s, 0, 1, 0x8b, reg, base, disp);
+}
+
+/* mov reg32, dword [base + disp] */
+static void jit_load32(JSJitCompiler *s, int reg, int base, int32_t disp)
+{
+    jit_mem(s, 0, 0, 0x8b, reg, base, disp);
+}
+
+/* mov qword [base + disp], reg */
+static void jit_store(JSJitCompiler *s, int base, int32_t disp, int reg)
+{
+    jit_mem(s, 0, 1, 0x89, reg, base, disp);
+}
+
+/* mov qword [base + disp], sign extended imm */
+static void jit_store_imm(JSJitCompiler *s, int base, int32_t disp,
+                          int32_t imm)
+{
+    jit_mem(s, 0, 1, 0xc7, 0, base, disp);
+    jit_u32(s, imm);
+}
+
+static void jit_mov(JSJitCompiler *s, int dst, int src)
+{
+    jit_reg(s, 0, 1, 0x89, src, dst);
+}
+
+static void jit_mov_imm(JSJitCompiler *s, int reg, uint64_t imm)
+{
+    if (imm <= UINT32_MAX) {
+        if (reg >= 8)
+            jit_u8(s, 0x41);
+        jit_u8(s, 0xb8 + (reg & 7));
+        jit_u32(s, imm);
+    } else {
+        jit_u8(s, 0x48 | (reg >> 3));
+        jit_u8(s, 0xb8 + (reg & 7));
+        jit_u32(s, imm);
+        jit_u32(s, imm >> 32);
+    }
+}
+
+static void jit_lea(JSJitCompiler *s, int reg, int base, int32_t disp)
+{
+    jit_mem(s, 0, 1, 0x8d, reg, base, disp);
+}
+
+/* 'op reg, imm' */
+static void jit_alu_imm(JSJitCompiler *s, JITAluEnum op, int rex_w, int reg,
+                        int32_t imm)
+{
+    if (imm == (int8_t)imm) {
+        jit_reg(s, 0, rex_w, 0x83, op, reg);
+        jit_u8(s, imm);
+    } else {
+        jit_reg(s, 0, rex_w, 0x81, op, reg);
+        jit_u32(s, imm);
+    }
+}
+
+/* 'op dword [base + disp], imm' */
+static void jit_alu_mem_imm(JSJitCompiler *s, JITAluEnum op, int base,
+                            int32_t disp, int32_t imm)
+{
+    if (imm == (int8_t)imm) {
+        jit_mem(s, 0, 0, 0x83, op, base, disp);
+        jit_u8(s, imm);
+    } else {
+        jit_mem(s, 0, 0, 0x81, op, base, disp);
+        jit_u32(s, imm);
+    }
+}
+
+/* 'op reg32, dword [base + disp]' */
+static void jit_alu_load32(JSJitCompiler *s, JITAluEnum op, int reg,
+                           int base, int32_t disp)
+{
+    jit_mem(s, 0, 0, op * 8 + 3, reg, base, disp);
+}
+
+/* test reg32, reg32 */
+static void jit_test32(JSJitCompiler *s, int reg)
+{
+    jit_reg(s, 0, 0, 0x85, reg, reg);
+}
+
+/* setcc al; movzx eax, al */
+static void jit_setcc(JSJitCompiler *s, JITCondEnum cc)
+{
+    jit_u8(s, 0x0f);
+    jit_u8(s, 0x90 + cc);
+    jit_u8(s, 0xc0);
+    jit_u8(s, 0x0f);
+    jit_u8(s, 0xb6);
+    jit_u8(s, 0xc0);
+}
+
+/* SSE2 scalar double operation 'op xmm, qword [base + disp]' */
+static void jit_sse_mem(JSJitCompiler *s, int prefix, int opcode, int xmm,
+                        int base, int32_t disp)
+{
+    jit_mem(s, prefix, 0, opcode, xmm, base, disp);
+}
+
+#define JIT_MOVSD_LOAD  0x0f10 /* prefix 0xf2 */
+#define JIT_MOVSD_STORE 0x0f11 /* prefix 0xf2 */
+#define JIT_MOVUPS_LOAD  0x0f10
+#define JIT_MOVUPS_STORE 0x0f11
+#define JIT_ADDSD       0x0f58 /* prefix 0xf2 */
+#define JIT_MULSD       0x0f59 /* prefix 0xf2 */
+#define JIT_SUBSD       0x0f5c /* prefix 0xf2 */
+#define JIT_UCOMISD     0x0f2e /* prefix 0x66 */
+
+/* conditional jump with a 8 bit displacement to be patched */
+static int jit_jcc8(JSJitCompiler *s, JITCondEnum cc)
+{
+    jit_u8(s, 0x70 + cc);
+    jit_u8(s, 0);
+    return jit_pos(s) - 1;
+}
+
+static void jit_patch8(JSJitCompiler *s, int pos)
+{
+    int diff = jit_pos(s) - (pos + 1);
+    assert(diff <= 127);
+    s->code.buf[pos] = diff;
+}
+
+/* conditional (cc >= 0) or unconditional jump with a 32 bit
+   displacement to be patched */
+static int jit_jump(JSJitCompiler *s, int cc)
+{
+    if (cc < 0) {
+        jit_u8(s, 0xe9);
+    } else {
+        jit_u8(s, 0x0f);
+        jit_u8(s, 0x80 + cc);
+    }
+    jit_u32(s, 0);
+    return jit_pos(s) - 4;
+}
+
+static void jit_patch32(JSJitCompiler *s, int pos, int target)
+{
+    put_u32(s->code.buf + pos, target - (pos + 4));
+}
+
+static void jit_patch32_here(JSJitCompiler *s, int pos)
+{
+    jit_patch32(s, pos, jit_pos(s));
+}
+
+static void jit_jump_to(JSJitCompiler *s, int cc, int target)
+{
+    jit_patch32(s, jit_jump(s, cc), target);
+}
+
+static void jit_call(JSJitCompiler *s, const void *func)
+{
+    jit_mov_imm(s, JIT_RAX, (uintptr_t)func);
+    jit_reg(s, 0, 0, 0xff, 2, JIT_RAX); /* call rax */
+}
+
+/* increment the reference count of the value (ptr, tag) */
+static void jit_emit_dup(JSJitCompiler *s, int ptr, int tag)
+{
+    int pos;
+    jit_alu_imm(s, JIT_CMP, 0, tag, JS_TAG_FIRST);
+    pos = jit_jcc8(s, JIT_CC_B);
+    jit_mem(s, 0, 0, 0xff, 0, ptr, 0); /* inc dword [ptr] */
+    jit_patch8(s, pos);
+}
+
+/* free the value (rax, rdx). All the scratch registers are modified. */
+static void jit_emit_free(JSJitCompiler *s)
+{
+    int pos1, pos2;
+    jit_alu_imm(s, JIT_CMP, 0, JIT_RDX, JS_TAG_FIRST);
+    pos1 = jit_jcc8(s, JIT_CC_B);
+    jit_mem(s, 0, 0, 0xff, 1, JIT_RAX, 0); /* dec dword [rax] */
+    pos2 = jit_jcc8(s, JIT_CC_G);
+    jit_mov(s, JIT_RSI, JIT_RAX);
+    jit_load(s, JIT_RDI, JIT_F, JIT_FRAME(rt));
+    jit_call(s, __JS_FreeValueRT);
+    jit_patch8(s, pos1);
+    jit_patch8(s, pos2);
+}
+
+/* make JIT_SP the real stack pointer */
+static void jit_flush_sp(JSJitCompiler *s)
+{
+    if (s->sp_delta != 0) {
+        jit_alu_imm(s, JIT_ADD, 1, JIT_SP, JIT_VAL(s->sp_delta));
+        s->sp_delta = 0;
+    }
+}
+
+/* store the stack pointer in the frame and call func(f, pc, opcode) */
+static void jit_emit_call_helper(JSJitCompiler *s, const void *func,
+                                 const uint8_t *pc, int opcode)
+{
+    if (s->sp_delta == 0) {
+        jit_store(s, JIT_F, JIT_FRAME(sp), JIT_SP);
+    } else {
+        jit_lea(s, JIT_RAX, JIT_SP, JIT_VAL(s->sp_delta));
+        jit_store(s, JIT_F, JIT_FRAME(sp), JIT_RAX);
+    }
+    jit_mov(s, JIT_RDI, JIT_F);
+    jit_mov_imm(s, JIT_RSI, (uintptr_t)pc);
+    jit_mov_imm(s, JIT_RDX, opcode);
+    jit_call(s, func);
+}
+
+static int js_jit_op(JSJitFrame *f, const uint8_t *pc, int opcode);
+
+/* execute the opcode with js_jit_op(). 'pc' points to the operands.
+   The stack pointer is not modified. */
+static void jit_emit_op_call(JSJitCompiler *s, const uint8_t *pc,
+                             int opcode)
+{
+    jit_emit_call_helper(s, js_jit_op, pc, opcode);
+    jit_test32(s, JIT_RAX);
+    jit_jump_to(s, JIT_CC_NE, s->exception_pos);
+}
+
+/* same as jit_emit_op_call() for the branches: eax contains the
+   condition */
+static void jit_emit_branch_call(JSJitCompiler *s, const uint8_t *pc,
+                                 int opcode)
+{
+    jit_emit_call_helper(s, js_jit_op, pc, opcode);
+    jit_test32(s, JIT_RAX);
+    jit_jump_to(s, JIT_CC_S, s->exception_pos);
+}
+
+static int jit_stack_effect(const uint8_t *pc)
+{
+    const JSOpCode *oi = &short_opcode_info(pc[0]);
+    int n_pop = oi->n_pop;
+
+    switch(oi->fmt) {
+    case OP_FMT_npop:
+        n_pop += get_u16(pc + 1);
+        break;
+#if SHORT_OPCODES
+    case OP_FMT_npopx:
+        n_pop += pc[0] - OP_call0;
+        break;
+#endif
+    default:
+        break;
+    }
+    return oi->n_push - n_pop;
+}
+
+/* jump to the bytecode position 'target' */
+static void jit_emit_jump_pos(JSJitCompiler *s, int cc, int target)
+{
+    JSJitFixup *fx;
+    int pos;
+
+    pos = jit_jump(s, cc);
+    if (s->labels[target] >= 0) {
+        jit_patch32(s, pos, s->labels[target]);
+    } else {
+        if (dbuf_realloc(&s->fixups, s->fixups.size + sizeof(*fx)))
+            return;
+        fx = (JSJitFixup *)(s->fixups.buf + s->fixups.size);
+        fx->code_pos = pos;
+        fx->pc_pos = target;
+        s->fixups.size += sizeof(*fx);
+    }
+}
+
+static int js_jit_poll_interrupts(JSJitFrame *f, const uint8_t *pc,
+                                  int opcode)
+{
+    if (__js_poll_interrupts(f->ctx)) {
+        f->pc = pc;
+        return -1;
+    }
+    return 0;
+}
+
+/* conditional (cc >= 0) or unconditional jump to the bytecode
+   position 'target'. The interrupts are polled on the back edges as
+   in the interpreter. sp_delta must be zero. */
+static void jit_emit_goto(JSJitCompiler *s, int cc, int pos, int target)
+{
+    int pos1, pos2;
+
+    assert(s->sp_delta == 0);
+    if (target > pos) {
+        jit_emit_jump_pos(s, cc, target);
+        return;
+    }
+    pos1 = -1;
+    if (cc >= 0)
+        pos1 = jit_jump(s, cc ^ 1);
+    jit_load(s, JIT_RAX, JIT_F, JIT_FRAME(ctx));
+    jit_mem(s, 0, 0, 0xff, 1, JIT_RAX, offsetof(JSContext, interrupt_counter));
+    pos2 = jit_jump(s, JIT_CC_G);
+    jit_emit_call_helper(s, js_jit_poll_interrupts,
+                         s->b->byte_code_buf + target, 0);
+    jit_test32(s, JIT_RAX);
+    jit_jump_to(s, JIT_CC_NE, s->exception_pos);
+    jit_patch32_here(s, pos2);
+    jit_emit_jump_pos(s, -1, target);
+    if (pos1 >= 0)
+        jit_patch32_here(s, pos1);
+}
+
+/* return to the interpreter which executes the opcode at 'pos' */
+static void jit_emit_bailout(JSJitCompiler *s, int pos)
+{
+    jit_flush_sp(s);
+    jit_store(s, JIT_F, JIT_FRAME(sp), JIT_SP);
+    jit_mov_imm(s, JIT_RAX, (uintptr_t)(s->b->byte_code_buf + pos));
+    jit_store(s, JIT_F, JIT_FRAME(pc), JIT_RAX);
+    jit_mov_imm(s, JIT_RAX, JS_JIT_BAILOUT);
+    jit_jump_to(s, -1, s->epilogue_pos);
+}
+
+static void jit_emit_push_imm(JSJitCompiler *s, int tag, int32_t val)
+{
+    if (val >= 0) {
+        jit_store_imm(s, JIT_SP, JIT_VAL(s->sp_delta), val);
+    } else {
+        /* the high part of the value is zero as with JS_NewInt32() */
+        jit_mem(s, 0, 0, 0xc7, 0, JIT_SP, JIT_VAL(s->sp_delta));
+        jit_u32(s, val);
+        jit_mem(s, 0, 0, 0xc7, 0, JIT_SP, JIT_VAL(s->sp_delta) + 4);
+        jit_u32(s, 0);
+    }
+    jit_store_imm(s, JIT_SP, JIT_TAG(s->sp_delta), tag);
+    s->sp_delta++;
+}
+
+/* push a copy of the value at [base + disp] */
+static void jit_emit_get(JSJitCompiler *s, int base, int32_t disp)
+{
+    jit_load(s, JIT_RAX, base, disp);
+    jit_load(s, JIT_RDX, base, disp + offsetof(JSValue, tag));
+    jit_store(s, JIT_SP, JIT_VAL(s->sp_delta), JIT_RAX);
+    jit_store(s, JIT_SP, JIT_TAG(s->sp_delta), JIT_RDX);
+    jit_emit_dup(s, JIT_RAX, JIT_RDX);
+    s->sp_delta++;
+}
+
+/* store the top of the stack to [base + disp] and free the previous
+   value. The value is popped unless 'keep' is set. */
+static void jit_emit_put(JSJitCompiler *s, int base, int32_t disp,
+                         BOOL keep)
+{
+    jit_load(s, JIT_RCX, JIT_SP, JIT_VAL(s->sp_delta - 1));
+    jit_load(s, JIT_R8, JIT_SP, JIT_TAG(s->sp_delta - 1));
+    if (keep)
+        jit_emit_dup(s, JIT_RCX, JIT_R8);
+    jit_load(s, JIT_RAX, base, disp);
+    jit_load(s, JIT_RDX, base, disp + offsetof(JSValue, tag));
+    jit_store(s, base, disp, JIT_RCX);
+    jit_store(s, base, disp + offsetof(JSValue, tag), JIT_R8);
+    if (!keep)
+        s->sp_delta--;
+    jit_emit_free(s);
+}
+
+/* rsi = var_refs[idx]->pvalue */
+static void jit_emit_var_ref(JSJitCompiler *s, int idx)
+{
+    jit_load(s, JIT_RSI, JIT_F, JIT_FRAME(var_refs));
+    jit_load(s, JIT_RSI, JIT_RSI, idx * sizeof(JSVarRef *));
+    jit_load(s, JIT_RSI, JIT_RSI, offsetof(JSVarRef, pvalue));
+}
+
+/* same as jit_emit_get() but throw an exception with js_jit_op() if
+   the variable is not initialized */
+static void jit_emit_get_check(JSJitCompiler *s, const uint8_t *pc,
+                               int opcode, int base, int32_t disp)
+{
+    int pos1, pos2;
+    jit_alu_mem_imm(s, JIT_CMP, base, disp + offsetof(JSValue, tag),
+                    JS_TAG_UNINITIALIZED);
+    pos1 = jit_jump(s, JIT_CC_E);
+    jit_emit_get(s, base, disp);
+    pos2 = jit_jump(s, -1);
+    jit_patch32_here(s, pos1);
+    s->sp_delta--;
+    jit_emit_op_call(s, pc, opcode);
+    s->sp_delta++;
+    jit_patch32_here(s, pos2);
+}
+
+/* load the tags of sp[-2] and sp[-1] and jump to the returned position
+   if they are not both integers */
+static int jit_emit_check_both_int(JSJitCompiler *s)
+{
+    jit_load32(s, JIT_RAX, JIT_SP, JIT_TAG(s->sp_delta - 2));
+    jit_alu_load32(s, JIT_OR, JIT_RAX, JIT_SP, JIT_TAG(s->sp_delta - 1));
+    return jit_jump(s, JIT_CC_NE);
+}
+
+/* jump to *ppos1 or *ppos2 if sp[-2] and sp[-1] are not both float64 */
+static void jit_emit_check_both_float(JSJitCompiler *s, int *ppos1,
+                                      int *ppos2)
+{
+    jit_alu_mem_imm(s, JIT_CMP, JIT_SP, JIT_TAG(s->sp_delta - 2),
+                    JS_TAG_FLOAT64);
+    *ppos1 = jit_jump(s, JIT_CC_NE);
+    jit_alu_mem_imm(s, JIT_CMP, JIT_SP, JIT_TAG(s->sp_delta - 1),
+                    JS_TAG_FLOAT64);
+    *ppos2 = jit_jump(s, JIT_CC_NE);
+}
+
+/* store the integer in eax to [base + disp]. The 32 bit operations
+   clear the high part of rax as JS_NewInt32() does. */
+static void jit_emit_store_int(JSJitCompiler *s, int base, int32_t disp)
+{
+    jit_store(s, base, disp, JIT_RAX);
+}
+
+/* OP_add, OP_sub, OP_mul */
+static void jit_emit_arith(JSJitCompiler *s, const uint8_t *pc, int opcode)
+{
+    int pos_float, pos_slow1, pos_slow2, pos_slow3, pos_slow4;
+    int pos_done1, pos_done2, sse_op;
+
+    pos_float = jit_emit_check_both_int(s);
+    jit_load32(s, JIT_RAX, JIT_SP, JIT_VAL(s->sp_delta - 2));
+    switch(opcode) {
+    case OP_add:
+        jit_alu_load32(s, JIT_ADD, JIT_RAX, JIT_SP, JIT_VAL(s->sp_delta - 1));
+        sse_op = JIT_ADDSD;
+        break;
+    case OP_sub:
+        jit_alu_load32(s, JIT_SUB, JIT_RAX, JIT_SP, JIT_VAL(s->sp_delta - 1));
+        sse_op = JIT_SUBSD;
+        break;
+    default:
+        jit_mem(s, 0, 0, 0x0faf, JIT_RAX, JIT_SP, JIT_VAL(s->sp_delta - 1));
+        sse_op = JIT_MULSD;
+        break;
+    }
+    pos_slow1 = jit_jump(s, JIT_CC_O);
+    pos_slow2 = -1;
+    if (opcode == OP_mul) {
+        /* the result may be -0 */
+        jit_test32(s, JIT_RAX);
+        pos_slow2 = jit_jump(s, JIT_CC_E);
+    }
+    jit_emit_store_int(s, JIT_SP, JIT_VAL(s->sp_delta - 2));
+    pos_done1 = jit_jump(s, -1);
+
+    jit_patch32_here(s, pos_float);
+    jit_emit_check_both_float(s, &pos_slow3, &pos_slow4);
+    jit_sse_mem(s, 0xf2, JIT_MOVSD_LOAD, 0, JIT_SP, JIT_VAL(s->sp_delta - 2));
+    jit_sse_mem(s, 0xf2, sse_op, 0, JIT_SP, JIT_VAL(s->sp_delta - 1));
+    jit_sse_mem(s, 0xf2, JIT_MOVSD_STORE, 0, JIT_SP, JIT_VAL(s->sp_delta - 2));
+    pos_done2 = jit_jump(s, -1);
+
+    jit_patch32_here(s, pos_slow1);
+    if (pos_slow2 >= 0)
+        jit_patch32_here(s, pos_slow2);
+    jit_patch32_here(s, pos_slow3);
+    jit_patch32_here(s, pos_slow4);
+    jit_emit_op_call(s, pc, opcode);
+
+    jit_patch32_here(s, pos_done1);
+    jit_patch32_here(s, pos_done2);
+    s->sp_delta--;
+}
+
+/* OP_and, OP_or, OP_xor, OP_shl, OP_sar, OP_shr */
+static void jit_emit_logic(JSJitCompiler *s, const uint8_t *pc, int opcode)
+{
+    int pos_slow1, pos_slow2, pos_done;
+
+    pos_slow1 = jit_emit_check_both_int(s);
+    pos_slow2 = -1;
+    jit_load32(s, JIT_RAX, JIT_SP, JIT_VAL(s->sp_delta - 2));
+    switch(opcode) {
+    case OP_and:
+        jit_alu_load32(s, JIT_AND, JIT_RAX, JIT_SP, JIT_VAL(s->sp_delta - 1));
+        break;
+    case OP_or:
+        jit_alu_load32(s, JIT_OR, JIT_RAX, JIT_SP, JIT_VAL(s->sp_delta - 1));
+        break;
+    case OP_xor:
+        jit_alu_load32(s, JIT_XOR, JIT_RAX, JIT_SP, JIT_VAL(s->sp_delta - 1));
+        break;
+    default:
+        /* the shift count is masked by the CPU as in JS */
+        jit_load32(s, JIT_RCX, JIT_SP, JIT_VAL(s->sp_delta - 1));
+        if (opcode == OP_shl) {
+            jit_reg(s, 0, 0, 0xd3, 4, JIT_RAX);
+        } else if (opcode == OP_sar) {
+            jit_reg(s, 0, 0, 0xd3, 7, JIT_RAX);
+        } else {
+            jit_reg(s, 0, 0, 0xd3, 5, JIT_RAX);
+            /* the result does not fit in an int32 */
+            jit_test32(s, JIT_RAX);
+            pos_slow2 = jit_jump(s, JIT_CC_S);
+        }
+        break;
+    }
+    jit_emit_store_int(s, JIT_SP, JIT_VAL(s->sp_delta - 2));
+    pos_done = jit_jump(s, -1);
+    jit_patch32_here(s, pos_slow1);
+    if (pos_slow2 >= 0)
+        jit_patch32_here(s, pos_slow2);
+    jit_emit_op_call(s, pc, opcode);
+    jit_patch32_here(s, pos_done);
+    s->sp_delta--;
+}
+
+/* condition codes of the comparison of sp[-2] and sp[-1] */
+static JITCondEnum jit_cmp_cond(int opcode, BOOL is_float)
+{
+    switch(opcode) {
+    case OP_lt:
+        return is_float ? JIT_CC_A : JIT_CC_L;
+    case OP_lte:
+        return is_float ? JIT_CC_AE : JIT_CC_LE;
+    case OP_gt:
+        return is_float ? JIT_CC_A : JIT_CC_G;
+    case OP_gte:
+        return is_float ? JIT_CC_AE : JIT_CC_GE;
+    case OP_eq:
+    case OP_strict_eq:
+        return JIT_CC_E;
+    default:
+        return JIT_CC_NE;
+    }
+}
+
+/* compare two float64 values. ucomisd sets CF for the unordered
+   results so the operands are swapped for OP_lt and OP_lte so that
+   'above' is false with NaN. */
+static void jit_emit_ucomisd(JSJitCompiler *s, int opcode)
+{
+    int a = s->sp_delta - 2, b = s->sp_delta - 1;
+    if (opcode == OP_lt || opcode == OP_lte) {
+        a = s->sp_delta - 1;
+        b = s->sp_delta - 2;
+    }
+    jit_sse_mem(s, 0xf2, JIT_MOVSD_LOAD, 0, JIT_SP, JIT_VAL(a));
+    jit_sse_mem(s, 0x66, JIT_UCOMISD, 0, JIT_SP, JIT_VAL(b));
+}
+
+/* OP_lt ... OP_strict_neq */
+static void jit_emit_cmp(JSJitCompiler *s, const uint8_t *pc, int opcode)
+{
+    int pos_float, pos_slow1, pos_slow2, pos_done1, pos_done2;
+    BOOL has_float = (opcode <= OP_gte);
+
+    pos_float = jit_emit_check_both_int(s);
+    jit_load32(s, JIT_RAX, JIT_SP, JIT_VAL(s->sp_delta - 2));
+    jit_alu_load32(s, JIT_CMP, JIT_RAX, JIT_SP, JIT_VAL(s->sp_delta - 1));
+    jit_setcc(s, jit_cmp_cond(opcode, FALSE));
+    pos_done1 = jit_jump(s, -1);
+    jit_patch32_here(s, pos_float);
+    pos_done2 = -1;
+    if (has_float) {
+        jit_emit_check_both_float(s, &pos_slow1, &pos_slow2);
+        jit_emit_ucomisd(s, opcode);
+        jit_setcc(s, jit_cmp_cond(opcode, TRUE));
+        pos_done2 = jit_jump(s, -1);
+        jit_patch32_here(s, pos_slow1);
+        jit_patch32_here(s, pos_slow2);
+    }
+    jit_emit_op_call(s, pc, opcode);
+    pos_slow1 = jit_jump(s, -1);
+    jit_patch32_here(s, pos_done1);
+    if (pos_done2 >= 0)
+        jit_patch32_here(s, pos_done2);
+    jit_store(s, JIT_SP, JIT_VAL(s->sp_delta - 2), JIT_RAX);
+    jit_store_imm(s, JIT_SP, JIT_TAG(s->sp_delta - 2), JS_TAG_BOOL);
+    jit_patch32_here(s, pos_slow1);
+    s->sp_delta--;
+}
+
+/* OP_lt_if_false8 ... OP_gte_if_false8 */
+static void jit_emit_cmp_branch(JSJitCompiler *s, const uint8_t *pc,
+                                int opcode, int pos, int target)
+{
+    int pos_float, pos_slow1, pos_slow2, pos_next[2];
+    int cmp_opcode = opcode - OP_lt_if_false8 + OP_lt;
+
+    jit_flush_sp(s);
+    pos_float = jit_emit_check_both_int(s);
+    jit_load32(s, JIT_RAX, JIT_SP, JIT_VAL(-2));
+    jit_alu_load32(s, JIT_CMP, JIT_RAX, JIT_SP, JIT_VAL(-1));
+    jit_lea(s, JIT_SP, JIT_SP, JIT_VAL(-2));
+    jit_emit_goto(s, jit_cmp_cond(cmp_opcode, FALSE) ^ 1, pos, target);
+    pos_next[0] = jit_jump(s, -1);
+
+    jit_patch32_here(s, pos_float);
+    jit_emit_check_both_float(s, &pos_slow1, &pos_slow2);
+    jit_emit_ucomisd(s, cmp_opcode);
+    jit_lea(s, JIT_SP, JIT_SP, JIT_VAL(-2));
+    jit_emit_goto(s, jit_cmp_cond(cmp_opcode, TRUE) ^ 1, pos, target);
+    pos_next[1] = jit_jump(s, -1);
+
+    jit_patch32_here(s, pos_slow1);
+    jit_patch32_here(s, pos_slow2);
+    jit_emit_branch_call(s, pc, opcode);
+    jit_lea(s, JIT_SP, JIT_SP, JIT_VAL(-2));
+    jit_test32(s, JIT_RAX);
+    jit_emit_goto(s, JIT_CC_E, pos, target);
+
+    jit_patch32_here(s, pos_next[0]);
+    jit_patch32_here(s, pos_next[1]);
+}
+
+/* OP_if_true, OP_if_false and their short forms */
+static void jit_emit_if(JSJitCompiler *s, const uint8_t *pc, int opcode,
+                        BOOL is_true, int pos, int target)
+{
+    int pos_slow, pos_join;
+
+    jit_flush_sp(s);
+    jit_alu_mem_imm(s, JIT_CMP, JIT_SP, JIT_TAG(-1), JS_TAG_UNDEFINED);
+    pos_slow = jit_jump(s, JIT_CC_A);
+    jit_load32(s, JIT_RAX, JIT_SP, JIT_VAL(-1));
+    pos_join = jit_jump(s, -1);
+    jit_patch32_here(s, pos_slow);
+    jit_emit_branch_call(s, pc, opcode);
+    jit_patch32_here(s, pos_join);
+    jit_lea(s, JIT_SP, JIT_SP, JIT_VAL(-1));
+    jit_test32(s, JIT_RAX);
+    jit_emit_goto(s, is_true ? JIT_CC_NE : JIT_CC_E, pos, target);
+}
+
+/* OP_inc, OP_dec, OP_neg, OP_not and OP_lnot on sp[-1] */
+static void jit_emit_unary(JSJitCompiler *s, const uint8_t *pc, int opcode)
+{
+    int pos_slow1, pos_slow2, pos_done;
+    int val = JIT_VAL(s->sp_delta - 1);
+
+    if (opcode == OP_lnot) {
+        jit_alu_mem_imm(s, JIT_CMP, JIT_SP, JIT_TAG(s->sp_delta - 1),
+                        JS_TAG_UNDEFINED);
+        pos_slow1 = jit_jump(s, JIT_CC_A);
+        jit_load32(s, JIT_RAX, JIT_SP, val);
+        jit_test32(s, JIT_RAX);
+        jit_setcc(s, JIT_CC_E);
+        jit_store(s, JIT_SP, val, JIT_RAX);
+        jit_store_imm(s, JIT_SP, JIT_TAG(s->sp_delta - 1), JS_TAG_BOOL);
+        pos_done = jit_jump(s, -1);
+        jit_patch32_here(s, pos_slow1);
+        jit_emit_op_call(s, pc, opcode);
+        jit_patch32_here(s, pos_done);
+        return;
+    }
+    jit_alu_mem_imm(s, JIT_CMP, JIT_SP, JIT_TAG(s->sp_delta - 1), JS_TAG_INT);
+    pos_slow1 = jit_jump(s, JIT_CC_NE);
+    pos_slow2 = -1;
+    jit_load32(s, JIT_RAX, JIT_SP, val);
+    switch(opcode) {
+    case OP_inc:
+        jit_alu_imm(s, JIT_ADD, 0, JIT_RAX, 1);
+        pos_slow2 = jit_jump(s, JIT_CC_O);
+        break;
+    case OP_dec:
+        jit_alu_imm(s, JIT_SUB, 0, JIT_RAX, 1);
+        pos_slow2 = jit_jump(s, JIT_CC_O);
+        break;
+    case OP_neg:
+        /* 0 and INT32_MIN give a float64 */
+        jit_reg(s, 0, 0, 0xf7, 0, JIT_RAX); /* test eax, imm */
+        jit_u32(s, 0x7fffffff);
+        pos_slow2 = jit_jump(s, JIT_CC_E);
+        jit_reg(s, 0, 0, 0xf7, 3, JIT_RAX); /* neg eax */
+        break;
+    default: /* OP_not */
+        jit_reg(s, 0, 0, 0xf7, 2, JIT_RAX); /* not eax */
+        break;
+    }
+    jit_emit_store_int(s, JIT_SP, val);
+    pos_done = jit_jump(s, -1);
+    jit_patch32_here(s, pos_slow1);
+    if (pos_slow2 >= 0)
+        jit_patch32_here(s, pos_slow2);
+    jit_emit_op_call(s, pc, opcode);
+    jit_patch32_here(s, pos_done);
+}
+
+/* OP_inc_loc, OP_dec_loc and OP_add_loc */
+static void jit_emit_loc_arith(JSJitCompiler *s, const uint8_t *pc,
+                               int opcode)
+{
+    int pos_slow1, pos_slow2, pos_slow3, pos_done;
+    int disp = JIT_VAL(pc[0]);
+
+    jit_alu_mem_imm(s, JIT_CMP, JIT_VAR, disp + offsetof(JSValue, tag),
+                    JS_TAG_INT);
+    pos_slow1 = jit_jump(s, JIT_CC_NE);
+    pos_slow2 = -1;
+    jit_load32(s, JIT_RAX, JIT_VAR, disp);
+    if (opcode == OP_inc_loc) {
+        jit_alu_imm(s, JIT_ADD, 0, JIT_RAX, 1);
+    } else if (opcode == OP_dec_loc) {
+        jit_alu_imm(s, JIT_SUB, 0, JIT_RAX, 1);
+    } else {
+        jit_alu_mem_imm(s, JIT_CMP, JIT_SP, JIT_TAG(s->sp_delta - 1),
+                        JS_TAG_INT);
+        pos_slow2 = jit_jump(s, JIT_CC_NE);
+        jit_alu_load32(s, JIT_ADD, JIT_RAX, JIT_SP, JIT_VAL(s->sp_delta - 1));
+    }
+    pos_slow3 = jit_jump(s, JIT_CC_O);
+    jit_emit_store_int(s, JIT_VAR, disp);
+    pos_done = jit_jump(s, -1);
+    jit_patch32_here(s, pos_slow1);
+    if (pos_slow2 >= 0)
+        jit_patch32_here(s, pos_slow2);
+    jit_patch32_here(s, pos_slow3);
+    jit_emit_op_call(s, pc, opcode);
+    jit_patch32_here(s, pos_done);
+    if (opcode == OP_add_loc)
+        s->sp_delta--;
+}
+
+typedef struct JSJitStackOp {
+    uint8_t opcode;
+    uint8_t n_pop;
+    uint8_t n_push;
+    int8_t src[6]; /* index of the popped value for each pushed value */
+} JSJitStackOp;
+
+static const JSJitStackOp jit_stack_ops[] = {
+    { OP_drop, 1, 0, { 0 } },
+    { OP_nip, 2, 1, { 1 } },
+    { OP_nip1, 3, 2, { 1, 2 } },
+    { OP_dup, 1, 2, { 0, 0 } },
+    { OP_dup1, 2, 3, { 0, 0, 1 } },
+    { OP_dup2, 2, 4, { 0, 1, 0, 1 } },
+    { OP_dup3, 3, 6, { 0, 1, 2, 0, 1, 2 } },
+    { OP_insert2, 2, 3, { 1, 0, 1 } },
+    { OP_insert3, 3, 4, { 2, 0, 1, 2 } },
+    { OP_insert4, 4, 5, { 3, 0, 1, 2, 3 } },
+    { OP_perm3, 3, 3, { 1, 0, 2 } },
+    { OP_perm4, 4, 4, { 2, 0, 1, 3 } },
+    { OP_perm5, 5, 5, { 3, 0, 1, 2, 4 } },
+    { OP_swap, 2, 2, { 1, 0 } },
+    { OP_swap2, 4, 4, { 2, 3, 0, 1 } },
+    { OP_rot3l, 3, 3, { 1, 2, 0 } },
+    { OP_rot3r, 3, 3, { 2, 0, 1 } },
+    { OP_rot4l, 4, 4, { 1, 2, 3, 0 } },
+    { OP_rot5l, 5, 5, { 1, 2, 3, 4, 0 } },
+};
+
+/* stack manipulation opcodes: the values are moved with the SSE
+   registers after updating the reference counts */
+static void jit_emit_stack_op(JSJitCompiler *s, const JSJitStackOp *so)
+{
+    int i, j, count, pos, base, free_idx;
+
+    base = s->sp_delta - so->n_pop;
+    free_idx = -1;
+    for(i = 0; i < so->n_pop; i++) {
+        count = 0;
+        for(j = 0; j < so->n_push; j++) {
+            if (so->src[j] == i)
+                count++;
+        }
+        if (count == 0) {
+            /* at most one value is dropped */
+            assert(free_idx < 0);
+            free_idx = i;
+        } else if (count >= 2) {
+            jit_load(s, JIT_RAX, JIT_SP, JIT_VAL(base + i));
+            jit_load32(s, JIT_RDX, JIT_SP, JIT_TAG(base + i));
+            jit_alu_imm(s, JIT_CMP, 0, JIT_RDX, JS_TAG_FIRST);
+            pos = jit_jcc8(s, JIT_CC_B);
+            jit_alu_mem_imm(s, JIT_ADD, JIT_RAX, 0, count - 1);
+            jit_patch8(s, pos);
+        }
+    }
+    if (free_idx >= 0) {
+        jit_load(s, JIT_RAX, JIT_SP, JIT_VAL(base + free_idx));
+        jit_load(s, JIT_RDX, JIT_SP, JIT_TAG(base + free_idx));
+    }
+    for(i = 0; i < so->n_pop; i++) {
+        jit_sse_mem(s, 0, JIT_MOVUPS_LOAD, i, JIT_SP, JIT_VAL(base + i));
+    }
+    for(j = 0; j < so->n_push; j++) {
+        if (so->src[j] != j)
+            jit_sse_mem(s, 0, JIT_MOVUPS_STORE, so->src[j], JIT_SP,
+                        JIT_VAL(base + j));
+    }
+    s->sp_delta += so->n_push - so->n_pop;
+    if (free_idx >= 0)
+        jit_emit_free(s);
+}
+
+/* get the target of a jump opcode or -1 */
+static int jit_jump_target(const uint8_t *bc, int pos)
+{
+    switch(bc[pos]) {
+    case OP_if_false:
+    case OP_if_true:
+    case OP_goto:
+        return pos + 1 + (int32_t)get_u32(bc + pos + 1);
+#if SHORT_OPCODES
+    case OP_if_false8:
+    case OP_if_true8:
+    case OP_goto8:
+    case OP_lt_if_false8:
+    case OP_lte_if_false8:
+    case OP_gt_if_false8:
+    case OP_gte_if_false8:
+        return pos + 1 + (int8_t)bc[pos + 1];
+    case OP_goto16:
+        return pos + 1 + (int16_t)get_u16(bc + pos + 1);
+    case OP_inc_loc_goto8:
+        return pos + 2 + (int8_t)bc[pos + 2];
+#endif
+    default:
+        return -1;
+    }
+}
+
+/* the opcodes executed by js_jit_op() */
+static BOOL jit_is_helper_op(int opcode)
+{
+    switch(opcode) {
+    case OP_push_const:
+    case OP_fclosure:
+    case OP_push_atom_value:
+    case OP_object:
+    case OP_push_this:
+    case OP_catch:
+    case OP_call_constructor:
+    case OP_call:
+    case OP_call_method:
+    case OP_array_from:
+    case OP_apply:
+    case OP_throw:
+    case OP_get_var_undef:
+    case OP_get_var:
+    case OP_put_var:
+    case OP_put_var_init:
+    case OP_put_var_strict:
+    case OP_put_loc_check_init:
+    case OP_put_var_ref_check:
+    case OP_put_var_ref_check_init:
+    case OP_close_loc:
+    case OP_for_in_start:
+    case OP_for_of_start:
+    case OP_for_in_next:
+    case OP_for_of_next:
+    case OP_iterator_close:
+    case OP_get_field:
+    case OP_get_field2:
+    case OP_put_field:
+    case OP_define_field:
+    case OP_define_array_el:
+    case OP_get_array_el:
+    case OP_get_array_el2:
+    case OP_put_array_el:
+    case OP_div:
+    case OP_mod:
+    case OP_pow:
+    case OP_plus:
+    case OP_post_inc:
+    case OP_post_dec:
+    case OP_typeof:
+    case OP_in:
+    case OP_instanceof:
+    case OP_is_undefined_or_null:
+    case OP_to_object:
+    case OP_to_propkey:
+    case OP_to_propkey2:
+#if SHORT_OPCODES
+    case OP_push_const8:
+    case OP_fclosure8:
+    case OP_push_empty_string:
+    case OP_get_length:
+    case OP_call0:
+    case OP_call1:
+    case OP_call2:
+    case OP_call3:
+    case OP_is_undefined:
+    case OP_is_null:
+    case OP_typeof_is_undefined:
+    case OP_typeof_is_function:
+#endif
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+static BOOL jit_has_template(int opcode)
+{
+    switch(opcode) {
+    case OP_push_i32:
+    case OP_undefined:
+    case OP_null:
+    case OP_push_false:
+    case OP_push_true:
+    case OP_get_loc:
+    case OP_put_loc:
+    case OP_set_loc:
+    case OP_get_arg:
+    case OP_put_arg:
+    case OP_set_arg:
+    case OP_get_var_ref:
+    case OP_put_var_ref:
+    case OP_set_var_ref:
+    case OP_set_loc_uninitialized:
+    case OP_get_loc_check:
+    case OP_put_loc_check:
+    case OP_get_var_ref_check:
+    case OP_if_false:
+    case OP_if_true:
+    case OP_goto:
+    case OP_return:
+    case OP_return_undef:
+    case OP_add:
+    case OP_sub:
+    case OP_mul:
+    case OP_and:
+    case OP_or:
+    case OP_xor:
+    case OP_shl:
+    case OP_sar:
+    case OP_shr:
+    case OP_lt:
+    case OP_lte:
+    case OP_gt:
+    case OP_gte:
+    case OP_eq:
+    case OP_neq:
+    case OP_strict_eq:
+    case OP_strict_neq:
+    case OP_inc:
+    case OP_dec:
+    case OP_neg:
+    case OP_not:
+    case OP_lnot:
+    case OP_inc_loc:
+    case OP_dec_loc:
+    case OP_add_loc:
+    case OP_nop:
+#if SHORT_OPCODES
+    case OP_push_minus1 ... OP_push_i16:
+    case OP_get_loc8 ... OP_set_var_ref3:
+    case OP_if_false8:
+    case OP_if_true8:
+    case OP_goto8:
+    case OP_goto16:
+    case OP_lt_if_false8 ... OP_inc_loc_goto8:
+#endif
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+static int jit_emit_code(JSJitCompiler *s)
+{
+    JSFunctionBytecode *b = s->b;
+    const uint8_t *bc = b->byte_code_buf;
+    const uint8_t *pc;
+    int pos, pos_next, op, idx, target, i;
+
+    /* prologue: int f(JSJitFrame *f, const uint8_t *entry) */
+    jit_u8(s, 0x53); /* push rbx */
+    jit_u8(s, 0x41); jit_u8(s, 0x54); /* push r12 */
+    jit_u8(s, 0x41); jit_u8(s, 0x55); /* push r13 */
+    jit_u8(s, 0x41); jit_u8(s, 0x56); /* push r14 */
+    jit_alu_imm(s, JIT_SUB, 1, JIT_RSP, 8); /* align the stack */
+    jit_mov(s, JIT_F, JIT_RDI);
+    jit_load(s, JIT_SP, JIT_F, JIT_FRAME(sp));
+    jit_load(s, JIT_VAR, JIT_F, JIT_FRAME(var_buf));
+    jit_load(s, JIT_ARG, JIT_F, JIT_FRAME(arg_buf));
+    jit_reg(s, 0, 0, 0xff, 4, JIT_RSI); /* jmp rsi */
+
+    /* the exception is pending, f->sp and f->pc are set */
+    s->exception_pos = jit_pos(s);
+    jit_mov_imm(s, JIT_RAX, JS_JIT_EXCEPTION);
+    s->epilogue_pos = jit_pos(s);
+    jit_alu_imm(s, JIT_ADD, 1, JIT_RSP, 8);
+    jit_u8(s, 0x41); jit_u8(s, 0x5e); /* pop r14 */
+    jit_u8(s, 0x41); jit_u8(s, 0x5d); /* pop r13 */
+    jit_u8(s, 0x41); jit_u8(s, 0x5c); /* pop r12 */
+    jit_u8(s, 0x5b); /* pop rbx */
+    jit_u8(s, 0xc3); /* ret */
+
+    s->sp_delta = 0;
+    for(pos = 0; pos < b->byte_code_len; pos = pos_next) {
+        op = bc[pos];
+        pc = bc + pos + 1;
+        pos_next = pos + short_opcode_info(op).size;
+        if (s->labels[pos] != -1) {
+            jit_flush_sp(s);
+            s->labels[pos] = jit_pos(s);
+        }
+        if (jit_is_helper_op(op)) {
+            jit_emit_op_call(s, pc, op);
+            s->sp_delta += jit_stack_effect(pc - 1);
+            if (op == OP_throw)
+                s->sp_delta = 0; /* not reached */
+            continue;
+        }
+        target = jit_jump_target(bc, pos);
+        switch(op) {
+        case OP_push_i32:
+            jit_emit_push_imm(s, JS_TAG_INT, get_u32(pc));
+            break;
+        case OP_undefined:
+            jit_emit_push_imm(s, JS_TAG_UNDEFINED, 0);
+            break;
+        case OP_null:
+            jit_emit_push_imm(s, JS_TAG_NULL, 0);
+            break;
+        case OP_push_false:
+        case OP_push_true:
+            jit_emit_push_imm(s, JS_TAG_BOOL, op - OP_push_false);
+            break;
+        case OP_get_loc:
+            jit_emit_get(s, JIT_VAR, JIT_VAL(get_u16(pc)));
+            break;
+        case OP_put_loc:
+        case OP_set_loc:
+            jit_emit_put(s, JIT_VAR, JIT_VAL(get_u16(pc)), op == OP_set_loc);
+            break;
+        case OP_get_arg:
+            jit_emit_get(s, JIT_ARG, JIT_VAL(get_u16(pc)));
+            break;
+        case OP_put_arg:
+        case OP_set_arg:
+            jit_emit_put(s, JIT_ARG, JIT_VAL(get_u16(pc)), op == OP_set_arg);
+            break;
+        case OP_get_var_ref:
+            jit_emit_var_ref(s, get_u16(pc));
+            jit_emit_get(s, JIT_RSI, 0);
+            break;
+        case OP_put_var_ref:
+        case OP_set_var_ref:
+            jit_emit_var_ref(s, get_u16(pc));
+            jit_emit_put(s, JIT_RSI, 0, op == OP_set_var_ref);
+            break;
+        case OP_set_loc_uninitialized:
+            idx = get_u16(pc);
+            jit_load(s, JIT_RAX, JIT_VAR, JIT_VAL(idx));
+            jit_load(s, JIT_RDX, JIT_VAR, JIT_TAG(idx));
+            jit_store_imm(s, JIT_VAR, JIT_VAL(idx), 0);
+            jit_store_imm(s, JIT_VAR, JIT_TAG(idx), JS_TAG_UNINITIALIZED);
+            jit_emit_free(s);
+            break;
+        case OP_get_loc_check:
+            jit_emit_get_check(s, pc, op, JIT_VAR, JIT_VAL(get_u16(pc)));
+            break;
+        case OP_get_var_ref_check:
+            jit_emit_var_ref(s, get_u16(pc));
+            jit_emit_get_check(s, pc, op, JIT_RSI, 0);
+            break;
+        case OP_put_loc_check:
+            {
+                int pos1, pos2;
+                idx = get_u16(pc);
+                jit_alu_mem_imm(s, JIT_CMP, JIT_VAR, JIT_TAG(idx),
+                                JS_TAG_UNINITIALIZED);
+                pos1 = jit_jump(s, JIT_CC_E);
+                jit_emit_put(s, JIT_VAR, JIT_VAL(idx), FALSE);
+                pos2 = jit_jump(s, -1);
+                jit_patch32_here(s, pos1);
+                s->sp_delta++;
+                jit_emit_op_call(s, pc, op);
+                s->sp_delta--;
+                jit_patch32_here(s, pos2);
+            }
+            break;
+        case OP_goto:
+#if SHORT_OPCODES
+        case OP_goto8:
+        case OP_goto16:
+#endif
+            jit_flush_sp(s);
+            jit_emit_goto(s, -1, pos, target);
+            break;
+        case OP_if_false:
+        case OP_if_true:
+            jit_emit_if(s, pc, op, op == OP_if_true, pos, target);
+            break;
+#if SHORT_OPCODES
+        case OP_if_false8:
+        case OP_if_true8:
+            jit_emit_if(s, pc, op, op == OP_if_true8, pos, target);
+            break;
+        case OP_lt_if_false8:
+        case OP_lte_if_false8:
+        case OP_gt_if_false8:
+        case OP_gte_if_false8:
+            jit_emit_cmp_branch(s, pc, op, pos, target);
+            break;
+        case OP_inc_loc_goto8:
+            jit_emit_loc_arith(s, pc, OP_inc_loc);
+            jit_flush_sp(s);
+            jit_emit_goto(s, -1, pos, target);
+            break;
+#endif
+        case OP_return:
+            jit_load(s, JIT_RAX, JIT_SP, JIT_VAL(s->sp_delta - 1));
+            jit_load(s, JIT_RDX, JIT_SP, JIT_TAG(s->sp_delta - 1));
+            jit_store(s, JIT_F, JIT_FRAME(ret_val), JIT_RAX);
+            jit_store(s, JIT_F, JIT_FRAME(ret_val) + offsetof(JSValue, tag),
+                      JIT_RDX);
+            s->sp_delta--;
+            goto do_return;
+        case OP_return_undef:
+            jit_store_imm(s, JIT_F, JIT_FRAME(ret_val), 0);
+            jit_store_imm(s, JIT_F, JIT_FRAME(ret_val) + offsetof(JSValue, tag),
+                          JS_TAG_UNDEFINED);
+        do_return:
+            jit_lea(s, JIT_RAX, JIT_SP, JIT_VAL(s->sp_delta));
+            jit_store(s, JIT_F, JIT_FRAME(sp), JIT_RAX);
+            jit_mov_imm(s, JIT_RAX, JS_JIT_RETURN);
+            jit_jump_to(s, -1, s->epilogue_pos);
+            s->sp_delta = 0;
+            break;
+        case OP_add:
+        case OP_sub:
+        case OP_mul:
+            jit_emit_arith(s, pc, op);
+            break;
+        case OP_and:
+        case OP_or:
+        case OP_xor:
+        case OP_shl:
+        case OP_sar:
+        case OP_shr:
+            jit_emit_logic(s, pc, op);
+            break;
+        case OP_lt:
+        case OP_lte:
+        case OP_gt:
+        case OP_gte:
+        case OP_eq:
+        case OP_neq:
+        case OP_strict_eq:
+        case OP_strict_neq:
+            jit_emit_cmp(s, pc, op);
+            break;
+        case OP_inc:
+        case OP_dec:
+        case OP_neg:
+        case OP_not:
+        case OP_lnot:
+            jit_emit_unary(s, pc, op);
+            break;
+        case OP_inc_loc:
+        case OP_dec_loc:
+        case OP_add_loc:
+            jit_emit_loc_arith(s, pc, op);
+            break;
+        case OP_nop:
+            break;
+#if SHORT_OPCODES
+        case OP_push_minus1:
+        case OP_push_0:
+        case OP_push_1:
+        case OP_push_2:
+        case OP_push_3:
+        case OP_push_4:
+        case OP_push_5:
+        case OP_push_6:
+        case OP_push_7:
+            jit_emit_push_imm(s, JS_TAG_INT, op - OP_push_0);
+            break;
+        case OP_push_i8:
+            jit_emit_push_imm(s, JS_TAG_INT, get_i8(pc));
+            break;
+        case OP_push_i16:
+            jit_emit_push_imm(s, JS_TAG_INT, get_i16(pc));
+            break;
+        case OP_get_loc8:
+            jit_emit_get(s, JIT_VAR, JIT_VAL(pc[0]));
+            break;
+        case OP_put_loc8:
+        case OP_set_loc8:
+            jit_emit_put(s, JIT_VAR, JIT_VAL(pc[0]), op == OP_set_loc8);
+            break;
+        case OP_get_loc0:
+        case OP_get_loc1:
+        case OP_get_loc2:
+        case OP_get_loc3:
+            jit_emit_get(s, JIT_VAR, JIT_VAL(op - OP_get_loc0));
+            break;
+        case OP_put_loc0:
+        case OP_put_loc1:
+        case OP_put_loc2:
+        case OP_put_loc3:
+            jit_emit_put(s, JIT_VAR, JIT_VAL(op - OP_put_loc0), FALSE);
+            break;
+        case OP_set_loc0:
+        case OP_set_loc1:
+        case OP_set_loc2:
+        case OP_set_loc3:
+            jit_emit_put(s, JIT_VAR, JIT_VAL(op - OP_set_loc0), TRUE);
+            break;
+        case OP_get_arg0:
+        case OP_get_arg1:
+        case OP_get_arg2:
+        case OP_get_arg3:
+            jit_emit_get(s, JIT_ARG, JIT_VAL(op - OP_get_arg0));
+            break;
+        case OP_put_arg0:
+        case OP_put_arg1:
+        case OP_put_arg2:
+        case OP_put_arg3:
+            jit_emit_put(s, JIT_ARG, JIT_VAL(op - OP_put_arg0), FALSE);
+            break;
+        case OP_set_arg0:
+        case OP_set_arg1:
+        case OP_set_arg2:
+        case OP_set_arg3:
+            jit_emit_put(s, JIT_ARG, JIT_VAL(op - OP_set_arg0), TRUE);
+            break;
+        case OP_get_var_ref0:
+        case OP_get_var_ref1:
+        case OP_get_var_ref2:
+        case OP_get_var_ref3:
+            jit_emit_var_ref(s, op - OP_get_var_ref0);
+            jit_emit_get(s, JIT_RSI, 0);
+            break;
+        case OP_put_var_ref0:
+        case OP_put_var_ref1:
+        case OP_put_var_ref2:
+        case OP_put_var_ref3:
+            jit_emit_var_ref(s, op - OP_put_var_ref0);
+            jit_emit_put(s, JIT_RSI, 0, FALSE);
+            break;
+        case OP_set_var_ref0:
+        case OP_set_var_ref1:
+        case OP_set_var_ref2:
+        case OP_set_var_ref3:
+            jit_emit_var_ref(s, op - OP_set_var_ref0);
+            jit_emit_put(s, JIT_RSI, 0, TRUE);
+            break;
+#endif
+        default:
+            for(i = 0; i < countof(jit_stack_ops); i++) {
+                if (jit_stack_ops[i].opcode == op) {
+                    jit_emit_stack_op(s, &jit_stack_ops[i]);
+                    break;
+                }
+            }
+            if (i == countof(jit_stack_ops)) {
+                jit_emit_bailout(s, pos);
+                s->sp_delta = 0;
+            }
+            break;
+        }
+    }
+    return 0;
+}
+
+static BOOL jit_is_supported(int opcode)
+{
+    int i;
+    if (jit_is_helper_op(opcode) || jit_has_template(opcode))
+        return TRUE;
+    for(i = 0; i < countof(jit_stack_ops); i++) {
+        if (jit_stack_ops[i].opcode == opcode)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+static void js_jit_free_code(JSRuntime *rt, JSJitCode *jc)
+{
+    munmap(jc->code, jc->code_size);
+    js_free_rt(rt, jc);
+}
+
+/* compile 'b' to native code. Return -1 if the function cannot be
+   compiled (no exception is raised). */
+static int js_jit_compile(JSRuntime *rt, JSFunctionBytecode *b)
+{
+    JSJitCompiler s_s, *s = &s_s;
+    JSJitCode *jc;
+    JSJitFixup *fx;
+    const uint8_t *bc = b->byte_code_buf;
+    int pos, target, n_ops, n_unsupported, entry_count, i;
+    uint8_t *code;
+
+    if (b->func_kind != JS_FUNC_NORMAL)
+        return -1;
+#ifdef CONFIG_BIGNUM
+    /* the fast paths do not implement the math mode */
+    if (b->js_mode & JS_MODE_MATH)
+        return -1;
+#endif
+    memset(s, 0, sizeof(*s));
+    s->rt = rt;
+    s->b = b;
+    s->labels = js_malloc_rt(rt, sizeof(s->labels[0]) * (b->byte_code_len + 1));
+    if (!s->labels)
+        return -1;
+    for(pos = 0; pos <= b->byte_code_len; pos++)
+        s->labels[pos] = -1;
+
+    /* find the jump targets. The function entry and the targets are
+       the positions where the interpreter may enter the native code. */
+    n_ops = 0;
+    n_unsupported = 0;
+    entry_count = 1;
+    s->labels[0] = -2;
+    for(pos = 0; pos < b->byte_code_len;
+        pos += short_opcode_info(bc[pos]).size) {
+        n_ops++;
+        if (!jit_is_supported(bc[pos]))
+            n_unsupported++;
+        target = jit_jump_target(bc, pos);
+        if (target >= 0 && s->labels[target] == -1) {
+            s->labels[target] = -2;
+            entry_count++;
+        }
+    }
+    /* not worth switching to the native code if most of the opcodes
+       return to the interpreter */
+    if (n_unsupported * 2 > n_ops)
+        goto fail;
+
+    dbuf_init2(&s->code, rt, (DynBufReallocFunc *)js_realloc_rt);
+    dbuf_init2(&s->fixups, rt, (DynBufReallocFunc *)js_realloc_rt);
+    jit_emit_code(s);
+    if (s->code.error || s->fixups.error)
+        goto fail_buf;
+    for(i = 0; i < s->fixups.size / sizeof(*fx); i++) {
+        fx = (JSJitFixup *)s->fixups.buf + i;
+        jit_patch32(s, fx->code_pos, s->labels[fx->pc_pos]);
+    }
+
+    jc = js_malloc_rt(rt, sizeof(*jc) + sizeof(jc->entries[0]) * entry_count);
+    if (!jc)
+        goto fail_buf;
+    code = mmap(NULL, s->code.size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED) {
+        js_free_rt(rt, jc);
+        goto fail_buf;
+    }
+    memcpy(code, s->code.buf, s->code.size);
+    if (mprotect(code, s->code.size, PROT_READ | PROT_EXEC)) {
+        munmap(code, s->code.size);
+        js_free_rt(rt, jc);
+        goto fail_buf;
+    }
+    jc->code = code;
+    jc->code_size = s->code.size;
+    jc->entry_count = 0;
+    for(pos = 0; pos < b->byte_code_len; pos++) {
+        if (s->labels[pos] >= 0) {
+            jc->entries[jc->entry_count].pc_pos = pos;
+            jc->entries[jc->entry_count].code_pos = s->labels[pos];
+            jc->entry_count++;
+        }
+    }
+    b->jit_code = jc;
+    dbuf_free(&s->code);
+    dbuf_free(&s->fixups);
+    js_free_rt(rt, s->labels);
+    return 0;
+ fail_buf:
+    dbuf_free(&s->code);
+    dbuf_free(&s->fixups);
+ fail:
+    js_free_rt(rt, s->labels);
+    return -1;
+}
+
+/* execute the native code of f->b from f->pc. Return JS_JIT_BAILOUT
+   with f->pc unchanged if f->pc is not an entry point. */
+static int js_jit_run(JSJitFrame *f)
+{
+    JSJitCode *jc = f->b->jit_code;
+    JSJitFunc *func;
+    uint32_t pc_pos;
+    int a, b, m;
+
+    pc_pos = f->pc - f->b->byte_code_buf;
+    a = 0;
+    b = jc->entry_count - 1;
+    while (a <= b) {
+        m = (a + b) >> 1;
+        if (jc->entries[m].pc_pos == pc_pos) {
+            func = (JSJitFunc *)(uintptr_t)jc->code;
+            return func(f, jc->code + jc->entries[m].code_pos);
+        } else if (jc->entries[m].pc_pos < pc_pos) {
+            a = m + 1;
+        } else {
+            b = m - 1;
+        }
+    }
+    return JS_JIT_BAILOUT;
+}
+
+/* execute one opcode as JS_CallInternal() does. 'pc' points to the
+   operands. Return -1 if exception with f->sp and f->pc set as in
+   the interpreter. The branches return their condition. */
+static int js_jit_op(JSJitFrame *f, const uint8_t *pc, int opcode)
+{
+    JSContext *ctx = f->ctx;
+    JSFunctionBytecode *b = f->b;
+    JSStackFrame *sf = f->sf;
+    JSValue *sp = f->sp;
+    JSValue *var_buf = f->var_buf;
+    JSVarRef **var_refs = f->var_refs;
+    JSValue ret_val;
+    JSAtom atom;
+    int ret = 0, idx, ic_idx, call_argc;
+    JSValue *call_argv;
+
+    switch(opcode) {
+    case OP_push_const:
+        *sp++ = JS_DupValue(ctx, b->cpool[get_u32(pc)]);
+        pc += 4;
+        break;
+    case OP_fclosure:
+        {
+            JSValue bfunc = JS_DupValue(ctx, b->cpool[get_u32(pc)]);
+            pc += 4;
+            *sp++ = js_closure(ctx, bfunc, var_refs, sf);
+            if (unlikely(JS_IsException(sp[-1])))
+                goto exception;
+        }
+        break;
+    case OP_push_atom_value:
+        *sp++ = JS_AtomToValue(ctx, get_u32(pc));
+        pc += 4;
+        break;
+    case OP_object:
+        *sp++ = JS_NewObject(ctx);
+        if (unlikely(JS_IsException(sp[-1])))
+            goto exception;
+        break;
+    case OP_push_this:
+        if (js_op_push_this(ctx, b, f->this_obj, sp))
+            goto exception;
+        sp++;
+        break;
+    case OP_catch:
+        {
+            int32_t diff;
+            diff = get_u32(pc);
+            sp[0] = JS_NewCatchOffset(ctx, pc + diff - b->byte_code_buf);
+            sp++;
+            pc += 4;
+        }
+        break;
+    case OP_call:
+        call_argc = get_u16(pc);
+        pc += 2;
+        goto has_call_argc;
+#if SHORT_OPCODES
+    case OP_call0:
+    case OP_call1:
+    case OP_call2:
+    case OP_call3:
+        call_argc = opcode - OP_call0;
+#endif
+    has_call_argc:
+        call_argv = sp - call_argc;
+        sf->cur_pc = pc;
+        ret_val = JS_CallInternal(ctx, call_argv[-1], JS_UNDEFINED,
+                                  JS_UNDEFINED, call_argc, call_argv, 0);
+        if (unlikely(JS_IsException(ret_val)))
+            goto exception;
+        sp = js_op_call_end(ctx, call_argv, call_argc, 1, ret_val);
+        break;
+    case OP_call_constructor:
+        call_argc = get_u16(pc);
+        pc += 2;
+        call_argv = sp - call_argc;
+        sf->cur_pc = pc;
+        ret_val = JS_CallConstructorInternal(ctx, call_argv[-2],
+                                             call_argv[-1],
+                                             call_argc, call_argv, 0);
+        if (unlikely(JS_IsException(ret_val)))
+            goto exception;
+        sp = js_op_call_end(ctx, call_argv, call_argc, 2, ret_val);
+        break;
+    case OP_call_method:
+        call_argc = get_u16(pc);
+        pc += 2;
+        call_argv = sp - call_argc;
+        sf->cur_pc = pc;
+        ret_val = JS_CallInternal(ctx, call_argv[-1], call_argv[-2],
+                                  JS_UNDEFINED, call_argc, call_argv, 0);
+        if (unlikely(JS_IsException(ret_val)))
+            goto exception;
+        sp = js_op_call_end(ctx, call_argv, call_argc, 2, ret_val);
+        break;
+    case OP_array_from:
+        call_argc = get_u16(pc);
+        pc += 2;
+        if (js_op_array_from(ctx, sp, call_argc))
+            goto exception;
+        sp -= call_argc - 1;
+        break;
+    case OP_apply:
+        idx = get_u16(pc);
+        pc += 2;
+        if (js_op_apply(ctx, sp, idx))
+            goto exception;
+        sp -= 2;
+        break;
+    case OP_throw:
+        JS_Throw(ctx, *--sp);
+        goto exception;
+    case OP_get_var_undef:
+    case OP_get_var:
+        atom = get_u32(pc);
+        ic_idx = get_u16(pc + 4);
+        pc += 6;
+        if (js_op_get_var(ctx, b, sp, atom, ic_idx,
+                          opcode - OP_get_var_undef))
+            goto exception;
+        sp++;
+        break;
+    case OP_put_var:
+    case OP_put_var_init:
+        atom = get_u32(pc);
+        ic_idx = get_u16(pc + 4);
+        pc += 6;
+        ret = js_op_put_var(ctx, b, sp, atom, ic_idx, opcode - OP_put_var);
+        sp--;
+        break;
+    case OP_put_var_strict:
+        atom = get_u32(pc);
+        ic_idx = get_u16(pc + 4);
+        pc += 6;
+        ret = js_op_put_var_strict(ctx, b, sp, atom, ic_idx);
+        sp -= 2;
+        break;
+    case OP_get_loc_check:
+        idx = get_u16(pc);
+        pc += 2;
+        if (js_op_get_var_check(ctx, b, sp, &var_buf[idx], idx, FALSE))
+            goto exception;
+        sp++;
+        break;
+    case OP_put_loc_check:
+    case OP_put_loc_check_init:
+        idx = get_u16(pc);
+        pc += 2;
+        if (js_op_put_var_check(ctx, b, sp, &var_buf[idx], idx, FALSE,
+                                opcode == OP_put_loc_check_init))
+            goto exception;
+        sp--;
+        break;
+    case OP_get_var_ref_check:
+        idx = get_u16(pc);
+        pc += 2;
+        if (js_op_get_var_check(ctx, b, sp, var_refs[idx]->pvalue, idx, TRUE))
+            goto exception;
+        sp++;
+        break;
+    case OP_put_var_ref_check:
+    case OP_put_var_ref_check_init:
+        idx = get_u16(pc);
+        pc += 2;
+        if (js_op_put_var_check(ctx, b, sp, var_refs[idx]->pvalue, idx, TRUE,
+                                opcode == OP_put_var_ref_check_init))
+            goto exception;
+        sp--;
+        break;
+    case OP_close_loc:
+        idx = get_u16(pc);
+        pc += 2;
+        close_lexical_var(ctx, sf, idx, FALSE);
+        break;
+    case OP_for_in_start:
+        if (js_for_in_start(ctx, sp))
+            goto exception;
+        break;
+    case OP_for_in_next:
+        if (js_for_in_next(ctx, sp))
+            goto exception;
+        sp += 2;
+        break;
+    case OP_for_of_start:
+        if (js_for_of_start(ctx, sp, FALSE))
+            goto exception;
+        sp += 1;
+        *sp++ = JS_NewCatchOffset(ctx, 0);
+        break;
+    case OP_for_of_next:
+        {
+            int offset = -3 - pc[0];
+            pc += 1;
+            if (js_for_of_next(ctx, sp, offset))
+                goto exception;
+            sp += 2;
+        }
+        break;
+    case OP_iterator_close:
+        ret = js_op_iterator_close(ctx, sp);
+        sp -= 3;
+        break;
+    case OP_get_field:
+        atom = get_u32(pc);
+        ic_idx = get_u16(pc + 4);
+        pc += 6;
+        if (js_op_get_field(ctx, b, sp, atom, ic_idx))
+            goto exception;
+        break;
+    case OP_get_field2:
+        atom = get_u32(pc);
+        ic_idx = get_u16(pc + 4);
+        pc += 6;
+        if (js_op_get_field2(ctx, b, sp, atom, ic_idx))
+            goto exception;
+        sp++;
+        break;
+    case OP_put_field:
+        atom = get_u32(pc);
+        ic_idx = get_u16(pc + 4);
+        pc += 6;
+        ret = js_op_put_field(ctx, b, sp, atom, ic_idx);
+        sp -= 2;
+        break;
+    case OP_define_field:
+        atom = get_u32(pc);
+        pc += 4;
+        ret = JS_DefinePropertyValue(ctx, sp[-2], atom, sp[-1],
+                                     JS_PROP_C_W_E | JS_PROP_THROW);
+        sp--;
+        break;
+    case OP_define_array_el:
+        ret = JS_DefinePropertyValueValue(ctx, sp[-3], JS_DupValue(ctx, sp[-2]), sp[-1],
+                                          JS_PROP_C_W_E | JS_PROP_THROW);
+        sp -= 1;
+        break;
+    case OP_get_array_el:
+        ret_val = JS_GetPropertyValue(ctx, sp[-2], sp[-1]);
+        JS_FreeValue(ctx, sp[-2]);
+        sp[-2] = ret_val;
+        sp--;
+        if (unlikely(JS_IsException(ret_val)))
+            goto exception;
+        break;
+    case OP_get_array_el2:
+        sp[-1] = JS_GetPropertyValue(ctx, sp[-2], sp[-1]);
+        if (unlikely(JS_IsException(sp[-1])))
+            goto exception;
+        break;
+    case OP_put_array_el:
+        ret = JS_SetPropertyValue(ctx, sp[-3], sp[-2], sp[-1], JS_PROP_THROW_STRICT);
+        JS_FreeValue(ctx, sp[-3]);
+        sp -= 3;
+        break;
+    case OP_add:
+        if (js_op_add(ctx, sp))
+            goto exception;
+        sp--;
+        break;
+    case OP_add_loc:
+        idx = *pc;
+        pc += 1;
+        ret = js_op_add_loc(ctx, &var_buf[idx], sp);
+        sp--;
+        break;
+    case OP_sub:
+    case OP_mul:
+    case OP_div:
+    case OP_mod:
+    case OP_pow:
+        /* the integer and float64 fast paths of OP_sub and OP_mul
+           are in the templates */
+        if (js_binary_arith_slow(ctx, sp, opcode))
+            goto exception;
+        sp--;
+        break;
+    case OP_plus:
+        if (js_op_plus(ctx, sp))
+            goto exception;
+        break;
+    case OP_neg:
+        if (js_op_neg(ctx, sp))
+            goto exception;
+        break;
+    case OP_inc:
+    case OP_dec:
+        if (js_unary_arith_slow(ctx, sp, opcode))
+            goto exception;
+        break;
+    case OP_post_inc:
+    case OP_post_dec:
+        if (js_post_inc_slow(ctx, sp, opcode))
+            goto exception;
+        sp++;
+        break;
+    case OP_inc_loc:
+    case OP_dec_loc:
+        idx = *pc;
+        pc += 1;
+        if (js_op_inc_loc(ctx, &var_buf[idx],
+                          opcode == OP_inc_loc ? OP_inc : OP_dec))
+            goto exception;
+        break;
+    case OP_not:
+        if (js_not_slow(ctx, sp))
+            goto exception;
+        break;
+    case OP_lnot:
+        sp[-1] = JS_NewBool(ctx, !JS_ToBoolFree(ctx, sp[-1]));
+        break;
+    case OP_shl:
+    case OP_sar:
+    case OP_and:
+    case OP_or:
+    case OP_xor:
+        if (js_binary_logic_slow(ctx, sp, opcode))
+            goto exception;
+        sp--;
+        break;
+    case OP_shr:
+        if (js_shr_slow(ctx, sp))
+            goto exception;
+        sp--;
+        break;
+    case OP_lt:
+    case OP_lte:
+    case OP_gt:
+    case OP_gte:
+        if (js_relational_slow(ctx, sp, opcode))
+            goto exception;
+        sp--;
+        break;
+    case OP_eq:
+    case OP_neq:
+        if (js_eq_slow(ctx, sp, opcode == OP_neq))
+            goto exception;
+        sp--;
+        break;
+    case OP_strict_eq:
+    case OP_strict_neq:
+        if (js_strict_eq_slow(ctx, sp, opcode == OP_strict_neq))
+            goto exception;
+        sp--;
+        break;
+    case OP_if_true:
+    case OP_if_false:
+#if SHORT_OPCODES
+    case OP_if_true8:
+    case OP_if_false8:
+#endif
+        f->sp = sp - 1;
+        return JS_ToBoolFree(ctx, sp[-1]);
+#if SHORT_OPCODES
+    case OP_lt_if_false8:
+    case OP_lte_if_false8:
+    case OP_gt_if_false8:
+    case OP_gte_if_false8:
+        pc += 1;
+        if (js_relational_slow(ctx, sp, opcode - OP_lt_if_false8 + OP_lt))
+            goto exception;
+        f->sp = sp - 2;
+        return JS_VALUE_GET_BOOL(sp[-2]);
+#endif
+    case OP_typeof:
+        js_op_typeof(ctx, sp);
+        break;
+    case OP_in:
+        if (js_operator_in(ctx, sp))
+            goto exception;
+        sp--;
+        break;
+    case OP_instanceof:
+        if (js_operator_instanceof(ctx, sp))
+            goto exception;
+        sp--;
+        break;
+    case OP_is_undefined_or_null:
+#if SHORT_OPCODES
+    case OP_is_undefined:
+    case OP_is_null:
+    case OP_typeof_is_undefined:
+    case OP_typeof_is_function:
+#endif
+        js_op_is(ctx, sp, opcode);
+        break;
+    case OP_to_object:
+        if (js_op_to_object(ctx, sp))
+            goto exception;
+        break;
+    case OP_to_propkey:
+        if (js_op_to_propkey(ctx, sp))
+            goto exception;
+        break;
+    case OP_to_propkey2:
+        if (js_op_to_propkey2(ctx, sp))
+            goto exception;
+        break;
+#if SHORT_OPCODES
+    case OP_push_const8:
+        *sp++ = JS_DupValue(ctx, b->cpool[*pc++]);
+        break;
+    case OP_fclosure8:
+        *sp++ = js_closure(ctx, JS_DupValue(ctx, b->cpool[*pc++]), var_refs, sf);
+        if (unlikely(JS_IsException(sp[-1])))
+            goto exception;
+        break;
+    case OP_push_empty_string:
+        *sp++ = JS_AtomToString(ctx, JS_ATOM_empty_string);
+        break;
+    case OP_get_length:
+        ret_val = JS_GetProperty(ctx, sp[-1], JS_ATOM_length);
+        if (unlikely(JS_IsException(ret_val)))
+            goto exception;
+        JS_FreeValue(ctx, sp[-1]);
+        sp[-1] = ret_val;
+        break;
+#endif
+    default:
+        abort();
+    }
+    if (unlikely(ret < 0))
+        goto exception;
+    f->sp = sp;
+    return 0;
+ exception:
+    f->sp = sp;
+    f->pc = pc;
+    return -1;
+}
+
+#endif /* CONFIG_JIT */
+
 /*******************************************************************/
 /* runtime functions & objects */
 
@@ -36277,6 +42623,15 @@ static JSValue JS_ToObject(JSContext *ctx, JSValueConst val)
     case JS_TAG_FLOAT64:
         obj = JS_NewObjectClass(ctx, JS_CLASS_NUMBER);
         goto set_value;
+    case JS_TAG_STRING_ROPE:
+        /* the String object holds a flat string */
+        {
+            JSString *p1 = js_string_rope_linearize(ctx, val);
+            if (!p1)
+                return JS_EXCEPTION;
+            val = JS_MKPTR(JS_TAG_STRING, p1);
+        }
+        /* fall thru */
     case JS_TAG_STRING:
         /* XXX: should call the string constructor */
         {
@@ -37611,9 +43966,33 @@ static void free_arg_list(JSContext *ctx, JSValue *tab, uint32_t len)
     js_free(ctx, tab);
 }
 
+/* Return TRUE if the arguments of 'func_obj' can be passed in a buffer
+   which is not owned by the caller: a bytecode function with a simple
+   parameter list only reads 'argv' when it is entered. */
+static BOOL js_function_borrows_argv(JSValueConst func_obj)
+{
+    JSObject *p;
+
+    for(;;) {
+        if (JS_VALUE_GET_TAG(func_obj) != JS_TAG_OBJECT)
+            return FALSE;
+        p = JS_VALUE_GET_OBJ(func_obj);
+        if (p->class_id != JS_CLASS_BOUND_FUNCTION)
+            break;
+        /* js_call_bound_function() only copies the argument pointers */
+        func_obj = p->u.bound_function->func_obj;
+    }
+    return (p->class_id == JS_CLASS_BYTECODE_FUNCTION &&
+            p->u.func.function_bytecode->has_simple_parameter_list);
+}
+
 /* XXX: should use ValueArray */
+/* If 'pborrowed' is not NULL and 'array_arg' is a non empty fast
+   array, its value array is returned without copy and '*pborrowed' is
+   set to TRUE. It must not be freed and is only valid until the
+   array is modified. */
 static JSValue *build_arg_list(JSContext *ctx, uint32_t *plen,
-                               JSValueConst array_arg)
+                               JSValueConst array_arg, BOOL *pborrowed)
 {
     uint32_t len, i;
     JSValue *tab, ret;
@@ -37629,11 +44008,19 @@ static JSValue *build_arg_list(JSContext *ctx, uint32_t *plen,
         JS_ThrowInternalError(ctx, "too many arguments");
         return NULL;
     }
+    p = JS_VALUE_GET_OBJ(array_arg);
+    if (pborrowed && len != 0 &&
+        (p->class_id == JS_CLASS_ARRAY || p->class_id == JS_CLASS_ARGUMENTS) &&
+        p->fast_array &&
+        len == p->u.array.count) {
+        *pborrowed = TRUE;
+        *plen = len;
+        return p->u.array.u.values;
+    }
     /* avoid allocating 0 bytes */
     tab = js_mallocz(ctx, sizeof(tab[0]) * max_uint32(1, len));
     if (!tab)
         return NULL;
-    p = JS_VALUE_GET_OBJ(array_arg);
     if ((p->class_id == JS_CLASS_ARRAY || p->class_id == JS_CLASS_ARGUMENTS) &&
         p->fast_array &&
         len == p->u.array.count) {
@@ -37662,6 +44049,7 @@ static JSValue js_function_apply(JSContext *ctx, JSValueConst this_val,
     JSValueConst this_arg, array_arg;
     uint32_t len;
     JSValue *tab, ret;
+    BOOL borrowed;
 
     if (check_function(ctx, this_val))
         return JS_EXCEPTION;
@@ -37671,15 +44059,81 @@ static JSValue js_function_apply(JSContext *ctx, JSValueConst this_val,
          JS_VALUE_GET_TAG(array_arg) == JS_TAG_NULL) && magic != 2) {
         return JS_Call(ctx, this_val, this_arg, 0, NULL);
     }
-    tab = build_arg_list(ctx, &len, array_arg);
+    borrowed = FALSE;
+    /* no copy for a constructor call: the getter of
+       new_target.prototype could modify the array before the callee
+       reads it */
+    tab = build_arg_list(ctx, &len, array_arg,
+                         !(magic & 1) && js_function_borrows_argv(this_val) ?
+                         &borrowed : NULL);
     if (!tab)
         return JS_EXCEPTION;
     if (magic & 1) {
         ret = JS_CallConstructor2(ctx, this_val, this_arg, len, (JSValueConst *)tab);
     } else {
-        ret = JS_Call(ctx, this_val, this_arg, len, (JSValueConst *)tab);
+        ret = JS_CallInternal(ctx, this_val, this_arg, JS_UNDEFINED, len, tab,
+                              JS_CALL_FLAG_COPY_ARGV);
     }
-    free_arg_list(ctx, tab, len);
+    if (!borrowed)
+        free_arg_list(ctx, tab, len);
+    return ret;
+}
+
+/* same as js_function_apply() with the arguments given by iterating
+   'iterable' (f(...iterable) call) */
+static JSValue js_function_apply_spread(JSContext *ctx, JSValueConst func_obj,
+                                        JSValueConst this_arg,
+                                        JSValueConst iterable, int magic)
+{
+    JSValue *arrp, *tab, ret, stack[3];
+    JSValueConst args[2];
+    uint32_t len, i;
+    BOOL borrowed;
+
+    if (js_get_fast_array_iterable(ctx, iterable, &arrp, &len) &&
+        len <= JS_MAX_LOCAL_VARS) {
+        /* the iteration has no side effect: the argument array is not
+           built */
+        if (check_function(ctx, func_obj))
+            return JS_EXCEPTION;
+        borrowed = (len != 0 && !(magic & 1) &&
+                    js_function_borrows_argv(func_obj));
+        if (borrowed) {
+            tab = arrp;
+        } else {
+            /* avoid allocating 0 bytes */
+            tab = js_malloc(ctx, sizeof(tab[0]) * max_uint32(1, len));
+            if (!tab)
+                return JS_EXCEPTION;
+            for(i = 0; i < len; i++)
+                tab[i] = JS_DupValue(ctx, arrp[i]);
+        }
+        if (magic & 1) {
+            ret = JS_CallConstructor2(ctx, func_obj, this_arg, len,
+                                      (JSValueConst *)tab);
+        } else {
+            ret = JS_CallInternal(ctx, func_obj, this_arg, JS_UNDEFINED,
+                                  len, tab, JS_CALL_FLAG_COPY_ARGV);
+        }
+        if (!borrowed)
+            free_arg_list(ctx, tab, len);
+        return ret;
+    }
+
+    /* build the argument array as OP_append does */
+    stack[0] = JS_NewArray(ctx);
+    if (JS_IsException(stack[0]))
+        return JS_EXCEPTION;
+    stack[1] = JS_NewInt32(ctx, 0);
+    stack[2] = JS_VALUE_CONST_CAST(iterable);
+    if (js_append_enumerate(ctx, stack + 3)) {
+        JS_FreeValue(ctx, stack[0]);
+        return JS_EXCEPTION;
+    }
+    args[0] = this_arg;
+    args[1] = stack[0];
+    ret = js_function_apply(ctx, func_obj, 2, args, magic);
+    JS_FreeValue(ctx, stack[0]);
     return ret;
 }
 
@@ -40208,6 +46662,8 @@ static JSValue js_thisStringValue(JSContext *ctx, JSValueConst this_val)
 {
     if (JS_VALUE_GET_TAG(this_val) == JS_TAG_STRING)
         return JS_DupValue(ctx, this_val);
+    if (JS_VALUE_GET_TAG(this_val) == JS_TAG_STRING_ROPE)
+        return JS_ToString(ctx, this_val);
 
     if (JS_VALUE_GET_TAG(this_val) == JS_TAG_OBJECT) {
         JSObject *p = JS_VALUE_GET_OBJ(this_val);
@@ -40738,8 +47194,10 @@ static JSValue js_string___GetSubstitution(JSContext *ctx, JSValueConst this_val
     if (!JS_IsString(rep) || !JS_IsString(str))
         return JS_ThrowTypeError(ctx, "not a string");
 
-    sp = JS_VALUE_GET_STRING(str);
-    rp = JS_VALUE_GET_STRING(rep);
+    sp = js_get_flat_string(ctx, str);
+    rp = js_get_flat_string(ctx, rep);
+    if (!sp || !rp)
+        return JS_EXCEPTION;
 
     string_buffer_init(ctx, b, 0);
 
@@ -43886,6 +50344,7 @@ static JSValue js_json_check(JSContext *ctx, JSONStringifyContext *jsc,
         if (JS_IsFunction(ctx, val))
             break;
     case JS_TAG_STRING:
+    case JS_TAG_STRING_ROPE:
     case JS_TAG_INT:
     case JS_TAG_FLOAT64:
 #ifdef CONFIG_BIGNUM
@@ -44066,6 +50525,11 @@ static int js_json_to_str(JSContext *ctx, JSONStringifyContext *jsc,
         JS_FreeValue(ctx, indent1);
         JS_FreeValue(ctx, prop);
         return 0;
+    case JS_TAG_STRING_ROPE:
+        val = JS_ToStringFree(ctx, val);
+        if (JS_IsException(val))
+            goto exception;
+        /* fall thru */
     case JS_TAG_STRING:
         val = JS_ToQuotedStringFree(ctx, val);
         if (JS_IsException(val))
@@ -44196,8 +50660,11 @@ JSValue JS_JSONStringify(JSContext *ctx, JSValueConst obj,
             goto exception;
         jsc->gap = JS_NewStringLen(ctx, "          ", n);
     } else if (JS_IsString(space)) {
-        JSString *p = JS_VALUE_GET_STRING(space);
-        jsc->gap = js_sub_string(ctx, p, 0, min_int(p->len, 10));
+        JSString *p = js_get_flat_string(ctx, space);
+        if (!p)
+            jsc->gap = JS_EXCEPTION;
+        else
+            jsc->gap = js_sub_string(ctx, p, 0, min_int(p->len, 10));
     } else {
         jsc->gap = JS_DupValue(ctx, jsc->empty);
     }
@@ -44285,7 +50752,7 @@ static JSValue js_reflect_construct(JSContext *ctx, JSValueConst this_val,
     } else {
         new_target = func;
     }
-    tab = build_arg_list(ctx, &len, array_arg);
+    tab = build_arg_list(ctx, &len, array_arg, NULL);
     if (!tab)
         return JS_EXCEPTION;
     ret = JS_CallConstructor2(ctx, func, new_target, len, (JSValueConst *)tab);
@@ -45655,6 +52122,9 @@ static uint32_t map_hash_key(JSContext *ctx, JSValueConst key)
     case JS_TAG_STRING:
         h = hash_string(JS_VALUE_GET_STRING(key), 0);
         break;
+    case JS_TAG_STRING_ROPE:
+        h = hash_string_rope(key, 0);
+        break;
     case JS_TAG_OBJECT:
     case JS_TAG_SYMBOL:
         h = (uintptr_t)JS_VALUE_GET_PTR(key) * 3163;
@@ -45733,7 +52203,7 @@ static JSMapRecord *map_add_record(JSContext *ctx, JSMapState *s,
     uint32_t h;
     JSMapRecord *mr;
 
-    mr = js_malloc(ctx, sizeof(*mr));
+    mr = js_slab_malloc(ctx, sizeof(*mr));
     if (!mr)
         return NULL;
     mr->ref_count = 1;
@@ -45792,7 +52262,7 @@ static void map_delete_record(JSRuntime *rt, JSMapState *s, JSMapRecord *mr)
     JS_FreeValueRT(rt, mr->value);
     if (--mr->ref_count == 0) {
         list_del(&mr->link);
-        js_free_rt(rt, mr);
+        js_slab_free_rt(rt, mr, sizeof(*mr));
     } else {
         /* keep a zombie record for iterators */
         mr->empty = TRUE;
@@ -45808,7 +52278,7 @@ static void map_decref_record(JSRuntime *rt, JSMapRecord *mr)
         /* the record can be safely removed */
         assert(mr->empty);
         list_del(&mr->link);
-        js_free_rt(rt, mr);
+        js_slab_free_rt(rt, mr, sizeof(*mr));
     }
 }
 
@@ -45832,7 +52302,7 @@ static void reset_weak_ref(JSRuntime *rt, JSObject *p)
     for(mr = p->first_weak_ref; mr != NULL; mr = mr_next) {
         mr_next = mr->next_weak_ref;
         JS_FreeValueRT(rt, mr->value);
-        js_free_rt(rt, mr);
+        js_slab_free_rt(rt, mr, sizeof(*mr));
     }
 
     p->first_weak_ref = NULL; /* fail safe */
@@ -46007,7 +52477,7 @@ static void js_map_finalizer(JSRuntime *rt, JSValue val)
                     JS_FreeValueRT(rt, mr->key);
                 JS_FreeValueRT(rt, mr->value);
             }
-            js_free_rt(rt, mr);
+            js_slab_free_rt(rt, mr, sizeof(*mr));
         }
         js_free_rt(rt, s->hash_table);
         js_free_rt(rt, s);
@@ -49191,6 +55661,7 @@ static JSValue JS_ToBigIntCtorFree(JSContext *ctx, JSValue val)
             break;
         goto redo;
     case JS_TAG_STRING:
+    case JS_TAG_STRING_ROPE:
         val = JS_StringToBigIntErr(ctx, val);
         break;
     case JS_TAG_OBJECT:
@@ -49745,6 +56216,7 @@ static JSValue js_bigfloat_constructor(JSContext *ctx,
                 break;
             goto redo;
         case JS_TAG_STRING:
+        case JS_TAG_STRING_ROPE:
             {
                 const char *str, *p;
                 size_t len;
@@ -50423,6 +56895,7 @@ static JSValue JS_ToBigDecimalFree(JSContext *ctx, JSValue val,
             break;
         goto redo;
     case JS_TAG_STRING:
+    case JS_TAG_STRING_ROPE:
         {
             const char *str, *p;
             size_t len;
@@ -54077,3 +60550,771 @@ void JS_AddIntrinsicTypedArrays(JSContext *ctx)
     JS_AddIntrinsicAtomics(ctx);
 #endif
 }
+
+/* Context cloning */
+
+typedef struct CloneEntry {
+    void *src; /* GC object of the source context */
+    void *dst; /* its copy (one reference is held by the CloneState) */
+} CloneEntry;
+
+typedef struct CloneState {
+    JSContext *ctx; /* source context, used for allocations and errors */
+    JSContext *new_ctx;
+    CloneEntry *hash; /* open addressing hash table indexed by 'src' */
+    int hash_bits;
+    uint32_t hash_count;
+    /* copied objects whose content remains to be copied */
+    CloneEntry *todo;
+    int todo_count;
+    int todo_size;
+} CloneState;
+
+static JSValue clone_value(CloneState *s, JSValueConst val);
+
+static inline uint32_t clone_hash(const void *ptr, int hash_bits)
+{
+    return ((uint32_t)((uintptr_t)ptr >> 3) * 0x9e370001) >> (32 - hash_bits);
+}
+
+static void *clone_find(CloneState *s, const void *src)
+{
+    uint32_t h, mask;
+    CloneEntry *e;
+
+    if (!s->hash)
+        return NULL;
+    mask = (1 << s->hash_bits) - 1;
+    for(h = clone_hash(src, s->hash_bits);; h = (h + 1) & mask) {
+        e = &s->hash[h];
+        if (e->src == src)
+            return e->dst;
+        if (!e->src)
+            return NULL;
+    }
+}
+
+static void clone_insert(CloneEntry *hash, int hash_bits,
+                         void *src, void *dst)
+{
+    uint32_t h, mask;
+
+    mask = (1 << hash_bits) - 1;
+    for(h = clone_hash(src, hash_bits); hash[h].src; h = (h + 1) & mask)
+        continue;
+    hash[h].src = src;
+    hash[h].dst = dst;
+}
+
+/* record that 'dst' is the copy of 'src'. If 'need_copy' is TRUE, the
+   content of the object is copied later by clone_flush(). */
+static int clone_add(CloneState *s, void *src, void *dst, BOOL need_copy)
+{
+    CloneEntry *new_hash;
+    int new_bits;
+    uint32_t i;
+
+    if (2 * (s->hash_count + 1) > (1U << s->hash_bits)) {
+        new_bits = max_int(s->hash_bits + 1, 10);
+        new_hash = js_mallocz(s->ctx, sizeof(new_hash[0]) << new_bits);
+        if (!new_hash)
+            return -1;
+        if (s->hash) {
+            for(i = 0; i < (1U << s->hash_bits); i++) {
+                if (s->hash[i].src)
+                    clone_insert(new_hash, new_bits,
+                                 s->hash[i].src, s->hash[i].dst);
+            }
+            js_free(s->ctx, s->hash);
+        }
+        s->hash = new_hash;
+        s->hash_bits = new_bits;
+    }
+    if (need_copy) {
+        if (js_resize_array(s->ctx, (void **)&s->todo, sizeof(s->todo[0]),
+                            &s->todo_size, s->todo_count + 1))
+            return -1;
+        s->todo[s->todo_count].src = src;
+        s->todo[s->todo_count].dst = dst;
+        s->todo_count++;
+    }
+    clone_insert(s->hash, s->hash_bits, src, dst);
+    s->hash_count++;
+    return 0;
+}
+
+static JSContext *clone_realm(CloneState *s, JSContext *realm)
+{
+    if (realm == s->ctx)
+        realm = s->new_ctx;
+    return JS_DupContext(realm);
+}
+
+static JSObject *clone_object(CloneState *s, JSObject *p1);
+
+static JSShape *clone_shape(CloneState *s, JSShape *sh1)
+{
+    JSRuntime *rt = s->ctx->rt;
+    JSShape *sh;
+    JSShapeProperty *pr;
+    JSObject *proto;
+    uint32_t h;
+    int i;
+
+    sh = clone_find(s, sh1);
+    if (sh)
+        return js_dup_shape(sh);
+    if (sh1->is_hashed && !sh1->proto) {
+        /* a hashed shape without prototype would be shared anyway */
+        if (clone_add(s, sh1, js_dup_shape(sh1), FALSE)) {
+            js_free_shape(rt, sh1);
+            return NULL;
+        }
+        return js_dup_shape(sh1);
+    }
+    for(i = 0, pr = get_shape_prop(sh1); i < sh1->prop_count; i++, pr++) {
+        if (pr->atom != JS_ATOM_NULL &&
+            (pr->flags & JS_PROP_TMASK) == JS_PROP_VARREF) {
+            JS_ThrowTypeError(s->ctx, "cannot clone a variable reference");
+            return NULL;
+        }
+    }
+    proto = NULL;
+    if (sh1->proto) {
+        proto = clone_object(s, sh1->proto);
+        if (!proto)
+            return NULL;
+    }
+    sh = js_clone_shape(s->ctx, sh1);
+    if (!sh)
+        goto fail;
+    if (sh->proto)
+        JS_FreeValueRT(rt, JS_MKPTR(JS_TAG_OBJECT, sh->proto));
+    sh->proto = proto;
+    proto = NULL;
+    if (sh1->is_hashed) {
+        /* same hash as if the properties were added one by one */
+        h = shape_initial_hash(sh->proto);
+        for(i = 0, pr = get_shape_prop(sh); i < sh->prop_count; i++, pr++) {
+            h = shape_hash(shape_hash(h, pr->atom), pr->flags);
+        }
+        if (2 * (rt->shape_hash_count + 1) > rt->shape_hash_size)
+            resize_shape_hash(rt, rt->shape_hash_bits + 1);
+        sh->hash = h;
+        sh->is_hashed = TRUE;
+        js_shape_hash_link(rt, sh);
+    }
+    if (clone_add(s, sh1, sh, FALSE)) {
+        js_free_shape(rt, sh);
+        return NULL;
+    }
+    return js_dup_shape(sh);
+ fail:
+    if (proto)
+        JS_FreeValueRT(rt, JS_MKPTR(JS_TAG_OBJECT, proto));
+    return NULL;
+}
+
+/* Create the copy of 'p1' with empty properties. The object is always
+   in a consistent state for the finalizers and the GC. */
+static JSObject *clone_object(CloneState *s, JSObject *p1)
+{
+    JSContext *ctx = s->ctx;
+    JSRuntime *rt = ctx->rt;
+    JSObject *p;
+    JSShape *sh;
+    JSShapeProperty *prs;
+    JSProperty *pr, *pr1;
+    JSBoundFunction *bf;
+    int i;
+
+    p = clone_find(s, p1);
+    if (p) {
+        p->header.ref_count++;
+        return p;
+    }
+
+    bf = NULL;
+    switch(p1->class_id) {
+    case JS_CLASS_OBJECT:
+    case JS_CLASS_ARRAY:
+    case JS_CLASS_ERROR:
+    case JS_CLASS_NUMBER:
+    case JS_CLASS_STRING:
+    case JS_CLASS_BOOLEAN:
+    case JS_CLASS_SYMBOL:
+    case JS_CLASS_DATE:
+#ifdef CONFIG_BIGNUM
+    case JS_CLASS_BIG_INT:
+    case JS_CLASS_BIG_FLOAT:
+    case JS_CLASS_BIG_DECIMAL:
+#endif
+    case JS_CLASS_C_FUNCTION:
+    case JS_CLASS_C_FUNCTION_DATA:
+    case JS_CLASS_BYTECODE_FUNCTION:
+    case JS_CLASS_GENERATOR_FUNCTION:
+    case JS_CLASS_ASYNC_FUNCTION:
+    case JS_CLASS_ASYNC_GENERATOR_FUNCTION:
+    case JS_CLASS_REGEXP:
+    case JS_CLASS_MAP:
+    case JS_CLASS_SET:
+        break;
+    case JS_CLASS_BOUND_FUNCTION:
+        /* the finalizer does not accept a NULL bound function */
+        bf = js_malloc(ctx, sizeof(*bf) + p1->u.bound_function->argc *
+                       sizeof(JSValue));
+        if (!bf)
+            return NULL;
+        bf->func_obj = JS_UNDEFINED;
+        bf->this_val = JS_UNDEFINED;
+        bf->argc = p1->u.bound_function->argc;
+        for(i = 0; i < bf->argc; i++)
+            bf->argv[i] = JS_UNDEFINED;
+        break;
+    default:
+        {
+            char buf[ATOM_GET_STR_BUF_SIZE];
+            JS_ThrowTypeError(ctx, "cannot clone an object of class '%s'",
+                              JS_AtomGetStr(ctx, buf, sizeof(buf),
+                                            rt->class_array[p1->class_id].class_name));
+        }
+        return NULL;
+    }
+
+    sh = clone_shape(s, p1->shape);
+    if (!sh)
+        goto fail;
+    p = js_slab_malloc(ctx, sizeof(JSObject));
+    if (!p)
+        goto fail;
+    p->prop = js_malloc(ctx, sizeof(JSProperty) * sh->prop_size);
+    if (!p->prop) {
+        js_slab_free_rt(rt, p, sizeof(JSObject));
+        goto fail;
+    }
+    p->class_id = p1->class_id;
+    p->extensible = p1->extensible;
+    p->free_mark = 0;
+    p->is_exotic = p1->is_exotic;
+    p->fast_array = p1->fast_array;
+    p->is_constructor = p1->is_constructor;
+    p->is_uncatchable_error = p1->is_uncatchable_error;
+    p->tmp_mark = 0;
+    p->is_HTMLDDA = p1->is_HTMLDDA;
+    p->first_weak_ref = NULL;
+    p->shape = sh;
+    memset(&p->u, 0, sizeof(p->u));
+
+    prs = get_shape_prop(sh);
+    for(i = 0; i < sh->prop_count; i++, prs++) {
+        pr = &p->prop[i];
+        pr1 = &p1->prop[i];
+        if (prs->atom == JS_ATOM_NULL) {
+            pr->u.value = JS_UNDEFINED;
+        } else if ((prs->flags & JS_PROP_TMASK) == JS_PROP_GETSET) {
+            pr->u.getset.getter = NULL;
+            pr->u.getset.setter = NULL;
+        } else if ((prs->flags & JS_PROP_TMASK) == JS_PROP_AUTOINIT) {
+            pr->u.init.realm_and_id = (uintptr_t)
+                clone_realm(s, js_autoinit_get_realm(pr1)) |
+                js_autoinit_get_id(pr1);
+            pr->u.init.opaque = pr1->u.init.opaque;
+        } else {
+            pr->u.value = JS_UNDEFINED;
+        }
+    }
+
+    switch(p->class_id) {
+    case JS_CLASS_NUMBER:
+    case JS_CLASS_STRING:
+    case JS_CLASS_BOOLEAN:
+    case JS_CLASS_SYMBOL:
+    case JS_CLASS_DATE:
+#ifdef CONFIG_BIGNUM
+    case JS_CLASS_BIG_INT:
+    case JS_CLASS_BIG_FLOAT:
+    case JS_CLASS_BIG_DECIMAL:
+#endif
+        p->u.object_data = JS_UNDEFINED;
+        break;
+    case JS_CLASS_C_FUNCTION:
+        p->u.cfunc = p1->u.cfunc;
+        if (p->u.cfunc.realm)
+            p->u.cfunc.realm = clone_realm(s, p->u.cfunc.realm);
+        break;
+    case JS_CLASS_REGEXP:
+        /* the strings are immutable and can be shared */
+        p->u.regexp.pattern = JS_VALUE_GET_STRING(JS_DupValue(ctx, JS_MKPTR(JS_TAG_STRING, p1->u.regexp.pattern)));
+        p->u.regexp.bytecode = JS_VALUE_GET_STRING(JS_DupValue(ctx, JS_MKPTR(JS_TAG_STRING, p1->u.regexp.bytecode)));
+        break;
+    case JS_CLASS_BOUND_FUNCTION:
+        p->u.bound_function = bf;
+        bf = NULL;
+        break;
+    default:
+        break;
+    }
+
+    p->header.ref_count = 1;
+    add_gc_object(rt, &p->header, JS_GC_OBJ_TYPE_JS_OBJECT);
+    if (clone_add(s, p1, p, TRUE)) {
+        JS_FreeValue(ctx, JS_MKPTR(JS_TAG_OBJECT, p));
+        return NULL;
+    }
+    p->header.ref_count++;
+    return p;
+ fail:
+    js_free(ctx, bf);
+    if (sh)
+        js_free_shape(rt, sh);
+    return NULL;
+}
+
+static JSVarRef *clone_var_ref(CloneState *s, JSVarRef *var_ref1)
+{
+    JSVarRef *var_ref;
+
+    var_ref = clone_find(s, var_ref1);
+    if (var_ref) {
+        var_ref->header.ref_count++;
+        return var_ref;
+    }
+    if (!var_ref1->is_detached) {
+        JS_ThrowTypeError(s->ctx, "cannot clone a running function");
+        return NULL;
+    }
+    var_ref = js_slab_malloc(s->ctx, sizeof(JSVarRef));
+    if (!var_ref)
+        return NULL;
+    var_ref->header.ref_count = 1;
+    var_ref->is_detached = TRUE;
+    var_ref->is_arg = var_ref1->is_arg;
+    var_ref->var_idx = var_ref1->var_idx;
+    var_ref->value = JS_UNDEFINED;
+    var_ref->pvalue = &var_ref->value;
+    add_gc_object(s->ctx->rt, &var_ref->header, JS_GC_OBJ_TYPE_VAR_REF);
+    if (clone_add(s, var_ref1, var_ref, TRUE)) {
+        free_var_ref(s->ctx->rt, var_ref);
+        return NULL;
+    }
+    var_ref->header.ref_count++;
+    return var_ref;
+}
+
+/* The code is shared with 'b1'. Only the realm specific fields are
+   copied. */
+static JSFunctionBytecode *clone_bytecode(CloneState *s, JSFunctionBytecode *b1)
+{
+    JSContext *ctx = s->ctx;
+    JSFunctionBytecode *b;
+    JSValue *cpool;
+    int i;
+
+    b = clone_find(s, b1);
+    if (b) {
+        b->header.ref_count++;
+        return b;
+    }
+    b = js_malloc(ctx, sizeof(*b));
+    if (!b)
+        return NULL;
+    cpool = NULL;
+    if (b1->cpool_count != 0) {
+        cpool = js_malloc(ctx, sizeof(cpool[0]) * b1->cpool_count);
+        if (!cpool) {
+            js_free(ctx, b);
+            return NULL;
+        }
+        for(i = 0; i < b1->cpool_count; i++)
+            cpool[i] = JS_UNDEFINED;
+    }
+    memcpy(b, b1, b1->has_debug ? sizeof(*b) :
+           offsetof(JSFunctionBytecode, debug));
+    b->header.ref_count = 1;
+    b->cpool = cpool;
+    b->ic = NULL;
+#ifdef CONFIG_JIT
+    b->jit_counter = 0;
+    b->jit_disabled = FALSE;
+    b->jit_code = NULL;
+#endif
+    if (b1->realm)
+        b->realm = clone_realm(s, b1->realm);
+    b->parent = b1->parent ? b1->parent : b1;
+    if (!b->parent->is_shared)
+        b->parent->header.ref_count++;
+    add_gc_object(ctx->rt, &b->header, JS_GC_OBJ_TYPE_FUNCTION_BYTECODE);
+    if (clone_add(s, b1, b, TRUE)) {
+        JS_FreeValue(ctx, JS_MKPTR(JS_TAG_FUNCTION_BYTECODE, b));
+        return NULL;
+    }
+    b->header.ref_count++;
+    return b;
+}
+
+static JSValue clone_value(CloneState *s, JSValueConst val)
+{
+    void *ptr;
+
+    switch(JS_VALUE_GET_TAG(val)) {
+    case JS_TAG_OBJECT:
+        ptr = clone_object(s, JS_VALUE_GET_OBJ(val));
+        break;
+    case JS_TAG_FUNCTION_BYTECODE:
+        ptr = clone_bytecode(s, JS_VALUE_GET_PTR(val));
+        break;
+    case JS_TAG_MODULE:
+        return JS_ThrowTypeError(s->ctx, "cannot clone a module");
+    default:
+        /* strings, symbols and numbers are immutable */
+        return JS_DupValue(s->ctx, val);
+    }
+    if (!ptr)
+        return JS_EXCEPTION;
+    return JS_MKPTR(JS_VALUE_GET_TAG(val), ptr);
+}
+
+static int clone_value_to(CloneState *s, JSValue *pval, JSValueConst val)
+{
+    JSValue v;
+
+    v = clone_value(s, val);
+    if (JS_IsException(v))
+        return -1;
+    set_value(s->ctx, pval, v);
+    return 0;
+}
+
+static int clone_object_content(CloneState *s, JSObject *p, JSObject *p1)
+{
+    JSContext *ctx = s->ctx;
+    JSShapeProperty *prs;
+    JSProperty *pr, *pr1;
+    uint32_t len;
+    int i;
+
+    prs = get_shape_prop(p->shape);
+    for(i = 0; i < p->shape->prop_count; i++, prs++) {
+        pr = &p->prop[i];
+        pr1 = &p1->prop[i];
+        if (prs->atom == JS_ATOM_NULL)
+            continue;
+        switch(prs->flags & JS_PROP_TMASK) {
+        case JS_PROP_GETSET:
+            if (pr1->u.getset.getter) {
+                pr->u.getset.getter = clone_object(s, pr1->u.getset.getter);
+                if (!pr->u.getset.getter)
+                    return -1;
+            }
+            if (pr1->u.getset.setter) {
+                pr->u.getset.setter = clone_object(s, pr1->u.getset.setter);
+                if (!pr->u.getset.setter)
+                    return -1;
+            }
+            break;
+        case JS_PROP_AUTOINIT:
+            break;
+        default:
+            if (clone_value_to(s, &pr->u.value, pr1->u.value))
+                return -1;
+            break;
+        }
+    }
+
+    switch(p->class_id) {
+    case JS_CLASS_ARRAY:
+        len = p1->u.array.count;
+        if (p1->fast_array && len != 0) {
+            JSValue *tab;
+            tab = js_malloc(ctx, sizeof(tab[0]) * len);
+            if (!tab)
+                return -1;
+            for(i = 0; i < len; i++)
+                tab[i] = JS_UNDEFINED;
+            p->u.array.u.values = tab;
+            p->u.array.u1.size = len;
+            p->u.array.count = len;
+            for(i = 0; i < len; i++) {
+                if (clone_value_to(s, &tab[i], p1->u.array.u.values[i]))
+                    return -1;
+            }
+        }
+        break;
+    case JS_CLASS_NUMBER:
+    case JS_CLASS_STRING:
+    case JS_CLASS_BOOLEAN:
+    case JS_CLASS_SYMBOL:
+    case JS_CLASS_DATE:
+#ifdef CONFIG_BIGNUM
+    case JS_CLASS_BIG_INT:
+    case JS_CLASS_BIG_FLOAT:
+    case JS_CLASS_BIG_DECIMAL:
+#endif
+        if (clone_value_to(s, &p->u.object_data, p1->u.object_data))
+            return -1;
+        break;
+    case JS_CLASS_C_FUNCTION_DATA:
+        {
+            JSCFunctionDataRecord *d, *d1 = p1->u.c_function_data_record;
+            d = js_malloc(ctx, sizeof(*d) + d1->data_len * sizeof(JSValue));
+            if (!d)
+                return -1;
+            d->func = d1->func;
+            d->length = d1->length;
+            d->data_len = d1->data_len;
+            d->magic = d1->magic;
+            for(i = 0; i < d->data_len; i++)
+                d->data[i] = JS_UNDEFINED;
+            p->u.c_function_data_record = d;
+            for(i = 0; i < d->data_len; i++) {
+                if (clone_value_to(s, &d->data[i], d1->data[i]))
+                    return -1;
+            }
+        }
+        break;
+    case JS_CLASS_BOUND_FUNCTION:
+        {
+            JSBoundFunction *bf = p->u.bound_function;
+            JSBoundFunction *bf1 = p1->u.bound_function;
+            if (clone_value_to(s, &bf->func_obj, bf1->func_obj) ||
+                clone_value_to(s, &bf->this_val, bf1->this_val))
+                return -1;
+            for(i = 0; i < bf->argc; i++) {
+                if (clone_value_to(s, &bf->argv[i], bf1->argv[i]))
+                    return -1;
+            }
+        }
+        break;
+    case JS_CLASS_BYTECODE_FUNCTION:
+    case JS_CLASS_GENERATOR_FUNCTION:
+    case JS_CLASS_ASYNC_FUNCTION:
+    case JS_CLASS_ASYNC_GENERATOR_FUNCTION:
+        {
+            JSFunctionBytecode *b = p1->u.func.function_bytecode;
+            JSVarRef **var_refs;
+
+            if (p1->u.func.home_object) {
+                p->u.func.home_object = clone_object(s, p1->u.func.home_object);
+                if (!p->u.func.home_object)
+                    return -1;
+            }
+            if (!b)
+                break;
+            p->u.func.function_bytecode = clone_bytecode(s, b);
+            if (!p->u.func.function_bytecode)
+                return -1;
+            if (p1->u.func.var_refs) {
+                var_refs = js_mallocz(ctx, sizeof(var_refs[0]) *
+                                      b->closure_var_count);
+                if (!var_refs)
+                    return -1;
+                p->u.func.var_refs = var_refs;
+                for(i = 0; i < b->closure_var_count; i++) {
+                    if (p1->u.func.var_refs[i]) {
+                        var_refs[i] = clone_var_ref(s, p1->u.func.var_refs[i]);
+                        if (!var_refs[i])
+                            return -1;
+                    }
+                }
+            }
+        }
+        break;
+    case JS_CLASS_MAP:
+    case JS_CLASS_SET:
+        {
+            JSMapState *ms, *ms1 = p1->u.map_state;
+            JSMapRecord *mr, *mr1;
+            struct list_head *el;
+            JSValue key;
+
+            ms = js_mallocz(ctx, sizeof(*ms));
+            if (!ms)
+                return -1;
+            init_list_head(&ms->records);
+            ms->is_weak = FALSE;
+            ms->hash_size = 1;
+            ms->hash_table = js_malloc(ctx, sizeof(ms->hash_table[0]));
+            if (!ms->hash_table) {
+                js_free(ctx, ms);
+                return -1;
+            }
+            init_list_head(&ms->hash_table[0]);
+            ms->record_count_threshold = 4;
+            p->u.map_state = ms;
+            list_for_each(el, &ms1->records) {
+                mr1 = list_entry(el, JSMapRecord, link);
+                if (mr1->empty)
+                    continue;
+                key = clone_value(s, mr1->key);
+                if (JS_IsException(key))
+                    return -1;
+                mr = map_add_record(ctx, ms, key);
+                JS_FreeValue(ctx, key);
+                if (!mr)
+                    return -1;
+                mr->value = clone_value(s, mr1->value);
+                if (JS_IsException(mr->value)) {
+                    mr->value = JS_UNDEFINED;
+                    return -1;
+                }
+            }
+        }
+        break;
+    default:
+        break;
+    }
+    return 0;
+}
+
+/* copy the content of the objects created since the last call */
+static int clone_flush(CloneState *s)
+{
+    JSGCObjectHeader *gp1;
+    CloneEntry e;
+    int i;
+
+    while (s->todo_count > 0) {
+        e = s->todo[--s->todo_count];
+        gp1 = e.src;
+        switch(gp1->gc_obj_type) {
+        case JS_GC_OBJ_TYPE_JS_OBJECT:
+            if (clone_object_content(s, e.dst, e.src))
+                return -1;
+            break;
+        case JS_GC_OBJ_TYPE_VAR_REF:
+            {
+                JSVarRef *var_ref = e.dst, *var_ref1 = e.src;
+                if (clone_value_to(s, &var_ref->value, var_ref1->value))
+                    return -1;
+            }
+            break;
+        case JS_GC_OBJ_TYPE_FUNCTION_BYTECODE:
+            {
+                JSFunctionBytecode *b = e.dst, *b1 = e.src;
+                for(i = 0; i < b1->cpool_count; i++) {
+                    if (clone_value_to(s, &b->cpool[i], b1->cpool[i]))
+                        return -1;
+                }
+            }
+            break;
+        default:
+            abort();
+        }
+    }
+    return 0;
+}
+
+static void clone_state_free(CloneState *s)
+{
+    JSRuntime *rt = s->ctx->rt;
+    JSGCObjectHeader *gp;
+    uint32_t i;
+
+    if (s->hash) {
+        for(i = 0; i < (1U << s->hash_bits); i++) {
+            gp = s->hash[i].dst;
+            if (!gp)
+                continue;
+            switch(gp->gc_obj_type) {
+            case JS_GC_OBJ_TYPE_JS_OBJECT:
+                JS_FreeValueRT(rt, JS_MKPTR(JS_TAG_OBJECT, gp));
+                break;
+            case JS_GC_OBJ_TYPE_FUNCTION_BYTECODE:
+                JS_FreeValueRT(rt, JS_MKPTR(JS_TAG_FUNCTION_BYTECODE, gp));
+                break;
+            case JS_GC_OBJ_TYPE_SHAPE:
+                js_free_shape(rt, (JSShape *)gp);
+                break;
+            case JS_GC_OBJ_TYPE_VAR_REF:
+                free_var_ref(rt, (JSVarRef *)gp);
+                break;
+            default:
+                abort();
+            }
+        }
+        js_free_rt(rt, s->hash);
+    }
+    js_free_rt(rt, s->todo);
+}
+
+/* Create a new context with a copy of all the objects reachable from
+   'ctx' (intrinsic objects, global variables, functions defined by
+   the scripts evaluated in 'ctx'). It is much faster than creating and
+   initializing a new context. The function bytecode is shared.
+   Return NULL and throw an exception in 'ctx' if an object cannot be
+   copied (e.g. modules, promises, typed arrays or running
+   functions). */
+JSContext *JS_CloneContext(JSContext *ctx)
+{
+    JSRuntime *rt = ctx->rt;
+    CloneState ss, *s = &ss;
+    JSContext *new_ctx;
+    int i;
+
+    if (!list_empty(&ctx->loaded_modules)) {
+        JS_ThrowTypeError(ctx, "cannot clone a context with modules");
+        return NULL;
+    }
+    /* no GC can happen during the copy */
+    js_trigger_gc(rt, sizeof(JSContext));
+    new_ctx = JS_NewContext0(rt);
+    if (!new_ctx) {
+        JS_ThrowOutOfMemory(ctx);
+        return NULL;
+    }
+    memset(s, 0, sizeof(*s));
+    s->ctx = ctx;
+    s->new_ctx = new_ctx;
+
+    new_ctx->binary_object_count = ctx->binary_object_count;
+    new_ctx->binary_object_size = ctx->binary_object_size;
+#ifdef CONFIG_BIGNUM
+    new_ctx->fp_env = ctx->fp_env;
+    new_ctx->bignum_ext = ctx->bignum_ext;
+    new_ctx->allow_operator_overloading = ctx->allow_operator_overloading;
+#endif
+    new_ctx->is_error_property_enabled = ctx->is_error_property_enabled;
+    new_ctx->compile_regexp = ctx->compile_regexp;
+    new_ctx->eval_internal = ctx->eval_internal;
+    new_ctx->value_arena_enabled = ctx->value_arena_enabled;
+    js_random_init(new_ctx);
+
+    if (ctx->array_shape) {
+        new_ctx->array_shape = clone_shape(s, ctx->array_shape);
+        if (!new_ctx->array_shape)
+            goto fail;
+    }
+    for(i = 0; i < rt->class_count; i++) {
+        if (clone_value_to(s, &new_ctx->class_proto[i], ctx->class_proto[i]))
+            goto fail;
+    }
+    for(i = 0; i < JS_NATIVE_ERROR_COUNT; i++) {
+        if (clone_value_to(s, &new_ctx->native_error_proto[i],
+                           ctx->native_error_proto[i]))
+            goto fail;
+    }
+    if (clone_value_to(s, &new_ctx->function_proto, ctx->function_proto) ||
+        clone_value_to(s, &new_ctx->function_ctor, ctx->function_ctor) ||
+        clone_value_to(s, &new_ctx->array_ctor, ctx->array_ctor) ||
+        clone_value_to(s, &new_ctx->regexp_ctor, ctx->regexp_ctor) ||
+        clone_value_to(s, &new_ctx->promise_ctor, ctx->promise_ctor) ||
+        clone_value_to(s, &new_ctx->iterator_proto, ctx->iterator_proto) ||
+        clone_value_to(s, &new_ctx->async_iterator_proto,
+                       ctx->async_iterator_proto) ||
+        clone_value_to(s, &new_ctx->array_proto_values,
+                       ctx->array_proto_values) ||
+        clone_value_to(s, &new_ctx->throw_type_error, ctx->throw_type_error) ||
+        clone_value_to(s, &new_ctx->eval_obj, ctx->eval_obj) ||
+        clone_value_to(s, &new_ctx->global_obj, ctx->global_obj) ||
+        clone_value_to(s, &new_ctx->global_var_obj, ctx->global_var_obj))
+        goto fail;
+    if (clone_flush(s))
+        goto fail;
+    clone_state_free(s);
+    return new_ctx;
+ fail:
+    /* the partial copy is freed by the GC */
+    clone_state_free(s);
+    JS_FreeContext(new_ctx);
+    return NULL;
+}
@@ -74,10 +74,22 @@ typedef uint32_t JSAtom;
 #define JS_PTR64_DEF(a)
 #endif
 
-#if !defined(JS_PTR64) && !defined(JS_NO_NAN_BOXING)
+#if !defined(JS_PTR64) && !defined(JS_NO_NAN_BOXING) && !defined(JS_NAN_BOXING)
 #define JS_NAN_BOXING
 #endif
 
+/* JS_NAN_BOXING can also be defined on 64 bit targets. In this case
+   the pointers are stored in the low 47 bits of the JSValue, so the
+   memory allocator must return addresses below 2^47. */
+#ifdef JS_NAN_BOXING
+#ifdef JS_PTR64
+#define JS_VALUE_TAG_SHIFT 47
+#define JS_VALUE_PTR_MASK (((uint64_t)1 << JS_VALUE_TAG_SHIFT) - 1)
+#else
+#define JS_VALUE_TAG_SHIFT 32
+#endif
+#endif
+
 enum {
     /* all tags with a reference count are negative */
     JS_TAG_FIRST       = -11, /* first negative tag */
@@ -86,6 +98,10 @@ enum {
     JS_TAG_BIG_FLOAT   = -9,
     JS_TAG_SYMBOL      = -8,
     JS_TAG_STRING      = -7,
+    /* Note: strings have two tags, so the tests of JS_TAG_STRING
+       written before ropes were added must use JS_TAG_IS_STRING() or
+       JS_IsString() */
+    JS_TAG_STRING_ROPE = -6, /* string built by concatenation */
     JS_TAG_MODULE      = -3, /* used internally */
     JS_TAG_FUNCTION_BYTECODE = -2, /* used internally */
     JS_TAG_OBJECT      = -1,
@@ -150,15 +166,25 @@ typedef uint64_t JSValue;
 #define JSValueConst JSValue
 #define JS_VALUE_CONST_CAST(v) (v)
 
-#define JS_VALUE_GET_TAG(v) (int)((v) >> 32)
+#define JS_VALUE_GET_TAG(v) (int)((int64_t)(v) >> JS_VALUE_TAG_SHIFT)
 #define JS_VALUE_GET_INT(v) (int)(v)
 #define JS_VALUE_GET_BOOL(v) (int)(v)
+#ifdef JS_PTR64
+#define JS_VALUE_GET_PTR(v) (void *)(intptr_t)((v) & JS_VALUE_PTR_MASK)
+#else
 #define JS_VALUE_GET_PTR(v) (void *)(intptr_t)(v)
+#endif
 
-#define JS_MKVAL(tag, val) (((uint64_t)(tag) << 32) | (uint32_t)(val))
-#define JS_MKPTR(tag, ptr) (((uint64_t)(tag) << 32) | (uintptr_t)(ptr))
+#define JS_MKVAL(tag, val) (((uint64_t)(tag) << JS_VALUE_TAG_SHIFT) | (uint32_t)(val))
+#define JS_MKPTR(tag, ptr) (((uint64_t)(tag) << JS_VALUE_TAG_SHIFT) | (uintptr_t)(ptr))
 
+#ifdef JS_PTR64
+/* the tags are stored in the 17 upper bits and the non float tags are
+   mapped to negative NaNs */
+#define JS_FLOAT64_TAG_ADDEND (0x20000 - JS_TAG_FLOAT64)
+#else
 #define JS_FLOAT64_TAG_ADDEND (0x7ff80000 - JS_TAG_FIRST + 1) /* quiet NaN encoding */
+#endif
 
 static inline double JS_VALUE_GET_FLOAT64(JSValue v)
 {
@@ -167,11 +193,11 @@ static inline double JS_VALUE_GET_FLOAT64(JSValue v)
         double d;
     } u;
     u.v = v;
-    u.v += (uint64_t)JS_FLOAT64_TAG_ADDEND << 32;
+    u.v += (uint64_t)JS_FLOAT64_TAG_ADDEND << JS_VALUE_TAG_SHIFT;
     return u.d;
 }
 
-#define JS_NAN (0x7ff8000000000000 - ((uint64_t)JS_FLOAT64_TAG_ADDEND << 32))
+#define JS_NAN (0x7ff8000000000000 - ((uint64_t)JS_FLOAT64_TAG_ADDEND << JS_VALUE_TAG_SHIFT))
 
 static inline JSValue __JS_NewFloat64(JSContext *ctx, double d)
 {
@@ -185,7 +211,7 @@ static inline JSValue __JS_NewFloat64(JSContext *ctx, double d)
     if (js_unlikely((u.u64 & 0x7fffffffffffffff) > 0x7ff0000000000000))
         v = JS_NAN;
     else
-        v = u.u64 - ((uint64_t)JS_FLOAT64_TAG_ADDEND << 32);
+        v = u.u64 - ((uint64_t)JS_FLOAT64_TAG_ADDEND << JS_VALUE_TAG_SHIFT);
     return v;
 }
 
@@ -204,9 +230,7 @@ static inline int JS_VALUE_GET_NORM_TAG(JSValue v)
 
 static inline JS_BOOL JS_VALUE_IS_NAN(JSValue v)
 {
-    uint32_t tag;
-    tag = JS_VALUE_GET_TAG(v);
-    return tag == (JS_NAN >> 32);
+    return JS_VALUE_GET_TAG(v) == JS_VALUE_GET_TAG(JS_NAN);
 }
     
 #else /* !JS_NAN_BOXING */
@@ -265,6 +289,8 @@ static inline JS_BOOL JS_VALUE_IS_NAN(JSValue v)
 
 #define JS_VALUE_IS_BOTH_INT(v1, v2) ((JS_VALUE_GET_TAG(v1) | JS_VALUE_GET_TAG(v2)) == 0)
 #define JS_VALUE_IS_BOTH_FLOAT(v1, v2) (JS_TAG_IS_FLOAT64(JS_VALUE_GET_TAG(v1)) && JS_TAG_IS_FLOAT64(JS_VALUE_GET_TAG(v2)))
+/* JS_TAG_STRING or JS_TAG_STRING_ROPE */
+#define JS_TAG_IS_STRING(tag) ((unsigned)((tag) - JS_TAG_STRING) <= (JS_TAG_STRING_ROPE - JS_TAG_STRING))
 
 #define JS_VALUE_GET_OBJ(v) ((JSObject *)JS_VALUE_GET_PTR(v))
 #define JS_VALUE_GET_STRING(v) ((JSString *)JS_VALUE_GET_PTR(v))
@@ -326,6 +352,11 @@ static inline JS_BOOL JS_VALUE_IS_NAN(JSValue v)
 #define JS_EVAL_FLAG_COMPILE_ONLY (1 << 5)
 /* don't include the stack frames before this eval in the Error() backtraces */
 #define JS_EVAL_FLAG_BACKTRACE_BARRIER (1 << 6)
+/* compile the inner functions on their first call. Their bodies are
+   only tokenized, so their syntax errors other than the token errors
+   are thrown on the first call. Ignored for the functions compiled
+   with JS_EVAL_FLAG_STRIP. */
+#define JS_EVAL_FLAG_LAZY (1 << 7)
 
 typedef JSValue JSCFunction(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv);
 typedef JSValue JSCFunctionMagic(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv, int magic);
@@ -352,6 +383,13 @@ QUICKJS_EXPORT JSRuntime *JS_NewRuntime(void);
 QUICKJS_EXPORT void JS_SetRuntimeInfo(JSRuntime *rt, const char *info);
 QUICKJS_EXPORT void JS_SetMemoryLimit(JSRuntime *rt, size_t limit);
 QUICKJS_EXPORT void JS_SetGCThreshold(JSRuntime *rt, size_t gc_threshold);
+QUICKJS_EXPORT void JS_SetMinorGCThreshold(JSRuntime *rt, size_t count);
+/* use a slab allocator for the small fixed size structures. Must be
+   called before creating the first context. Return -1 if too late. */
+QUICKJS_EXPORT int JS_EnableSlabAllocator(JSRuntime *rt, JS_BOOL enable);
+/* compile the hot functions to native code (disabled by default, only
+   supported on x86-64) */
+QUICKJS_EXPORT void JS_EnableJIT(JSRuntime *rt, JS_BOOL enable);
 /* use 0 to disable maximum stack size check */
 QUICKJS_EXPORT void JS_SetMaxStackSize(JSRuntime *rt, size_t stack_size);
 /* should be called when changing thread to update the stack top value
@@ -364,17 +402,43 @@ QUICKJS_EXPORT void JS_SetRuntimeOpaque(JSRuntime *rt, void *opaque);
 typedef void JS_MarkFunc(JSRuntime *rt, JSGCObjectHeader *gp);
 QUICKJS_EXPORT void JS_MarkValue(JSRuntime *rt, JSValueConst val, JS_MarkFunc *mark_func);
 QUICKJS_EXPORT void JS_RunGC(JSRuntime *rt);
+/* look for cycles in at most 'budget' young objects (0 = all the young
+   objects). Return TRUE if young objects remain to be examined. */
+QUICKJS_EXPORT JS_BOOL JS_RunGCStep(JSRuntime *rt, size_t budget);
 QUICKJS_EXPORT JS_BOOL JS_IsLiveObject(JSRuntime *rt, JSValueConst obj);
 
 QUICKJS_EXPORT JSContext *JS_NewContext(JSRuntime *rt);
 QUICKJS_EXPORT void JS_FreeContext(JSContext *s);
 QUICKJS_EXPORT JSContext *JS_DupContext(JSContext *ctx);
+/* create a context with a copy of the objects of 'ctx'. Return NULL
+   and throw an exception in 'ctx' if some objects cannot be copied. */
+QUICKJS_EXPORT JSContext *JS_CloneContext(JSContext *ctx);
 QUICKJS_EXPORT void *JS_GetContextOpaque(JSContext *ctx);
 QUICKJS_EXPORT void JS_SetContextOpaque(JSContext *ctx, void *opaque);
 QUICKJS_EXPORT JSRuntime *JS_GetRuntime(JSContext *ctx);
 QUICKJS_EXPORT void JS_SetClassProto(JSContext *ctx, JSClassID class_id, JSValue obj);
 QUICKJS_EXPORT JSValue JS_GetClassProto(JSContext *ctx, JSClassID class_id);
 
+/* value arena: JSValue slots allocated by bumping a pointer and released
+   all together by JS_ResetValueArena() or when the context is freed */
+QUICKJS_EXPORT void JS_EnableValueArena(JSContext *ctx, JS_BOOL enable);
+QUICKJS_EXPORT JS_BOOL JS_IsValueArenaEnabled(JSContext *ctx);
+/* take ownership of 'v'. Return NULL if the arena is disabled or if
+   there is no memory. */
+QUICKJS_EXPORT JSValue *JS_NewArenaValue(JSContext *ctx, JSValue v);
+/* also TRUE for the slots of the closed value scopes */
+QUICKJS_EXPORT JS_BOOL JS_IsArenaValue(JSContext *ctx, const JSValue *pv);
+QUICKJS_EXPORT JS_BOOL JS_IsArenaValueRT(JSRuntime *rt, const JSValue *pv);
+QUICKJS_EXPORT void JS_FreeArenaValue(JSContext *ctx, JSValue *pv);
+QUICKJS_EXPORT void JS_ResetValueArena(JSContext *ctx);
+/* value scopes: the arena values allocated after JS_OpenValueScope() are
+   freed by JS_CloseValueScope(). Scopes can be nested and also work when
+   the value arena is disabled. JS_FreeArenaValue() does nothing on the
+   slot of a closed scope until a new arena value reuses it. */
+QUICKJS_EXPORT int JS_OpenValueScope(JSContext *ctx);
+QUICKJS_EXPORT void JS_CloseValueScope(JSContext *ctx, int level);
+QUICKJS_EXPORT int JS_GetValueScopeLevel(JSContext *ctx);
+
 /* the following functions are used to select the intrinsic object to
    save memory */
 QUICKJS_EXPORT JSContext *JS_NewContextRaw(JSRuntime *rt);
@@ -429,6 +493,7 @@ typedef struct JSMemoryUsage {
     int64_t c_func_count, array_count;
     int64_t fast_array_count, fast_array_elements;
     int64_t binary_object_count, binary_object_size;
+    int64_t slab_count, slab_size, slab_used_size;
 } JSMemoryUsage;
 
 QUICKJS_EXPORT void JS_ComputeMemoryUsage(JSRuntime *rt, JSMemoryUsage *s);
@@ -633,7 +698,7 @@ static inline JS_BOOL JS_IsUninitialized(JSValueConst v)
 
 static inline JS_BOOL JS_IsString(JSValueConst v)
 {
-    return JS_VALUE_GET_TAG(v) == JS_TAG_STRING;
+    return JS_TAG_IS_STRING(JS_VALUE_GET_TAG(v));
 }
 
 static inline JS_BOOL JS_IsSymbol(JSValueConst v)
@@ -726,11 +791,19 @@ static inline const char *JS_ToCString(JSContext *ctx, JSValueConst val1)
     return JS_ToCStringLen2(ctx, NULL, val1, 0);
 }
 QUICKJS_EXPORT void JS_FreeCString(JSContext *ctx, const char *ptr);
+QUICKJS_EXPORT JSValue JS_NewString16(JSContext *ctx, const uint16_t *buf, size_t len);
+/* the characters must be written in '*pbuf' before the string is used */
+QUICKJS_EXPORT JSValue JS_NewStringBuffer(JSContext *ctx, size_t len, JS_BOOL is_wide_char, void **pbuf);
+/* return the Latin-1 or UTF-16 characters of the string 'val' without
+   copy. They are valid as long as 'val' is alive. */
+QUICKJS_EXPORT const void *JS_GetStringBuffer(JSContext *ctx, JSValueConst val, size_t *plen, JS_BOOL *pis_wide_char);
 
 QUICKJS_EXPORT JSValue JS_NewObjectProtoClass(JSContext *ctx, JSValueConst proto, JSClassID class_id);
 QUICKJS_EXPORT JSValue JS_NewObjectClass(JSContext *ctx, int class_id);
 QUICKJS_EXPORT JSValue JS_NewObjectProto(JSContext *ctx, JSValueConst proto);
 QUICKJS_EXPORT JSValue JS_NewObject(JSContext *ctx);
+QUICKJS_EXPORT JSValue JS_NewObjectFromTemplate(JSContext *ctx, JSValueConst tmpl,
+                                                int count, JSValueConst *values);
 
 QUICKJS_EXPORT JS_BOOL JS_IsFunction(JSContext* ctx, JSValueConst val);
 QUICKJS_EXPORT JS_BOOL JS_IsConstructor(JSContext* ctx, JSValueConst val);
@@ -911,6 +984,29 @@ QUICKJS_EXPORT uint8_t *JS_WriteObject2(JSContext *ctx, size_t *psize, JSValueCo
 #define JS_READ_OBJ_REFERENCE (1 << 3) /* allow object references */
 QUICKJS_EXPORT JSValue JS_ReadObject(JSContext *ctx, const uint8_t *buf, size_t buf_len,
                       int flags);
+/* With JS_READ_OBJ_ROM_DATA, the byte code and the debug info of the
+   functions are used in place when their atoms have the index stored
+   in 'buf', so 'buf' must be kept until the runtime is freed. Calling
+   JS_ReserveObjectAtoms() on the same buffer just after JS_NewRuntime()
+   gives these indexes to the atoms. Return -1 if some atoms could not
+   get their index. */
+QUICKJS_EXPORT int JS_ReserveObjectAtoms(JSRuntime *rt, const uint8_t *buf, size_t buf_len);
+
+/* Bytecode loaded once and instantiated in several runtimes, possibly
+   running in different threads. The bytecode, the variable
+   definitions and the debug info of the functions are not copied in
+   each runtime. */
+typedef struct JSSharedBytecode JSSharedBytecode;
+/* 'buf' is a JS_WriteObject() output containing a script or a module.
+   It must be kept until JS_FreeSharedBytecode(). Return NULL if
+   error. */
+QUICKJS_EXPORT JSSharedBytecode *JS_NewSharedBytecode(const uint8_t *buf, size_t buf_len);
+/* must be called after all the runtimes using 'sb' are freed */
+QUICKJS_EXPORT void JS_FreeSharedBytecode(JSSharedBytecode *sb);
+/* Same as JS_ReadObject() on the shared buffer. JS_ReserveObjectAtoms()
+   must have been called with this buffer just after creating the
+   runtime of 'ctx'. */
+QUICKJS_EXPORT JSValue JS_ReadSharedBytecode(JSContext *ctx, JSSharedBytecode *sb);
 /* instantiate and evaluate a bytecode function. Only used when
    reading a script or module with JS_ReadObject() */
 QUICKJS_EXPORT JSValue JS_EvalFunction(JSContext *ctx, JSValue fun_obj);
@@ -918,6 +1014,30 @@ QUICKJS_EXPORT JSValue JS_EvalFunction(JSContext *ctx, JSValue fun_obj);
    returns a module. */
 QUICKJS_EXPORT int JS_ResolveModule(JSContext *ctx, JSValueConst obj);
 
+/* Compilation cache of JS_Eval(): the byte code of the evaluated
+   scripts and modules is kept, keyed by a hash of the source, the
+   filename, the eval flags and the context state affecting the
+   compilation, and read with JS_ReadObject() instead of compiling the
+   source again. The source length and the filename are stored with
+   the byte code and checked in addition to the hash. */
+#define JS_EVAL_CACHE_KEY_LEN 32 /* length of the hexadecimal keys */
+typedef struct JSEvalCacheFunctions {
+    /* return the byte code stored with 'key' in a buffer allocated
+       with js_malloc_rt() or NULL if none */
+    uint8_t *(*load)(JSRuntime *rt, void *opaque, const char *key,
+                     size_t *psize);
+    void (*store)(JSRuntime *rt, void *opaque, const char *key,
+                  const uint8_t *buf, size_t size);
+} JSEvalCacheFunctions;
+/* keep at most 'max_size' bytes of byte code in memory (0 = no memory
+   cache). The least recently used entries are freed first. 'cf' is an
+   optional persistent storage. */
+QUICKJS_EXPORT void JS_SetEvalCache(JSRuntime *rt, size_t max_size,
+                                    const JSEvalCacheFunctions *cf,
+                                    void *opaque);
+/* number of JS_Eval() calls whose byte code was found in the cache */
+QUICKJS_EXPORT int64_t JS_GetEvalCacheHitCount(JSRuntime *rt);
+
 /* only exported for os.Worker() */
 QUICKJS_EXPORT JSAtom JS_GetScriptOrModuleName(JSContext *ctx, int n_stack_levels);
 /* only exported for os.Worker() */
@@ -2,6 +2,19 @@
 #include <stdlib.h>
 #include <string.h>
 #include "quickjs-extern.h"
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+#ifdef TEST_EXTERN_THREADS
+#include <pthread.h>
+#endif
+#ifdef TEST_EXTERN_LIBC
+#include "quickjs-libc.h"
+#ifndef _WIN32
+#include <dirent.h>
+#include <unistd.h>
+#endif
+#endif
 
 #define ASSERT(expr, msg) do { \
     if(!(expr)) { \
@@ -160,6 +173,23 @@ void test_value_types(JSContext* ctx) {
     js_value_free(ctx, value);
 }
 
+void test_value_size(JSContext* ctx) {
+    ASSERT_EQ(js_value_size(), sizeof(JSValue));
+#ifdef JS_NAN_BOXING
+    ASSERT_EQ(js_value_size(), 8);
+#endif
+
+    JSValue* value = js_value_new_float(ctx, -1.0 / 0.0);
+    ASSERT_EQ(js_value_get_type(value), JS_VALUE_TYPE_FLOAT64);
+    ASSERT_EQ(js_value_get_float(value), -1.0 / 0.0);
+    js_value_free(ctx, value);
+
+    value = js_value_new_float(ctx, -0.5);
+    ASSERT_EQ(js_value_get_type(value), JS_VALUE_TYPE_FLOAT64);
+    ASSERT_EQ(js_value_get_float(value), -0.5);
+    js_value_free(ctx, value);
+}
+
 void test_string(JSContext* ctx) {
     JSValue* value = js_value_new(ctx);
     const char* str;
@@ -270,6 +300,92 @@ void test_string(JSContext* ctx) {
     js_value_free(ctx, value);
 }
 
+void test_string16(JSContext* ctx) {
+    static const uint16_t latin1[] = { 'c', 'a', 'f', 0xe9 };
+    static const uint16_t wide[] = { 'p', 'i', '=', 0x3c0 };
+    uint16_t buf[16];
+    const void* chars;
+    const char* str;
+    size_t length;
+    int is_wide;
+    int err;
+
+    JSValue* value = js_value_new_str16(ctx, latin1, 4);
+    ASSERT_EQ(js_value_get_type(value), JS_VALUE_TYPE_STRING);
+    str = js_str_from_value(ctx, value);
+    ASSERT_STREQ(str, "caf\xc3\xa9");
+    js_str_free(ctx, str);
+
+    // Latin-1 strings are stored with 8 bit characters
+    chars = js_str_borrow(ctx, value, &length, &is_wide);
+    ASSERT(chars, "Failed to borrow string");
+    ASSERT_EQ(length, 4);
+    ASSERT_EQ(is_wide, 0);
+    ASSERT_EQ(((const uint8_t*)chars)[3], 0xe9);
+
+    js_value_load_str16(ctx, value, wide, 4);
+    chars = js_str_borrow(ctx, value, &length, &is_wide);
+    ASSERT_EQ(length, 4);
+    ASSERT_EQ(is_wide, 1);
+    ASSERT(memcmp(chars, wide, sizeof(wide)) == 0, "Unexpected characters");
+
+    err = js_str_read16(ctx, value, NULL, 0, &length);
+    ASSERT_EQ(err, JS_OK);
+    ASSERT_EQ(length, 4);
+    err = js_str_read16(ctx, value, buf, 2, &length);
+    ASSERT_EQ(err, JS_OK);
+    ASSERT(buf[0] == 'p' && buf[1] == 'i', "Unexpected characters");
+
+    // non string values are converted
+    js_value_load_int32(ctx, value, 42);
+    ASSERT(!js_str_borrow(ctx, value, &length, &is_wide), "Expected NULL");
+    err = js_str_read16(ctx, value, buf, 16, &length);
+    ASSERT_EQ(err, JS_OK);
+    ASSERT(length == 2 && buf[0] == '4' && buf[1] == '2', "Unexpected characters");
+
+    // ropes are linearized in place
+    err = js_eval_cstr(ctx, value, "'x'.repeat(300) + '\\u03c0'.repeat(300)", "<input>", 0);
+    ASSERT_EQ(err, JS_OK);
+    chars = js_str_borrow(ctx, value, &length, &is_wide);
+    ASSERT(chars && length == 600 && is_wide, "Failed to borrow rope");
+    ASSERT_EQ(((const uint16_t*)chars)[599], 0x3c0);
+    js_value_free(ctx, value);
+
+    // the host writes the characters in place
+    uint16_t* dst;
+    value = js_value_new_str_buffer(ctx, 4, 1, (void**)&dst);
+    ASSERT(value && dst, "Failed to create string buffer");
+    memcpy(dst, wide, sizeof(wide));
+    str = js_str_from_value(ctx, value);
+    ASSERT_STREQ(str, "pi=\xcf\x80");
+    js_str_free(ctx, str);
+    js_value_free(ctx, value);
+
+    // an empty string is never stored as a wide string
+    value = js_value_new_str_buffer(ctx, 0, 1, (void**)&dst);
+    ASSERT(value, "Failed to create string buffer");
+    chars = js_str_borrow(ctx, value, &length, &is_wide);
+    ASSERT(chars && length == 0 && !is_wide, "Unexpected empty string");
+    JSValue* result = js_value_new(ctx);
+    JSValue* func = js_value_new(ctx);
+    err = js_eval_cstr(ctx, func, "(s => Symbol(s).toString() + typeof Symbol(s).description)", "<input>", 0);
+    ASSERT_EQ(err, JS_OK);
+    err = js_value_call(ctx, result, func, NULL, 1, value);
+    ASSERT_EQ(err, JS_OK);
+    str = js_str_from_value(ctx, result);
+    ASSERT_STREQ(str, "Symbol()string");
+    js_str_free(ctx, str);
+    js_value_free(ctx, func);
+    js_value_free(ctx, result);
+    js_value_free(ctx, value);
+
+    value = js_value_new_str16(ctx, NULL, 0);
+    err = js_str_read16(ctx, value, NULL, 0, &length);
+    ASSERT_EQ(err, JS_OK);
+    ASSERT_EQ(length, 0);
+    js_value_free(ctx, value);
+}
+
 void test_eval(JSContext* ctx) {
     JSValue* value = js_value_new(ctx);
     ASSERT(value, "Failed to create JSValue.");
@@ -365,6 +481,137 @@ void test_objects(JSContext* ctx) {
     js_value_free(ctx, value);
 }
 
+void test_atoms(JSContext* ctx) {
+    JSValue *value = js_value_new(ctx);
+    JSValue *obj;
+    JSValue *temp;
+    JSAtom atom_a, atom_b;
+    const char *str;
+
+    atom_a = js_atom_new(ctx, "a");
+    atom_b = js_atom_new_str(ctx, "bc", 1);
+    ASSERT(atom_a != JS_ATOM_NULL, "Failed to create atom a");
+    ASSERT(atom_b != JS_ATOM_NULL, "Failed to create atom b");
+    ASSERT_EQ(js_atom_new(ctx, NULL), JS_ATOM_NULL);
+
+    obj = js_value_new_obj(ctx);
+    js_value_load_cstr(ctx, value, "Hello");
+    js_obj_set_property_atom(ctx, obj, atom_a, value);
+    js_value_load_int32(ctx, value, 2);
+    js_obj_set_property_atom(ctx, obj, atom_b, value);
+
+    // the atoms and the names designate the same properties
+    js_obj_read_property(ctx, value, obj, "b");
+    ASSERT_EQ(js_value_get_int(value), 2);
+
+    js_obj_read_property_atom(ctx, value, obj, atom_a);
+    str = js_str_from_value(ctx, value);
+    ASSERT_STREQ(str, "Hello");
+    js_str_free(ctx, str);
+
+    temp = js_obj_get_property_atom(ctx, obj, atom_b);
+    ASSERT(temp, "Failed to get property b");
+    ASSERT_EQ(js_value_get_int(temp), 2);
+    js_value_free(ctx, temp);
+    js_value_free(ctx, obj);
+
+    // indexed access
+    JS_LOAD_JSON(ctx, value, "[10, 20, 30]");
+    temp = js_obj_get_index(ctx, value, 1);
+    ASSERT_EQ(js_value_get_int(temp), 20);
+    js_obj_set_index(ctx, value, 3, temp);
+    js_obj_read_index(ctx, temp, value, 3);
+    ASSERT_EQ(js_value_get_int(temp), 20);
+    js_obj_read_index(ctx, temp, value, 4);
+    ASSERT_EQ(js_value_get_type(temp), JS_VALUE_TYPE_UNDEFINED);
+    js_value_free(ctx, temp);
+
+    js_atom_free(ctx, atom_a);
+    js_atom_free(ctx, atom_b);
+    js_value_free(ctx, value);
+}
+
+void test_call(JSContext* ctx) {
+    JSValue* func = js_value_new(ctx);
+    JSValue* obj = js_value_new(ctx);
+    JSValue* result = js_value_new(ctx);
+    JSValue* argv;
+    JSAtom atom;
+    const char *str;
+    int err;
+
+    /* the arguments are a contiguous array owned by the caller */
+    argv = (JSValue*)calloc(2, js_value_size());
+    js_value_load_int32(ctx, &argv[0], 40);
+    js_value_load_int32(ctx, &argv[1], 2);
+
+    err = js_eval_cstr(ctx, func, "(function(a, b) { \"use strict\"; return a + b + (this ? this.c : 0); })", "<input>", 0);
+    ASSERT_EQ(err, JS_OK);
+    err = js_value_call(ctx, result, func, NULL, 2, argv);
+    ASSERT_EQ(err, JS_OK);
+    ASSERT_EQ(js_value_get_int(result), 42);
+
+    JS_LOAD_JSON(ctx, obj, "{\"c\":100}");
+    err = js_value_call(ctx, result, func, obj, 2, argv);
+    ASSERT_EQ(err, JS_OK);
+    ASSERT_EQ(js_value_get_int(result), 142);
+
+    // method call
+    err = js_eval_cstr(ctx, obj, "({ c: 1, add(a, b) { return a * b + this.c; } })", "<input>", 0);
+    ASSERT_EQ(err, JS_OK);
+    atom = js_atom_new(ctx, "add");
+    err = js_value_call_method_atom(ctx, result, obj, atom, 2, argv);
+    ASSERT_EQ(err, JS_OK);
+    ASSERT_EQ(js_value_get_int(result), 81);
+    js_atom_free(ctx, atom);
+
+    // the exception is returned in 'out'
+    atom = js_atom_new(ctx, "missing");
+    err = js_value_call_method_atom(ctx, result, obj, atom, 0, NULL);
+    ASSERT_EQ(err, JS_ERR_EXCEPTION);
+    ASSERT(js_value_is_error(ctx, result), "Expected an error");
+    js_atom_free(ctx, atom);
+
+    // constructor
+    err = js_eval_cstr(ctx, func, "(class { constructor(a, b) { this.sum = a + b; } })", "<input>", 0);
+    ASSERT_EQ(err, JS_OK);
+    err = js_value_call(ctx, result, func, NULL, 2, argv);
+    ASSERT_EQ(err, JS_ERR_EXCEPTION);
+    err = js_value_construct(ctx, result, func, 2, argv);
+    ASSERT_EQ(err, JS_OK);
+    js_obj_read_property(ctx, result, result, "sum");
+    ASSERT_EQ(js_value_get_int(result), 42);
+
+    // invalid arguments throw a TypeError
+    err = js_value_call(ctx, result, func, NULL, 2, NULL);
+    ASSERT_EQ(err, JS_ERR_EXCEPTION);
+    ASSERT(js_value_is_error(ctx, result), "Expected an error");
+    js_obj_read_property(ctx, result, result, "name");
+    str = js_str_from_value(ctx, result);
+    ASSERT_STREQ(str, "TypeError");
+    js_str_free(ctx, str);
+    err = js_value_construct(ctx, result, func, -1, argv);
+    ASSERT_EQ(err, JS_ERR_EXCEPTION);
+    ASSERT(js_value_is_error(ctx, result), "Expected an error");
+    ASSERT(JS_IsNull(JS_GetException(ctx)), "Unexpected pending exception");
+
+    js_value_load_cstr(ctx, &argv[0], "x");
+    err = js_eval_cstr(ctx, func, "String.prototype.concat.bind('a')", "<input>", 0);
+    ASSERT_EQ(err, JS_OK);
+    err = js_value_call(ctx, result, func, NULL, 2, argv);
+    ASSERT_EQ(err, JS_OK);
+    str = js_str_from_value(ctx, result);
+    ASSERT_STREQ(str, "ax2");
+    js_str_free(ctx, str);
+
+    js_value_release(ctx, &argv[0]);
+    js_value_release(ctx, &argv[1]);
+    free(argv);
+    js_value_free(ctx, result);
+    js_value_free(ctx, obj);
+    js_value_free(ctx, func);
+}
+
 void test_json(JSContext* ctx) {
     JSValue* value = js_value_new(ctx);
     int err;
@@ -419,6 +666,796 @@ void test_eval_ctx(JSContext* ctx)
     js_value_free(ctx, value);
 }
 
+void test_string_concat(JSContext* ctx)
+{
+    JSValue* value = js_value_new(ctx);
+    ASSERT(value, "Failed to create JSValue.");
+
+    /* long concatenations are built as ropes */
+    int err = js_eval_cstr(ctx, value,
+                           "var s = ''; for (var i = 0; i < 1000; i++) s += 'ab' + i; s",
+                           "<eval>", JS_EVAL_TYPE_GLOBAL);
+    ASSERT(err == 0, "Error in evaluation");
+    ASSERT_EQ(js_value_get_type(value), JS_VALUE_TYPE_STRING);
+    /* the C code must accept both string tags */
+    ASSERT_EQ(JS_VALUE_GET_TAG(*value), JS_TAG_STRING_ROPE);
+    ASSERT(JS_TAG_IS_STRING(JS_VALUE_GET_TAG(*value)) && JS_IsString(*value), "Not a string");
+    const char* str = js_str_from_value(ctx, value);
+    ASSERT_EQ(strlen(str), 4890);
+    ASSERT(!strncmp(str, "ab0ab1ab2", 9), "Bad rope content");
+    js_str_free(ctx, str);
+
+    err = js_eval_cstr(ctx, value,
+                       "var t = ''; for (var i = 999; i >= 0; i--) t = 'ab' + i + t; "
+                       "s === t && s.length === 4890 && s[3] === 'a'",
+                       "<eval>", JS_EVAL_TYPE_GLOBAL);
+    ASSERT(err == 0, "Error in evaluation");
+    ASSERT_EQ(js_value_get_bool(value), 1);
+
+    js_value_free(ctx, value);
+}
+
+void test_context_arena(JSRuntime* rt)
+{
+    JSContext* ctx = js_context_new_arena(rt);
+    ASSERT(ctx, "Failed to create JSContext.");
+
+    /* arena values do not need to be freed one by one */
+    for (int i = 0; i < 1000; i++) {
+        JSValue* obj = js_value_new_obj(ctx);
+        ASSERT(obj, "Failed to create JSValue.");
+        JSValue* value = js_value_new_int32(ctx, i);
+        js_obj_set_property(ctx, obj, "x", value);
+        if (i & 1) {
+            js_value_free(ctx, value);
+        }
+    }
+    js_context_reset_arena(ctx);
+
+    JSValue* value = js_value_new(ctx);
+    int err = js_eval_cstr(ctx, value, "({ s: 'kept' })", "<eval>", JS_EVAL_TYPE_GLOBAL);
+    ASSERT(err == 0, "Error in evaluation");
+    JSValue* kept = js_value_escape(ctx, value);
+    ASSERT(kept && kept != value, "Failed to escape value");
+    ASSERT_EQ(js_value_get_type(value), JS_VALUE_TYPE_UNDEFINED);
+
+    js_context_free(ctx);
+
+    ASSERT_EQ(js_value_get_type(kept), JS_VALUE_TYPE_OBJECT);
+    js_value_free_rt(rt, kept);
+}
+
+void test_batch_properties(JSContext* ctx) {
+    JSAtom atoms[3];
+    JSValue* values;
+    JSValue* out;
+    JSValue* obj = js_value_new_obj(ctx);
+    JSValue* func = js_value_new(ctx);
+    JSValue* result = js_value_new(ctx);
+    JSValue exc;
+    const char *str;
+    int err;
+
+    atoms[0] = js_atom_new(ctx, "x");
+    atoms[1] = js_atom_new(ctx, "y");
+    atoms[2] = js_atom_new(ctx, "name");
+
+    /* the values are contiguous arrays owned by the caller */
+    values = (JSValue*)calloc(3, js_value_size());
+    out = (JSValue*)calloc(3, js_value_size());
+    js_value_load_int32(ctx, &values[0], 1);
+    js_value_load_int32(ctx, &values[1], 2);
+    js_value_load_cstr(ctx, &values[2], "point");
+
+    err = js_obj_set_properties(ctx, obj, 3, atoms, values);
+    ASSERT_EQ(err, JS_OK);
+    err = js_obj_get_properties(ctx, obj, 3, atoms, out);
+    ASSERT_EQ(err, JS_OK);
+    ASSERT_EQ(js_value_get_int(&out[0]), 1);
+    ASSERT_EQ(js_value_get_int(&out[1]), 2);
+    ASSERT_EQ(js_value_get_type(&out[2]), JS_VALUE_TYPE_STRING);
+
+    // the exception is returned in the slot of the failing property
+    err = js_eval_cstr(ctx, obj, "({ x: 0, get y() { throw new Error('y'); } })", "<input>", 0);
+    ASSERT_EQ(err, JS_OK);
+    err = js_obj_get_properties(ctx, obj, 3, atoms, out);
+    ASSERT_EQ(err, JS_ERR_EXCEPTION);
+    ASSERT(js_value_is_error(ctx, &out[1]), "Expected an error");
+
+    // invalid arguments throw a TypeError
+    err = js_obj_get_properties(ctx, result, 3, atoms, out);
+    ASSERT_EQ(err, JS_ERR_EXCEPTION);
+    ASSERT(js_value_is_error(ctx, &out[0]), "Expected an error");
+    err = js_obj_set_properties(ctx, obj, 3, atoms, NULL);
+    ASSERT_EQ(err, JS_ERR_EXCEPTION);
+    exc = JS_GetException(ctx);
+    ASSERT(JS_IsError(ctx, exc), "Expected a pending error");
+    JS_FreeValue(ctx, exc);
+
+    // objects created from a template share its shape
+    js_value_free(ctx, obj);
+    obj = js_obj_new_template(ctx, 3, atoms);
+    ASSERT_EQ(js_value_get_type(obj), JS_VALUE_TYPE_OBJECT);
+    err = js_obj_new_from_template(ctx, &out[0], obj, 3, values);
+    ASSERT_EQ(err, JS_OK);
+    err = js_eval_cstr(ctx, func, "(p => JSON.stringify(p) + (p.z = 3) + Object.keys(p))", "<input>", 0);
+    ASSERT_EQ(err, JS_OK);
+    err = js_value_call(ctx, result, func, NULL, 1, &out[0]);
+    ASSERT_EQ(err, JS_OK);
+    str = js_str_from_value(ctx, result);
+    ASSERT_STREQ(str, "{\"x\":1,\"y\":2,\"name\":\"point\"}3x,y,name,z");
+    js_str_free(ctx, str);
+
+    // without values, the template values are copied
+    err = js_obj_new_from_template(ctx, &out[0], obj, 0, NULL);
+    ASSERT_EQ(err, JS_OK);
+    js_obj_read_property(ctx, result, &out[0], "x");
+    ASSERT_EQ(js_value_get_type(result), JS_VALUE_TYPE_UNDEFINED);
+
+    err = js_obj_new_from_template(ctx, &out[0], obj, 2, values);
+    ASSERT_EQ(err, JS_ERR_EXCEPTION);
+    ASSERT(js_value_is_error(ctx, &out[0]), "Expected an error");
+    err = js_obj_new_from_template(ctx, &out[0], NULL, 0, NULL);
+    ASSERT_EQ(err, JS_ERR_EXCEPTION);
+    ASSERT(js_value_is_error(ctx, &out[0]), "Expected an error");
+
+    for (int i = 0; i < 3; i++) {
+        js_value_release(ctx, &values[i]);
+        js_value_release(ctx, &out[i]);
+        js_atom_free(ctx, atoms[i]);
+    }
+    free(values);
+    free(out);
+    js_value_free(ctx, result);
+    js_value_free(ctx, func);
+    js_value_free(ctx, obj);
+}
+
+void test_scopes(JSContext* ctx)
+{
+    JSValue* outer = js_value_new_obj(ctx);
+    ASSERT(outer, "Failed to create JSValue.");
+
+    int scope = js_scope_open(ctx);
+    ASSERT(scope > 0, "Failed to open scope");
+
+    /* enough values to need several slabs */
+    JSValue* first = NULL;
+    JSValue* last = NULL;
+    for (int i = 0; i < 1000; i++) {
+        JSValue* value = js_value_new_int32(ctx, i);
+        ASSERT(value, "Failed to create JSValue.");
+        js_obj_set_index(ctx, outer, i, value);
+        if (i & 1) {
+            js_value_free(ctx, value);
+        }
+        if (i == 0) {
+            first = js_value_new_str(ctx, "first", 5);
+        }
+        last = value;
+    }
+
+    int inner = js_scope_open(ctx);
+    ASSERT(inner > scope, "Failed to open nested scope");
+    JSValue* str = js_value_new_str(ctx, "kept", 4);
+    JSValue* kept = js_value_escape(ctx, str);
+    ASSERT(kept && kept != str, "Failed to escape value");
+    js_value_new_obj(ctx);
+
+    /* closing the outer scope also closes the nested one */
+    js_scope_close(ctx, scope);
+
+    /* the values of the closed scopes are already released */
+    js_value_free(ctx, first);
+    js_value_free(ctx, last);
+    js_value_free(ctx, str);
+    js_value_free_rt(JS_GetRuntime(ctx), first);
+
+    JSValue* value = js_obj_get_index(ctx, outer, 999);
+    ASSERT_EQ(js_value_get_int(value), 999);
+    ASSERT_EQ(js_value_get_type(kept), JS_VALUE_TYPE_STRING);
+    js_value_free(ctx, value);
+    js_value_free(ctx, kept);
+
+    /* the slab is reused by the next scopes */
+    for (int i = 0; i < 100; i++) {
+        scope = js_scope_open(ctx);
+        ASSERT(scope > 0, "Failed to open scope");
+        for (int j = 0; j < 300; j++) {
+            ASSERT(js_obj_get_index(ctx, outer, j), "Failed to get index");
+        }
+        js_scope_close(ctx, scope);
+    }
+
+    js_value_free(ctx, outer);
+}
+
+void test_context_clone(JSRuntime* rt)
+{
+    JSContext* tmpl = js_context_new(rt);
+    ASSERT(tmpl, "Failed to create JSContext.");
+
+    int err = js_eval_cstr(tmpl, NULL,
+                           "var n = 0; function next() { return ++n; }"
+                           "var m = new Map([[1, [2, 3]]]);",
+                           "<boot>", JS_EVAL_TYPE_GLOBAL);
+    ASSERT(err == 0, "Error in evaluation");
+
+    JSValue* value = js_value_new(tmpl);
+    for (int i = 0; i < 2; i++) {
+        JSContext* ctx = js_context_clone(tmpl);
+        ASSERT(ctx, "Failed to clone JSContext.");
+        err = js_eval_cstr(ctx, value,
+                           "next() + next() + m.get(1)[1] + [1, 2].indexOf(2)",
+                           "<eval>", JS_EVAL_TYPE_GLOBAL);
+        ASSERT(err == 0, "Error in evaluation");
+        ASSERT_EQ(js_value_get_int(value), 7);
+        js_value_release(ctx, value);
+        js_context_free(ctx);
+    }
+
+    /* the template is not modified by its copies */
+    err = js_eval_cstr(tmpl, value, "n", "<eval>", JS_EVAL_TYPE_GLOBAL);
+    ASSERT(err == 0, "Error in evaluation");
+    ASSERT_EQ(js_value_get_int(value), 0);
+
+    js_value_free(tmpl, value);
+    js_context_free(tmpl);
+}
+
+static void test_eval_cache_run(JSRuntime* rt, const char* script,
+                                const char* filename, const char* expected)
+{
+    JSContext* ctx = js_context_new(rt);
+    ASSERT(ctx, "Failed to create JSContext.");
+    JSValue* value = js_value_new(ctx);
+    int err = js_eval_cstr(ctx, value, script, filename, JS_EVAL_TYPE_GLOBAL);
+    ASSERT(err == 0, "Error in evaluation");
+    const char* str = js_str_from_value(ctx, value);
+    ASSERT_STREQ(str, expected);
+    js_str_free(ctx, str);
+    js_value_free(ctx, value);
+    js_context_free(ctx);
+}
+
+/* persistent store keeping a single entry */
+typedef struct {
+    uint8_t* buf;
+    size_t size;
+    int load_count;
+    int store_count;
+} TestEvalStore;
+
+static uint8_t* test_eval_store_load(JSRuntime* rt, void* opaque,
+                                     const char* key, size_t* psize)
+{
+    TestEvalStore* st = (TestEvalStore*)opaque;
+    st->load_count++;
+    if (!st->buf)
+        return NULL;
+    /* the same entry is returned for all the keys: the entries of the
+       other sources must be detected */
+    uint8_t* buf = (uint8_t*)js_malloc_rt(rt, st->size);
+    ASSERT(buf, "Failed to allocate");
+    memcpy(buf, st->buf, st->size);
+    *psize = st->size;
+    return buf;
+}
+
+static void test_eval_store_store(JSRuntime* rt, void* opaque, const char* key,
+                                  const uint8_t* buf, size_t size)
+{
+    TestEvalStore* st = (TestEvalStore*)opaque;
+    st->store_count++;
+    free(st->buf);
+    st->buf = (uint8_t*)malloc(size);
+    ASSERT(st->buf, "Failed to allocate");
+    memcpy(st->buf, buf, size);
+    st->size = size;
+}
+
+static const char eval_cache_script1[] =
+    "function f(n) { return n <= 1 ? n : f(n - 1) + f(n - 2); }"
+    "var s = `${f(10)}`; s";
+static const char eval_cache_script2[] = "'a' + 'b'";
+
+void test_eval_cache(void)
+{
+    JSRuntime* rt = js_runtime_new();
+    ASSERT(rt, "Failed to create JSRuntime.");
+    js_runtime_set_eval_cache(rt, 1 << 20);
+
+    /* the second and third evaluations use the cached byte code */
+    for (int i = 0; i < 3; i++) {
+        test_eval_cache_run(rt, eval_cache_script1, "<boot>", "55");
+        ASSERT_EQ(JS_GetEvalCacheHitCount(rt), i);
+    }
+    /* a different filename is a different entry */
+    test_eval_cache_run(rt, eval_cache_script1, "<other>", "55");
+    ASSERT_EQ(JS_GetEvalCacheHitCount(rt), 2);
+
+    /* compilation errors are not cached */
+    JSContext* ctx = js_context_new(rt);
+    ASSERT(ctx, "Failed to create JSContext.");
+    JSValue* value = js_value_new(ctx);
+    for (int i = 0; i < 2; i++) {
+        int err = js_eval_cstr(ctx, value, "(", "<boot>", JS_EVAL_TYPE_GLOBAL);
+        ASSERT(err != 0, "Expected a syntax error");
+    }
+    ASSERT_EQ(JS_GetEvalCacheHitCount(rt), 2);
+    js_value_free(ctx, value);
+    js_context_free(ctx);
+    js_runtime_free(rt);
+
+    /* persistent store */
+    TestEvalStore st = { NULL, 0, 0, 0 };
+    JSEvalCacheFunctions cf;
+    cf.load = test_eval_store_load;
+    cf.store = test_eval_store_store;
+    rt = js_runtime_new();
+    ASSERT(rt, "Failed to create JSRuntime.");
+    JS_SetEvalCache(rt, 0, &cf, &st);
+    test_eval_cache_run(rt, eval_cache_script1, "<boot>", "55");
+    ASSERT_EQ(st.load_count, 1);
+    ASSERT_EQ(st.store_count, 1);
+    size_t size1 = st.size;
+    test_eval_cache_run(rt, eval_cache_script1, "<boot>", "55");
+    ASSERT_EQ(st.load_count, 2);
+    ASSERT_EQ(st.store_count, 1);
+    ASSERT_EQ(JS_GetEvalCacheHitCount(rt), 1);
+    /* the stored entry is not used for another source or filename */
+    test_eval_cache_run(rt, eval_cache_script2, "<boot>", "ab");
+    ASSERT_EQ(st.store_count, 2);
+    test_eval_cache_run(rt, eval_cache_script2, "<other>", "ab");
+    ASSERT_EQ(st.store_count, 3);
+    size_t size2 = st.size;
+    ASSERT_EQ(JS_GetEvalCacheHitCount(rt), 1);
+    js_runtime_free(rt);
+
+    /* the memory cache only keeps the most recently used entry when two
+       entries do not fit */
+    rt = js_runtime_new();
+    ASSERT(rt, "Failed to create JSRuntime.");
+    JS_SetEvalCache(rt, size1 > size2 ? size1 : size2, &cf, &st);
+    st.load_count = 0;
+    test_eval_cache_run(rt, eval_cache_script2, "<other>", "ab");
+    test_eval_cache_run(rt, eval_cache_script2, "<other>", "ab");
+    ASSERT_EQ(st.load_count, 1);
+    ASSERT_EQ(JS_GetEvalCacheHitCount(rt), 2);
+    test_eval_cache_run(rt, eval_cache_script1, "<boot>", "55");
+    test_eval_cache_run(rt, eval_cache_script1, "<boot>", "55");
+    ASSERT_EQ(st.load_count, 2);
+    ASSERT_EQ(JS_GetEvalCacheHitCount(rt), 3);
+    test_eval_cache_run(rt, eval_cache_script2, "<other>", "ab");
+    ASSERT_EQ(st.load_count, 3);
+    js_runtime_free(rt);
+    free(st.buf);
+}
+
+#if defined(TEST_EXTERN_LIBC) && !defined(_WIN32)
+static int test_eval_cache_dir_clean(const char* dir)
+{
+    int count = 0;
+    DIR* d = opendir(dir);
+    ASSERT(d, "Failed to open the cache directory");
+    struct dirent* de;
+    while ((de = readdir(d)) != NULL) {
+        if (de->d_name[0] == '.')
+            continue;
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+        remove(path);
+        count++;
+    }
+    closedir(d);
+    return count;
+}
+
+/* disk store of quickjs-libc */
+void test_eval_cache_dir(void)
+{
+    char dir[] = "/tmp/qjs-eval-cache-XXXXXX";
+    ASSERT(mkdtemp(dir), "Failed to create the cache directory");
+
+    for (int i = 0; i < 2; i++) {
+        JSRuntime* rt = js_runtime_new();
+        ASSERT(rt, "Failed to create JSRuntime.");
+        js_std_init_handlers(rt);
+        ASSERT_EQ(js_std_set_eval_cache(rt, 0, dir), 0);
+        test_eval_cache_run(rt, eval_cache_script1, "<boot>", "55");
+        /* the second runtime loads the file stored by the first one */
+        ASSERT_EQ(JS_GetEvalCacheHitCount(rt), i);
+        js_std_free_handlers(rt);
+        js_runtime_free(rt);
+    }
+    ASSERT_EQ(test_eval_cache_dir_clean(dir), 1);
+    rmdir(dir);
+}
+#endif
+
+static const char lazy_script[] =
+    "var n = 10;\n"
+    "function outer(a) {\n"
+    "    var local = 5;\n"
+    "    function inner(b) { return a + b + local++ + n; }\n"
+    "    return inner;\n"
+    "}\n"
+    "function never(x) { return x * 2 + n; }\n"
+    /* regexps, divisions, templates and braces in a skipped body */
+    "function tokens(x) {\n"
+    "    var o = { a: x / 2 }, s = `${x}{${`}`}`;\n"
+    "    if (x) /[(]}/.test('}');\n"
+    "    { } /'\\//.test(\"'\");\n"
+    "    return s + o.a / 2 / 1 + (x) / 2 + /[/]/.source + '}';\n"
+    "}\n"
+    /* variables in a with object or created by a later direct eval */
+    "function scopes(code) {\n"
+    "    var r = [];\n"
+    "    with ({ w: 'with' }) { r.push(function() { return w; }); }\n"
+    "    function later() { return v; }\n"
+    "    eval(code);\n"
+    "    r.push(later);\n"
+    "    return r.map(function(f) { return f(); }).join();\n"
+    "}\n";
+
+static void test_lazy_check(JSContext* ctx, const char* expr, const char* expected)
+{
+    JSValue* value = js_value_new(ctx);
+    int err = js_eval_cstr(ctx, value, expr, "<input>", JS_EVAL_TYPE_GLOBAL);
+    ASSERT_EQ(err, JS_OK);
+    const char* str = js_str_from_value(ctx, value);
+    ASSERT_STREQ(str, expected);
+    js_str_free(ctx, str);
+    js_value_free(ctx, value);
+}
+
+void test_lazy_compile(JSRuntime* rt)
+{
+    JSContext* ctx = js_context_new(rt);
+    ASSERT(ctx, "Failed to create JSContext.");
+    JSValue* value = js_value_new(ctx);
+
+    int err = js_eval_cstr(ctx, value, lazy_script, "<lazy>",
+                           JS_EVAL_TYPE_GLOBAL | JS_EVAL_FLAG_LAZY);
+    ASSERT_EQ(err, JS_OK);
+
+    /* the source of a stub is the source of the function */
+    test_lazy_check(ctx, "never.toString()", "function never(x) { return x * 2 + n; }");
+    test_lazy_check(ctx, "never.name + never.length", "never1");
+
+    /* the compiled function uses the variables of the enclosing scopes */
+    test_lazy_check(ctx, "var f = outer(1); [f(2), f(2), outer(0)(0)].join()", "18,19,15");
+    test_lazy_check(ctx, "f.toString()", "function inner(b) { return a + b + local++ + n; }");
+
+    /* the skipped bodies only check the tokens */
+    test_lazy_check(ctx, "tokens(4)", "4{}12[/]}");
+    test_lazy_check(ctx, "scopes('var v = 3')", "with,3");
+
+    /* the token errors of the inner functions are reported at once */
+    err = js_eval_cstr(ctx, value, "function g() { function h() { return '1; } }",
+                       "<lazy>", JS_EVAL_TYPE_GLOBAL | JS_EVAL_FLAG_LAZY);
+    ASSERT_EQ(err, JS_ERR_EXCEPTION);
+    test_lazy_check(ctx, "typeof g", "undefined");
+    err = js_eval_cstr(ctx, value, "function g() { return (1]; }",
+                       "<lazy>", JS_EVAL_TYPE_GLOBAL | JS_EVAL_FLAG_LAZY);
+    ASSERT_EQ(err, JS_ERR_EXCEPTION);
+    test_lazy_check(ctx, "typeof g", "undefined");
+
+    /* the other syntax errors are reported on the first call */
+    err = js_eval_cstr(ctx, value, "function g() { let a; let a; }",
+                       "<lazy>", JS_EVAL_TYPE_GLOBAL | JS_EVAL_FLAG_LAZY);
+    ASSERT_EQ(err, JS_OK);
+    test_lazy_check(ctx, "try { g(); } catch(e) { e.name }", "SyntaxError");
+    /* unless the function is parsed because it contains a direct eval */
+    err = js_eval_cstr(ctx, value, "function g2() { let a; let a; eval(''); }",
+                       "<lazy>", JS_EVAL_TYPE_GLOBAL | JS_EVAL_FLAG_LAZY);
+    ASSERT_EQ(err, JS_ERR_EXCEPTION);
+
+    /* a stub which was never called is copied by JS_CloneContext() */
+    JSContext* clone = js_context_clone(ctx);
+    ASSERT(clone, "Failed to clone JSContext.");
+    test_lazy_check(clone, "n = 1; never(3)", "7");
+    test_lazy_check(ctx, "never(3)", "16");
+    js_context_free(clone);
+
+    /* the byte code of a never called stub is written compiled */
+    JSValue obj = JS_Eval(ctx, lazy_script, sizeof(lazy_script) - 1, "<lazy>",
+                          JS_EVAL_TYPE_GLOBAL | JS_EVAL_FLAG_LAZY | JS_EVAL_FLAG_COMPILE_ONLY);
+    ASSERT(!JS_IsException(obj), "Failed to compile");
+    size_t size;
+    uint8_t* buf = JS_WriteObject(ctx, &size, obj, JS_WRITE_OBJ_BYTECODE);
+    JS_FreeValue(ctx, obj);
+    ASSERT(buf, "Failed to write the byte code");
+
+    JSContext* ctx2 = js_context_new(rt);
+    ASSERT(ctx2, "Failed to create JSContext.");
+    obj = JS_ReadObject(ctx2, buf, size, JS_READ_OBJ_BYTECODE);
+    js_free(ctx, buf);
+    ASSERT(!JS_IsException(obj), "Failed to read the byte code");
+    obj = JS_EvalFunction(ctx2, obj);
+    ASSERT(!JS_IsException(obj), "Failed to run the byte code");
+    JS_FreeValue(ctx2, obj);
+    test_lazy_check(ctx2, "never(4)", "18");
+    test_lazy_check(ctx2, "outer(1)(1)", "17");
+    js_context_free(ctx2);
+
+    js_value_free(ctx, value);
+    js_context_free(ctx);
+}
+
+static const char shared_script[] =
+    "function hot(n) {\n"
+    "    var o = { alpha: 1, beta: 'b' }, s = 0;\n"
+    "    for (var i = 0; i < n; i++) { o.alpha += i & 3; s += o.beta.length; }\n"
+    "    return o.alpha + s;\n"
+    "}\n"
+    "function make(k) { return function(x) { return k + x + '_suffix'; }; }\n";
+
+/* create a runtime using the shared bytecode 'sb' of 'buf' */
+static JSContext* test_shared_context(JSSharedBytecode* sb, const uint8_t* buf, size_t size)
+{
+    JSRuntime* rt = js_runtime_new();
+    ASSERT(rt, "Failed to create JSRuntime.");
+    ASSERT_EQ(JS_ReserveObjectAtoms(rt, buf, size), 0);
+    /* the copies of the shared functions are compiled, not the shared
+       functions themselves */
+    JS_EnableJIT(rt, 1);
+    JSContext* ctx = js_context_new(rt);
+    ASSERT(ctx, "Failed to create JSContext.");
+    JSValue obj = JS_ReadSharedBytecode(ctx, sb);
+    ASSERT(!JS_IsException(obj), "Failed to read the shared bytecode");
+    obj = JS_EvalFunction(ctx, obj);
+    ASSERT(!JS_IsException(obj), "Failed to run the shared bytecode");
+    JS_FreeValue(ctx, obj);
+    return ctx;
+}
+
+static void test_shared_run(JSContext* ctx)
+{
+    JSValue* value = js_value_new(ctx);
+    int err = js_eval_cstr(ctx, value, "hot(5000) + make('p')('q')",
+                           "<input>", JS_EVAL_TYPE_GLOBAL);
+    ASSERT_EQ(err, JS_OK);
+    const char* str = js_str_from_value(ctx, value);
+    ASSERT_STREQ(str, "12501pq_suffix");
+    js_str_free(ctx, str);
+    js_value_free(ctx, value);
+}
+
+static void test_shared_free(JSContext* ctx)
+{
+    JSRuntime* rt = JS_GetRuntime(ctx);
+    js_context_free(ctx);
+    js_runtime_free(rt);
+}
+
+#ifdef TEST_EXTERN_THREADS
+typedef struct {
+    pthread_t tid;
+    JSSharedBytecode* sb;
+    const uint8_t* buf;
+    size_t size;
+} TestSharedThread;
+
+static void* test_shared_thread(void* arg)
+{
+    TestSharedThread* t = (TestSharedThread*)arg;
+    JSContext* ctx = test_shared_context(t->sb, t->buf, t->size);
+    for (int i = 0; i < 20; i++)
+        test_shared_run(ctx);
+    test_shared_free(ctx);
+    return NULL;
+}
+#endif
+
+/* return a read-only copy of 'buf': any write to it faults */
+static const uint8_t* test_rom_new(const uint8_t* buf, size_t size)
+{
+#ifndef _WIN32
+    uint8_t* rom = (uint8_t*)mmap(NULL, size, PROT_READ | PROT_WRITE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ASSERT(rom != MAP_FAILED, "Failed to map");
+    memcpy(rom, buf, size);
+    ASSERT_EQ(mprotect(rom, size, PROT_READ), 0);
+#else
+    uint8_t* rom = (uint8_t*)malloc(size);
+    ASSERT(rom, "Failed to allocate");
+    memcpy(rom, buf, size);
+#endif
+    return rom;
+}
+
+static void test_rom_free(const uint8_t* rom, size_t size)
+{
+#ifndef _WIN32
+    munmap((void*)rom, size);
+#else
+    free((void*)rom);
+#endif
+}
+
+/* return the size of the byte code copied in the runtime of 'ctx' */
+static int64_t test_rom_code_size(JSContext* ctx)
+{
+    JSMemoryUsage stats;
+    JS_ComputeMemoryUsage(JS_GetRuntime(ctx), &stats);
+    ASSERT(stats.js_func_count > 0, "No functions");
+    return stats.js_func_code_size + stats.js_func_pc2line_size;
+}
+
+/* run the bytecode 'buf' with JS_READ_OBJ_ROM_DATA */
+static JSContext* test_rom_context(const uint8_t* buf, size_t size, int reserve)
+{
+    JSRuntime* rt = js_runtime_new();
+    ASSERT(rt, "Failed to create JSRuntime.");
+    if (reserve)
+        ASSERT_EQ(JS_ReserveObjectAtoms(rt, buf, size), 0);
+    JSContext* ctx = js_context_new(rt);
+    ASSERT(ctx, "Failed to create JSContext.");
+    JSValue obj = JS_ReadObject(ctx, buf, size,
+                                JS_READ_OBJ_BYTECODE | JS_READ_OBJ_ROM_DATA);
+    ASSERT(!JS_IsException(obj), "Failed to read the bytecode");
+    obj = JS_EvalFunction(ctx, obj);
+    ASSERT(!JS_IsException(obj), "Failed to run the bytecode");
+    JS_FreeValue(ctx, obj);
+    test_shared_run(ctx);
+    return ctx;
+}
+
+void test_rom_bytecode(void)
+{
+    JSRuntime* rt = js_runtime_new();
+    ASSERT(rt, "Failed to create JSRuntime.");
+    JSContext* ctx = js_context_new(rt);
+    ASSERT(ctx, "Failed to create JSContext.");
+    JSValue obj = JS_Eval(ctx, shared_script, sizeof(shared_script) - 1, "<rom>",
+                          JS_EVAL_TYPE_GLOBAL | JS_EVAL_FLAG_COMPILE_ONLY);
+    ASSERT(!JS_IsException(obj), "Failed to compile");
+    size_t size;
+    uint8_t* buf = JS_WriteObject(ctx, &size, obj, JS_WRITE_OBJ_BYTECODE);
+    ASSERT(buf, "Failed to write the bytecode");
+    JS_FreeValue(ctx, obj);
+
+    const uint8_t* rom = test_rom_new(buf, size);
+
+    /* with the reserved atoms, no byte code or debug info is copied */
+    JSContext* ctx1 = test_rom_context(rom, size, 1);
+    ASSERT_EQ(test_rom_code_size(ctx1), 0);
+    test_shared_free(ctx1);
+    /* otherwise the functions whose atoms are relocated are copied */
+    ctx1 = test_rom_context(rom, size, 0);
+    ASSERT(test_rom_code_size(ctx1) > 0, "Expected relocated byte code");
+    test_shared_free(ctx1);
+
+    /* no atom is created from a truncated atom table */
+    JSRuntime* rt1 = js_runtime_new();
+    ASSERT(rt1, "Failed to create JSRuntime.");
+    JSMemoryUsage stats0, stats1;
+    JS_ComputeMemoryUsage(rt1, &stats0);
+    size_t len;
+    for (len = 0; JS_ReserveObjectAtoms(rt1, rom, len) != 0; len++) {
+        ASSERT(len < size, "Failed to reserve the atoms");
+        JS_ComputeMemoryUsage(rt1, &stats1);
+        ASSERT_EQ(stats0.atom_count, stats1.atom_count);
+    }
+    ASSERT(len > 16, "Expected a larger atom table");
+    js_runtime_free(rt1);
+
+    test_rom_free(rom, size);
+    js_free(ctx, buf);
+    js_context_free(ctx);
+    js_runtime_free(rt);
+}
+
+void test_shared_bytecode(void)
+{
+    JSRuntime* rt = js_runtime_new();
+    ASSERT(rt, "Failed to create JSRuntime.");
+    JSContext* ctx = js_context_new(rt);
+    ASSERT(ctx, "Failed to create JSContext.");
+    JSValue obj = JS_Eval(ctx, shared_script, sizeof(shared_script) - 1, "<shared>",
+                          JS_EVAL_TYPE_GLOBAL | JS_EVAL_FLAG_COMPILE_ONLY);
+    ASSERT(!JS_IsException(obj), "Failed to compile");
+    size_t size;
+    uint8_t* buf = JS_WriteObject(ctx, &size, obj, JS_WRITE_OBJ_BYTECODE);
+    ASSERT(buf, "Failed to write the bytecode");
+    JS_FreeValue(ctx, obj);
+
+    const uint8_t* rom = test_rom_new(buf, size);
+    JSSharedBytecode* sb = JS_NewSharedBytecode(rom, size);
+    ASSERT(sb, "Failed to load the shared bytecode");
+
+    /* the atoms must be reserved */
+    JSContext* ctx1 = js_context_new(rt);
+    obj = JS_ReadSharedBytecode(ctx1, sb);
+    ASSERT(JS_IsException(obj), "Expected an error");
+    JS_FreeValue(ctx1, JS_GetException(ctx1));
+    js_context_free(ctx1);
+
+    /* the runtimes are freed in both orders. Once a runtime is freed,
+       the other ones still use the shared functions and their atoms */
+    for (int i = 0; i < 2; i++) {
+        ctx1 = test_shared_context(sb, rom, size);
+        JSContext* ctx2 = test_shared_context(sb, rom, size);
+        test_shared_run(ctx1);
+        test_shared_run(ctx2);
+        test_shared_run(ctx1);
+        if (i == 0) {
+            test_shared_free(ctx1);
+            test_shared_run(ctx2);
+            test_shared_free(ctx2);
+        } else {
+            test_shared_free(ctx2);
+            test_shared_run(ctx1);
+            test_shared_free(ctx1);
+        }
+    }
+
+    /* the shared functions are unchanged after the runtimes are freed */
+    ctx1 = test_shared_context(sb, rom, size);
+    test_shared_run(ctx1);
+    test_shared_free(ctx1);
+
+#ifdef TEST_EXTERN_THREADS
+    /* the runtimes of different threads run the shared functions at the
+       same time */
+    TestSharedThread threads[4];
+    for (int i = 0; i < 4; i++) {
+        threads[i].sb = sb;
+        threads[i].buf = rom;
+        threads[i].size = size;
+        ASSERT_EQ(pthread_create(&threads[i].tid, NULL, test_shared_thread,
+                                 &threads[i]), 0);
+    }
+    for (int i = 0; i < 4; i++)
+        ASSERT_EQ(pthread_join(threads[i].tid, NULL), 0);
+#endif
+
+    JS_FreeSharedBytecode(sb);
+    test_rom_free(rom, size);
+    js_free(ctx, buf);
+    js_context_free(ctx);
+    js_runtime_free(rt);
+}
+
+static int test_interrupt_handler(JSRuntime* rt, void* opaque)
+{
+    int* count = (int*)opaque;
+    return ++(*count) >= 100;
+}
+
+void test_jit(void)
+{
+    JSRuntime* rt = js_runtime_new();
+    ASSERT(rt, "Failed to create JSRuntime.");
+    JS_EnableJIT(rt, 1);
+    JSContext* ctx = js_context_new(rt);
+    ASSERT(ctx, "Failed to create JSContext.");
+    JSValue* value = js_value_new(ctx);
+
+    /* the loop is compiled at a back edge */
+    int err = js_eval_cstr(ctx, value,
+                           "var s = 0; for (var i = 0; i < 100000; i++) s = (s + i * 3) | 0; s",
+                           "<input>", JS_EVAL_TYPE_GLOBAL);
+    ASSERT_EQ(err, JS_OK);
+    ASSERT_EQ(js_value_get_int(value), 2114948112);
+
+    /* the native code polls the interrupt handler on the back edges */
+    int count = 0;
+    JS_SetInterruptHandler(rt, test_interrupt_handler, &count);
+    err = js_eval_cstr(ctx, value,
+                       "function spin() { for (;;) {} } spin()",
+                       "<input>", JS_EVAL_TYPE_GLOBAL);
+    ASSERT_EQ(err, JS_ERR_EXCEPTION);
+    ASSERT(js_value_is_error(ctx, value), "Expected an error");
+    ASSERT_EQ(count, 100);
+    JS_SetInterruptHandler(rt, NULL, NULL);
+
+    js_value_free(ctx, value);
+    js_context_free(ctx);
+    js_runtime_free(rt);
+}
+
 static int test_counter = 0;
 
 static JSValue inc_counter(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv, int magic, JSValue *func_data)
@@ -466,18 +1503,38 @@ int main(int argc, char** argv) {
     ASSERT(ctx, "Failed to create JSContext.");
 
     test_value_types(ctx);
+    test_value_size(ctx);
     test_string(ctx);
+    test_string16(ctx);
     test_eval(ctx);
     test_objects(ctx);
+    test_atoms(ctx);
     test_globals(ctx);
     test_eval_ctx(ctx);
+    test_string_concat(ctx);
     test_cfunction(ctx);
+    test_call(ctx);
+    test_batch_properties(ctx);
+    test_scopes(ctx);
     test_json(ctx);
 
     /* Clean up */
     js_context_free(ctx);
+
+    test_context_arena(rt);
+    test_context_clone(rt);
+    test_lazy_compile(rt);
+
     js_runtime_free(rt);
 
+    test_eval_cache();
+#if defined(TEST_EXTERN_LIBC) && !defined(_WIN32)
+    test_eval_cache_dir();
+#endif
+    test_jit();
+    test_rom_bytecode();
+    test_shared_bytecode();
+
     fprintf(stderr, "All tests passed.\n");
 
     return 0;
@@ -667,6 +667,98 @@ function test_generator()
     assert(v.value === undefined && v.done === true);
 }
 
+function test_apply_spread()
+{
+    var arr, r, proto_iter, desc;
+
+    function f(a, b, c) {
+        var mutate = this && this.mutate;
+        if (mutate)
+            mutate();
+        return [a, b, c].join();
+    }
+
+    /* the callee modifies the array while its arguments are used */
+    function check(mutate) {
+        var ctx = { mutate: mutate };
+        arr = [1, 2, 3];
+        assert(f.apply(ctx, arr), "1,2,3");
+        arr = [1, 2, 3];
+        assert(f.call(ctx, ...arr), "1,2,3");
+        arr = [1, 2, 3];
+        assert(Reflect.apply(f, ctx, arr), "1,2,3");
+        arr = [1, 2, 3];
+        assert(f.bind(ctx, 0).apply(null, arr), "0,1,2");
+    }
+    check(function() {
+        for(var i = 0; i < 100; i++)
+            arr.push({});
+    });
+    check(function() { arr.length = 0; });
+    check(function() { arr.length = 1; arr[0] = "x"; });
+    check(function() { arr.pop(); arr.shift(); });
+
+    /* the arguments object is a copy */
+    function g(a) {
+        arr.length = 0;
+        return [a, arguments.length, arguments[1]].join();
+    }
+    arr = [1, 2];
+    assert(g(...arr), "1,2,2");
+    arr = [1, 2];
+    assert(g.apply(null, arr), "1,2,2");
+
+    /* a C function gets a copy */
+    arr = [1, 2];
+    arr.push(...arr);
+    assert(arr.join(), "1,2,1,2");
+
+    /* sparse and holey arrays */
+    arr = [1, , 3];
+    assert(f(...arr), "1,,3");
+    assert(f.apply(null, arr), "1,,3");
+    arr = [];
+    arr[2] = 3;
+    assert(f(...arr), ",,3");
+    assert(f.apply(null, arr), ",,3");
+    arr = [1, 2, 3];
+    delete arr[1];
+    assert(f(...arr), "1,,3");
+
+    /* a patched iterator or prototype must not take the fast path */
+    arr = [1, 2, 3];
+    arr[Symbol.iterator] = function* () { yield "i"; };
+    assert(f(...arr), "i,,");
+    assert(f.apply(null, arr), "1,2,3");
+
+    proto_iter = Array.prototype[Symbol.iterator];
+    Array.prototype[Symbol.iterator] = function* () { yield "p"; };
+    try {
+        assert(f(...[1, 2, 3]), "p,,");
+        assert([...[1, 2]].join(), "p");
+    } finally {
+        Array.prototype[Symbol.iterator] = proto_iter;
+    }
+    assert(f(...[1, 2, 3]), "1,2,3");
+
+    desc = Object.getOwnPropertyDescriptor(Array.prototype, 1);
+    Object.defineProperty(Array.prototype, 1, {
+        get() { return "g"; }, configurable: true });
+    try {
+        arr = [1, , 3];
+        assert(f(...arr), "1,g,3");
+        assert(f.apply(null, arr), "1,g,3");
+    } finally {
+        delete Array.prototype[1];
+    }
+    assert(desc, undefined);
+
+    arr = [1, 2, 3];
+    Object.setPrototypeOf(arr, { __proto__: Array.prototype,
+                                 [Symbol.iterator]: function* () { yield "s"; } });
+    assert(f(...arr), "s,,");
+}
+
 test();
 test_function();
 test_enum();
@@ -683,3 +775,4 @@ test_symbol();
 test_map();
 test_weak_map();
 test_generator();
+test_apply_spread();
@@ -0,0 +1,103 @@
+/* compiled with 'qjsc -b -m' and run with 'qjs -b': the byte code of
+   the functions is executed in place from the read-only mapped file */
+
+function assert(actual, expected, message) {
+    if (arguments.length == 1)
+        expected = true;
+
+    if (actual === expected)
+        return;
+
+    throw Error("assertion failed: got |" + actual + "|" +
+                ", expected |" + expected + "|" +
+                (message ? " (" + message + ")" : ""));
+}
+
+function make_counter(step) {
+    var n = 0;
+    return {
+        inc() { n += step; return n; },
+        get value() { return n; },
+    };
+}
+
+function test_closures()
+{
+    var c1 = make_counter(1), c2 = make_counter(10);
+    for(let i = 0; i < 3; i++) {
+        c1.inc();
+        c2.inc();
+    }
+    assert(c1.value, 3);
+    assert(c2.value, 30);
+
+    var fs = [];
+    for(let i = 0; i < 4; i++)
+        fs.push(() => i * i);
+    assert(fs.map((f) => f()).join(), "0,1,4,9");
+}
+
+class Point {
+    #x;
+    constructor(x) { this.#x = x; }
+    get x() { return this.#x; }
+    static origin() { return new Point(0); }
+}
+
+function fail(msg) {
+    throw new TypeError(msg);
+}
+
+function test_exceptions()
+{
+    var err = null;
+    try {
+        fail("mapped");
+    } catch(e) {
+        err = e;
+    }
+    assert(err instanceof TypeError);
+    assert(err.message, "mapped");
+    /* the line numbers come from the mapped debug info */
+    assert(err.stack.includes("fail (") && err.stack.includes("test_bytecode.js:48)"), true, err.stack);
+
+    try {
+        null.x;
+    } catch(e) {
+        err = e;
+    }
+    assert(err instanceof TypeError);
+
+    var count = 0;
+    function* gen() {
+        try {
+            yield 1;
+            yield 2;
+        } finally {
+            count++;
+        }
+    }
+    for(var v of gen()) {
+        if (v == 1)
+            break;
+    }
+    assert(count, 1);
+}
+
+function test_constants()
+{
+    var o = { a: "str", b: [1.5, 2 ** 64], c: /a+b/g };
+    assert(o.a + o.b[0], "str1.5");
+    assert(o.b[1], 18446744073709551616);
+    assert("xaab".replace(o.c, "-"), "x-");
+    assert(`t${o.a}`, "tstr");
+    assert(Point.origin().x, 0);
+    assert(new Point(7).x, 7);
+}
+
+test_closures();
+test_exceptions();
+test_constants();
+/* the functions still work when called again */
+test_closures();
+test_exceptions();
@@ -0,0 +1,276 @@
+"use strict";
+
+function assert(actual, expected, message) {
+    if (arguments.length == 1)
+        expected = true;
+
+    if (Object.is(actual, expected))
+        return;
+
+    if (actual !== null && expected !== null
+    &&  typeof actual == 'object' && typeof expected == 'object'
+    &&  actual.toString() === expected.toString())
+        return;
+
+    throw Error("assertion failed: got |" + actual + "|" +
+                ", expected |" + expected + "|" +
+                (message ? " (" + message + ")" : ""));
+}
+
+function assert_throws(expected_error, func)
+{
+    var err = false;
+    try {
+        func();
+    } catch(e) {
+        err = true;
+        if (!(e instanceof expected_error)) {
+            throw Error("unexpected exception type");
+        }
+    }
+    if (!err) {
+        throw Error("expected exception");
+    }
+}
+
+// load more elaborate version of assert if available
+try { __loadScript("test_assert.js"); } catch(e) {}
+
+/*----------------*/
+
+/* The functions are run more often than the compilation threshold
+   (1000 calls or loop iterations) so that the tests exercise the
+   native code when qjs is started with --jit. The results must be the
+   same as with the interpreter. */
+
+var N = 5000;
+
+function int_ops(a, b)
+{
+    return [a + b, a - b, a * b, a & b, a | b, a ^ b,
+            a << (b & 31), a >> (b & 31), a >>> (b & 31),
+            a < b, a <= b, a > b, a >= b, a == b, a != b,
+            a === b, a !== b];
+}
+
+function test_int()
+{
+    var i, s, r;
+
+    /* sum in a loop entered once: compiled at a back edge */
+    s = 0;
+    for(i = 0; i < 100000; i++)
+        s = (s + i * 3) | 0;
+    assert(s, 2114948112);
+
+    for(i = 0; i < N; i++) {
+        r = int_ops(i, 7);
+    }
+    assert(r.join(), "5006,4992,34993,7,4999,4992,639872,39,39," +
+           "false,false,true,true,false,true,false,true");
+
+    /* the int32 fast paths overflow to float */
+    for(i = 0; i < N; i++) {
+        r = int_ops(0x7fffffff - (i & 1), 0x7fffffff);
+    }
+    assert(r[0], 4294967293);
+    assert(r[1], -1);
+    assert(r[2], 0x7ffffffe * 0x7fffffff);
+    assert(r[8], 0);
+    r = int_ops(-0x80000000, 1);
+    assert(r[1], -2147483649);
+    assert(r[8], 1073741824);
+
+    /* negative zero cannot be an int32 */
+    for(i = 0; i < N; i++) {
+        r = int_ops(0, -(i & 3));
+    }
+    assert(r[2], -0);
+    assert(r[0], -3);
+
+    /* inc, dec and increments of locals */
+    s = 0x7fffff00;
+    for(i = 0; i < 0x200; i++)
+        s++;
+    assert(s, 0x80000100);
+    for(i = 0; i < 0x300; i++)
+        s--;
+    assert(s, 0x7ffffe00);
+}
+
+function test_float()
+{
+    var i, s, r;
+
+    s = 0;
+    for(i = 0; i < N; i++)
+        s += i * 0.5;
+    assert(s, 6248750);
+
+    for(i = 0; i < N; i++)
+        r = int_ops(i + 0.5, 0.25);
+    assert(r.slice(0, 3).join(), "4999.75,4999.25,1249.875");
+    assert(r.slice(9).join(), "false,false,true,true,false,true,false,true");
+
+    /* NaN comparisons are all false */
+    for(i = 0; i < N; i++)
+        r = int_ops(NaN, i);
+    assert(r.slice(9).join(), "false,false,false,false,false,true,false,true");
+    assert(r[0], NaN);
+
+    /* mixed int and float operands */
+    s = 0;
+    for(i = 0; i < N; i++) {
+        s = s * 0.5 + (i & 1 ? i : i / 4);
+    }
+    assert(s, 7497.333333333334);
+}
+
+function test_generic_ops()
+{
+    var i, s, o, a, r;
+
+    /* the generic cases of the templates call js_jit_op() */
+    s = "";
+    for(i = 0; i < N; i++) {
+        s = i + "";
+        if (s == i && s !== i)
+            r = s + 1;
+    }
+    assert(r, "49991");
+
+    s = 0;
+    for(i = 0; i < N; i++) {
+        s += { valueOf() { return 2; } } * "3";
+    }
+    assert(s, 6 * N);
+
+    o = { x: 1, get y() { return this.x * 2; } };
+    a = [];
+    for(i = 0; i < N; i++) {
+        o.x = i;
+        a[i & 15] = o.y % 7;
+        r = typeof o.z === "undefined" && ("x" in o) && (o instanceof Object);
+    }
+    assert(a.join(), "2,4,6,1,3,5,0,2,0,2,4,6,1,3,5,0");
+    assert(r, true);
+
+    s = 0;
+    for(i = 0; i < N; i++) {
+        for(var k in o)
+            s++;
+        for(var v of [1, 2])
+            s += v;
+    }
+    assert(s, 5 * N);
+
+    /* type changes after compilation */
+    function add(x, y) { return x + y; }
+    for(i = 0; i < N; i++)
+        add(i, i);
+    assert(add("a", 1), "a1");
+    assert(add(1.5, true), 2.5);
+    assert(add([1], null), "1null");
+}
+
+function test_closures()
+{
+    var i, f, fs, s;
+
+    function counter() {
+        var n = 0;
+        return function() { return ++n; };
+    }
+    f = counter();
+    for(i = 0; i < N; i++)
+        f();
+    assert(f(), N + 1);
+
+    fs = [];
+    for(let j = 0; j < N; j++)
+        fs.push(() => j);
+    s = 0;
+    for(i = 0; i < N; i++)
+        s += fs[i]();
+    assert(s, N * (N - 1) / 2);
+}
+
+function test_bailout()
+{
+    var i, o, s, a;
+
+    /* the opcodes without template return to the interpreter in the
+       middle of a compiled loop */
+    o = {};
+    s = 0;
+    for(i = 0; i < N; i++) {
+        o.x = i;
+        delete o.x;
+        a = [...[i, 1]];
+        s += a.length + ("x" in o ? 1 : 0);
+    }
+    assert(s, 2 * N);
+
+    function* gen(n) {
+        for(var i = 0; i < n; i++)
+            yield i;
+    }
+    s = 0;
+    for(var v of gen(N))
+        s += v;
+    assert(s, N * (N - 1) / 2);
+}
+
+function test_exceptions()
+{
+    var i, s, o;
+
+    function thrower(i) {
+        if (i == N - 1)
+            throw new RangeError("last");
+        return i;
+    }
+    s = 0;
+    try {
+        for(i = 0; i < N; i++)
+            s += thrower(i);
+    } catch(e) {
+        assert(e instanceof RangeError);
+        assert(i, N - 1);
+    }
+    assert(s, (N - 1) * (N - 2) / 2);
+
+    /* exceptions caught in the compiled function */
+    s = 0;
+    for(i = 0; i < N; i++) {
+        try {
+            o = i & 1 ? null : {};
+            o.x = 1;
+        } catch(e) {
+            s++;
+        }
+    }
+    assert(s, N / 2);
+
+    /* TDZ check in the compiled code */
+    function tdz(i) {
+        if (i == N - 1)
+            return x;
+        let x = i;
+        return x;
+    }
+    for(i = 0; i < N - 1; i++)
+        tdz(i);
+    assert_throws(ReferenceError, () => tdz(N - 1));
+
+    /* stack overflow in a hot recursive function */
+    function rec(n) { return rec(n + 1) + 1; }
+    assert_throws(InternalError, () => rec(0));
+}
+
+test_int();
+test_float();
+test_generic_ops();
+test_closures();
+test_bailout();
+test_exceptions();
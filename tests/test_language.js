@@ -526,6 +526,295 @@ function test_function_expr_name()
     assert_throws(TypeError, f);
 }
 
+function test_const_fold()
+{
+    var x = 2, s;
+
+    /* negative zero */
+    assert(Object.is(0 * -1, -0));
+    assert(Object.is(-0, -0));
+    assert(Object.is(-(0), -0));
+    assert(Object.is(0 / -1, -0));
+    assert(Object.is(-0 - 0, -0));
+    assert(Object.is(-0 + 0, 0));
+    assert(Object.is(-0 * -0, 0));
+    assert(Object.is(-1 % 1, -0));
+    assert(1 / -0, -Infinity);
+
+    /* division by zero and NaN */
+    assert(1 / 0, Infinity);
+    assert(-1 / 0, -Infinity);
+    assert(Object.is(0 / 0, NaN));
+    assert(Object.is(5 % 0, NaN));
+    assert(2 ** -1074, 5e-324);
+    assert(2 ** 53 + 1, 9007199254740992);
+
+    /* integer overflow and bitwise operators */
+    assert(0x7fffffff + 1, 2147483648);
+    assert(-0x80000000 - 1, -2147483649);
+    assert(1 << 31, -2147483648);
+    assert(1 << 32, 1);
+    assert(-1 >>> 0, 4294967295);
+    assert(-1 >> 28, -1);
+    assert(~5 & 0xff, 250);
+
+    /* string and number coercions */
+    assert("a" + 1 + 2, "a12");
+    assert(1 + 2 + "a", "3a");
+    assert("3" * "4", 12);
+    assert("5" - 2, 3);
+    assert(-0 + "", "0");
+    assert(1e21 + "", "1e+21");
+    assert(0.1 + 0.2, 0.30000000000000004);
+    assert(1 + null, 1);
+    assert(Object.is(1 + undefined, NaN));
+    assert("x" + undefined + null, "xundefinednull");
+    assert(true + 1, 2);
+    assert(+"", 0);
+    assert(+" 12 ", 12);
+    assert(Object.is(+"1x", NaN));
+    assert(!"", true);
+    assert(!"0", false);
+
+    /* template literals with constant substitutions */
+    assert(`${1 + 2}${"a"}${null}${-0}`, "3anull0");
+    assert(`a${1e21}b${void 0}`, "a1e+21bundefined");
+    assert(`${`${1}${2}`}3`, "123");
+    assert(`${1}` + 2, "12");
+    assert(`${x}${1 + 1}`, "22");
+    s = `${"a"}`;
+    assert(s, "a");
+
+    /* typeof of constant expressions */
+    assert(typeof (1 + ""), "string");
+    assert(typeof -0, "number");
+    assert(typeof (1 / 0), "number");
+    assert(typeof null, "object");
+    assert(typeof void 0, "undefined");
+    assert(typeof !0, "boolean");
+    assert(typeof `${1}`, "string");
+}
+
+function test_tdz()
+{
+    var fs, r, i, f;
+
+    /* use before the declaration in the same block */
+    assert_throws(ReferenceError, function() { x; let x = 1; });
+    assert_throws(ReferenceError, function() { x = 2; let x = 1; });
+    assert_throws(ReferenceError, function() { c; const c = 1; });
+    assert_throws(ReferenceError, function() { let y = y + 1; });
+    assert_throws(ReferenceError, function() {
+        if (true) {
+            typeof z;
+            let z;
+        }
+    });
+
+    /* the check is kept on one path only */
+    function cond(b) {
+        if (b)
+            x = 1;
+        let x = 2;
+        return x;
+    }
+    assert(cond(false), 2);
+    assert_throws(ReferenceError, () => cond(true));
+
+    /* use from a closure called before the declaration */
+    assert_throws(ReferenceError, function() {
+        function get() { return v; }
+        get();
+        let v = 1;
+    });
+    f = (function() {
+        const get = () => v;
+        assert_throws(ReferenceError, get);
+        let v = 3;
+        return get;
+    })();
+    assert(f(), 3);
+
+    /* a loop carried let is a new binding per iteration */
+    fs = [];
+    for(let j = 0; j < 3; j++) {
+        let k = j * 2;
+        fs.push(() => j + k);
+        j += 0;
+    }
+    assert(fs.map((g) => g()).join(), "0,3,6");
+    fs = [];
+    for(i = 0; i < 3; i++) {
+        if (i == 1)
+            assert_throws(ReferenceError, () => w);
+        let w = i;
+        fs.push(() => w);
+    }
+    assert(fs.map((g) => g()).join(), "0,1,2");
+
+    /* the case clauses share the switch scope */
+    function sw(n) {
+        switch(n) {
+        case 0:
+            let a = "a";
+            return a;
+        case 1:
+            return a;
+        default:
+            a = 1;
+            return a;
+        }
+    }
+    assert(sw(0), "a");
+    assert_throws(ReferenceError, () => sw(1));
+    assert_throws(ReferenceError, () => sw(2));
+
+    /* disjoint scopes may share a stack slot, but not a captured
+       variable */
+    function disjoint() {
+        var get;
+        {
+            let p = "p";
+            get = () => p;
+        }
+        {
+            let q;
+            assert(q, undefined);
+            q = "q";
+            assert(get(), "p");
+        }
+        {
+            assert_throws(ReferenceError, () => t);
+            let t = 1;
+            r = get() + t;
+        }
+        {
+            let u = [];
+            for(let m = 0; m < 2; m++) {
+                let n = m;
+                u.push(n);
+            }
+            return u.join() + get();
+        }
+    }
+    assert(disjoint(), "0,1p");
+    assert(r, "p1");
+
+    /* with the debug info, only the variables of the same name share a
+       slot */
+    function same_name() {
+        var get, res = [];
+        {
+            let s = 1;
+            res.push(s);
+        }
+        {
+            let s;
+            res.push(s);
+            s = 2;
+            get = () => s;
+        }
+        {
+            assert_throws(ReferenceError, () => s);
+            let s = 3;
+            res.push(s, get());
+        }
+        {
+            let s;
+            res.push(s);
+        }
+        return res.join();
+    }
+    assert(same_name(), "1,,3,2,");
+}
+
+function test_tail_call()
+{
+    var o, g, bound, count;
+
+    /* strict mode tail calls reuse the frame */
+    function sum(n, acc) {
+        "use strict";
+        if (n == 0)
+            return acc;
+        return sum(n - 1, acc + n);
+    }
+    assert(sum(1e6, 0), 500000500000);
+
+    function sum_cond(n, acc) {
+        "use strict";
+        return n == 0 ? acc : sum_cond(n - 1, acc + n);
+    }
+    assert(sum_cond(1e6, 0), 500000500000);
+
+    /* through a bound function */
+    g = function(n, acc) {
+        "use strict";
+        return n == 0 ? acc + this.k : bound(n - 1, acc + 1);
+    };
+    bound = g.bind({ k: 0.5 });
+    assert(bound(1e6, 0), 1e6 + 0.5);
+
+    /* method calls */
+    o = {
+        n: 0,
+        count(k) {
+            "use strict";
+            if (k == 0)
+                return this.n;
+            this.n++;
+            return this.count(k - 1);
+        }
+    };
+    assert(o.count(1e6), 1e6);
+
+    /* the callee has more arguments and locals than the caller */
+    function even(n) {
+        "use strict";
+        return n == 0 ? true : odd(n - 1, 1, 2, 3);
+    }
+    function odd(n, a, b, c, d, e) {
+        "use strict";
+        var x = a + b, y = c, z = x * y, t = [a, b, c];
+        if (d !== undefined || e !== undefined || z != 9 || t.length != 3)
+            return "bad";
+        return n == 0 ? false : even(n - 1, x, y, z);
+    }
+    assert(even(1e6), true);
+    assert(even(1e6 + 1), false);
+
+    /* the frame is not reused when an exception handler is active */
+    count = 0;
+    function with_finally(n) {
+        "use strict";
+        try {
+            if (n == 0)
+                throw Error("bottom");
+            return with_finally(n - 1);
+        } finally {
+            count++;
+        }
+    }
+    try {
+        with_finally(20);
+    } catch(e) {
+        assert(e.message, "bottom");
+    }
+    assert(count, 21);
+
+    /* sloppy mode calls are not tail calls */
+    function sloppy(n) {
+        return n == 0 ? 0 : sloppy(n - 1);
+    }
+    assert_throws(InternalError, () => sloppy(1e6));
+
+    function strict_to_sloppy(n) {
+        "use strict";
+        return n == 0 ? 0 : sloppy(n - 1);
+    }
+    assert_throws(InternalError, () => strict_to_sloppy(1e6));
+}
+
 test_op1();
 test_cvt();
 test_eq();
@@ -545,3 +834,6 @@ test_spread();
 test_function_length();
 test_argument_scope();
 test_function_expr_name();
+test_const_fold();
+test_tdz();
+test_tail_call();